@@ -300,7 +300,8 @@ struct EmbeddedResource : public Content {
 // todo: 
 struct CallToolResult : public Result {
     bool isError = false;
-    std::vector<Content> content;
+    // 元素为 TextContent/ImageContent 等序列化后的 JSON: std::vector<Content> 会把子类切成只剩 type
+    std::vector<nlohmann::json> content;
     std::optional<nlohmann::json> structureContent;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE_OPTIONAL(CallToolResult, _meta, isError, content, structureContent)
@@ -462,7 +463,7 @@ struct ListToolsRequest : public PaginatedRequest {
 
 struct CallToolRequestParams : public RequestParams {
     std::string name;
-    std::map<std::string, std::string> arguments;
+    nlohmann::json arguments = nlohmann::json::object();
     NLOHMANN_DEFINE_TYPE_INTRUSIVE_OPTIONAL(CallToolRequestParams, _meta, name, arguments)
 };
 
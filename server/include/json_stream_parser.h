@@ -0,0 +1,78 @@
+#ifndef JSON_STREAM_PARSER_H_
+#define JSON_STREAM_PARSER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <nlohmann/json/json.hpp>
+
+namespace mcp {
+namespace server {
+
+// 可续传的推式 JSON 解析器: 数据分片到达时逐段喂入, 直接构建 nlohmann::json,
+// 不需要先把整个 body 拼接成一块连续内存
+class JsonStreamParser {
+public:
+    explicit JsonStreamParser(size_t max_depth = 256);
+
+    // 喂入一段数据; 语法错误时返回 false, 之后的调用均忽略
+    bool feed(const char* data, size_t len);
+
+    // 输入结束; 仅当恰好解析出一个完整文档时返回 true
+    bool finish();
+
+    bool failed() const { return !error_.empty(); }
+    const std::string& error() const { return error_; }
+    size_t consumed() const { return consumed_; }
+
+    nlohmann::json& result() { return root_; }
+
+private:
+    enum class Mode {
+        Value,           // 期待一个值
+        ArrayFirst,      // '[' 之后: 值或 ']'
+        ObjectFirst,     // '{' 之后: 键或 '}'
+        Key,             // ',' 之后: 键
+        Colon,
+        CommaOrEnd,
+        Done
+    };
+
+    enum class Token {
+        None,
+        String,
+        Number,
+        Literal
+    };
+
+    bool step(char c);
+    bool begin_value(char c);
+    bool end_number();
+    bool end_string();
+    bool put(nlohmann::json&& v);
+    bool push(nlohmann::json&& container);
+    bool pop(char close);
+    bool fail(const char* msg);
+    void append_utf8(uint32_t cp);
+
+    nlohmann::json                root_;
+    std::vector<nlohmann::json*>  stack_;
+    std::string                   key_;
+    std::string                   buf_;
+    std::string                   error_;
+    const char*                   literal_ = nullptr;
+    Mode                          mode_ = Mode::Value;
+    Token                         token_ = Token::None;
+    bool                          is_key_ = false;
+    int                           escape_ = 0;    // 0 无, 1 刚读到 '\', 2..5 读取 \u 的十六进制位
+    uint32_t                      unicode_ = 0;
+    uint32_t                      high_surrogate_ = 0;
+    int                           utf8_need_ = 0; // 当前 UTF-8 字符尚缺的后续字节数
+    size_t                        max_depth_;
+    size_t                        consumed_ = 0;
+};
+
+} // namespace server
+} // namespace mcp
+
+#endif
@@ -5,6 +5,9 @@
 #include <string>
 #include <nlohmann/json/json.hpp>
 #include "../../common/types.h"
+#include "request_context.h"
+#include "subscription_registry.h"
+#include "tool_registry.h"
 
 // 引入 Nginx 头，便于在实现中直接使用 ngx_log_error
 extern "C" {
@@ -46,16 +49,39 @@ public:
                                      std::string& method_out,
                                      ngx_log_t* log);
 
+    // 新增: 从已解析的 JSON(如流式解析结果)完成 method 提取 + 具体类型构建
+    static bool build_request(const nlohmann::json& j,
+                              MCPRequestVariant& out,
+                              std::string& method_out,
+                              ngx_log_t* log);
+
+    // 方法名是否受支持; 用于区分 JSON-RPC 的 -32601 与 -32602
+    static bool is_known_method(const std::string& method);
+
+    // 向 ToolRegistry 注册内置工具(echo), 每个 worker 启动时调用
+    static void register_builtin_tools();
+
+    // 可缓存的目录: 内容变化后调用 catalog_changed, 已缓存的结果随之失效
+    // (Tools 对应 mcp_tool_cache 缓存的 tools/call 结果)
+    enum class Catalog { Prompts, Resources, Tools };
+    using CatalogListener = void (*)(Catalog);
+    // 由 nginx 模块在 worker 启动时注册; catalog_changed 可在任意线程调用, 未注册时忽略
+    static void set_catalog_listener(CatalogListener listener);
+    static void catalog_changed(Catalog c);
+
     // ==== 新增：各类请求处理函数（仅声明，需在 cpp 中实现） ====
     static InitializeResult          handle_initialize(const InitializeRequest&, ngx_log_t* log);
     static EmptyResult               handle_ping(const PingRequest&, ngx_log_t* log);
     static ListToolsResult           handle_list_tools(const ListToolsRequest&, ngx_log_t* log);
-    static CallToolResult            handle_call_tool(const CallToolRequest&, ngx_log_t* log);
+    static CallToolResult            handle_call_tool(const CallToolRequest&, ngx_log_t* log,
+                                                      RequestContext* ctx = nullptr);
     static ListResourcesResult       handle_list_resources(const ListResourcesRequest&, ngx_log_t* log);
     static ListResourceTemplatesResult handle_list_resource_templates(const ListResourceTemplatesRequest&, ngx_log_t* log);
     static ReadResourceResult        handle_read_resource(const ReadResourceRequest&, ngx_log_t* log);
-    static EmptyResult               handle_subscribe(const SubscribeRequest&, ngx_log_t* log);
-    static EmptyResult               handle_unsubscribe(const UnsubscribeRequest&, ngx_log_t* log);
+    static EmptyResult               handle_subscribe(const SubscribeRequest&, ngx_log_t* log,
+                                                      RequestContext* ctx = nullptr);
+    static EmptyResult               handle_unsubscribe(const UnsubscribeRequest&, ngx_log_t* log,
+                                                        RequestContext* ctx = nullptr);
     static ListPromptsResult         handle_list_prompts(const ListPromptsRequest&, ngx_log_t* log);
     static GetPromptResult           handle_get_prompt(const GetPromptRequest&, ngx_log_t* log);
     static CompleteResult            handle_complete_from_resource_template(const CompleteRequest1&, ngx_log_t* log);
@@ -63,10 +89,14 @@ public:
     static EmptyResult               handle_set_level(const SetLevelRequest&, ngx_log_t* log);
 
     // 统一分发（可在实现里用 std::visit 调用上面函数，再序列化）
-    static nlohmann::json            handle(const MCPRequestVariant& req, ngx_log_t* log);
+    // ctx 用于 SSE 模式下推送进度与取消检查, 可为空; 已取消时抛出 Cancelled
+    static nlohmann::json            handle(const MCPRequestVariant& req, ngx_log_t* log,
+                                            RequestContext* ctx = nullptr);
 
     // 可选工具：将 Result 序列化为 JSON-RPC 响应数据部分
-    static nlohmann::json            to_json_result(const Result& r);
+    // (按具体类型模板化, 避免以基类 Result 传参时切片只剩 _meta)
+    template <typename T>
+    static nlohmann::json            to_json_result(const T& r) { return nlohmann::json(r); }
 };
 
 } // namespace server
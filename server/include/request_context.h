@@ -0,0 +1,85 @@
+#ifndef MCP_REQUEST_CONTEXT_H_
+#define MCP_REQUEST_CONTEXT_H_
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <nlohmann/json/json.hpp>
+
+namespace mcp {
+namespace server {
+
+// 取消原因; 客户端取消与断开时不再应答, 超时与超出 CPU 时间时返回 JSON-RPC 错误
+enum class CancelReason { None = 0, Cancelled, Disconnected, Timeout, CpuLimit };
+
+// 处理函数因取消而中止时抛出
+class Cancelled : public std::exception {
+public:
+    explicit Cancelled(CancelReason reason) : reason_(reason) {}
+    CancelReason reason() const { return reason_; }
+    const char* what() const noexcept override;
+
+private:
+    CancelReason reason_;
+};
+
+// 请求执行上下文: 线程池中的处理函数通过它在最终结果之前向客户端推送
+// notifications/progress 和中间内容; 非 SSE 响应时 sink 为空, 调用均被忽略。
+// 同时携带取消令牌、截止时间与 CPU 时间上限: 长时间运行的处理函数应定期调用 check(),
+// progress() 与 partial() 也会先检查, 取消后抛出 Cancelled
+class RequestContext {
+public:
+    // 接收一条序列化好的 JSON-RPC 通知, 可在任意线程调用
+    using Sink = std::function<void(std::string&&)>;
+
+    RequestContext() = default;
+    RequestContext(nlohmann::json progress_token, Sink sink);
+
+    bool streaming() const { return static_cast<bool>(sink_); }
+
+    // 请求所属会话(Mcp-Session-Id), 无会话时为空
+    const std::string& session() const { return session_; }
+    void set_session(std::string session) { session_ = std::move(session); }
+
+    // notifications/progress, 以请求 _meta.progressToken 标识; progress 必须递增, 否则丢弃
+    void progress(double progress,
+                  std::optional<double> total = std::nullopt,
+                  const std::string& message = "");
+
+    // 中间内容, 以 notifications/message 推送
+    void partial(const nlohmann::json& data, const std::string& level = "info");
+
+    // 任意线程调用; 只记录第一次的原因
+    void cancel(CancelReason reason);
+    // 已取消、已过截止时间或本线程 CPU 时间超限时返回原因, 否则为 None
+    CancelReason cancelled() const;
+    bool is_cancelled() const { return cancelled() != CancelReason::None; }
+    // 已记录的原因, 不做检查
+    CancelReason reason() const { return static_cast<CancelReason>(cancel_->load(std::memory_order_acquire)); }
+    // 已取消时抛出 Cancelled
+    void check() const;
+
+    void set_deadline(std::chrono::steady_clock::time_point deadline) { deadline_ = deadline; }
+    void set_cpu_limit(std::chrono::microseconds limit) { cpu_limit_ = limit; }
+    // 在执行处理函数的线程中调用, 记录 CPU 时间起点
+    void begin();
+
+private:
+    nlohmann::json progress_token_;
+    Sink           sink_;
+    double         last_progress_ = -1;
+    std::string    session_;
+    std::shared_ptr<std::atomic<int>> cancel_ = std::make_shared<std::atomic<int>>(0);
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
+    std::chrono::microseconds cpu_limit_{0};  // 0 不限
+    std::chrono::microseconds cpu_start_{0};
+};
+
+} // namespace server
+} // namespace mcp
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef MCP_SUBSCRIPTION_REGISTRY_H_
+#define MCP_SUBSCRIPTION_REGISTRY_H_
+
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace mcp {
+namespace server {
+
+// 资源订阅表: URI 与 URI 前缀到会话的映射, 以基数树组织, 一次更新按 URI 长度线性找到全部订阅者。
+// 订阅/退订在线程池中调用, 匹配在事件循环中调用, 内部以读写锁保护。每个 worker 进程一份,
+// 订阅与退订经观察者转发给其他 worker, 各 worker 的表互为副本。
+class SubscriptionRegistry {
+public:
+    // 更新发布出口: 由 nginx 模块注册, 负责合并与推送
+    using Publisher = std::function<void(const std::string& uri)>;
+
+    enum class Change { Subscribe, Unsubscribe };
+    // 订阅表变化的出口: 由 nginx 模块注册, 转发给其他 worker; 在调用订阅/退订的线程中回调
+    using Observer = std::function<void(Change change, const std::string& uri, const std::string& session)>;
+
+    static SubscriptionRegistry& instance();
+
+    // uri 以 '*' 结尾时订阅该前缀下的全部资源; 表有变化且 notify 为 true 时回调观察者,
+    // 应用其他 worker 转来的变化时传 false
+    void subscribe(const std::string& uri, const std::string& session, bool notify = true);
+    bool unsubscribe(const std::string& uri, const std::string& session, bool notify = true);
+    // 会话原先有订阅时返回 true
+    bool remove_session(const std::string& session);
+
+    // 当前有订阅的会话
+    std::vector<std::string> sessions() const;
+
+    // 追加订阅了 uri(精确或前缀)的会话, 同一会话只出现一次
+    void match(const std::string& uri, std::unordered_set<std::string>& sessions) const;
+
+    size_t size() const;
+
+    void set_publisher(Publisher p);
+    void set_observer(Observer o);
+    // 通知资源已变化; 可在任意线程调用, 未注册出口时忽略
+    void publish(const std::string& uri) const;
+
+private:
+    struct Node {
+        std::string                        label;   // 父节点到此节点的边
+        std::vector<std::unique_ptr<Node>> children;
+        std::unordered_set<std::string>    exact;   // 精确订阅此路径的会话
+        std::unordered_set<std::string>    prefix;  // 订阅以此路径为前缀的会话
+
+        bool empty() const { return exact.empty() && prefix.empty(); }
+    };
+
+    static std::unique_ptr<Node>* child(Node* n, char c);
+    Node* insert_path(const std::string& key);
+    bool erase_path(Node* n, const std::string& key, size_t pos, bool is_prefix, const std::string& session);
+    void changed(Change change, const std::string& uri, const std::string& session) const;
+
+    mutable std::shared_mutex mutex_;
+    Node                      root_;
+    size_t                    count_ = 0;
+    // 会话 -> 已订阅的 (路径, 是否前缀), 便于会话结束时整体移除
+    std::unordered_map<std::string, std::vector<std::pair<std::string, bool>>> by_session_;
+    Publisher                 publisher_;
+    Observer                  observer_;
+};
+
+} // namespace server
+} // namespace mcp
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef MCP_TOOL_REGISTRY_H_
+#define MCP_TOOL_REGISTRY_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "../../common/types.h"
+#include "request_context.h"
+
+namespace mcp {
+namespace server {
+
+namespace detail {
+template <typename T> struct dependent_false : std::false_type {};
+
+template <typename T> struct is_vector : std::false_type {};
+template <typename T, typename A> struct is_vector<std::vector<T, A>> : std::true_type {};
+
+template <typename T> struct is_string_map : std::false_type {};
+template <typename T, typename C, typename A>
+struct is_string_map<std::map<std::string, T, C, A>> : std::true_type {};
+
+template <typename T, typename = void> struct has_input_schema : std::false_type {};
+template <typename T>
+struct has_input_schema<T, std::void_t<decltype(T::mcp_input_schema())>> : std::true_type {};
+} // namespace detail
+
+// 由 C++ 类型得到 JSON Schema; 不支持的字段类型在编译期报错
+template <typename T>
+nlohmann::json json_schema() {
+    if constexpr (is_optional<T>::value) {
+        return json_schema<typename T::value_type>();
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return nlohmann::json{{"type", "string"}};
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return nlohmann::json{{"type", "boolean"}};
+    } else if constexpr (std::is_integral_v<T> && std::is_unsigned_v<T>) {
+        return nlohmann::json{{"type", "integer"}, {"minimum", 0}};
+    } else if constexpr (std::is_integral_v<T>) {
+        return nlohmann::json{{"type", "integer"}};
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return nlohmann::json{{"type", "number"}};
+    } else if constexpr (detail::is_vector<T>::value) {
+        return nlohmann::json{{"type", "array"}, {"items", json_schema<typename T::value_type>()}};
+    } else if constexpr (detail::is_string_map<T>::value) {
+        return nlohmann::json{{"type", "object"},
+                              {"additionalProperties", json_schema<typename T::mapped_type>()}};
+    } else if constexpr (std::is_same_v<T, nlohmann::json>) {
+        return nlohmann::json::object();
+    } else if constexpr (detail::has_input_schema<T>::value) {
+        return T::mcp_input_schema();
+    } else {
+        static_assert(detail::dependent_false<T>::value, "unsupported tool argument type");
+    }
+}
+
+// MCP_TOOL_ARGUMENTS 展开时逐字段调用; std::optional 字段不进入 required
+class SchemaBuilder {
+public:
+    template <typename M>
+    void field(const char* name) {
+        properties_[name] = json_schema<M>();
+        if (!is_optional<M>::value) required_.push_back(name);
+    }
+
+    nlohmann::json build() const {
+        nlohmann::json s{{"type", "object"}, {"properties", properties_}};
+        if (!required_.empty()) s["required"] = required_;
+        return s;
+    }
+
+private:
+    nlohmann::json           properties_ = nlohmann::json::object();
+    std::vector<std::string> required_;
+};
+
+#define MCP_TOOL_ARGUMENTS_FIELD(v1) \
+    mcp_schema.field<decltype(mcp_tool_arguments_self::v1)>(#v1);
+
+// 在工具参数结构体内声明字段列表: 生成 to_json/from_json 与 inputSchema,
+// schema 按字段类型推导, 每个类型只构建一次
+#define MCP_TOOL_ARGUMENTS(Type, ...) \
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE_OPTIONAL(Type, __VA_ARGS__) \
+    using mcp_tool_arguments_self = Type; \
+    static const nlohmann::json& mcp_input_schema() { \
+        static const nlohmann::json schema = [] { \
+            ::mcp::server::SchemaBuilder mcp_schema; \
+            NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MCP_TOOL_ARGUMENTS_FIELD, __VA_ARGS__)) \
+            return mcp_schema.build(); \
+        }(); \
+        return schema; \
+    }
+
+// 工具注册表: 工具在启动时(C++ 代码或 nginx.conf 中的 mcp_tool)注册一次,
+// tools/list 的每一页在注册表变化时预先序列化, 请求只引用快照中的字节。每个进程一份。
+class ToolRegistry {
+public:
+    // tools/call 的处理函数, arguments 为请求中的原始 JSON
+    using Handler = std::function<CallToolResult(const nlohmann::json& arguments, RequestContext* ctx)>;
+
+    // 一次变化后的完整快照; 页内容为 ListToolsResult 的 JSON 文本, 游标为页号
+    struct Snapshot {
+        std::vector<std::string> pages;
+        std::vector<uint64_t>    etags;   // 每页内容的哈希, 用作 ETag
+
+        // 游标无效时返回 nullptr
+        const std::string* page(const std::optional<std::string>& cursor) const;
+
+        // 按名称取处理函数: 完美哈希定位槽位后只比较一次名称。
+        // 工具不存在时 known 为 false; 存在但没有处理函数(仅在配置中声明)时返回 nullptr
+        const Handler* handler(std::string_view name, bool* known = nullptr) const;
+
+        // 工具标注了 readOnlyHint 与 idempotentHint, 结果可以按参数缓存
+        bool memoizable(std::string_view name) const;
+
+        // 名称在 names 中的下标, 不存在时为 -1
+        int32_t index(std::string_view name) const;
+
+        // 名称表: 先按 hash(name, 0) 分桶, 每个桶一个位移种子使桶内名称落到互不冲突的槽位
+        std::vector<std::string>                    names;
+        std::vector<std::shared_ptr<const Handler>> handlers;
+        std::vector<bool>                           memo;
+        std::vector<uint32_t>                       seeds;   // 每桶一个
+        std::vector<int32_t>                        slots;   // 槽位 -> names 下标, -1 为空
+    };
+
+    static ToolRegistry& instance();
+
+    // 同名工具覆盖; name 为空或 inputSchema 不是 object 时抛 std::invalid_argument
+    void add(Tool tool);
+    void add(Tool tool, Handler handler);
+
+    // 以参数结构体注册工具: inputSchema 由 Args 的 MCP_TOOL_ARGUMENTS 生成,
+    // 调用时 arguments 直接解码到 Args; 缺少必填字段或类型不符时返回 isError 结果
+    template <typename Args, typename F>
+    void add_typed(Tool tool, F fn) {
+        tool.inputSchema = Args::mcp_input_schema();
+        add(std::move(tool), [fn = std::move(fn)](const nlohmann::json& arguments,
+                                                  RequestContext* ctx) -> CallToolResult {
+            Args args;
+            std::string error = decode(arguments, Args::mcp_input_schema(), [&](const nlohmann::json& j) {
+                from_json(j, args);
+            });
+            if (!error.empty()) return error_result(std::move(error));
+            return fn(static_cast<const Args&>(args), ctx);
+        });
+    }
+    bool remove(const std::string& name);
+    // 整体替换来自配置文件的工具, 代码注册的工具保持不变
+    void set_config_tools(std::vector<Tool> tools);
+    // 每页工具数, 0 表示不分页
+    void set_page_size(size_t n);
+
+    std::optional<Tool> find(const std::string& name) const;
+    size_t size() const;
+
+    std::shared_ptr<const Snapshot> snapshot() const;
+    // 未预序列化的路径(批量请求等)使用; 游标无效时抛 std::invalid_argument
+    ListToolsResult list(const std::optional<std::string>& cursor) const;
+
+    static void validate(const Tool& tool);
+    static CallToolResult error_result(std::string message);
+
+private:
+    ToolRegistry() { rebuild(); }
+
+    struct Entry {
+        Tool                           tool;
+        bool                           from_config;
+        std::shared_ptr<const Handler> handler;
+    };
+
+    // 检查必填字段后调用 from_json; 失败时返回错误描述
+    static std::string decode(const nlohmann::json& arguments, const nlohmann::json& schema,
+                              const std::function<void(const nlohmann::json&)>& from);
+
+    void rebuild();   // 持写锁调用
+
+    mutable std::shared_mutex               mutex_;
+    std::vector<Entry>                      tools_;   // 注册顺序即列出顺序
+    std::unordered_map<std::string, size_t> index_;
+    size_t                                  page_size_ = 100;
+    std::shared_ptr<const Snapshot>         snapshot_;
+};
+
+} // namespace server
+} // namespace mcp
+
+#endif
@@ -0,0 +1,135 @@
+#include <string>
+#include <unordered_map>
+#include "ngx_http_mcp_module.h"
+
+// 有会话状态的工具(游标、打开的文件句柄、临时缓冲)按 actor 执行: mcp_actor 列出的工具或方法,
+// 同一 Mcp-Session-Id 的请求进入同一个信箱, 前一个完成后才把下一个交给调度器, 因此同一时刻
+// 只有一个线程处理该会话的该工具, 且按到达顺序执行, 工具内部不必为会话状态加锁; 不同会话照常并行。
+// 信箱只在事件循环线程访问, 无需加锁; 每个 worker 一份, 同一会话的请求落到不同 worker 时各自串行。
+
+struct ngx_http_mcp_actor_mailbox_s {
+    std::string  key;               // 会话 "\n" 工具名(非 tools/call 为方法名)
+    ngx_queue_t  waiting;           // 等待中的 ngx_http_mcp_actor_t
+    ngx_flag_t   busy;              // 有任务已交给调度器或正在执行
+};
+
+// 以下仅在事件循环线程访问
+static std::unordered_map<std::string, ngx_http_mcp_actor_mailbox_t>  ngx_http_mcp_actor_mailboxes;
+
+static bool
+ngx_http_mcp_actor_listed(ngx_array_t *actors, ngx_str_t *name) {
+    if (name->len == 0) return false;
+    ngx_str_t *a = (ngx_str_t*)actors->elts;
+    for (ngx_uint_t i = 0; i < actors->nelts; ++i) {
+        if ((a[i].len == 1 && a[i].data[0] == '*')
+            || (a[i].len == name->len && ngx_strncmp(a[i].data, name->data, name->len) == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 交给调度器; 拒收时与调度器补投相同, 在事件循环中执行, 完成回调照常触发
+static void
+ngx_http_mcp_actor_start(ngx_http_mcp_actor_t *a) {
+    if (ngx_http_mcp_sched_post(a->r, a->tp, a->task, &a->in, a->sched) == NGX_OK) return;
+
+    ngx_log_error(NGX_LOG_ERR, a->r->connection->log, 0, "mcp failed to post actor task, running inline");
+    a->task->handler(a->task->ctx, a->r->connection->log);
+    ngx_post_event(&a->task->event, &ngx_posted_events);
+}
+
+extern "C" {
+
+// 请求带会话且工具名或方法名在 mcp_actor 中时按会话串行
+ngx_flag_t
+ngx_http_mcp_actor_wanted(ngx_http_request_t *r, ngx_http_mcp_sched_input_t *in) {
+    ngx_http_mcp_loc_conf_t *conf =
+        (ngx_http_mcp_loc_conf_t *)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
+    return conf->actors != NULL && in->session.len
+        && (ngx_http_mcp_actor_listed(conf->actors, &in->tool)
+            || ngx_http_mcp_actor_listed(conf->actors, &in->method));
+}
+
+// 代替 ngx_http_mcp_sched_post: 信箱忙时只入队并返回 NGX_OK, 轮到时再投递, *sched 在投递后才非空
+ngx_int_t
+ngx_http_mcp_actor_post(ngx_http_request_t *r, ngx_http_mcp_thread_pool_t *tp, ngx_thread_task_t *task,
+    ngx_http_mcp_sched_input_t *in, ngx_http_mcp_sched_entry_t **sched, ngx_http_mcp_actor_t *a)
+{
+    a->mailbox = NULL;
+    a->waiting = 0;
+    if (!ngx_http_mcp_actor_wanted(r, in)) {
+        return ngx_http_mcp_sched_post(r, tp, task, in, sched);
+    }
+
+    ngx_http_mcp_actor_mailbox_t *m;
+    try {
+        ngx_str_t *name = in->tool.len ? &in->tool : &in->method;
+        std::string key((const char*)in->session.data, in->session.len);
+        key += '\n';
+        key.append((const char*)name->data, name->len);
+        auto ins = ngx_http_mcp_actor_mailboxes.try_emplace(key);
+        m = &ins.first->second;
+        if (ins.second) {
+            m->key = std::move(key);
+            ngx_queue_init(&m->waiting);
+            m->busy = 0;
+        }
+    } catch (const std::bad_alloc &) {
+        return NGX_ERROR;
+    }
+
+    a->mailbox = m;
+    a->r = r;
+    a->tp = tp;
+    a->task = task;
+    a->in = *in;
+    a->sched = sched;
+    *sched = NULL;
+
+    if (m->busy) {
+        ngx_queue_insert_tail(&m->waiting, &a->queue);
+        a->waiting = 1;
+        return NGX_OK;
+    }
+
+    m->busy = 1;
+    if (ngx_http_mcp_sched_post(r, tp, task, in, sched) != NGX_OK) {
+        ngx_http_mcp_actor_done(a);
+        return NGX_ERROR;
+    }
+    return NGX_OK;
+}
+
+// 任务完成或请求销毁时调用, 可重复调用: 等待中的移出信箱, 执行中的让出信箱并投递下一个
+void
+ngx_http_mcp_actor_done(ngx_http_mcp_actor_t *a) {
+    ngx_http_mcp_actor_mailbox_t *m = a->mailbox;
+    if (m == NULL) return;
+    a->mailbox = NULL;
+
+    if (a->waiting) {
+        ngx_queue_remove(&a->queue);
+        a->waiting = 0;
+    } else {
+        m->busy = 0;
+    }
+
+    if (!m->busy && !ngx_queue_empty(&m->waiting)) {
+        ngx_queue_t *q = ngx_queue_head(&m->waiting);
+        ngx_queue_remove(q);
+        auto *next = ngx_queue_data(q, ngx_http_mcp_actor_t, queue);
+        next->waiting = 0;
+        m->busy = 1;
+        ngx_http_mcp_actor_start(next);
+        return;
+    }
+
+    if (!m->busy) {
+        auto it = ngx_http_mcp_actor_mailboxes.find(m->key);
+        ngx_http_mcp_actor_mailboxes.erase(it);
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,232 @@
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include "ngx_http_mcp_module.h"
+
+// 自适应并发限制: 每个 location 一个限制值, 按进入线程池到完成的延迟调整(gradient):
+// 各方法分别维护长期基线与短期均值, 短期均值超过基线的 tolerance 倍时按比例收缩, 否则在饱和时
+// 以 sqrt(limit) 的余量缓慢增长。超出限制的请求直接 503 + Retry-After; 高优先级方法可用到
+// 2 倍限制, 低优先级在 3/4 处就被拒绝, 过载时先丢弃 tools/call 这类低优先级请求。
+// 状态都在配置内存中, fork 后每个 worker 一份, 仅事件循环线程访问。
+
+// 短期均值权重 1/8, 长期基线约 100 个样本
+#define NGX_HTTP_MCP_ADAPTIVE_SHORT     0.125
+#define NGX_HTTP_MCP_ADAPTIVE_LONG      0.01
+
+// 每个方法累计这么多个样本后才参与调整
+#define NGX_HTTP_MCP_ADAPTIVE_WARMUP    10
+
+// 新旧限制值的平滑系数
+#define NGX_HTTP_MCP_ADAPTIVE_SMOOTHING 0.2
+
+typedef struct {
+    double      long_usec;
+    double      short_usec;
+    ngx_uint_t  samples;
+} ngx_http_mcp_adaptive_rtt_t;
+
+struct ngx_http_mcp_concurrency_s {
+    ngx_uint_t  min;
+    ngx_uint_t  max;
+    ngx_uint_t  tolerance;          // 百分比
+    ngx_msec_t  retry_after;
+
+    // 以下每个 worker 一份
+    double      limit;
+    ngx_uint_t  inflight;
+    std::unordered_map<std::string, ngx_http_mcp_adaptive_rtt_t> *rtt; // 首次采样时分配, 键为方法名
+};
+
+// 各优先级可占用的限制比例(百分比)
+static const ngx_uint_t ngx_http_mcp_adaptive_share[NGX_HTTP_MCP_PRIO_CLASSES] = { 200, 100, 75 };
+
+static uint64_t
+ngx_http_mcp_adaptive_now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void
+ngx_http_mcp_adaptive_update(ngx_http_mcp_concurrency_t *c, ngx_str_t *method, uint64_t usec) {
+    if (c->rtt == nullptr) {
+        c->rtt = new std::unordered_map<std::string, ngx_http_mcp_adaptive_rtt_t>();
+    }
+    ngx_http_mcp_adaptive_rtt_t &m = (*c->rtt)[std::string((const char*)method->data, method->len)];
+    double sample = (double)(usec ? usec : 1);
+
+    if (m.samples++ == 0) {
+        m.long_usec = m.short_usec = sample;
+        return;
+    }
+    m.short_usec += (sample - m.short_usec) * NGX_HTTP_MCP_ADAPTIVE_SHORT;
+    m.long_usec += (sample - m.long_usec) * NGX_HTTP_MCP_ADAPTIVE_LONG;
+    // 延迟回落时基线跟着回落, 免得过载期间抬高的基线掩盖下一次过载
+    if (m.long_usec > m.short_usec * 2) {
+        m.long_usec *= 0.95;
+    }
+    if (m.samples < NGX_HTTP_MCP_ADAPTIVE_WARMUP) return;
+
+    double gradient = (double)c->tolerance / 100 * m.long_usec / m.short_usec;
+    gradient = std::max(0.5, std::min(1.0, gradient));
+    // 未饱和时延迟正常不说明能承受更多并发, 不增长
+    if (gradient >= 1.0 && (double)c->inflight * 2 < c->limit) return;
+
+    double next = c->limit * gradient + std::sqrt(c->limit);
+    c->limit = c->limit * (1 - NGX_HTTP_MCP_ADAPTIVE_SMOOTHING) + next * NGX_HTTP_MCP_ADAPTIVE_SMOOTHING;
+    c->limit = std::max((double)c->min, std::min((double)c->max, c->limit));
+}
+
+static ngx_http_mcp_max_inflight_t *
+ngx_http_mcp_adaptive_rule(ngx_array_t *rules, ngx_str_t *name) {
+    if (rules == NULL || name == NULL || name->len == 0) return NULL;
+    ngx_http_mcp_max_inflight_t *rule = (ngx_http_mcp_max_inflight_t*)rules->elts;
+    for (ngx_uint_t i = 0; i < rules->nelts; ++i) {
+        if (rule[i].name.len == name->len && ngx_strncmp(rule[i].name.data, name->data, name->len) == 0) {
+            return &rule[i];
+        }
+    }
+    return NULL;
+}
+
+extern "C" {
+
+// 工具名规则优先于方法名规则; 拒绝时返回 NGX_BUSY 并在 a->retry_after 给出重试间隔
+ngx_int_t
+ngx_http_mcp_admit(ngx_http_request_t *r, ngx_str_t *method, ngx_str_t *tool, ngx_http_mcp_admit_t *a) {
+    ngx_http_mcp_loc_conf_t *conf =
+        (ngx_http_mcp_loc_conf_t *)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
+    ngx_http_mcp_concurrency_t *c = conf->concurrency;
+
+    ngx_memzero(a, sizeof(ngx_http_mcp_admit_t));
+    a->retry_after = c ? c->retry_after : 1000;
+
+    ngx_http_mcp_max_inflight_t *rule = ngx_http_mcp_adaptive_rule(conf->max_inflight, tool);
+    if (rule == NULL) rule = ngx_http_mcp_adaptive_rule(conf->max_inflight, method);
+    if (rule && rule->inflight >= rule->max) {
+        ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                      "mcp max in-flight %ui reached for \"%V\"", rule->max, &rule->name);
+        return NGX_BUSY;
+    }
+
+    if (c) {
+        ngx_uint_t prio = ngx_http_mcp_sched_priority(r, method, tool);
+        double allowed = c->limit * ngx_http_mcp_adaptive_share[prio] / 100;
+        if ((double)c->inflight >= std::max(allowed, 1.0)) {
+            ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                          "mcp concurrency limit %ui reached, shedding method: %V",
+                          (ngx_uint_t)c->limit, method);
+            return NGX_BUSY;
+        }
+        c->inflight++;
+        a->limiter = c;
+    }
+    if (rule) {
+        rule->inflight++;
+        a->rule = rule;
+    }
+    a->method = *method;
+    a->start = ngx_http_mcp_adaptive_now();
+    return NGX_OK;
+}
+
+// 可重复调用; sample 为真时以本次延迟调整限制(仅成功完成的请求)
+void
+ngx_http_mcp_admit_release(ngx_http_mcp_admit_t *a, ngx_flag_t sample) {
+    if (a->rule) {
+        a->rule->inflight--;
+        a->rule = NULL;
+    }
+    ngx_http_mcp_concurrency_t *c = a->limiter;
+    if (c == NULL) return;
+    a->limiter = NULL;
+    c->inflight--;
+    if (sample) {
+        try {
+            ngx_http_mcp_adaptive_update(c, &a->method, ngx_http_mcp_adaptive_now() - a->start);
+        } catch (const std::bad_alloc &) {
+        }
+    }
+}
+
+// mcp_concurrency off | [min=n] [max=n] [initial=n] [tolerance=x] [retry_after=time]
+char *ngx_http_mcp_concurrency(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_loc_conf_t *lcf = (ngx_http_mcp_loc_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (lcf->concurrency != NGX_CONF_UNSET_PTR) return (char*)"is duplicate";
+
+    if (cf->args->nelts == 2 && value[1].len == 3 && ngx_strncmp(value[1].data, "off", 3) == 0) {
+        lcf->concurrency = NULL;
+        return NGX_CONF_OK;
+    }
+
+    auto *c = (ngx_http_mcp_concurrency_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_concurrency_t));
+    if (c == NULL) return (char*)NGX_CONF_ERROR;
+    c->min = 4;
+    c->max = 256;
+    c->tolerance = 200;
+    c->retry_after = 1000;
+    ngx_uint_t initial = 16;
+
+    for (ngx_uint_t i = 1; i < cf->args->nelts; ++i) {
+        ngx_str_t s;
+        if (ngx_strncmp(value[i].data, "min=", 4) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 4, value[i].len - 4);
+            if (n == NGX_ERROR || n == 0) return (char*)"invalid min";
+            c->min = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "max=", 4) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 4, value[i].len - 4);
+            if (n == NGX_ERROR || n == 0) return (char*)"invalid max";
+            c->max = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "initial=", 8) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 8, value[i].len - 8);
+            if (n == NGX_ERROR || n == 0) return (char*)"invalid initial";
+            initial = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "tolerance=", 10) == 0) {
+            ngx_int_t n = ngx_atofp(value[i].data + 10, value[i].len - 10, 2);
+            if (n == NGX_ERROR || n < 100) return (char*)"invalid tolerance";
+            c->tolerance = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "retry_after=", 12) == 0) {
+            s.data = value[i].data + 12;
+            s.len = value[i].len - 12;
+            c->retry_after = ngx_parse_time(&s, 0);
+            if (c->retry_after == (ngx_msec_t)NGX_ERROR) return (char*)"invalid retry_after";
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    if (c->min > c->max) return (char*)"min must not exceed max";
+    c->limit = (double)ngx_max(c->min, ngx_min(initial, c->max));
+    lcf->concurrency = c;
+    return NGX_CONF_OK;
+}
+
+// mcp_max_inflight name n: 方法或工具在每个 worker 上同时进入线程池的请求数上限
+char *ngx_http_mcp_max_inflight(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_loc_conf_t *lcf = (ngx_http_mcp_loc_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (lcf->max_inflight == NGX_CONF_UNSET_PTR) {
+        lcf->max_inflight = ngx_array_create(cf->pool, 4, sizeof(ngx_http_mcp_max_inflight_t));
+        if (lcf->max_inflight == NULL) return (char*)NGX_CONF_ERROR;
+    }
+    if (ngx_http_mcp_adaptive_rule(lcf->max_inflight, &value[1])) return (char*)"is duplicate";
+
+    ngx_int_t n = ngx_atoi(value[2].data, value[2].len);
+    if (n == NGX_ERROR || n == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid max in-flight \"%V\"", &value[2]);
+        return (char*)NGX_CONF_ERROR;
+    }
+
+    ngx_http_mcp_max_inflight_t *rule = (ngx_http_mcp_max_inflight_t*)ngx_array_push(lcf->max_inflight);
+    if (rule == NULL) return (char*)NGX_CONF_ERROR;
+    rule->name = value[1];
+    rule->max = (ngx_uint_t)n;
+    rule->inflight = 0;
+    return NGX_CONF_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,442 @@
+#include <new>
+#include "ngx_http_mcp_module.h"
+
+// JSON-RPC 批量请求: 每个元素独立构建、独立限流、各自投递一个线程任务,
+// 全部完成后按请求顺序拼成一个数组响应。单个元素失败只产生对应的 error 对象。
+
+static const char kBatchOpen[] = "[";
+static const char kBatchSep[] = ",";
+static const char kBatchClose[] = "]";
+
+typedef struct ngx_http_mcp_batch_item_s {
+    struct ngx_http_mcp_batch_s *batch = nullptr;
+    ngx_thread_task_t           *task = nullptr;
+    ngx_http_mcp_sched_entry_t  *sched = nullptr;       // 经调度器投递时非空
+    ngx_msec_t                   deadline = 0;          // params._meta.timeout 换算的截止时间
+    ngx_http_mcp_admit_t         admit{};               // 并发限制的准入
+    ngx_http_mcp_cancel_t        cancel{};              // 投递后登记, 可被单独取消
+    ngx_http_mcp_actor_t         actor{};               // 经 mcp_actor 串行执行时使用
+    std::string                  id;                    // 序列化后的 id, 无效元素为 "null"
+    bool                         notification = false;  // 无 id: 请求方法照常执行, 但不产生响应
+    std::string                  method;
+    mcp::server::McpServer::MCPRequestVariant req_variant;
+    mcp::server::RequestContext rctx;                   // 仅携带会话, 批量请求不推送进度
+    ngx_pool_t                  *pool = nullptr;        // 线程独占的私有 pool
+    ngx_chain_t                 *out = nullptr;
+    size_t                       out_len = 0;
+    ngx_array_t                 *charges = nullptr;
+    int                          code = 0;              // 非 0 时返回 JSON-RPC 错误
+    const char                  *message = nullptr;
+    nlohmann::json               data;
+    uint64_t                     handler_usec = 0;      // 以下用于指标, 单位微秒; 0 表示未执行
+    uint64_t                     serialize_usec = 0;
+    uint64_t                     cpu_usec = 0;
+} ngx_http_mcp_batch_item_t;
+
+typedef struct ngx_http_mcp_batch_s {
+    ngx_http_request_t                    *r = nullptr;
+    std::vector<ngx_http_mcp_batch_item_t> items;
+    ngx_uint_t                             pending = 0;  // 未完成的线程任务, 仅事件循环线程访问
+    bool                                   disconnected = false; // 客户端已断开, 不再应答
+} ngx_http_mcp_batch_t;
+
+extern "C" {
+
+// 每个元素各记一个指标样本; 元素的排队与请求体时间不单独测量
+static void
+ngx_http_mcp_batch_metrics(ngx_http_mcp_batch_item_t *it) {
+    if (it->method.empty()) return;
+    ngx_http_mcp_metrics_sample_t s;
+    s.method.len = it->method.size();
+    s.method.data = (u_char*)it->method.data();
+    ngx_str_null(&s.tool);
+    if (auto *call = std::get_if<mcp::CallToolRequest>(&it->req_variant)) {
+        s.tool.len = call->params.name.size();
+        s.tool.data = (u_char*)call->params.name.data();
+    }
+    s.error = it->code != 0;
+    s.rate_limited = it->code == NGX_HTTP_MCP_RPC_RATE_LIMITED;
+    s.cpu_usec = it->cpu_usec;
+    for (ngx_uint_t h = 0; h < NGX_HTTP_MCP_METRICS; ++h) {
+        s.values[h] = NGX_HTTP_MCP_METRIC_NONE;
+    }
+    if (it->handler_usec) {
+        s.values[NGX_HTTP_MCP_METRIC_HANDLER] = it->handler_usec - it->serialize_usec;
+        s.values[NGX_HTTP_MCP_METRIC_SERIALIZE] = it->serialize_usec;
+    }
+    s.values[NGX_HTTP_MCP_METRIC_BYTES] = it->out_len;
+    ngx_http_mcp_metrics_record(&s);
+}
+
+static void
+ngx_http_mcp_batch_cleanup(void *data) {
+    auto *batch = static_cast<ngx_http_mcp_batch_t*>(data);
+    for (auto &it : batch->items) {
+        ngx_http_mcp_batch_metrics(&it);
+    }
+    // 先撤下信箱中等待的元素, 免得执行中的元素让出信箱时又投递同批的下一个
+    for (auto &it : batch->items) {
+        if (it.actor.waiting) ngx_http_mcp_actor_done(&it.actor);
+    }
+    for (auto &it : batch->items) {
+        ngx_http_mcp_admit_release(&it.admit, 0);
+        ngx_http_mcp_actor_done(&it.actor);
+        ngx_http_mcp_cancel_unregister(&it.cancel);
+        if (it.task && it.task->event.posted) {
+            ngx_delete_posted_event(&it.task->event);
+        }
+        if (it.pool != NULL && it.pool != batch->r->pool) {
+            ngx_destroy_pool(it.pool);
+        }
+    }
+    delete batch;
+}
+
+static void
+ngx_http_mcp_batch_fail(ngx_http_mcp_batch_item_t *it, int code, const char *message) {
+    it->code = code;
+    it->message = message;
+}
+
+// 元素构建失败时区分无效请求、未知方法与参数错误
+static void
+ngx_http_mcp_batch_reject(ngx_http_mcp_batch_item_t *it, const nlohmann::json &e) {
+    auto m = e.find("method");
+    if (m == e.end() || !m->is_string()) {
+        ngx_http_mcp_batch_fail(it, NGX_HTTP_MCP_RPC_INVALID_REQUEST, "Invalid Request");
+    } else if (!mcp::server::McpServer::is_known_method(m->get_ref<const std::string&>())) {
+        ngx_http_mcp_batch_fail(it, NGX_HTTP_MCP_RPC_METHOD_NOT_FOUND, "Method not found");
+    } else {
+        ngx_http_mcp_batch_fail(it, NGX_HTTP_MCP_RPC_INVALID_PARAMS, "Invalid params");
+    }
+}
+
+static void
+ngx_http_mcp_batch_run(ngx_http_mcp_batch_item_t *it, ngx_log_t *log) {
+    uint64_t start = ngx_http_mcp_metrics_usec();
+    uint64_t cpu = ngx_http_mcp_metrics_cpu_usec();
+    try {
+        it->rctx.begin();
+        nlohmann::json result = mcp::server::McpServer::handle(it->req_variant, log, &it->rctx);
+        if (!it->notification) {
+            uint64_t serialize = ngx_http_mcp_metrics_usec();
+            it->out = ngx_http_mcp_serialize_result(it->pool, it->id, result, &it->out_len);
+            it->serialize_usec = ngx_http_mcp_metrics_usec() - serialize;
+        }
+    } catch (const mcp::server::Cancelled &) {
+        it->cancel.aborted = 1;
+    } catch (const std::invalid_argument &) {
+        ngx_http_mcp_batch_fail(it, NGX_HTTP_MCP_RPC_INVALID_PARAMS, "Invalid params");
+    } catch (const std::exception &e) {
+        if (log) {
+            ngx_log_error(NGX_LOG_ERR, log, 0,
+                          "mcp batch handle std::exception: %s (method=%s)",
+                          e.what(), it->method.c_str());
+        }
+        ngx_http_mcp_batch_fail(it, NGX_HTTP_MCP_RPC_INTERNAL_ERROR, "Internal error");
+    }
+    it->handler_usec = ngx_http_mcp_metrics_usec() - start;
+    it->cpu_usec = ngx_http_mcp_metrics_cpu_usec() - cpu;
+}
+
+// 被取消的元素: 超时与 CPU 超限返回 error 对象, 客户端取消的不再应答
+static void
+ngx_http_mcp_batch_aborted(ngx_http_mcp_batch_item_t *it) {
+    if (!it->cancel.aborted) return;
+    mcp::server::CancelReason reason = it->rctx.reason();
+    if (reason == mcp::server::CancelReason::Timeout || reason == mcp::server::CancelReason::CpuLimit) {
+        ngx_http_mcp_batch_fail(it, NGX_HTTP_MCP_RPC_TIMEOUT, mcp::server::Cancelled(reason).what());
+    } else {
+        it->notification = true;
+    }
+}
+
+static void
+ngx_http_mcp_batch_worker(void *data, ngx_log_t *log) {
+    ngx_http_mcp_batch_run(static_cast<ngx_http_mcp_batch_item_t*>(data), log);
+}
+
+static ngx_chain_t *
+ngx_http_mcp_batch_literal(ngx_pool_t *pool, const char *s, size_t len) {
+    ngx_buf_t *b = ngx_calloc_buf(pool);
+    ngx_chain_t *cl = ngx_alloc_chain_link(pool);
+    if (b == NULL || cl == NULL) return NULL;
+    b->pos = (u_char*)s;
+    b->last = b->pos + len;
+    b->memory = 1;
+    cl->buf = b;
+    cl->next = NULL;
+    return cl;
+}
+
+// 按请求顺序拼接 "[" elem ("," elem)* "]"; 每个分隔符单独一个 buf, 输出过滤器会移动 buf->pos
+static ngx_int_t
+ngx_http_mcp_batch_send(ngx_http_request_t *r, ngx_http_mcp_batch_t *batch) {
+    ngx_chain_t  *out = NULL;
+    ngx_chain_t **last = &out;
+    size_t        len = 0;
+
+    for (auto &it : batch->items) {
+        if (it.notification) continue;
+
+        if (it.code == 0) {
+            ngx_http_mcp_limit_charge_response(it.charges, it.out_len);
+        } else {
+            try {
+                it.out = ngx_http_mcp_serialize_error(r->pool, it.id, it.code, it.message,
+                                                      it.data, &it.out_len);
+            } catch (const std::exception &) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+        }
+
+        ngx_chain_t *sep = (out == NULL)
+            ? ngx_http_mcp_batch_literal(r->pool, kBatchOpen, sizeof(kBatchOpen) - 1)
+            : ngx_http_mcp_batch_literal(r->pool, kBatchSep, sizeof(kBatchSep) - 1);
+        if (sep == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        *last = sep;
+        sep->next = it.out;
+        ngx_chain_t *cl = sep;
+        while (cl->next) cl = cl->next;
+        last = &cl->next;
+        len += 1 + it.out_len;
+    }
+
+    // 全部是通知时没有响应体
+    if (out == NULL) {
+        return ngx_http_mcp_send_accepted(r);
+    }
+
+    ngx_chain_t *close = ngx_http_mcp_batch_literal(r->pool, kBatchClose, sizeof(kBatchClose) - 1);
+    if (close == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    *last = close;
+    len += 1;
+
+    return ngx_http_mcp_send_chain(r, out, len);
+}
+
+static void
+ngx_http_mcp_batch_complete(ngx_event_t *ev) {
+    ngx_thread_task_t *task = static_cast<ngx_thread_task_t*>(ev->data);
+    auto *it = static_cast<ngx_http_mcp_batch_item_t*>(task->ctx);
+    ngx_http_mcp_batch_t *batch = it->batch;
+
+    ngx_http_mcp_sched_done(it->sched);
+    ngx_http_mcp_actor_done(&it->actor);
+    ngx_http_mcp_cancel_unregister(&it->cancel);
+    ngx_http_mcp_admit_release(&it->admit, it->code == 0 && !it->cancel.aborted);
+    ngx_http_mcp_batch_aborted(it);
+    if (--batch->pending) return;
+
+    ngx_http_request_t *r = batch->r;
+    if (batch->disconnected) {
+        ngx_http_finalize_request(r, NGX_HTTP_CLIENT_CLOSED_REQUEST);
+        return;
+    }
+    ngx_http_finalize_request(r, ngx_http_mcp_batch_send(r, batch));
+}
+
+// 解析各元素并逐个限流; 排队中的元素取最大延迟, 整批延迟后再投递
+ngx_int_t
+ngx_http_mcp_batch_process(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    ngx_http_mcp_loc_conf_t *conf =
+        (ngx_http_mcp_loc_conf_t *)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
+    const nlohmann::json &body = ctx->body_parser.result();
+
+    // 空数组按规范返回单个 Invalid Request
+    if (body.empty()) {
+        size_t len;
+        ngx_chain_t *out;
+        try {
+            out = ngx_http_mcp_serialize_error(r->pool, "null", NGX_HTTP_MCP_RPC_INVALID_REQUEST,
+                                               "Invalid Request", nullptr, &len);
+        } catch (const std::exception &) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        return ngx_http_mcp_send_chain(r, out, len);
+    }
+
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    auto *batch = new (std::nothrow) ngx_http_mcp_batch_t();
+    if (batch == nullptr) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    batch->r = r;
+    cln->handler = ngx_http_mcp_batch_cleanup;
+    cln->data = batch;
+
+    try {
+        batch->items.resize(body.size());
+    } catch (const std::bad_alloc &) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    ngx_http_mcp_limit_state_t worst;
+    ngx_memzero(&worst, sizeof(worst));
+    ngx_msec_t delay = 0;
+    ngx_uint_t checked = 0, rejected = 0;
+
+    for (size_t i = 0; i < body.size(); ++i) {
+        const nlohmann::json &e = body[i];
+        ngx_http_mcp_batch_item_t &it = batch->items[i];
+        it.batch = batch;
+        it.id = "null";
+
+        if (e.is_object()) {
+            auto id = e.find("id");
+            if (id != e.end()) {
+                it.id = id->dump();
+            } else {
+                it.notification = true;
+            }
+        }
+
+        // 通知与客户端发回的响应既不执行也不应答
+        if (ngx_http_mcp_no_reply(e)) {
+            it.notification = true;
+            auto m = e.find("method");
+            if (m != e.end() && *m == "notifications/cancelled") {
+                ngx_http_mcp_cancel_notification(r, &ctx->session_id, e);
+            }
+            continue;
+        }
+
+        if (!mcp::server::McpServer::build_request(e, it.req_variant, it.method, r->connection->log)) {
+            ngx_http_mcp_batch_reject(&it, e);
+            continue;
+        }
+        it.deadline = ngx_http_mcp_cancel_deadline(r, e);
+
+        // 请求体字节权重按元素数均摊
+        ngx_http_mcp_limit_input_t in;
+        in.method.len = it.method.size();
+        in.method.data = (u_char*)it.method.data();
+        in.tool.len = 0;
+        in.tool.data = NULL;
+        in.body_bytes = ctx->body_bytes / (off_t)body.size();
+        if (auto *call = std::get_if<mcp::CallToolRequest>(&it.req_variant)) {
+            in.tool.len = call->params.name.size();
+            in.tool.data = (u_char*)call->params.name.data();
+        }
+
+        ngx_http_mcp_limit_state_t st;
+        ngx_int_t rc = ngx_http_mcp_limit_check(r, conf, &in, &st, &it.charges);
+        if (rc == NGX_ERROR) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        if (st.rule == NULL) continue;
+
+        checked++;
+        if (worst.rule == NULL || st.remaining < worst.remaining) {
+            worst = st;
+        }
+        if (rc == NGX_BUSY) {
+            ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                          "mcp rate limit exceeded for batch method: %V", &in.method);
+            ngx_http_mcp_batch_fail(&it, NGX_HTTP_MCP_RPC_RATE_LIMITED, "Rate limit exceeded");
+            it.data = {{"retryAfter", (st.retry_after + 999) / 1000}};
+            ctx->rate_limited = true;   // $mcp_rate_limited: 任一元素被拒绝
+            rejected++;
+        } else if (rc == NGX_AGAIN) {
+            delay = ngx_max(delay, st.delay);
+        }
+    }
+
+    // 只有整批都被拒绝时才给出 Retry-After
+    if (worst.rule) {
+        if (rejected != checked) worst.retry_after = 0;
+        if (ngx_http_mcp_limit_set_headers(r, &worst) != NGX_OK) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+    }
+
+    ctx->batch = batch;
+    if (delay) {
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                      "mcp rate limit delaying batch by %M ms", delay);
+        return ngx_http_mcp_delay(r, delay);
+    }
+    return ngx_http_mcp_batch_dispatch(r, ctx);
+}
+
+// 每个有效元素投递一个线程任务; 整批只持有一次请求引用
+ngx_int_t
+ngx_http_mcp_batch_dispatch(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    ngx_http_mcp_batch_t *batch = ctx->batch;
+
+    for (auto &it : batch->items) {
+        if (it.code != 0 || it.method.empty()) continue;
+        it.rctx.set_session(std::string((const char*)ctx->session_id.data, ctx->session_id.len));
+        ngx_http_mcp_cancel_limits(r, &it.rctx, it.deadline);
+
+        ngx_http_mcp_thread_pool_t *tp = ngx_http_mcp_get_thread_pool(r, it.method, it.req_variant);
+        if (tp == nullptr) {
+            // 回退同步（无线程池）
+            it.pool = r->pool;
+            ngx_http_mcp_batch_run(&it, r->connection->log);
+            ngx_http_mcp_batch_aborted(&it);
+            continue;
+        }
+
+        ngx_http_mcp_sched_input_t in;
+        in.method.len = it.method.size();
+        in.method.data = (u_char*)it.method.data();
+        ngx_str_null(&in.tool);
+        if (auto *call = std::get_if<mcp::CallToolRequest>(&it.req_variant)) {
+            in.tool.len = call->params.name.size();
+            in.tool.data = (u_char*)call->params.name.data();
+        }
+        in.session = ctx->session_id;
+        in.deadline = it.deadline;
+
+        if (ngx_http_mcp_admit(r, &in.method, &in.tool, &it.admit) == NGX_BUSY) {
+            ngx_http_mcp_batch_fail(&it, NGX_HTTP_MCP_RPC_OVERLOADED, "Server overloaded");
+            it.data = {{"retryAfter", (it.admit.retry_after + 999) / 1000}};
+            continue;
+        }
+
+        it.task = ngx_thread_task_alloc(r->pool, 0);
+        it.pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, r->connection->log);
+        if (it.task == NULL || it.pool == NULL) {
+            ngx_http_mcp_admit_release(&it.admit, 0);
+            ngx_http_mcp_batch_fail(&it, NGX_HTTP_MCP_RPC_INTERNAL_ERROR, "Internal error");
+            continue;
+        }
+        it.task->ctx = &it;
+        it.task->handler = ngx_http_mcp_batch_worker;
+        it.task->event.handler = ngx_http_mcp_batch_complete;
+        it.task->event.data = it.task;
+
+        if (ngx_http_mcp_actor_post(r, tp, it.task, &in, &it.sched, &it.actor) != NGX_OK) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "mcp failed to post batch thread task");
+            ngx_http_mcp_admit_release(&it.admit, 0);
+            ngx_http_mcp_batch_fail(&it, NGX_HTTP_MCP_RPC_INTERNAL_ERROR, "Internal error");
+            continue;
+        }
+        ngx_http_mcp_cancel_register(r, &it.cancel, &ctx->session_id, it.id, &it.rctx, &it.sched, it.deadline);
+        batch->pending++;
+    }
+
+    if (batch->pending == 0) {
+        return ngx_http_mcp_batch_send(r, batch);
+    }
+
+    // 增加引用计数，最后一个元素完成后 finalize
+    r->main->count++;
+    ngx_http_mcp_cancel_watch(r);
+    return NGX_DONE;
+}
+
+} // extern "C"
+
+// 客户端断开: 取消全部在途元素, 完成后不再应答
+void
+ngx_http_mcp_batch_cancel(ngx_http_mcp_async_ctx_t *ctx, mcp::server::CancelReason reason) {
+    ngx_http_mcp_batch_t *batch = ctx->batch;
+    if (reason == mcp::server::CancelReason::Disconnected) {
+        batch->disconnected = true;
+    }
+    for (auto &it : batch->items) {
+        if (it.task) ngx_http_mcp_cancel_request(&it.cancel, reason);
+    }
+}
@@ -0,0 +1,234 @@
+#include <sys/mman.h>
+#include "ngx_http_mcp_module.h"
+
+// 线程池中解析的大请求体, 与线程任务一同分配
+typedef struct {
+    ngx_http_mcp_async_ctx_t   *ctx;
+    ngx_http_mcp_sched_entry_t *sched;
+    ngx_int_t                   status;
+} ngx_http_mcp_body_parse_t;
+
+extern "C" {
+
+static void ngx_http_mcp_read_body_more(ngx_http_request_t *r);
+
+// 落盘的请求体片段: 优先 mmap 直接喂给解析器, 失败时分块读取
+static ngx_int_t
+ngx_http_mcp_body_feed_file(ngx_http_mcp_async_ctx_t *ctx, ngx_buf_t *b, ngx_log_t *log) {
+    off_t start = b->file_pos;
+    off_t end = b->file_last;
+    if (end <= start) return NGX_OK;
+
+    off_t aligned = start & ~((off_t)ngx_pagesize - 1);
+    size_t len = (size_t)(end - aligned);
+    void *p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, b->file->fd, aligned);
+    if (p != MAP_FAILED) {
+        ctx->body_parser.feed((const char*)p + (start - aligned), (size_t)(end - start));
+        munmap(p, len);
+        return NGX_OK;
+    }
+
+    ngx_log_error(NGX_LOG_INFO, log, ngx_errno,
+                  "mcp mmap request body file \"%V\" failed, falling back to read", &b->file->name);
+
+    u_char chunk[16384];
+    while (start < end) {
+        size_t size = (size_t)ngx_min((off_t)sizeof(chunk), end - start);
+        ssize_t n = ngx_read_file(b->file, chunk, size, start);
+        if (n <= 0) return NGX_ERROR;
+        ctx->body_parser.feed((const char*)chunk, (size_t)n);
+        start += n;
+    }
+    return NGX_OK;
+}
+
+// 将一段请求体链逐个喂给流式解析器; 解析失败后只计数不再解析, 等待 body 读完再返回 400
+static ngx_int_t
+ngx_http_mcp_body_consume(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx, ngx_chain_t *in) {
+    uint64_t start = ngx_http_mcp_metrics_usec();
+    ngx_int_t rc = NGX_OK;
+    for (ngx_chain_t *cl = in; cl && rc == NGX_OK; cl = cl->next) {
+        ngx_buf_t *b = cl->buf;
+
+        if (ngx_buf_in_memory(b)) {
+            size_t n = b->last - b->pos;
+            if (n && !ctx->body_parser.failed()) {
+                ctx->body_parser.feed((const char*)b->pos, n);
+            }
+            ctx->body_bytes += n;
+            if (r->request_body_no_buffering) {
+                b->pos = b->last;   // 归还缓冲区, 让 nginx 继续接收
+            }
+        } else if (b->in_file) {
+            if (!ctx->body_parser.failed()
+                && ngx_http_mcp_body_feed_file(ctx, b, r->connection->log) != NGX_OK)
+            {
+                rc = NGX_ERROR;
+                break;
+            }
+            ctx->body_bytes += b->file_last - b->file_pos;
+        }
+    }
+    ctx->parse_usec += ngx_http_mcp_metrics_usec() - start;
+    return rc;
+}
+
+static bool
+ngx_http_mcp_body_finish(ngx_http_mcp_async_ctx_t *ctx) {
+    uint64_t start = ngx_http_mcp_metrics_usec();
+    bool ok = ctx->body_parser.finish();
+    ctx->parse_usec += ngx_http_mcp_metrics_usec() - start;
+    return ok;
+}
+
+static void
+ngx_http_mcp_body_done(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    r->read_event_handler = ngx_http_block_reading;
+
+    if (ctx->body_bytes == 0) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0, "mcp empty body");
+        ngx_http_finalize_request(r, NGX_HTTP_BAD_REQUEST);
+        return;
+    }
+    if (!ngx_http_mcp_body_finish(ctx)) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "mcp json parse error: %s", ctx->body_parser.error().c_str());
+        ngx_http_finalize_request(r, NGX_HTTP_BAD_REQUEST);
+        return;
+    }
+    // 从进入 handler 到请求体读完, 扣除期间的解析时间
+    uint64_t elapsed = ngx_http_mcp_metrics_usec() - ctx->start_usec;
+    ctx->body_usec = elapsed > ctx->parse_usec ? elapsed - ctx->parse_usec : 0;
+
+    ngx_http_finalize_request(r, ngx_http_mcp_process(r, ctx));
+}
+
+// 线程中解析: 任务完成前事件循环不会访问 ctx, r 只读
+static void ngx_http_mcp_body_parse_worker(void *data, ngx_log_t *log) {
+    auto *p = static_cast<ngx_http_mcp_body_parse_t*>(data);
+    ngx_http_mcp_async_ctx_t *ctx = p->ctx;
+    p->status = ngx_http_mcp_body_consume(ctx->r, ctx, ctx->r->request_body->bufs);
+    if (p->status == NGX_OK) {
+        ngx_http_mcp_body_finish(ctx);
+    }
+}
+
+static void ngx_http_mcp_body_parse_complete(ngx_event_t *ev) {
+    ngx_thread_task_t *task = static_cast<ngx_thread_task_t*>(ev->data);
+    auto *p = static_cast<ngx_http_mcp_body_parse_t*>(task->ctx);
+    ngx_http_request_t *r = p->ctx->r;
+
+    ngx_http_mcp_sched_done(p->sched);
+    if (p->status != NGX_OK) {
+        ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+        return;
+    }
+    ngx_http_mcp_body_done(r, p->ctx);
+}
+
+// 缓冲模式下超过 mcp_placement body 阈值的请求体交给线程池解析; NGX_DECLINED 表示在事件循环中解析
+static ngx_int_t
+ngx_http_mcp_body_offload(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    off_t size = 0;
+    for (ngx_chain_t *cl = r->request_body->bufs; cl; cl = cl->next) {
+        size += ngx_buf_size(cl->buf);
+    }
+    if (!ngx_http_mcp_placement_offload_body(size)) return NGX_DECLINED;
+
+    static const std::string parse_method;
+    ngx_http_mcp_thread_pool_t *tp = ngx_http_mcp_get_thread_pool(r, parse_method, ctx->req_variant);
+    if (tp == nullptr) return NGX_DECLINED;
+
+    ngx_thread_task_t *task = ngx_thread_task_alloc(r->pool, sizeof(ngx_http_mcp_body_parse_t));
+    if (task == NULL) return NGX_ERROR;
+    auto *p = static_cast<ngx_http_mcp_body_parse_t*>(task->ctx);
+    p->ctx = ctx;
+    p->sched = NULL;
+    p->status = NGX_OK;
+    task->handler = ngx_http_mcp_body_parse_worker;
+    task->event.handler = ngx_http_mcp_body_parse_complete;
+    task->event.data = task;
+
+    ngx_http_mcp_sched_input_t in;
+    ngx_str_null(&in.method);
+    ngx_str_null(&in.tool);
+    ngx_str_null(&in.session);
+    in.deadline = 0;
+
+    r->read_event_handler = ngx_http_block_reading;
+    r->main->count++;
+    if (ngx_http_mcp_sched_post(r, tp, task, &in, &p->sched) != NGX_OK) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "mcp failed to post body parse task");
+        r->main->count--;
+        return NGX_ERROR;
+    }
+    return NGX_OK;
+}
+
+// 非缓冲模式: 每次读事件取走新到达的数据并立即解析
+static void ngx_http_mcp_read_body_more(ngx_http_request_t *r) {
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+
+    for ( ;; ) {
+        ngx_int_t rc = ngx_http_read_unbuffered_request_body(r);
+        if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+            ngx_http_finalize_request(r, rc);
+            return;
+        }
+
+        off_t before = ctx->body_bytes;
+        ngx_chain_t *in = r->request_body->bufs;
+        r->request_body->bufs = NULL;
+        if (ngx_http_mcp_body_consume(r, ctx, in) != NGX_OK) {
+            ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+            return;
+        }
+
+        if (!r->reading_body) break;
+        if (ctx->body_bytes == before) return;   // 等待下一次读事件
+    }
+
+    ngx_http_mcp_body_done(r, ctx);
+}
+
+// ngx_http_read_client_request_body 的回调: 缓冲模式下 body 已完整(可能跨多个 buf 或落盘),
+// 非缓冲模式下只是首批数据
+void ngx_http_mcp_body_handler(ngx_http_request_t *r) {
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    if (ctx == nullptr || r->request_body == NULL) {
+        ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+        return;
+    }
+
+    if (!r->request_body_no_buffering) {
+        ngx_int_t rc = ngx_http_mcp_body_offload(r, ctx);
+        if (rc == NGX_OK) {
+            ngx_http_finalize_request(r, NGX_DONE);
+            return;
+        }
+        if (rc == NGX_ERROR) {
+            ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+            return;
+        }
+    }
+
+    ngx_chain_t *in = r->request_body->bufs;
+    if (r->request_body_no_buffering) {
+        r->request_body->bufs = NULL;
+    }
+    if (ngx_http_mcp_body_consume(r, ctx, in) != NGX_OK) {
+        ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+        return;
+    }
+
+    if (r->request_body_no_buffering && r->reading_body) {
+        r->read_event_handler = ngx_http_mcp_read_body_more;
+        ngx_http_mcp_read_body_more(r);
+        return;
+    }
+
+    ngx_http_mcp_body_done(r, ctx);
+}
+
+} // extern "C"
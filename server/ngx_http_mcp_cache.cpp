@@ -0,0 +1,1052 @@
+#include <list>
+#include <new>
+#include <unordered_map>
+#include "ngx_http_mcp_module.h"
+
+// list/read 类方法的结果缓存: 每个 worker 一份 L1(进程内, 命中时零拷贝引用),
+// 所有 worker 共享一份 L2(共享内存, 命中后复制进 L1)。缓存的是 result 的 JSON 文本,
+// 响应时再套上本次请求的 id; ETag 取自 result 文本, If-None-Match 命中时返回 304。
+// 过期后在 stale 窗口内先返回旧结果, 同时在线程池中后台刷新。
+// 目录变化时按类别递增共享内存中的代数, 旧代数的条目全部视为未命中。
+// 未命中的相同请求只执行一次(single-flight): 同一 worker 内后到的请求挂在首个请求上等待结果;
+// 跨 worker 时首个请求在共享内存中登记执行中的键, 其他 worker 上的同键请求轮询 L2 直到结果写入或登记超时。
+// tools/call 的结果只对 mcp_tool_cache 选中且标注了 readOnlyHint 与 idempotentHint 的工具缓存,
+// 键为工具名加规范化后的参数, 每个工具有独立的 TTL 与 L2 字节预算(超出时淘汰该工具最旧的条目)。
+
+#define NGX_HTTP_MCP_CACHE_ZONE_NAME  "mcp_cache"
+
+// 超过 L2 容量该比例的结果不进入 L2
+#define NGX_HTTP_MCP_CACHE_MAX_SHARE  8
+
+// 插入 L2 分配失败时最多淘汰的条目数
+#define NGX_HTTP_MCP_CACHE_EVICT      16
+
+// 共享内存中可同时记账的工具数
+#define NGX_HTTP_MCP_CACHE_BUDGETS    64
+
+// 跨 worker 执行中登记表的槽位数与每个键的探测范围
+#define NGX_HTTP_MCP_CACHE_FLIGHTS    256
+#define NGX_HTTP_MCP_CACHE_PROBE      8
+
+// 登记的有效期: 执行方异常退出时其他 worker 最多等待这么久
+#define NGX_HTTP_MCP_CACHE_FLIGHT_TIMEOUT  5000
+
+// 等待其他 worker 结果时检查 L2 的间隔
+#define NGX_HTTP_MCP_CACHE_POLL       10
+
+// ctx->cache_flight
+#define NGX_HTTP_MCP_FLIGHT_NONE      0
+#define NGX_HTTP_MCP_FLIGHT_LEADER    1   // 执行方, 结果出来后分发给等待者
+#define NGX_HTTP_MCP_FLIGHT_FOLLOWER  2   // 等待同 worker 的执行方
+#define NGX_HTTP_MCP_FLIGHT_SOLO      3   // 执行方失败后各自执行, 不再合并
+
+namespace {
+
+// L1 条目; body 由正在发送的请求共同持有, 淘汰后仍可安全发送
+struct ngx_http_mcp_cache_entry_t {
+    std::shared_ptr<const std::string>      body;
+    uint64_t                                etag;
+    ngx_atomic_uint_t                       generation;
+    uint64_t                                expires;     // 毫秒时间戳
+    uint64_t                                stale;
+    bool                                    refreshing;
+    std::list<std::string>::iterator        lru;
+};
+
+// 后台刷新任务, 与线程任务一同分配在独立 pool 中
+struct ngx_http_mcp_cache_refresh_t {
+    ngx_pool_t                                 *pool;
+    mcp::server::McpServer::MCPRequestVariant   req;
+    std::string                                 key;
+    ngx_http_mcp_cache_policy_t                 policy;
+    ngx_atomic_uint_t                           generation;
+    std::shared_ptr<const std::string>          body;
+};
+
+// 同一 worker 内同键的执行中请求
+struct ngx_http_mcp_cache_flight_t {
+    ngx_http_mcp_async_ctx_t                *leader;
+    std::vector<ngx_http_mcp_async_ctx_t*>   followers;
+    uint64_t                                 hash;
+    bool                                     shared;    // 已在共享内存中登记
+    ngx_event_t                             *poll;      // 等待其他 worker 时的定时器
+};
+
+} // namespace
+
+// 以下仅在事件循环线程访问
+static std::unordered_map<std::string, ngx_http_mcp_cache_entry_t>  ngx_http_mcp_cache_l1;
+static std::list<std::string>                                       ngx_http_mcp_cache_lru;
+static ngx_shm_zone_t                                              *ngx_http_mcp_cache_zone;
+static ngx_array_t                                                 *ngx_http_mcp_cache_tools;
+static std::unordered_map<std::string, ngx_http_mcp_cache_flight_t> ngx_http_mcp_cache_flights;
+
+extern "C" {
+
+// L2 条目: 先键后结果文本; 同一键哈希只保留一个条目
+typedef struct {
+    ngx_rbtree_node_t   node;        // node.key 为键哈希
+    ngx_queue_t         queue;       // LRU, 头部最近使用
+    ngx_queue_t         tool_queue;  // 所属工具预算的 LRU
+    uint32_t            budget;      // 工具预算下标 + 1, 0 表示不按工具记账
+    uint64_t            etag;
+    ngx_atomic_uint_t   generation;
+    uint64_t            expires;
+    uint64_t            stale;
+    uint32_t            key_len;
+    uint32_t            len;
+    u_char              data[1];
+} ngx_http_mcp_cache_node_t;
+
+// 单个工具在 L2 中的占用
+typedef struct {
+    uint64_t            key;         // 工具名哈希, 0 为空槽
+    size_t              used;
+    ngx_queue_t         lru;
+} ngx_http_mcp_cache_budget_t;
+
+// 跨 worker 执行中的键; key 为 0 或 deadline 已过的槽位可复用
+typedef struct {
+    uint64_t            key;
+    uint64_t            deadline;
+} ngx_http_mcp_cache_inflight_t;
+
+typedef struct {
+    ngx_rbtree_t        rbtree;
+    ngx_rbtree_node_t   sentinel;
+    ngx_queue_t         lru;
+    ngx_atomic_t        generation[NGX_HTTP_MCP_CACHE_FAMILIES];
+    ngx_atomic_t        l1_hits;
+    ngx_atomic_t        l2_hits;
+    ngx_atomic_t        stale_hits;
+    ngx_atomic_t        misses;
+    ngx_atomic_t        not_modified;
+    ngx_atomic_t        evicted;
+    ngx_atomic_t        entries;
+    ngx_atomic_t        coalesced;   // 挂在执行中的同键请求上的次数
+    ngx_http_mcp_cache_budget_t budgets[NGX_HTTP_MCP_CACHE_BUDGETS];
+    ngx_http_mcp_cache_inflight_t inflight[NGX_HTTP_MCP_CACHE_FLIGHTS];
+} ngx_http_mcp_cache_shctx_t;
+
+typedef struct {
+    ngx_http_mcp_cache_shctx_t  *sh;
+    ngx_slab_pool_t             *shpool;
+    size_t                       size;
+    ngx_msec_t                   ttl;
+    ngx_msec_t                   stale;
+    ngx_uint_t                   l1;         // 每个 worker 的 L1 条目数上限
+} ngx_http_mcp_cache_zone_ctx_t;
+
+static uint64_t
+ngx_http_mcp_cache_now() {
+    ngx_time_t *tp = ngx_timeofday();
+    return (uint64_t)tp->sec * 1000 + tp->msec;
+}
+
+static ngx_http_mcp_cache_zone_ctx_t *
+ngx_http_mcp_cache_ctx() {
+    return ngx_http_mcp_cache_zone
+        ? static_cast<ngx_http_mcp_cache_zone_ctx_t*>(ngx_http_mcp_cache_zone->data) : NULL;
+}
+
+// tools/call 的缓存规则: 精确匹配工具名优先, 其次 "*"
+static ngx_http_mcp_tool_cache_t *
+ngx_http_mcp_cache_tool_rule(const std::string &name) {
+    if (ngx_http_mcp_cache_tools == NULL) return NULL;
+    auto *rules = (ngx_http_mcp_tool_cache_t*)ngx_http_mcp_cache_tools->elts;
+    ngx_http_mcp_tool_cache_t *any = NULL;
+    for (ngx_uint_t i = 0; i < ngx_http_mcp_cache_tools->nelts; ++i) {
+        if (rules[i].tool.len == 1 && rules[i].tool.data[0] == '*') {
+            any = &rules[i];
+        } else if (rules[i].tool.len == name.size()
+                   && ngx_strncmp(rules[i].tool.data, name.data(), name.size()) == 0)
+        {
+            return &rules[i];
+        }
+    }
+    return any;
+}
+
+// 请求的缓存策略; 不可缓存时返回 NGX_DECLINED
+static ngx_int_t
+ngx_http_mcp_cache_policy(ngx_http_mcp_cache_zone_ctx_t *cctx, ngx_http_mcp_async_ctx_t *ctx,
+    ngx_http_mcp_cache_policy_t *p)
+{
+    const std::string &method = ctx->method;
+    p->ttl = cctx->ttl;
+    p->stale = cctx->stale;
+    p->max_size = 0;
+    p->budget = 0;
+
+    if (method == "prompts/list") {
+        p->family = NGX_HTTP_MCP_CACHE_PROMPTS;
+        return NGX_OK;
+    }
+    if (method == "resources/list" || method == "resources/templates/list"
+        || method == "resources/read")
+    {
+        p->family = NGX_HTTP_MCP_CACHE_RESOURCES;
+        return NGX_OK;
+    }
+    if (method != "tools/call") return NGX_DECLINED;
+
+    const std::string &name = std::get<mcp::CallToolRequest>(ctx->req_variant).params.name;
+    ngx_http_mcp_tool_cache_t *rule = ngx_http_mcp_cache_tool_rule(name);
+    if (rule == NULL || !mcp::server::ToolRegistry::instance().snapshot()->memoizable(name)) {
+        return NGX_DECLINED;
+    }
+    // 工具结果过期即失效, 不在 stale 窗口内返回旧结果
+    p->family = NGX_HTTP_MCP_CACHE_TOOLS;
+    p->ttl = rule->ttl;
+    p->stale = 0;
+    p->max_size = rule->max_size;
+    p->budget = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)name.data(), name.size());
+    return NGX_OK;
+}
+
+// 缓存键: 方法名 + 去掉 _meta 后的 params; JSON 对象按键排序输出, 字段顺序不影响键
+static std::string
+ngx_http_mcp_cache_key(const std::string &method, const mcp::server::McpServer::MCPRequestVariant &req) {
+    nlohmann::json j;
+    std::visit([&j](const auto &concrete) {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(concrete)>, std::monostate>) {
+            j = concrete;
+        }
+    }, req);
+
+    std::string key = method;
+    key.push_back('\0');
+    auto p = j.is_object() ? j.find("params") : j.end();
+    if (j.is_object() && p != j.end() && p->is_object()) {
+        p->erase("_meta");
+        key += p->dump();
+    }
+    return key;
+}
+
+static void
+ngx_http_mcp_cache_l1_erase(std::unordered_map<std::string, ngx_http_mcp_cache_entry_t>::iterator it) {
+    ngx_http_mcp_cache_lru.erase(it->second.lru);
+    ngx_http_mcp_cache_l1.erase(it);
+}
+
+static void
+ngx_http_mcp_cache_l1_put(ngx_http_mcp_cache_zone_ctx_t *ctx, const std::string &key,
+    std::shared_ptr<const std::string> body, uint64_t etag, ngx_atomic_uint_t generation,
+    uint64_t expires, uint64_t stale)
+{
+    auto it = ngx_http_mcp_cache_l1.find(key);
+    if (it == ngx_http_mcp_cache_l1.end()) {
+        while (ngx_http_mcp_cache_l1.size() >= ctx->l1 && !ngx_http_mcp_cache_lru.empty()) {
+            ngx_http_mcp_cache_l1_erase(ngx_http_mcp_cache_l1.find(ngx_http_mcp_cache_lru.back()));
+        }
+        ngx_http_mcp_cache_lru.push_front(key);
+        it = ngx_http_mcp_cache_l1.emplace(key, ngx_http_mcp_cache_entry_t()).first;
+        it->second.lru = ngx_http_mcp_cache_lru.begin();
+        it->second.refreshing = false;
+    } else {
+        ngx_http_mcp_cache_lru.splice(ngx_http_mcp_cache_lru.begin(), ngx_http_mcp_cache_lru, it->second.lru);
+    }
+    it->second.body = std::move(body);
+    it->second.etag = etag;
+    it->second.generation = generation;
+    it->second.expires = expires;
+    it->second.stale = stale;
+}
+
+static ngx_http_mcp_cache_node_t *
+ngx_http_mcp_cache_l2_lookup(ngx_http_mcp_cache_shctx_t *sh, uint64_t hash) {
+    ngx_rbtree_node_t *node = sh->rbtree.root;
+    ngx_rbtree_node_t *sentinel = sh->rbtree.sentinel;
+    ngx_rbtree_key_t key = (ngx_rbtree_key_t)hash;
+
+    while (node != sentinel) {
+        if (key != node->key) {
+            node = (key < node->key) ? node->left : node->right;
+            continue;
+        }
+        return (ngx_http_mcp_cache_node_t*)node;
+    }
+    return NULL;
+}
+
+// 工具的预算槽; 表满时复用已清空的槽, 仍无可用槽返回 NULL
+static ngx_http_mcp_cache_budget_t *
+ngx_http_mcp_cache_budget(ngx_http_mcp_cache_shctx_t *sh, uint64_t key) {
+    ngx_http_mcp_cache_budget_t *unused = NULL;
+    for (ngx_uint_t i = 0; i < NGX_HTTP_MCP_CACHE_BUDGETS; ++i) {
+        ngx_http_mcp_cache_budget_t *b = &sh->budgets[i];
+        if (b->key == key) return b;
+        if (unused == NULL && ngx_queue_empty(&b->lru)) unused = b;
+    }
+    if (unused) unused->key = key;
+    return unused;
+}
+
+static void
+ngx_http_mcp_cache_l2_free(ngx_http_mcp_cache_zone_ctx_t *ctx, ngx_http_mcp_cache_node_t *cn) {
+    if (cn->budget) {
+        ngx_queue_remove(&cn->tool_queue);
+        ctx->sh->budgets[cn->budget - 1].used -=
+            offsetof(ngx_http_mcp_cache_node_t, data) + cn->key_len + cn->len;
+    }
+    ngx_queue_remove(&cn->queue);
+    ngx_rbtree_delete(&ctx->sh->rbtree, &cn->node);
+    ngx_slab_free_locked(ctx->shpool, cn);
+    (void)ngx_atomic_fetch_add(&ctx->sh->entries, -1);
+}
+
+static void
+ngx_http_mcp_cache_l2_put(ngx_http_mcp_cache_zone_ctx_t *ctx, const std::string &key,
+    const std::string &body, uint64_t etag, ngx_atomic_uint_t generation, uint64_t expires, uint64_t stale,
+    ngx_http_mcp_cache_policy_t *policy)
+{
+    size_t size = offsetof(ngx_http_mcp_cache_node_t, data) + key.size() + body.size();
+    if (size > ctx->size / NGX_HTTP_MCP_CACHE_MAX_SHARE) return;
+    if (policy->budget && size > policy->max_size) return;
+
+    ngx_http_mcp_cache_shctx_t *sh = ctx->sh;
+    uint64_t hash = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)key.data(), key.size());
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_http_mcp_cache_node_t *cn = ngx_http_mcp_cache_l2_lookup(sh, hash);
+    if (cn) ngx_http_mcp_cache_l2_free(ctx, cn);
+
+    ngx_http_mcp_cache_budget_t *b = NULL;
+    if (policy->budget) {
+        b = ngx_http_mcp_cache_budget(sh, policy->budget);
+        if (b == NULL) {
+            ngx_shmtx_unlock(&ctx->shpool->mutex);
+            return;
+        }
+        // 超出该工具的预算时先淘汰它自己最旧的结果
+        while (b->used + size > policy->max_size && !ngx_queue_empty(&b->lru)) {
+            ngx_queue_t *q = ngx_queue_last(&b->lru);
+            ngx_http_mcp_cache_l2_free(ctx, ngx_queue_data(q, ngx_http_mcp_cache_node_t, tool_queue));
+            (void)ngx_atomic_fetch_add(&sh->evicted, 1);
+        }
+    }
+
+    cn = (ngx_http_mcp_cache_node_t*)ngx_slab_alloc_locked(ctx->shpool, size);
+    for (ngx_uint_t n = 0; cn == NULL && n < NGX_HTTP_MCP_CACHE_EVICT && !ngx_queue_empty(&sh->lru); ++n) {
+        ngx_queue_t *q = ngx_queue_last(&sh->lru);
+        ngx_http_mcp_cache_l2_free(ctx, ngx_queue_data(q, ngx_http_mcp_cache_node_t, queue));
+        (void)ngx_atomic_fetch_add(&sh->evicted, 1);
+        cn = (ngx_http_mcp_cache_node_t*)ngx_slab_alloc_locked(ctx->shpool, size);
+    }
+    if (cn == NULL) {
+        ngx_shmtx_unlock(&ctx->shpool->mutex);
+        return;
+    }
+
+    if (b) {
+        cn->budget = (uint32_t)(b - sh->budgets) + 1;
+        b->used += size;
+        ngx_queue_insert_head(&b->lru, &cn->tool_queue);
+    } else {
+        cn->budget = 0;
+        ngx_queue_init(&cn->tool_queue);
+    }
+    cn->node.key = (ngx_rbtree_key_t)hash;
+    cn->etag = etag;
+    cn->generation = generation;
+    cn->expires = expires;
+    cn->stale = stale;
+    cn->key_len = (uint32_t)key.size();
+    cn->len = (uint32_t)body.size();
+    ngx_memcpy(cn->data, key.data(), key.size());
+    ngx_memcpy(cn->data + key.size(), body.data(), body.size());
+    ngx_rbtree_insert(&sh->rbtree, &cn->node);
+    ngx_queue_insert_head(&sh->lru, &cn->queue);
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+    (void)ngx_atomic_fetch_add(&sh->entries, 1);
+}
+
+// L2 命中时复制进 L1; 返回 L1 条目, 未命中返回 NULL
+static ngx_http_mcp_cache_entry_t *
+ngx_http_mcp_cache_l2_get(ngx_http_mcp_cache_zone_ctx_t *ctx, const std::string &key,
+    ngx_atomic_uint_t generation, uint64_t now)
+{
+    ngx_http_mcp_cache_shctx_t *sh = ctx->sh;
+    uint64_t hash = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)key.data(), key.size());
+    std::shared_ptr<std::string> body;
+    uint64_t etag = 0, expires = 0, stale = 0;
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_http_mcp_cache_node_t *cn = ngx_http_mcp_cache_l2_lookup(sh, hash);
+    if (cn && (cn->generation != generation || cn->stale <= now)) {
+        ngx_http_mcp_cache_l2_free(ctx, cn);
+        cn = NULL;
+    }
+    if (cn && cn->key_len == key.size() && ngx_memcmp(cn->data, key.data(), key.size()) == 0) {
+        ngx_queue_remove(&cn->queue);
+        ngx_queue_insert_head(&sh->lru, &cn->queue);
+        if (cn->budget) {
+            ngx_queue_remove(&cn->tool_queue);
+            ngx_queue_insert_head(&sh->budgets[cn->budget - 1].lru, &cn->tool_queue);
+        }
+        try {
+            body = std::make_shared<std::string>((const char*)cn->data + cn->key_len, cn->len);
+        } catch (const std::bad_alloc &) {
+            body.reset();
+        }
+        etag = cn->etag;
+        expires = cn->expires;
+        stale = cn->stale;
+    }
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    if (!body) return NULL;
+    ngx_http_mcp_cache_l1_put(ctx, key, std::move(body), etag, generation, expires, stale);
+    return &ngx_http_mcp_cache_l1.find(key)->second;
+}
+
+static void
+ngx_http_mcp_cache_store(ngx_http_mcp_cache_zone_ctx_t *ctx, const std::string &key,
+    std::shared_ptr<const std::string> body, ngx_atomic_uint_t generation, ngx_http_mcp_cache_policy_t *policy)
+{
+    uint64_t now = ngx_http_mcp_cache_now();
+    uint64_t expires = now + policy->ttl;
+    uint64_t stale = expires + policy->stale;
+    uint64_t etag = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)body->data(), body->size());
+
+    ngx_http_mcp_cache_l2_put(ctx, key, *body, etag, generation, expires, stale, policy);
+    ngx_http_mcp_cache_l1_put(ctx, key, std::move(body), etag, generation, expires, stale);
+}
+
+static void
+ngx_http_mcp_cache_refresh_cleanup(void *data) {
+    static_cast<ngx_http_mcp_cache_refresh_t*>(data)->~ngx_http_mcp_cache_refresh_t();
+}
+
+static void
+ngx_http_mcp_cache_refresh_worker(void *data, ngx_log_t *log) {
+    auto *rf = static_cast<ngx_http_mcp_cache_refresh_t*>(data);
+    try {
+        rf->body = std::make_shared<const std::string>(
+            mcp::server::McpServer::handle(rf->req, log, nullptr).dump());
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_ERR, log, 0, "mcp cache refresh failed: %s", e.what());
+    }
+}
+
+static void
+ngx_http_mcp_cache_refresh_done(ngx_event_t *ev) {
+    auto *task = static_cast<ngx_thread_task_t*>(ev->data);
+    auto *rf = static_cast<ngx_http_mcp_cache_refresh_t*>(task->ctx);
+    ngx_http_mcp_cache_zone_ctx_t *ctx = ngx_http_mcp_cache_ctx();
+
+    auto it = ngx_http_mcp_cache_l1.find(rf->key);
+    if (it != ngx_http_mcp_cache_l1.end()) it->second.refreshing = false;
+
+    // 刷新期间目录已变化时结果作废
+    if (ctx && rf->body && ctx->sh->generation[rf->policy.family] == rf->generation) {
+        try {
+            ngx_http_mcp_cache_store(ctx, rf->key, std::move(rf->body), rf->generation, &rf->policy);
+        } catch (const std::bad_alloc &) {
+        }
+    }
+    ngx_destroy_pool(rf->pool);
+}
+
+// stale 条目在后台重新计算, 本次请求直接返回旧结果; 每个 worker 同一键只刷新一次
+static void
+ngx_http_mcp_cache_refresh(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx,
+    ngx_http_mcp_cache_entry_t *e)
+{
+    if (e->refreshing) return;
+    ngx_http_mcp_thread_pool_t *tp = ngx_http_mcp_get_thread_pool(r, ctx->method, ctx->req_variant);
+    if (tp == NULL) return;
+
+    ngx_pool_t *pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_cycle->log);
+    if (pool == NULL) return;
+    ngx_thread_task_t *task = ngx_thread_task_alloc(pool, sizeof(ngx_http_mcp_cache_refresh_t));
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(pool, 0);
+    if (task == NULL || cln == NULL) {
+        ngx_destroy_pool(pool);
+        return;
+    }
+
+    ngx_http_mcp_cache_refresh_t *rf;
+    try {
+        rf = new (task->ctx) ngx_http_mcp_cache_refresh_t{pool, ctx->req_variant, ctx->cache_key,
+                                                          ctx->cache_policy, ctx->cache_generation, nullptr};
+    } catch (const std::bad_alloc &) {
+        ngx_destroy_pool(pool);
+        return;
+    }
+    cln->handler = ngx_http_mcp_cache_refresh_cleanup;
+    cln->data = rf;
+
+    task->handler = ngx_http_mcp_cache_refresh_worker;
+    task->event.handler = ngx_http_mcp_cache_refresh_done;
+    task->event.data = task;
+    task->event.log = ngx_cycle->log;
+    if (ngx_http_mcp_thread_task_post(tp, task) != NGX_OK) {
+        ngx_destroy_pool(pool);
+        return;
+    }
+    e->refreshing = true;
+}
+
+// If-None-Match 中是否包含 etag(或为 "*")
+ngx_flag_t
+ngx_http_mcp_cache_not_modified(ngx_http_request_t *r, uint64_t etag) {
+    ngx_table_elt_t *h = r->headers_in.if_none_match;
+    if (h == NULL) return 0;
+    if (h->value.len == 1 && h->value.data[0] == '*') return 1;
+
+    u_char buf[NGX_HTTP_MCP_ETAG_LEN];
+    ngx_sprintf(buf, "\"%016xL\"", etag);
+    return ngx_strlcasestrn(h->value.data, h->value.data + h->value.len, buf, NGX_HTTP_MCP_ETAG_LEN - 2) != NULL;
+}
+
+ngx_int_t
+ngx_http_mcp_cache_set_etag(ngx_http_request_t *r, uint64_t etag) {
+    ngx_table_elt_t *h = (ngx_table_elt_t*)ngx_list_push(&r->headers_out.headers);
+    u_char *p = (u_char*)ngx_pnalloc(r->pool, NGX_HTTP_MCP_ETAG_LEN);
+    if (h == NULL || p == NULL) return NGX_ERROR;
+    h->hash = 1;
+#if (nginx_version >= 1023000)
+    h->next = NULL;
+#endif
+    ngx_str_set(&h->key, "ETag");
+    h->value.data = p;
+    h->value.len = ngx_sprintf(p, "\"%016xL\"", etag) - p;
+    r->headers_out.etag = h;
+    return NGX_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_cache_send_not_modified(ngx_http_request_t *r, uint64_t etag) {
+    if (ngx_http_mcp_cache_set_etag(r, etag) != NGX_OK) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    r->headers_out.status = NGX_HTTP_NOT_MODIFIED;
+    r->headers_out.content_length_n = -1;
+    r->header_only = 1;
+
+    ngx_int_t rc = ngx_http_send_header(r);
+    if (rc == NGX_ERROR || rc > NGX_OK) {
+        return rc;
+    }
+    return ngx_http_send_special(r, NGX_HTTP_LAST);
+}
+
+// 以缓存的 result 文本响应, body 由请求 pool 持有到请求结束。
+// 要求事件流的请求此时还未发出响应头, 整个结果只有一条消息, 直接以 JSON 响应
+static ngx_int_t
+ngx_http_mcp_cache_send(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx,
+    std::shared_ptr<const std::string> body, uint64_t etag)
+{
+    ngx_http_mcp_cache_shctx_t *sh = ngx_http_mcp_cache_ctx()->sh;
+    ctx->sse = false;
+
+    if (ngx_http_mcp_cache_not_modified(r, etag)) {
+        (void)ngx_atomic_fetch_add(&sh->not_modified, 1);
+        return ngx_http_mcp_cache_send_not_modified(r, etag);
+    }
+
+    size_t len = 0;
+    ctx->cache_body = std::move(body);
+    ngx_chain_t *out = ngx_http_mcp_wrap_result(r->pool, ctx->id, (const u_char*)ctx->cache_body->data(),
+                                                 ctx->cache_body->size(), &len);
+    if (out == NULL || ngx_http_mcp_cache_set_etag(r, etag) != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    ngx_http_mcp_limit_charge_response(ctx->charges, len);
+    return ngx_http_mcp_send_chain(r, out, len);
+}
+
+// 共享内存中登记 hash 为执行中; 其他 worker 已登记且未超时时返回 NGX_BUSY
+static ngx_int_t
+ngx_http_mcp_cache_inflight_claim(ngx_http_mcp_cache_zone_ctx_t *cctx, uint64_t hash, uint64_t now) {
+    ngx_http_mcp_cache_shctx_t *sh = cctx->sh;
+    ngx_http_mcp_cache_inflight_t *free = NULL;
+    ngx_int_t rc = NGX_DECLINED;
+
+    ngx_shmtx_lock(&cctx->shpool->mutex);
+    for (ngx_uint_t i = 0; i < NGX_HTTP_MCP_CACHE_PROBE; ++i) {
+        ngx_http_mcp_cache_inflight_t *f = &sh->inflight[(hash + i) % NGX_HTTP_MCP_CACHE_FLIGHTS];
+        if (f->key == hash && f->deadline > now) {
+            rc = NGX_BUSY;
+            break;
+        }
+        if (free == NULL && (f->key == 0 || f->deadline <= now)) free = f;
+    }
+    if (rc != NGX_BUSY && free) {
+        free->key = hash;
+        free->deadline = now + NGX_HTTP_MCP_CACHE_FLIGHT_TIMEOUT;
+        rc = NGX_OK;
+    }
+    ngx_shmtx_unlock(&cctx->shpool->mutex);
+    // 登记表满时不跨 worker 合并, 直接执行
+    return rc;
+}
+
+static void
+ngx_http_mcp_cache_inflight_clear(ngx_http_mcp_cache_zone_ctx_t *cctx, uint64_t hash) {
+    ngx_http_mcp_cache_shctx_t *sh = cctx->sh;
+    ngx_shmtx_lock(&cctx->shpool->mutex);
+    for (ngx_uint_t i = 0; i < NGX_HTTP_MCP_CACHE_PROBE; ++i) {
+        ngx_http_mcp_cache_inflight_t *f = &sh->inflight[(hash + i) % NGX_HTTP_MCP_CACHE_FLIGHTS];
+        if (f->key == hash) {
+            f->key = 0;
+            break;
+        }
+    }
+    ngx_shmtx_unlock(&cctx->shpool->mutex);
+}
+
+// 等待者恢复: 带回结果时直接响应, 否则自行执行
+static void
+ngx_http_mcp_cache_resume(ngx_http_request_t *r) {
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    r->write_event_handler = ngx_http_request_empty_handler;
+
+    if (ctx->cache_body) {
+        ctx->cache_status = NGX_HTTP_MCP_CACHE_STATUS_COALESCED;
+        const std::string &body = *ctx->cache_body;
+        uint64_t etag = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)body.data(), body.size());
+        ngx_http_finalize_request(r, ngx_http_mcp_cache_send(r, ctx, ctx->cache_body, etag));
+        return;
+    }
+    ctx->cache_flight = NGX_HTTP_MCP_FLIGHT_SOLO;
+    ngx_http_finalize_request(r, ngx_http_mcp_dispatch(r, ctx));
+}
+
+// 结束一次执行: body 非空时等待者共享该结果, 否则各自执行。等待者经写事件恢复, 不在调用方栈上处理
+static void
+ngx_http_mcp_cache_land(ngx_http_mcp_async_ctx_t *ctx, std::shared_ptr<const std::string> body) {
+    auto it = ngx_http_mcp_cache_flights.find(ctx->cache_key);
+    if (it == ngx_http_mcp_cache_flights.end() || it->second.leader != ctx) return;
+
+    ngx_http_mcp_cache_flight_t flight = std::move(it->second);
+    ngx_http_mcp_cache_flights.erase(it);
+    ctx->cache_flight = NGX_HTTP_MCP_FLIGHT_NONE;
+
+    ngx_http_mcp_cache_zone_ctx_t *cctx = ngx_http_mcp_cache_ctx();
+    if (flight.shared && cctx) ngx_http_mcp_cache_inflight_clear(cctx, flight.hash);
+    if (flight.poll && flight.poll->timer_set) ngx_del_timer(flight.poll);
+
+    for (ngx_http_mcp_async_ctx_t *f : flight.followers) {
+        f->cache_body = body;
+        f->cache_flight = NGX_HTTP_MCP_FLIGHT_NONE;
+        f->r->write_event_handler = ngx_http_mcp_cache_resume;
+        ngx_post_event(f->r->connection->write, &ngx_posted_events);
+    }
+}
+
+// 执行方请求销毁时仍未分发(失败或客户端断开): 等待者各自执行
+static void
+ngx_http_mcp_cache_leader_cleanup(void *data) {
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(data);
+    if (ctx->cache_flight == NGX_HTTP_MCP_FLIGHT_LEADER) {
+        ngx_http_mcp_cache_land(ctx, nullptr);
+    }
+}
+
+static void
+ngx_http_mcp_cache_follower_cleanup(void *data) {
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(data);
+    if (ctx->cache_flight != NGX_HTTP_MCP_FLIGHT_FOLLOWER) return;
+    for (auto &kv : ngx_http_mcp_cache_flights) {
+        auto &v = kv.second.followers;
+        for (auto f = v.begin(); f != v.end(); ++f) {
+            if (*f == ctx) {
+                v.erase(f);
+                return;
+            }
+        }
+    }
+}
+
+// 其他 worker 正在执行同键请求: 定期检查 L2, 结果写入后直接响应; 登记失效后改为自己执行
+static void
+ngx_http_mcp_cache_poll(ngx_event_t *ev) {
+    auto *r = static_cast<ngx_http_request_t*>(ev->data);
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    ngx_connection_t *c = r->connection;
+    ngx_http_mcp_cache_zone_ctx_t *cctx = ngx_http_mcp_cache_ctx();
+    uint64_t now = ngx_http_mcp_cache_now();
+    auto &flight = ngx_http_mcp_cache_flights[ctx->cache_key];
+    ngx_int_t rc;
+
+    try {
+        ngx_http_mcp_cache_entry_t *e = ngx_http_mcp_cache_l2_get(cctx, ctx->cache_key, ctx->cache_generation, now);
+        if (e) {
+            std::shared_ptr<const std::string> body = e->body;
+            uint64_t etag = e->etag;
+            (void)ngx_atomic_fetch_add(&cctx->sh->l2_hits, 1);
+            ctx->cache_status = NGX_HTTP_MCP_CACHE_STATUS_COALESCED;
+            ngx_http_mcp_cache_land(ctx, body);
+            rc = ngx_http_mcp_cache_send(r, ctx, std::move(body), etag);
+        } else {
+            rc = ngx_http_mcp_cache_inflight_claim(cctx, flight.hash, now);
+            if (rc == NGX_BUSY) {
+                ngx_add_timer(ev, NGX_HTTP_MCP_CACHE_POLL);
+                return;
+            }
+            flight.shared = (rc == NGX_OK);
+            rc = ngx_http_mcp_dispatch(r, ctx);
+        }
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_ERR, c->log, 0, "mcp cache poll failed: %s", e.what());
+        rc = NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    ngx_http_finalize_request(r, rc);
+    ngx_http_run_posted_requests(c);
+}
+
+static void
+ngx_http_mcp_cache_poll_cleanup(void *data) {
+    auto *ev = static_cast<ngx_event_t*>(data);
+    if (ev->timer_set) ngx_del_timer(ev);
+}
+
+// 未命中时加入或发起一次执行: 需要等待时返回 NGX_DONE, 由本请求执行时返回 NGX_DECLINED
+static ngx_int_t
+ngx_http_mcp_cache_join(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx,
+    ngx_http_mcp_cache_zone_ctx_t *cctx, uint64_t now)
+{
+    ngx_http_mcp_cache_shctx_t *sh = cctx->sh;
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) return NGX_DECLINED;
+    cln->data = ctx;
+
+    auto it = ngx_http_mcp_cache_flights.find(ctx->cache_key);
+    if (it != ngx_http_mcp_cache_flights.end()) {
+        it->second.followers.push_back(ctx);
+        ctx->cache_flight = NGX_HTTP_MCP_FLIGHT_FOLLOWER;
+        cln->handler = ngx_http_mcp_cache_follower_cleanup;
+        (void)ngx_atomic_fetch_add(&sh->coalesced, 1);
+
+        r->main->count++;
+        r->read_event_handler = ngx_http_test_reading;
+        r->write_event_handler = ngx_http_request_empty_handler;
+        return NGX_DONE;
+    }
+
+    ngx_http_mcp_cache_flight_t &flight = ngx_http_mcp_cache_flights[ctx->cache_key];
+    flight.leader = ctx;
+    flight.hash = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)ctx->cache_key.data(),
+                                      ctx->cache_key.size());
+    flight.shared = false;
+    flight.poll = NULL;
+    ctx->cache_flight = NGX_HTTP_MCP_FLIGHT_LEADER;
+    cln->handler = ngx_http_mcp_cache_leader_cleanup;
+
+    ngx_int_t rc = ngx_http_mcp_cache_inflight_claim(cctx, flight.hash, now);
+    if (rc != NGX_BUSY) {
+        flight.shared = (rc == NGX_OK);
+        return NGX_DECLINED;
+    }
+
+    // 其他 worker 正在执行: 本 worker 的执行方改为等待其结果
+    ngx_event_t *ev = (ngx_event_t*)ngx_pcalloc(r->pool, sizeof(ngx_event_t));
+    ngx_pool_cleanup_t *pcln = ngx_pool_cleanup_add(r->pool, 0);
+    if (ev == NULL || pcln == NULL) return NGX_DECLINED;
+    ev->handler = ngx_http_mcp_cache_poll;
+    ev->data = r;
+    ev->log = r->connection->log;
+    pcln->handler = ngx_http_mcp_cache_poll_cleanup;
+    pcln->data = ev;
+    flight.poll = ev;
+    (void)ngx_atomic_fetch_add(&sh->coalesced, 1);
+
+    r->main->count++;
+    r->read_event_handler = ngx_http_test_reading;
+    r->write_event_handler = ngx_http_request_empty_handler;
+    ngx_add_timer(ev, NGX_HTTP_MCP_CACHE_POLL);
+    return NGX_DONE;
+}
+
+// 事件循环中查找缓存, 在事件流响应头发出之前调用: 命中时直接响应并返回最终状态;
+// 未命中返回 NGX_DECLINED, 此时 ctx->cache_key 已设置, 结果算出后由 ngx_http_mcp_cache_save 存入
+ngx_int_t
+ngx_http_mcp_cache_lookup(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    ngx_http_mcp_cache_zone_ctx_t *cctx = ngx_http_mcp_cache_ctx();
+    if (cctx == NULL) return NGX_DECLINED;
+
+    ngx_http_mcp_cache_shctx_t *sh = cctx->sh;
+    try {
+        if (ngx_http_mcp_cache_policy(cctx, ctx, &ctx->cache_policy) != NGX_OK) return NGX_DECLINED;
+        ctx->cache_key = ngx_http_mcp_cache_key(ctx->method, ctx->req_variant);
+        ctx->cache_generation = sh->generation[ctx->cache_policy.family];
+
+        uint64_t now = ngx_http_mcp_cache_now();
+        ngx_http_mcp_cache_entry_t *e = NULL;
+        ngx_atomic_t *counter = &sh->l1_hits;
+
+        auto it = ngx_http_mcp_cache_l1.find(ctx->cache_key);
+        if (it != ngx_http_mcp_cache_l1.end()) {
+            if (it->second.generation != ctx->cache_generation || it->second.stale <= now) {
+                ngx_http_mcp_cache_l1_erase(it);
+            } else {
+                ngx_http_mcp_cache_lru.splice(ngx_http_mcp_cache_lru.begin(), ngx_http_mcp_cache_lru,
+                                              it->second.lru);
+                e = &it->second;
+            }
+        }
+        if (e == NULL) {
+            e = ngx_http_mcp_cache_l2_get(cctx, ctx->cache_key, ctx->cache_generation, now);
+            counter = &sh->l2_hits;
+        }
+        if (e == NULL) {
+            if (ctx->cache_flight == NGX_HTTP_MCP_FLIGHT_NONE) {
+                ngx_int_t rc = ngx_http_mcp_cache_join(r, ctx, cctx, now);
+                if (rc != NGX_DECLINED) return rc;
+            }
+            (void)ngx_atomic_fetch_add(&sh->misses, 1);
+            ctx->cache_status = NGX_HTTP_MCP_CACHE_STATUS_MISS;
+            return NGX_DECLINED;
+        }
+
+        ctx->cache_status = NGX_HTTP_MCP_CACHE_STATUS_HIT;
+        if (e->expires <= now) {
+            counter = &sh->stale_hits;
+            ctx->cache_status = NGX_HTTP_MCP_CACHE_STATUS_STALE;
+            ngx_http_mcp_cache_refresh(r, ctx, e);
+        }
+        (void)ngx_atomic_fetch_add(counter, 1);
+        // 等待其他 worker 期间结果已写入
+        if (ctx->cache_flight == NGX_HTTP_MCP_FLIGHT_LEADER) ngx_http_mcp_cache_land(ctx, e->body);
+        return ngx_http_mcp_cache_send(r, ctx, e->body, e->etag);
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0, "mcp cache lookup failed: %s", e.what());
+        ctx->cache_key.clear();
+        return NGX_DECLINED;
+    }
+}
+
+// 未命中时处理完成后调用(事件循环线程): 存入两级缓存并设置 ETag; 事件流的响应头已发出, 不设 ETag
+ngx_int_t
+ngx_http_mcp_cache_save(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    ngx_http_mcp_cache_zone_ctx_t *cctx = ngx_http_mcp_cache_ctx();
+    if (cctx == NULL || !ctx->cache_body) return NGX_OK;
+
+    const std::string &body = *ctx->cache_body;
+    uint64_t etag = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)body.data(), body.size());
+    // 处理期间目录已变化时只响应不缓存, 但等待者仍共享本次结果
+    if (cctx->sh->generation[ctx->cache_policy.family] == ctx->cache_generation) {
+        try {
+            ngx_http_mcp_cache_store(cctx, ctx->cache_key, ctx->cache_body, ctx->cache_generation,
+                                     &ctx->cache_policy);
+        } catch (const std::bad_alloc &) {
+        }
+    }
+    ngx_http_mcp_cache_land(ctx, ctx->cache_body);
+    if (ctx->sse) return NGX_OK;
+    return ngx_http_mcp_cache_set_etag(r, etag);
+}
+
+// 使一类目录的缓存全部失效; 任意线程、任意 worker 均可调用
+void
+ngx_http_mcp_cache_invalidate(ngx_uint_t family) {
+    ngx_http_mcp_cache_zone_ctx_t *ctx = ngx_http_mcp_cache_ctx();
+    if (ctx == NULL || family >= NGX_HTTP_MCP_CACHE_FAMILIES) return;
+    (void)ngx_atomic_fetch_add(&ctx->sh->generation[family], 1);
+}
+
+void
+ngx_http_mcp_cache_stats(ngx_cycle_t *cycle, ngx_http_mcp_cache_stats_t *st) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(cycle, ngx_http_mcp_module);
+    ngx_memzero(st, sizeof(ngx_http_mcp_cache_stats_t));
+    if (mcf == NULL || mcf->cache_zone == NULL) return;
+    auto *ctx = static_cast<ngx_http_mcp_cache_zone_ctx_t*>(mcf->cache_zone->data);
+    ngx_http_mcp_cache_shctx_t *sh = ctx->sh;
+    if (sh == NULL) return;
+
+    st->entries = sh->entries;
+    st->l1_hits = sh->l1_hits;
+    st->l2_hits = sh->l2_hits;
+    st->stale_hits = sh->stale_hits;
+    st->misses = sh->misses;
+    st->not_modified = sh->not_modified;
+    st->evicted = sh->evicted;
+    st->coalesced = sh->coalesced;
+}
+
+static ngx_int_t
+ngx_http_mcp_cache_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    auto *octx = static_cast<ngx_http_mcp_cache_zone_ctx_t*>(data);
+    auto *ctx  = static_cast<ngx_http_mcp_cache_zone_ctx_t*>(shm_zone->data);
+
+    if (octx) {
+        ctx->sh = octx->sh;
+        ctx->shpool = octx->shpool;
+        return NGX_OK;
+    }
+
+    ctx->shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        ctx->sh = (ngx_http_mcp_cache_shctx_t*)ctx->shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_cache_shctx_t*)ngx_slab_calloc(ctx->shpool, sizeof(ngx_http_mcp_cache_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    ctx->sh = sh;
+    ctx->shpool->data = sh;
+    ngx_rbtree_init(&sh->rbtree, &sh->sentinel, ngx_rbtree_insert_value);
+    ngx_queue_init(&sh->lru);
+    for (ngx_uint_t i = 0; i < NGX_HTTP_MCP_CACHE_BUDGETS; ++i) {
+        ngx_queue_init(&sh->budgets[i].lru);
+    }
+
+    size_t len = sizeof(" in mcp cache \"\"") + shm_zone->shm.name.len;
+    ctx->shpool->log_ctx = (u_char*)ngx_slab_alloc(ctx->shpool, len);
+    if (ctx->shpool->log_ctx == NULL) return NGX_ERROR;
+    ngx_sprintf(ctx->shpool->log_ctx, " in mcp cache \"%V\"%Z", &shm_zone->shm.name);
+    // 缓存满时按 LRU 淘汰, 不必记录分配失败
+    ctx->shpool->log_nomem = 0;
+    return NGX_OK;
+}
+
+} // extern "C"
+
+ngx_chain_t *
+ngx_http_mcp_cache_result(ngx_http_mcp_async_ctx_t *ctx, ngx_pool_t *pool, const nlohmann::json &result, size_t *len) {
+    // 工具返回的错误结果不缓存
+    if (ctx->cache_key.empty()
+        || (ctx->cache_policy.family == NGX_HTTP_MCP_CACHE_TOOLS
+            && result.is_object() && result.value("isError", false)))
+    {
+        return ngx_http_mcp_serialize_result(pool, ctx->id, result, len);
+    }
+    ctx->cache_body = std::make_shared<const std::string>(result.dump());
+    ngx_chain_t *out = ngx_http_mcp_wrap_result(pool, ctx->id, (const u_char*)ctx->cache_body->data(),
+                                                ctx->cache_body->size(), len);
+    if (out == NULL) throw std::bad_alloc();
+    return out;
+}
+
+// 目录变化的出口: 由 McpServer::catalog_changed 调用
+static void
+ngx_http_mcp_cache_catalog_changed(mcp::server::McpServer::Catalog c) {
+    switch (c) {
+    case mcp::server::McpServer::Catalog::Prompts:
+        ngx_http_mcp_cache_invalidate(NGX_HTTP_MCP_CACHE_PROMPTS);
+        break;
+    case mcp::server::McpServer::Catalog::Resources:
+        ngx_http_mcp_cache_invalidate(NGX_HTTP_MCP_CACHE_RESOURCES);
+        break;
+    case mcp::server::McpServer::Catalog::Tools:
+        ngx_http_mcp_cache_invalidate(NGX_HTTP_MCP_CACHE_TOOLS);
+        break;
+    }
+}
+
+// mcp_cache size [ttl=time] [stale=time] [l1=n];
+char *ngx_http_mcp_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->cache_zone) return (char*)"is duplicate";
+
+    ssize_t size = ngx_parse_size(&value[1]);
+    if (size == NGX_ERROR) return (char*)"invalid zone size";
+    if (size < (ssize_t)(8 * ngx_pagesize)) return (char*)"zone is too small";
+
+    auto *ctx = (ngx_http_mcp_cache_zone_ctx_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_cache_zone_ctx_t));
+    if (ctx == NULL) return (char*)NGX_CONF_ERROR;
+    ctx->size = (size_t)size;
+    ctx->ttl = 5000;
+    ctx->stale = 30000;
+    ctx->l1 = 1024;
+
+    for (ngx_uint_t i = 2; i < cf->args->nelts; ++i) {
+        ngx_str_t s;
+        if (ngx_strncmp(value[i].data, "ttl=", 4) == 0) {
+            s.data = value[i].data + 4;
+            s.len = value[i].len - 4;
+            ngx_msec_t t = ngx_parse_time(&s, 0);
+            if (t == (ngx_msec_t)NGX_ERROR || t == 0) return (char*)"invalid ttl";
+            ctx->ttl = t;
+        } else if (ngx_strncmp(value[i].data, "stale=", 6) == 0) {
+            s.data = value[i].data + 6;
+            s.len = value[i].len - 6;
+            ngx_msec_t t = ngx_parse_time(&s, 0);
+            if (t == (ngx_msec_t)NGX_ERROR) return (char*)"invalid stale";
+            ctx->stale = t;
+        } else if (ngx_strncmp(value[i].data, "l1=", 3) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 3, value[i].len - 3);
+            if (n == NGX_ERROR || n < 1) return (char*)"invalid l1";
+            ctx->l1 = (ngx_uint_t)n;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    ngx_str_t name = ngx_string(NGX_HTTP_MCP_CACHE_ZONE_NAME);
+    ngx_shm_zone_t *shm_zone = ngx_shared_memory_add(cf, &name, size, (void*)ngx_http_mcp_cache_init_zone);
+    if (shm_zone == NULL) return (char*)NGX_CONF_ERROR;
+    shm_zone->init = ngx_http_mcp_cache_init_zone;
+    shm_zone->data = ctx;
+    mcf->cache_zone = shm_zone;
+    return NGX_CONF_OK;
+}
+
+// mcp_tool_cache name|* [ttl=time] [max_size=size];
+char *ngx_http_mcp_tool_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->tool_cache == NULL) {
+        mcf->tool_cache = ngx_array_create(cf->pool, 4, sizeof(ngx_http_mcp_tool_cache_t));
+        if (mcf->tool_cache == NULL) return (char*)NGX_CONF_ERROR;
+    }
+    auto *rules = (ngx_http_mcp_tool_cache_t*)mcf->tool_cache->elts;
+    for (ngx_uint_t i = 0; i < mcf->tool_cache->nelts; ++i) {
+        if (rules[i].tool.len == value[1].len
+            && ngx_strncmp(rules[i].tool.data, value[1].data, value[1].len) == 0)
+        {
+            return (char*)"is duplicate";
+        }
+    }
+
+    auto *rule = (ngx_http_mcp_tool_cache_t*)ngx_array_push(mcf->tool_cache);
+    if (rule == NULL) return (char*)NGX_CONF_ERROR;
+    rule->tool = value[1];
+    rule->ttl = 60000;
+    rule->max_size = 1024 * 1024;
+
+    for (ngx_uint_t i = 2; i < cf->args->nelts; ++i) {
+        ngx_str_t s;
+        if (ngx_strncmp(value[i].data, "ttl=", 4) == 0) {
+            s.data = value[i].data + 4;
+            s.len = value[i].len - 4;
+            ngx_msec_t t = ngx_parse_time(&s, 0);
+            if (t == (ngx_msec_t)NGX_ERROR || t == 0) return (char*)"invalid ttl";
+            rule->ttl = t;
+        } else if (ngx_strncmp(value[i].data, "max_size=", 9) == 0) {
+            s.data = value[i].data + 9;
+            s.len = value[i].len - 9;
+            ssize_t n = ngx_parse_size(&s);
+            if (n == NGX_ERROR || n <= 0) return (char*)"invalid max_size";
+            rule->max_size = (size_t)n;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+    return NGX_CONF_OK;
+}
+
+char *ngx_http_mcp_cache_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->tool_cache && mcf->cache_zone == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"mcp_tool_cache\" requires \"mcp_cache\"");
+        return (char*)NGX_CONF_ERROR;
+    }
+    return NGX_CONF_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_cache_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->cache_zone == NULL) return NGX_OK;
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+    ngx_http_mcp_cache_zone = mcf->cache_zone;
+    ngx_http_mcp_cache_tools = mcf->tool_cache;
+    mcp::server::McpServer::set_catalog_listener(ngx_http_mcp_cache_catalog_changed);
+    return NGX_OK;
+}
@@ -0,0 +1,306 @@
+#include <sys/socket.h>
+#include <unordered_map>
+#include "ngx_http_mcp_module.h"
+
+// 在途请求的取消: 进入线程池的请求按 (会话或客户端地址, 请求 id) 登记在本 worker 的表中,
+// 截止时间(params._meta.timeout 或 mcp_request_timeout)到期、客户端断开或收到
+// notifications/cancelled 时设置 RequestContext 的取消令牌; 仍在调度器中排队的任务直接移出,
+// 已在执行的由处理函数检查令牌后中止。notifications/cancelled 可能落到其他 worker,
+// 本 worker 找不到时写入共享内存中的公告板, 有在途请求的 worker 定时查看。
+
+#define NGX_HTTP_MCP_CANCEL_ZONE_NAME  "mcp_cancel"
+
+// 公告板槽数, 按写入顺序循环覆盖
+#define NGX_HTTP_MCP_CANCEL_SLOTS      128
+
+// 公告的有效期
+#define NGX_HTTP_MCP_CANCEL_TTL        10000
+
+// 有在途请求时查看公告板的间隔
+#define NGX_HTTP_MCP_CANCEL_POLL       20
+
+using mcp::server::CancelReason;
+
+typedef struct {
+    ngx_atomic_t   key;
+    ngx_atomic_t   posted;         // 写入时的 ngx_current_msec
+} ngx_http_mcp_cancel_slot_t;
+
+typedef struct {
+    ngx_atomic_t                seq;    // 每次写入加一, 未变化时不必扫描
+    ngx_atomic_t                next;
+    ngx_http_mcp_cancel_slot_t  slots[NGX_HTTP_MCP_CANCEL_SLOTS];
+} ngx_http_mcp_cancel_shctx_t;
+
+// 以下仅在事件循环线程访问
+static ngx_http_mcp_cancel_shctx_t                                  *ngx_http_mcp_cancel_sh;
+static std::unordered_multimap<uint64_t, ngx_http_mcp_cancel_t*>     ngx_http_mcp_cancel_inflight;
+static ngx_event_t                                                   ngx_http_mcp_cancel_poll_ev;
+static ngx_atomic_uint_t                                             ngx_http_mcp_cancel_seen;
+
+static uint64_t
+ngx_http_mcp_cancel_key(ngx_http_request_t *r, ngx_str_t *session, const std::string &id) {
+    ngx_str_t *scope = (session && session->len) ? session : &r->connection->addr_text;
+    uint64_t h = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, scope->data, scope->len);
+    h = ngx_http_mcp_hash64(h, (const u_char*)"\n", 1);
+    return ngx_http_mcp_hash64(h, (const u_char*)id.data(), id.size());
+}
+
+static void
+ngx_http_mcp_cancel_timer_handler(ngx_event_t *ev) {
+    ngx_http_mcp_cancel_request(static_cast<ngx_http_mcp_cancel_t*>(ev->data), CancelReason::Timeout);
+}
+
+// 本 worker 中同键的在途请求全部取消; since 之前登记的才受影响, 返回取消的数量
+static ngx_uint_t
+ngx_http_mcp_cancel_local(uint64_t key, ngx_msec_t since, ngx_flag_t check_since) {
+    ngx_uint_t n = 0;
+    auto range = ngx_http_mcp_cancel_inflight.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        ngx_http_mcp_cancel_t *c = it->second;
+        if (check_since && (ngx_msec_int_t)(since - c->since) < 0) continue;
+        ngx_http_mcp_cancel_request(c, CancelReason::Cancelled);
+        n++;
+    }
+    return n;
+}
+
+static void
+ngx_http_mcp_cancel_poll(ngx_event_t *ev) {
+    ngx_http_mcp_cancel_shctx_t *sh = ngx_http_mcp_cancel_sh;
+    if (sh == NULL || ngx_http_mcp_cancel_inflight.empty()) return;
+
+    ngx_atomic_uint_t seq = sh->seq;
+    if (seq != ngx_http_mcp_cancel_seen) {
+        ngx_http_mcp_cancel_seen = seq;
+        for (ngx_uint_t i = 0; i < NGX_HTTP_MCP_CANCEL_SLOTS; ++i) {
+            uint64_t key = sh->slots[i].key;
+            ngx_msec_t posted = (ngx_msec_t)sh->slots[i].posted;
+            if (key == 0 || (ngx_msec_int_t)(ngx_current_msec - posted) > NGX_HTTP_MCP_CANCEL_TTL) continue;
+            ngx_http_mcp_cancel_local(key, posted, 1);
+        }
+    }
+    if (!ngx_http_mcp_cancel_inflight.empty() && !ngx_exiting) {
+        ngx_add_timer(ev, NGX_HTTP_MCP_CANCEL_POLL);
+    }
+}
+
+// 客户端断开: 与 upstream 检查断连的方式相同, 优先用 EPOLLRDHUP, 否则 MSG_PEEK 一个字节
+static void
+ngx_http_mcp_cancel_check_broken(ngx_http_request_t *r) {
+    ngx_connection_t *c = r->connection;
+    ngx_event_t *rev = c->read;
+    ngx_err_t err = 0;
+
+    if (!c->error) {
+#if (NGX_HTTP_V2)
+        if (r->stream) return;
+#endif
+#if (NGX_HAVE_EPOLLRDHUP)
+        if ((ngx_event_flags & NGX_USE_EPOLL_EVENT) && ngx_use_epoll_rdhup) {
+            if (!rev->pending_eof) return;
+        } else
+#endif
+        {
+            u_char buf[1];
+            ssize_t n = recv(c->fd, buf, 1, MSG_PEEK);
+            err = ngx_socket_errno;
+            if (n > 0 || (n == -1 && err == NGX_EAGAIN)) {
+                // 客户端提前发来下一个请求: 水平触发时停止监视, 免得反复唤醒
+                if (n > 0 && (ngx_event_flags & NGX_USE_LEVEL_EVENT) && rev->active) {
+                    ngx_del_event(rev, NGX_READ_EVENT, 0);
+                }
+                return;
+            }
+        }
+    }
+
+    ngx_log_error(NGX_LOG_INFO, c->log, err, "mcp client closed connection, cancelling request");
+    r->read_event_handler = ngx_http_block_reading;
+
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    if (ctx == nullptr) return;
+    if (ctx->batch) {
+        ngx_http_mcp_batch_cancel(ctx, CancelReason::Disconnected);
+    } else {
+        ngx_http_mcp_cancel_request(&ctx->cancel, CancelReason::Disconnected);
+    }
+}
+
+static ngx_int_t
+ngx_http_mcp_cancel_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    if (data) {
+        shm_zone->data = data;
+        return NGX_OK;
+    }
+
+    auto *shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        shm_zone->data = shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_cancel_shctx_t*)ngx_slab_calloc(shpool, sizeof(ngx_http_mcp_cancel_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    shpool->data = sh;
+    shm_zone->data = sh;
+    return NGX_OK;
+}
+
+extern "C" {
+
+char *ngx_http_mcp_cancel_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf) {
+    ngx_str_t name = ngx_string(NGX_HTTP_MCP_CANCEL_ZONE_NAME);
+    mcf->cancel_zone = ngx_shared_memory_add(cf, &name, 8 * ngx_pagesize, &ngx_http_mcp_module);
+    if (mcf->cancel_zone == NULL) return (char*)NGX_CONF_ERROR;
+    mcf->cancel_zone->init = ngx_http_mcp_cancel_init_zone;
+    return NGX_CONF_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_cancel_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    ngx_http_mcp_cancel_sh = mcf->cancel_zone
+        ? static_cast<ngx_http_mcp_cancel_shctx_t*>(mcf->cancel_zone->data) : NULL;
+    if (ngx_http_mcp_cancel_sh) ngx_http_mcp_cancel_seen = ngx_http_mcp_cancel_sh->seq;
+    ngx_http_mcp_cancel_poll_ev.handler = ngx_http_mcp_cancel_poll;
+    ngx_http_mcp_cancel_poll_ev.log = cycle->log;
+    ngx_http_mcp_cancel_poll_ev.cancelable = 1;
+    return NGX_OK;
+}
+
+// 线程任务已投递后调用: 监视连接, 客户端断开时取消
+void
+ngx_http_mcp_cancel_watch(ngx_http_request_t *r) {
+    r->read_event_handler = ngx_http_mcp_cancel_check_broken;
+    if ((ngx_event_flags & NGX_USE_LEVEL_EVENT) && !r->connection->read->active) {
+        (void)ngx_handle_read_event(r->connection->read, 0);
+    }
+}
+
+} // extern "C"
+
+// params._meta.timeout 与 mcp_request_timeout 中较早的一个
+ngx_msec_t
+ngx_http_mcp_cancel_deadline(ngx_http_request_t *r, const nlohmann::json &msg) {
+    ngx_http_mcp_loc_conf_t *conf =
+        (ngx_http_mcp_loc_conf_t *)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
+    ngx_msec_t deadline = ngx_http_mcp_request_deadline(msg);
+    if (conf->request_timeout) {
+        ngx_msec_t d = ngx_current_msec + conf->request_timeout;
+        if (d == 0) d = 1;
+        if (deadline == 0 || (ngx_msec_int_t)(d - deadline) < 0) deadline = d;
+    }
+    return deadline;
+}
+
+// 截止时间与 CPU 上限交给处理线程检查
+void
+ngx_http_mcp_cancel_limits(ngx_http_request_t *r, mcp::server::RequestContext *rctx, ngx_msec_t deadline) {
+    ngx_http_mcp_loc_conf_t *conf =
+        (ngx_http_mcp_loc_conf_t *)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
+    if (deadline) {
+        ngx_msec_int_t left = (ngx_msec_int_t)(deadline - ngx_current_msec);
+        rctx->set_deadline(std::chrono::steady_clock::now()
+                           + std::chrono::milliseconds(left > 0 ? left : 0));
+    }
+    if (conf->cpu_limit) {
+        rctx->set_cpu_limit(std::chrono::milliseconds(conf->cpu_limit));
+    }
+}
+
+void
+ngx_http_mcp_cancel_register(ngx_http_request_t *r, ngx_http_mcp_cancel_t *c, ngx_str_t *session,
+                             const std::string &id, mcp::server::RequestContext *rctx,
+                             ngx_http_mcp_sched_entry_t **sched, ngx_msec_t deadline)
+{
+    c->rctx = rctx;
+    c->sched = sched;
+    c->since = ngx_current_msec;
+    c->aborted = 0;
+
+    if (deadline) {
+        ngx_msec_int_t left = (ngx_msec_int_t)(deadline - ngx_current_msec);
+        c->timer.handler = ngx_http_mcp_cancel_timer_handler;
+        c->timer.data = c;
+        c->timer.log = r->connection->log;
+        ngx_add_timer(&c->timer, left > 0 ? (ngx_msec_t)left : 1);
+    }
+
+    // 通知无 id, 无法被 notifications/cancelled 指名
+    if (id == "null") return;
+    try {
+        c->key = ngx_http_mcp_cancel_key(r, session, id);
+        ngx_http_mcp_cancel_inflight.emplace(c->key, c);
+    } catch (const std::bad_alloc &) {
+        c->key = 0;
+        return;
+    }
+    if (ngx_http_mcp_cancel_sh && !ngx_http_mcp_cancel_poll_ev.timer_set) {
+        ngx_add_timer(&ngx_http_mcp_cancel_poll_ev, NGX_HTTP_MCP_CANCEL_POLL);
+    }
+}
+
+// 可重复调用
+void
+ngx_http_mcp_cancel_unregister(ngx_http_mcp_cancel_t *c) {
+    if (c->timer.timer_set) {
+        ngx_del_timer(&c->timer);
+    }
+    if (c->key) {
+        auto range = ngx_http_mcp_cancel_inflight.equal_range(c->key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == c) {
+                ngx_http_mcp_cancel_inflight.erase(it);
+                break;
+            }
+        }
+        c->key = 0;
+    }
+    c->sched = NULL;
+}
+
+// 排队中的任务移出调度器并立即触发完成回调; 正在执行的由处理函数检查令牌后中止
+void
+ngx_http_mcp_cancel_request(ngx_http_mcp_cancel_t *c, CancelReason reason) {
+    if (c->rctx == NULL) return;
+    c->rctx->cancel(reason);
+    if (c->sched && ngx_http_mcp_sched_cancel(*c->sched) == NGX_OK) {
+        c->aborted = 1;
+    }
+}
+
+// notifications/cancelled: params.requestId 指名同一会话(无会话时同一客户端地址)的在途请求
+void
+ngx_http_mcp_cancel_notification(ngx_http_request_t *r, ngx_str_t *session, const nlohmann::json &msg) {
+    auto params = msg.find("params");
+    if (params == msg.end() || !params->is_object()) return;
+    auto id = params->find("requestId");
+    if (id == params->end() || !(id->is_string() || id->is_number())) return;
+
+    uint64_t key;
+    try {
+        key = ngx_http_mcp_cancel_key(r, session, id->dump());
+    } catch (const std::bad_alloc &) {
+        return;
+    }
+
+    if (ngx_http_mcp_cancel_local(key, 0, 0)) {
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0, "mcp request cancelled by client");
+        return;
+    }
+
+    ngx_http_mcp_cancel_shctx_t *sh = ngx_http_mcp_cancel_sh;
+    if (sh == NULL) return;
+    ngx_http_mcp_cancel_slot_t *slot =
+        &sh->slots[ngx_atomic_fetch_add(&sh->next, 1) % NGX_HTTP_MCP_CANCEL_SLOTS];
+    slot->key = 0;
+    slot->posted = ngx_current_msec;
+    slot->key = (ngx_atomic_uint_t)key;
+    (void)ngx_atomic_fetch_add(&sh->seq, 1);
+}
+
+ngx_chain_t *
+ngx_http_mcp_cancel_error(ngx_pool_t *pool, const std::string &id, CancelReason reason, size_t *len) {
+    return ngx_http_mcp_serialize_error(pool, id, NGX_HTTP_MCP_RPC_TIMEOUT,
+                                        mcp::server::Cancelled(reason).what(), nullptr, len);
+}
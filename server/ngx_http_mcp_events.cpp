@@ -0,0 +1,464 @@
+#include <sys/mman.h>
+#include "ngx_http_mcp_module.h"
+
+// 可续传的事件流: GET 事件流上的每个事件带全局递增的 id, 并按会话写入共享内存中的定长环形缓冲区;
+// 断线重连的 GET 携带 Last-Event-ID 时只补发其后的事件。
+// 配置 spill 文件时环形缓冲区放在该文件的共享映射中, 共享内存区只保存索引, 冷数据由内核换出。
+
+extern "C" {
+
+#define NGX_HTTP_MCP_EVENTS_ZONE_NAME  "mcp_events"
+
+// 事件槽头部, 之后是事件数据(已序列化的 JSON-RPC 消息)
+typedef struct {
+    uint64_t      id;
+    uint32_t      len;
+    uint32_t      reserved;
+} ngx_http_mcp_event_slot_t;
+
+// 会话索引, 线性探测, 删除时回移后续槽位而不留删除标记
+typedef struct {
+    uint64_t      key;          // 会话 id 哈希, 0 为空槽
+    uint64_t      base;         // 该会话最近一个不再保留的事件 id, 之后的事件全部在环中
+    uint32_t      ring;
+    uint32_t      head;         // 下一个写入位置
+    uint32_t      count;
+    uint32_t      reserved;
+} ngx_http_mcp_events_entry_t;
+
+typedef struct {
+    uint64_t                      next_id;    // 持锁递增
+    ngx_uint_t                    mask;       // 索引槽位数 - 1
+    ngx_uint_t                    nrings;
+    ngx_uint_t                    nfree;
+    ngx_uint_t                    hand;       // 无空闲环时按时钟指针淘汰
+    ngx_uint_t                    live;
+    ngx_uint_t                    events;     // 每个环的事件数
+    size_t                        event_size; // 事件槽大小(含头部)
+    size_t                        spill_size; // 0 表示环在共享内存中
+    ngx_atomic_t                  appended;
+    ngx_atomic_t                  evicted;    // 因环满被覆盖的事件
+    ngx_atomic_t                  oversize;   // 超过事件槽大小未能保存的事件
+    ngx_atomic_t                  hits;
+    ngx_atomic_t                  misses;
+    ngx_http_mcp_events_entry_t  *entries;
+    uint32_t                     *free;
+    u_char                       *rings;      // 共享内存中的环; spill 时为空
+} ngx_http_mcp_events_shctx_t;
+
+typedef struct {
+    ngx_http_mcp_events_shctx_t  *sh;
+    ngx_slab_pool_t              *shpool;
+    ngx_uint_t                    events;
+    size_t                        event_size;
+    ngx_str_t                     spill;
+    size_t                        spill_size;
+    u_char                       *spill_addr; // 本配置周期的文件映射
+} ngx_http_mcp_events_zone_ctx_t;
+
+static ngx_shm_zone_t  *ngx_http_mcp_events_zone;
+
+static u_char *
+ngx_http_mcp_events_rings(ngx_http_mcp_events_zone_ctx_t *ctx) {
+    return ctx->spill_addr ? ctx->spill_addr : ctx->sh->rings;
+}
+
+static ngx_http_mcp_event_slot_t *
+ngx_http_mcp_events_slot(ngx_http_mcp_events_zone_ctx_t *ctx, ngx_http_mcp_events_entry_t *e, ngx_uint_t i) {
+    ngx_http_mcp_events_shctx_t *sh = ctx->sh;
+    return (ngx_http_mcp_event_slot_t*)(ngx_http_mcp_events_rings(ctx)
+        + ((size_t)e->ring * sh->events + i % sh->events) * sh->event_size);
+}
+
+static ngx_http_mcp_events_entry_t *
+ngx_http_mcp_events_lookup(ngx_http_mcp_events_shctx_t *sh, uint64_t key) {
+    for (ngx_uint_t i = key & sh->mask; sh->entries[i].key; i = (i + 1) & sh->mask) {
+        if (sh->entries[i].key == key) return &sh->entries[i];
+    }
+    return NULL;
+}
+
+// 删除槽位 i 并回移其后同一探测链上的项, 归还其环
+static void
+ngx_http_mcp_events_remove(ngx_http_mcp_events_shctx_t *sh, ngx_uint_t i) {
+    sh->free[sh->nfree++] = sh->entries[i].ring;
+    sh->live--;
+
+    for (ngx_uint_t j = (i + 1) & sh->mask; sh->entries[j].key; j = (j + 1) & sh->mask) {
+        ngx_uint_t home = sh->entries[j].key & sh->mask;
+        // home 不在 (i, j] 区间内时, j 处的项可以前移到 i
+        if (((j - home) & sh->mask) >= ((j - i) & sh->mask)) {
+            sh->entries[i] = sh->entries[j];
+            i = j;
+        }
+    }
+    sh->entries[i].key = 0;
+}
+
+static ngx_http_mcp_events_entry_t *
+ngx_http_mcp_events_insert(ngx_http_mcp_events_shctx_t *sh, uint64_t key) {
+    if (sh->nfree == 0) {
+        // 所有环都在使用: 淘汰时钟指针处的会话
+        while (sh->entries[sh->hand].key == 0) {
+            sh->hand = (sh->hand + 1) & sh->mask;
+        }
+        ngx_http_mcp_events_remove(sh, sh->hand);
+        sh->hand = (sh->hand + 1) & sh->mask;
+    }
+
+    ngx_uint_t i = key & sh->mask;
+    while (sh->entries[i].key) {
+        i = (i + 1) & sh->mask;
+    }
+    ngx_http_mcp_events_entry_t *e = &sh->entries[i];
+    e->key = key;
+    e->base = 0;
+    e->ring = sh->free[--sh->nfree];
+    e->head = 0;
+    e->count = 0;
+    sh->live++;
+    return e;
+}
+
+static ngx_int_t
+ngx_http_mcp_events_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    auto *octx = static_cast<ngx_http_mcp_events_zone_ctx_t*>(data);
+    auto *ctx  = static_cast<ngx_http_mcp_events_zone_ctx_t*>(shm_zone->data);
+
+    if (octx) {
+        // reload: 环的布局不变时沿用旧数据, 否则事件 id 与环内容对不上
+        if (octx->events != ctx->events || octx->event_size != ctx->event_size
+            || octx->spill_size != ctx->spill_size
+            || (octx->spill.len != ctx->spill.len
+                || ngx_strncmp(octx->spill.data, ctx->spill.data, ctx->spill.len) != 0))
+        {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "mcp event store layout changed, restart is required");
+            return NGX_ERROR;
+        }
+        ctx->sh = octx->sh;
+        ctx->shpool = octx->shpool;
+        return NGX_OK;
+    }
+
+    ctx->shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        ctx->sh = (ngx_http_mcp_events_shctx_t*)ctx->shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_events_shctx_t*)ngx_slab_calloc(ctx->shpool, sizeof(ngx_http_mcp_events_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    ctx->sh = sh;
+    ctx->shpool->data = sh;
+
+    sh->events = ctx->events;
+    sh->event_size = ctx->event_size;
+    sh->spill_size = ctx->spill_size;
+    // 以启动时间为 id 起点, 重启后的 id 仍大于客户端手中的 Last-Event-ID
+    sh->next_id = (uint64_t)ngx_time() << 20;
+
+    size_t ring_size = sh->events * sh->event_size;
+    size_t per_ring = 2 * sizeof(ngx_http_mcp_events_entry_t) + sizeof(uint32_t);
+    ngx_uint_t nrings;
+    if (ctx->spill_size) {
+        nrings = ngx_min(ctx->spill_size / ring_size, shm_zone->shm.size / 2 / per_ring);
+    } else {
+        nrings = shm_zone->shm.size * 3 / 4 / (ring_size + per_ring);
+    }
+
+    for ( ;; ) {
+        if (nrings < 1) return NGX_ERROR;
+        ngx_uint_t n = 2;
+        while (n < nrings * 2) n *= 2;
+
+        sh->entries = (ngx_http_mcp_events_entry_t*)ngx_slab_calloc(
+            ctx->shpool, n * sizeof(ngx_http_mcp_events_entry_t));
+        sh->free = (uint32_t*)ngx_slab_alloc(ctx->shpool, nrings * sizeof(uint32_t));
+        sh->rings = ctx->spill_size ? NULL : (u_char*)ngx_slab_alloc(ctx->shpool, nrings * ring_size);
+        if (sh->entries && sh->free && (ctx->spill_size || sh->rings)) {
+            sh->mask = n - 1;
+            break;
+        }
+        if (sh->entries) ngx_slab_free(ctx->shpool, sh->entries);
+        if (sh->free) ngx_slab_free(ctx->shpool, sh->free);
+        if (sh->rings) ngx_slab_free(ctx->shpool, sh->rings);
+        nrings = nrings * 3 / 4;
+    }
+
+    sh->nrings = nrings;
+    sh->nfree = nrings;
+    for (ngx_uint_t i = 0; i < nrings; ++i) {
+        sh->free[i] = (uint32_t)(nrings - 1 - i);
+    }
+
+    size_t len = sizeof(" in mcp event store \"\"") + shm_zone->shm.name.len;
+    ctx->shpool->log_ctx = (u_char*)ngx_slab_alloc(ctx->shpool, len);
+    if (ctx->shpool->log_ctx == NULL) return NGX_ERROR;
+    ngx_sprintf(ctx->shpool->log_ctx, " in mcp event store \"%V\"%Z", &shm_zone->shm.name);
+    return NGX_OK;
+}
+
+static void
+ngx_http_mcp_events_unmap(void *data) {
+    auto *ctx = static_cast<ngx_http_mcp_events_zone_ctx_t*>(data);
+    if (ctx->spill_addr) {
+        munmap(ctx->spill_addr, ctx->spill_size);
+        ctx->spill_addr = NULL;
+    }
+}
+
+// 在 master 中映射 spill 文件, worker 继承映射
+static char *
+ngx_http_mcp_events_map(ngx_conf_t *cf, ngx_http_mcp_events_zone_ctx_t *ctx) {
+    if (ngx_conf_full_name(cf->cycle, &ctx->spill, 0) != NGX_OK) return (char*)NGX_CONF_ERROR;
+
+    ngx_fd_t fd = ngx_open_file(ctx->spill.data, NGX_FILE_RDWR, NGX_FILE_CREATE_OR_OPEN,
+                                NGX_FILE_DEFAULT_ACCESS);
+    if (fd == NGX_INVALID_FILE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno, "open spill file \"%V\" failed", &ctx->spill);
+        return (char*)NGX_CONF_ERROR;
+    }
+
+    void *addr = MAP_FAILED;
+    if (ftruncate(fd, (off_t)ctx->spill_size) == 0) {
+        addr = mmap(NULL, ctx->spill_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ngx_err_t err = ngx_errno;
+    ngx_close_file(fd);
+    if (addr == MAP_FAILED) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, err, "map spill file \"%V\" failed", &ctx->spill);
+        return (char*)NGX_CONF_ERROR;
+    }
+    ctx->spill_addr = (u_char*)addr;
+
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(cf->pool, 0);
+    if (cln == NULL) return (char*)NGX_CONF_ERROR;
+    cln->handler = ngx_http_mcp_events_unmap;
+    cln->data = ctx;
+    return NGX_CONF_OK;
+}
+
+// mcp_event_store size [events=n] [event_size=size] [spill=path] [spill_size=size];
+char *ngx_http_mcp_event_store(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->event_zone) return (char*)"is duplicate";
+
+    ssize_t size = ngx_parse_size(&value[1]);
+    if (size == NGX_ERROR) return (char*)"invalid zone size";
+    if (size < (ssize_t)(8 * ngx_pagesize)) return (char*)"zone is too small";
+
+    auto *ctx = (ngx_http_mcp_events_zone_ctx_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_events_zone_ctx_t));
+    if (ctx == NULL) return (char*)NGX_CONF_ERROR;
+    ctx->events = 64;
+    ctx->event_size = 1024;
+
+    for (ngx_uint_t i = 2; i < cf->args->nelts; ++i) {
+        ngx_str_t s;
+        if (ngx_strncmp(value[i].data, "events=", 7) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 7, value[i].len - 7);
+            if (n == NGX_ERROR || n < 1 || n > 65536) return (char*)"invalid events";
+            ctx->events = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "event_size=", 11) == 0) {
+            s.data = value[i].data + 11;
+            s.len = value[i].len - 11;
+            ssize_t n = ngx_parse_size(&s);
+            if (n == NGX_ERROR || n < 256) return (char*)"invalid event_size";
+            ctx->event_size = ngx_align((size_t)n, 8);
+        } else if (ngx_strncmp(value[i].data, "spill=", 6) == 0) {
+            ctx->spill.data = value[i].data + 6;
+            ctx->spill.len = value[i].len - 6;
+            if (ctx->spill.len == 0) return (char*)"invalid spill";
+        } else if (ngx_strncmp(value[i].data, "spill_size=", 11) == 0) {
+            s.data = value[i].data + 11;
+            s.len = value[i].len - 11;
+            ssize_t n = ngx_parse_size(&s);
+            if (n == NGX_ERROR || n <= 0) return (char*)"invalid spill_size";
+            ctx->spill_size = (size_t)n;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    if ((ctx->spill.len == 0) != (ctx->spill_size == 0)) {
+        return (char*)"\"spill\" and \"spill_size\" must be used together";
+    }
+    if (ctx->spill_size) {
+        if (ctx->spill_size < ctx->events * ctx->event_size) return (char*)"spill_size is too small";
+        char *rv = ngx_http_mcp_events_map(cf, ctx);
+        if (rv != NGX_CONF_OK) return rv;
+    }
+
+    ngx_str_t name = ngx_string(NGX_HTTP_MCP_EVENTS_ZONE_NAME);
+    ngx_shm_zone_t *shm_zone = ngx_shared_memory_add(cf, &name, size, (void*)ngx_http_mcp_events_init_zone);
+    if (shm_zone == NULL) return (char*)NGX_CONF_ERROR;
+    shm_zone->init = ngx_http_mcp_events_init_zone;
+    shm_zone->data = ctx;
+    mcf->event_zone = shm_zone;
+    return NGX_CONF_OK;
+}
+
+// 记录发往会话 GET 流的一个事件, 返回其 id; 未配置事件存储时返回 0(事件不带 id)
+uint64_t
+ngx_http_mcp_events_append(ngx_str_t *session, const u_char *data, size_t len) {
+    if (ngx_http_mcp_events_zone == NULL) return 0;
+    auto *ctx = static_cast<ngx_http_mcp_events_zone_ctx_t*>(ngx_http_mcp_events_zone->data);
+    ngx_http_mcp_events_shctx_t *sh = ctx->sh;
+    uint64_t key = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, session->data, session->len);
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    uint64_t id = ++sh->next_id;
+    ngx_http_mcp_events_entry_t *e = ngx_http_mcp_events_lookup(sh, key);
+    if (e == NULL) {
+        e = ngx_http_mcp_events_insert(sh, key);
+        e->base = id - 1;
+    }
+
+    if (len > sh->event_size - sizeof(ngx_http_mcp_event_slot_t)) {
+        // 放不下的事件无法补发: 清空环, 重连时从这里之后开始续传
+        e->count = 0;
+        e->base = id;
+        ngx_shmtx_unlock(&ctx->shpool->mutex);
+        (void)ngx_atomic_fetch_add(&sh->oversize, 1);
+        return id;
+    }
+
+    ngx_http_mcp_event_slot_t *slot = ngx_http_mcp_events_slot(ctx, e, e->head);
+    if (e->count == sh->events) {
+        e->base = slot->id;
+        (void)ngx_atomic_fetch_add(&sh->evicted, 1);
+    } else {
+        e->count++;
+    }
+    slot->id = id;
+    slot->len = (uint32_t)len;
+    ngx_memcpy((u_char*)(slot + 1), data, len);
+    e->head = (e->head + 1) % sh->events;
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    (void)ngx_atomic_fetch_add(&sh->appended, 1);
+    return id;
+}
+
+// 补发 last 之后的事件到 *out(可能为空); last 之后的事件全部仍在环中时返回 NGX_OK,
+// 否则补发仍保留的部分并返回 NGX_DECLINED
+ngx_int_t
+ngx_http_mcp_events_replay(ngx_http_request_t *r, ngx_str_t *session, uint64_t last, ngx_chain_t **out) {
+    *out = NULL;
+    if (ngx_http_mcp_events_zone == NULL) return NGX_DECLINED;
+    auto *ctx = static_cast<ngx_http_mcp_events_zone_ctx_t*>(ngx_http_mcp_events_zone->data);
+    ngx_http_mcp_events_shctx_t *sh = ctx->sh;
+    uint64_t key = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, session->data, session->len);
+    ngx_int_t rc = NGX_DECLINED;
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_http_mcp_events_entry_t *e = ngx_http_mcp_events_lookup(sh, key);
+    if (e == NULL) goto done;
+
+    {
+        ngx_uint_t first = e->head + sh->events - e->count;
+        size_t size = 0;
+        for (ngx_uint_t i = 0; i < e->count; ++i) {
+            ngx_http_mcp_event_slot_t *slot = ngx_http_mcp_events_slot(ctx, e, first + i);
+            if (slot->id > last) size += ngx_http_mcp_sse_event_size(slot->id, slot->len);
+        }
+
+        if (size) {
+            ngx_buf_t *b = ngx_create_temp_buf(r->pool, size);
+            ngx_chain_t *cl = ngx_alloc_chain_link(r->pool);
+            if (b == NULL || cl == NULL) {
+                rc = NGX_ERROR;
+                goto done;
+            }
+            for (ngx_uint_t i = 0; i < e->count; ++i) {
+                ngx_http_mcp_event_slot_t *slot = ngx_http_mcp_events_slot(ctx, e, first + i);
+                if (slot->id <= last) continue;
+                b->last = ngx_http_mcp_sse_event(b->last, slot->id, (u_char*)(slot + 1), slot->len);
+            }
+            b->flush = 1;
+            cl->buf = b;
+            cl->next = NULL;
+            *out = cl;
+        }
+        if (last >= e->base) rc = NGX_OK;
+    }
+
+done:
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+    if (rc != NGX_ERROR) {
+        (void)ngx_atomic_fetch_add(rc == NGX_OK ? &sh->hits : &sh->misses, 1);
+    }
+    return rc;
+}
+
+// 会话结束时释放其环
+void
+ngx_http_mcp_events_drop(ngx_str_t *session) {
+    if (ngx_http_mcp_events_zone == NULL) return;
+    auto *ctx = static_cast<ngx_http_mcp_events_zone_ctx_t*>(ngx_http_mcp_events_zone->data);
+    ngx_http_mcp_events_shctx_t *sh = ctx->sh;
+    uint64_t key = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, session->data, session->len);
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_http_mcp_events_entry_t *e = ngx_http_mcp_events_lookup(sh, key);
+    if (e) ngx_http_mcp_events_remove(sh, e - sh->entries);
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+}
+
+void
+ngx_http_mcp_events_stats(ngx_cycle_t *cycle, ngx_http_mcp_events_stats_t *st) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(cycle, ngx_http_mcp_module);
+    ngx_memzero(st, sizeof(ngx_http_mcp_events_stats_t));
+    if (mcf == NULL || mcf->event_zone == NULL) return;
+    auto *ctx = static_cast<ngx_http_mcp_events_zone_ctx_t*>(mcf->event_zone->data);
+    ngx_http_mcp_events_shctx_t *sh = ctx->sh;
+    if (sh == NULL) return;
+
+    st->sessions = sh->live;
+    st->rings = sh->nrings;
+    st->events = sh->events;
+    st->memory = sh->nrings * sh->events * sh->event_size;
+    st->appended = sh->appended;
+    st->evicted = sh->evicted;
+    st->oversize = sh->oversize;
+    st->hits = sh->hits;
+    st->misses = sh->misses;
+}
+
+static void
+ngx_http_mcp_events_report(ngx_event_t *ev) {
+    ngx_http_mcp_events_stats_t st;
+    ngx_http_mcp_events_stats((ngx_cycle_t*)ngx_cycle, &st);
+    ngx_uint_t replays = st.hits + st.misses;
+    ngx_log_error(NGX_LOG_INFO, ev->log, 0,
+                  "mcp event store: %ui/%ui sessions, %ui events per ring, %uz bytes, "
+                  "%ui appended, %ui evicted, %ui oversize, replay hit %ui miss %ui (%ui%%)",
+                  st.sessions, st.rings, st.events, st.memory, st.appended, st.evicted, st.oversize,
+                  st.hits, st.misses, replays ? st.hits * 100 / replays : 100);
+    if (!ngx_exiting) {
+        ngx_add_timer(ev, 60000);
+    }
+}
+
+// 0 号 worker 定期输出统计
+ngx_int_t
+ngx_http_mcp_events_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->event_zone == NULL) return NGX_OK;
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+    ngx_http_mcp_events_zone = mcf->event_zone;
+
+    if (ngx_worker != 0) return NGX_OK;
+    ngx_event_t *ev = (ngx_event_t*)ngx_pcalloc(cycle->pool, sizeof(ngx_event_t));
+    if (ev == NULL) return NGX_ERROR;
+    ev->handler = ngx_http_mcp_events_report;
+    ev->log = cycle->log;
+    ev->cancelable = 1;
+    ngx_add_timer(ev, 60000);
+    return NGX_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,479 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <signal.h>
+#include "ngx_http_mcp_module.h"
+
+// 模块自己的执行器(mcp_executor), 可代替 nginx thread_pool 作为 mcp_thread_pool 的目标。
+// 每个线程有自己的任务队列: 事件循环轮流投递到各线程队尾, 线程从自己的队头取任务,
+// 自己的队列空时从其他线程的队尾窃取。任务完成后不走 ngx_notify, 而是挂到 notify 通道的
+// 无锁 MPSC 栈上, 事件循环每次被 eventfd 唤醒时成批处理。
+// 线程数在 threads 与 max_threads 之间按采样到的排队时间伸缩; cpus 给出时线程依次绑定到这些 CPU。
+
+// 伸缩的采样周期
+#define NGX_HTTP_MCP_EXECUTOR_TICK   100
+
+// 排队时间连续这么多个周期低于目标的 1/4 且无积压时减少一个线程
+#define NGX_HTTP_MCP_EXECUTOR_IDLE   50
+
+// 空闲线程的最长睡眠时间, 防止唤醒丢失时任务长期滞留
+#define NGX_HTTP_MCP_EXECUTOR_SLEEP  std::chrono::milliseconds(100)
+
+struct ngx_http_mcp_executor_rt_s;
+
+struct ngx_http_mcp_executor_s {
+    ngx_str_t                          name;
+    ngx_uint_t                         threads;       // 最少线程数
+    ngx_uint_t                         max_threads;
+    ngx_array_t                       *cpus;          // 元素类型: ngx_uint_t, 为空时不绑定
+    ngx_msec_t                         latency;       // 目标排队时间
+    struct ngx_http_mcp_executor_rt_s *rt;            // 运行时状态, 每个 worker 一份
+};
+
+namespace {
+
+typedef struct ngx_http_mcp_executor_job_s  ngx_http_mcp_executor_job_t;
+
+struct ngx_http_mcp_executor_job_s {
+    ngx_http_mcp_notify_t                  notify;    // 须为首成员, 完成后经 notify 通道回到事件循环
+    ngx_thread_task_t                     *task;
+    struct ngx_http_mcp_executor_rt_s     *rt;
+    std::chrono::steady_clock::time_point  posted;
+    ngx_http_mcp_executor_job_t           *next_free;
+};
+
+struct ngx_http_mcp_executor_slot_t {
+    std::mutex                                lock;
+    std::deque<ngx_http_mcp_executor_job_t*>  jobs;
+    std::atomic<size_t>                       size{0};    // 窃取前不加锁判断是否为空
+    std::thread                               thread;
+    std::atomic<bool>                         retire{false};
+    std::atomic<bool>                         exited{false};
+    bool                                      running = false;  // 线程已创建且未 join, 仅事件循环访问
+};
+
+} // namespace
+
+struct ngx_http_mcp_executor_rt_s {
+    ngx_http_mcp_executor_t                         *conf;
+    ngx_log_t                                       *log;
+    std::unique_ptr<ngx_http_mcp_executor_slot_t[]>  slots;       // max_threads 个
+    ngx_uint_t                                       live = 0;    // [0, live) 接收新任务
+    ngx_uint_t                                       next = 0;    // 轮流投递
+    std::atomic<size_t>                              pending{0};  // 已投递未开始的任务
+    std::atomic<bool>                                stop{false};
+    std::mutex                                       sleep_lock;
+    std::condition_variable                          wake;
+    std::atomic<ngx_uint_t>                          sleepers{0};
+    std::atomic<uint64_t>                            wait_ns{0};  // 本周期排队时间之和
+    std::atomic<uint64_t>                            samples{0};
+    std::atomic<uint64_t>                            completed{0};
+    std::atomic<uint64_t>                            stolen{0};
+    uint64_t                                         latency_usec = 0;
+    ngx_uint_t                                       idle_ticks = 0;
+    ngx_http_mcp_executor_job_t                     *free_jobs = nullptr;  // 仅事件循环访问
+    ngx_event_t                                      tick{};
+};
+
+typedef struct ngx_http_mcp_executor_rt_s  ngx_http_mcp_executor_rt_t;
+
+static ngx_http_mcp_executor_job_t *
+ngx_http_mcp_executor_pop(ngx_http_mcp_executor_slot_t *slot, bool front) {
+    if (slot->size.load(std::memory_order_acquire) == 0) return nullptr;
+    std::lock_guard<std::mutex> lk(slot->lock);
+    if (slot->jobs.empty()) return nullptr;
+    ngx_http_mcp_executor_job_t *job;
+    if (front) {
+        job = slot->jobs.front();
+        slot->jobs.pop_front();
+    } else {
+        job = slot->jobs.back();
+        slot->jobs.pop_back();
+    }
+    slot->size.fetch_sub(1, std::memory_order_release);
+    return job;
+}
+
+static ngx_http_mcp_executor_job_t *
+ngx_http_mcp_executor_steal(ngx_http_mcp_executor_rt_t *rt, ngx_uint_t self) {
+    ngx_uint_t n = rt->conf->max_threads;
+    for (ngx_uint_t k = 1; k < n; ++k) {
+        ngx_http_mcp_executor_job_t *job = ngx_http_mcp_executor_pop(&rt->slots[(self + k) % n], false);
+        if (job) {
+            rt->stolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+static void
+ngx_http_mcp_executor_pin(ngx_http_mcp_executor_rt_t *rt, ngx_uint_t index) {
+    ngx_array_t *cpus = rt->conf->cpus;
+    if (cpus == NULL || cpus->nelts == 0) return;
+#if (NGX_HAVE_SCHED_SETAFFINITY && NGX_LINUX)
+    ngx_uint_t cpu = ((ngx_uint_t*)cpus->elts)[index % cpus->nelts];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        ngx_log_error(NGX_LOG_ALERT, rt->log, err, "mcp executor \"%V\" failed to pin thread to cpu %ui",
+                      &rt->conf->name, cpu);
+    }
+#else
+    ngx_log_error(NGX_LOG_WARN, rt->log, 0, "mcp executor \"%V\": cpu pinning is not supported",
+                  &rt->conf->name);
+#endif
+}
+
+static void
+ngx_http_mcp_executor_run(ngx_http_mcp_executor_rt_t *rt, ngx_uint_t index) {
+    ngx_http_mcp_executor_slot_t *self = &rt->slots[index];
+
+    // 信号只由事件循环线程处理, 与 nginx 线程池一致
+    sigset_t set;
+    sigfillset(&set);
+    sigdelset(&set, SIGILL);
+    sigdelset(&set, SIGFPE);
+    sigdelset(&set, SIGSEGV);
+    sigdelset(&set, SIGBUS);
+    (void)pthread_sigmask(SIG_BLOCK, &set, NULL);
+    ngx_http_mcp_executor_pin(rt, index);
+
+    for ( ;; ) {
+        ngx_http_mcp_executor_job_t *job = ngx_http_mcp_executor_pop(self, true);
+        if (job == nullptr) job = ngx_http_mcp_executor_steal(rt, index);
+
+        if (job) {
+            rt->pending.fetch_sub(1);
+            auto start = std::chrono::steady_clock::now();
+            rt->wait_ns.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(start - job->posted).count(),
+                std::memory_order_relaxed);
+            rt->samples.fetch_add(1, std::memory_order_relaxed);
+
+            job->task->handler(job->task->ctx, rt->log);
+            rt->completed.fetch_add(1, std::memory_order_relaxed);
+            (void)ngx_http_mcp_notify_post(&job->notify);
+            continue;
+        }
+
+        if (rt->stop.load() || (self->retire.load() && self->size.load() == 0)) break;
+
+        std::unique_lock<std::mutex> lk(rt->sleep_lock);
+        rt->sleepers.fetch_add(1);
+        rt->wake.wait_for(lk, NGX_HTTP_MCP_EXECUTOR_SLEEP, [&] {
+            return rt->pending.load() > 0 || rt->stop.load() || self->retire.load();
+        });
+        rt->sleepers.fetch_sub(1);
+    }
+    self->exited.store(true);
+}
+
+extern "C" {
+
+// 事件循环中: 与 nginx 线程池的完成处理相同, 回调任务自己的 event handler
+static void
+ngx_http_mcp_executor_complete(ngx_http_mcp_notify_t *item) {
+    auto *job = reinterpret_cast<ngx_http_mcp_executor_job_t*>(item);
+    ngx_http_mcp_executor_rt_t *rt = job->rt;
+    ngx_event_t *ev = &job->task->event;
+
+    job->next_free = rt->free_jobs;
+    rt->free_jobs = job;
+
+    ev->complete = 1;
+    ev->active = 0;
+    ev->handler(ev);
+}
+
+static ngx_int_t
+ngx_http_mcp_executor_spawn(ngx_http_mcp_executor_rt_t *rt, ngx_uint_t index) {
+    ngx_http_mcp_executor_slot_t *slot = &rt->slots[index];
+    slot->retire.store(false);
+    slot->exited.store(false);
+    try {
+        slot->thread = std::thread(ngx_http_mcp_executor_run, rt, index);
+    } catch (const std::system_error &e) {
+        ngx_log_error(NGX_LOG_ALERT, rt->log, 0, "mcp executor \"%V\" failed to start thread: %s",
+                      &rt->conf->name, e.what());
+        return NGX_ERROR;
+    }
+    slot->running = true;
+    return NGX_OK;
+}
+
+// 回收已退出的线程; 排队时间超过目标且有积压时加线程, 长期空闲时减线程
+static void
+ngx_http_mcp_executor_tick(ngx_event_t *ev) {
+    auto *rt = static_cast<ngx_http_mcp_executor_rt_t*>(ev->data);
+    ngx_http_mcp_executor_t *conf = rt->conf;
+
+    for (ngx_uint_t i = rt->live; i < conf->max_threads; ++i) {
+        ngx_http_mcp_executor_slot_t *slot = &rt->slots[i];
+        if (slot->running && slot->exited.load()) {
+            slot->thread.join();
+            slot->running = false;
+        }
+    }
+
+    uint64_t samples = rt->samples.exchange(0, std::memory_order_relaxed);
+    uint64_t wait_ns = rt->wait_ns.exchange(0, std::memory_order_relaxed);
+    rt->latency_usec = samples ? wait_ns / samples / 1000 : 0;
+    uint64_t target = (uint64_t)conf->latency * 1000;
+
+    if (rt->latency_usec > target && rt->pending.load() > 0) {
+        rt->idle_ticks = 0;
+        // 上一个被回收的线程尚未退出时本周期不扩容
+        if (rt->live < conf->max_threads && !rt->slots[rt->live].running
+            && ngx_http_mcp_executor_spawn(rt, rt->live) == NGX_OK)
+        {
+            rt->live++;
+            ngx_log_error(NGX_LOG_INFO, ev->log, 0, "mcp executor \"%V\" grew to %ui threads, queue latency %uLus",
+                          &conf->name, rt->live, rt->latency_usec);
+        }
+    } else if (rt->latency_usec * 4 < target && rt->pending.load() == 0) {
+        if (++rt->idle_ticks >= NGX_HTTP_MCP_EXECUTOR_IDLE && rt->live > conf->threads) {
+            rt->idle_ticks = 0;
+            rt->live--;
+            rt->slots[rt->live].retire.store(true);
+            {
+                std::lock_guard<std::mutex> lk(rt->sleep_lock);
+                rt->wake.notify_all();
+            }
+            ngx_log_error(NGX_LOG_INFO, ev->log, 0, "mcp executor \"%V\" shrank to %ui threads",
+                          &conf->name, rt->live);
+        }
+    } else {
+        rt->idle_ticks = 0;
+    }
+
+    if (!ngx_exiting) {
+        ngx_add_timer(ev, NGX_HTTP_MCP_EXECUTOR_TICK);
+    }
+}
+
+static ngx_int_t
+ngx_http_mcp_executor_post(ngx_http_mcp_executor_t *ex, ngx_thread_task_t *task) {
+    ngx_http_mcp_executor_rt_t *rt = ex->rt;
+    if (rt == NULL || rt->live == 0) return NGX_ERROR;
+
+    if (task->event.active) {
+        ngx_log_error(NGX_LOG_ALERT, rt->log, 0, "mcp executor \"%V\" task #%ui already active",
+                      &ex->name, task->id);
+        return NGX_ERROR;
+    }
+
+    ngx_http_mcp_executor_job_t *job = rt->free_jobs;
+    if (job) {
+        rt->free_jobs = job->next_free;
+    } else {
+        job = new (std::nothrow) ngx_http_mcp_executor_job_t();
+        if (job == nullptr) return NGX_ERROR;
+        job->rt = rt;
+        job->notify.handler = ngx_http_mcp_executor_complete;
+    }
+    job->task = task;
+    job->posted = std::chrono::steady_clock::now();
+
+    ngx_http_mcp_executor_slot_t *slot = &rt->slots[rt->next++ % rt->live];
+    try {
+        std::lock_guard<std::mutex> lk(slot->lock);
+        slot->jobs.push_back(job);
+        slot->size.fetch_add(1, std::memory_order_release);
+    } catch (const std::bad_alloc &) {
+        job->next_free = rt->free_jobs;
+        rt->free_jobs = job;
+        return NGX_ERROR;
+    }
+    task->event.active = 1;
+
+    // 先计入 pending 再看有无睡眠线程: 线程入睡前在锁内检查 pending, 二者不会同时错过
+    rt->pending.fetch_add(1);
+    if (rt->sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lk(rt->sleep_lock);
+        rt->wake.notify_one();
+    }
+    return NGX_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_thread_task_post(ngx_http_mcp_thread_pool_t *tp, ngx_thread_task_t *task) {
+    if (tp->ex) return ngx_http_mcp_executor_post(tp->ex, task);
+    return ngx_thread_task_post(tp->tp, task);
+}
+
+ngx_http_mcp_executor_t *
+ngx_http_mcp_executor_find(ngx_http_mcp_main_conf_t *mcf, ngx_str_t *name) {
+    if (mcf->executors == NULL) return NULL;
+    auto **ex = (ngx_http_mcp_executor_t**)mcf->executors->elts;
+    for (ngx_uint_t i = 0; i < mcf->executors->nelts; ++i) {
+        if (ex[i]->name.len == name->len && ngx_strncmp(ex[i]->name.data, name->data, name->len) == 0) {
+            return ex[i];
+        }
+    }
+    return NULL;
+}
+
+void
+ngx_http_mcp_executor_stats(ngx_http_mcp_executor_t *ex, ngx_http_mcp_executor_stats_t *st) {
+    ngx_memzero(st, sizeof(*st));
+    st->name = ex->name;
+    ngx_http_mcp_executor_rt_t *rt = ex->rt;
+    if (rt == NULL) return;
+    st->threads = rt->live;
+    st->queued = rt->pending.load();
+    st->completed = rt->completed.load(std::memory_order_relaxed);
+    st->stolen = rt->stolen.load(std::memory_order_relaxed);
+    st->latency_usec = rt->latency_usec;
+}
+
+// cpus=0-3,6: 逗号分隔的 CPU 编号或区间
+static char *
+ngx_http_mcp_executor_cpus(ngx_conf_t *cf, ngx_http_mcp_executor_t *ex, u_char *p, u_char *last) {
+    ex->cpus = ngx_array_create(cf->pool, 4, sizeof(ngx_uint_t));
+    if (ex->cpus == NULL) return (char*)NGX_CONF_ERROR;
+
+    while (p < last) {
+        u_char *comma = (u_char*)ngx_strlchr(p, last, ',');
+        if (comma == NULL) comma = last;
+        u_char *dash = (u_char*)ngx_strlchr(p, comma, '-');
+        ngx_int_t from = ngx_atoi(p, (dash ? dash : comma) - p);
+        ngx_int_t to = dash ? ngx_atoi(dash + 1, comma - dash - 1) : from;
+        if (from == NGX_ERROR || to == NGX_ERROR || to < from || to >= 1024) return (char*)"invalid cpus";
+        for (ngx_int_t c = from; c <= to; ++c) {
+            ngx_uint_t *cpu = (ngx_uint_t*)ngx_array_push(ex->cpus);
+            if (cpu == NULL) return (char*)NGX_CONF_ERROR;
+            *cpu = (ngx_uint_t)c;
+        }
+        p = comma + 1;
+    }
+    return ex->cpus->nelts ? NGX_CONF_OK : (char*)"invalid cpus";
+}
+
+// mcp_executor name [threads=n] [max_threads=n] [cpus=list] [latency=time];
+char *ngx_http_mcp_executor(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (ngx_http_mcp_executor_find(mcf, &value[1])) return (char*)"is duplicate";
+    if (mcf->executors == NULL) {
+        mcf->executors = ngx_array_create(cf->pool, 2, sizeof(ngx_http_mcp_executor_t*));
+        if (mcf->executors == NULL) return (char*)NGX_CONF_ERROR;
+    }
+
+    auto *ex = (ngx_http_mcp_executor_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_executor_t));
+    if (ex == NULL) return (char*)NGX_CONF_ERROR;
+    ex->name = value[1];
+    ex->threads = 4;
+    ex->max_threads = NGX_CONF_UNSET_UINT;
+    ex->latency = 5;
+
+    for (ngx_uint_t i = 2; i < cf->args->nelts; ++i) {
+        if (ngx_strncmp(value[i].data, "threads=", 8) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 8, value[i].len - 8);
+            if (n == NGX_ERROR || n < 1) return (char*)"invalid threads";
+            ex->threads = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "max_threads=", 12) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 12, value[i].len - 12);
+            if (n == NGX_ERROR || n < 1) return (char*)"invalid max_threads";
+            ex->max_threads = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "cpus=", 5) == 0) {
+            char *rv = ngx_http_mcp_executor_cpus(cf, ex, value[i].data + 5, value[i].data + value[i].len);
+            if (rv != NGX_CONF_OK) return rv;
+        } else if (ngx_strncmp(value[i].data, "latency=", 8) == 0) {
+            ngx_str_t s;
+            s.data = value[i].data + 8;
+            s.len = value[i].len - 8;
+            ngx_msec_t t = ngx_parse_time(&s, 0);
+            if (t == (ngx_msec_t)NGX_ERROR || t == 0) return (char*)"invalid latency";
+            ex->latency = t;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    ngx_conf_init_uint_value(ex->max_threads, ex->threads);
+    if (ex->max_threads < ex->threads) return (char*)"max_threads is less than threads";
+
+    auto **slot = (ngx_http_mcp_executor_t**)ngx_array_push(mcf->executors);
+    if (slot == NULL) return (char*)NGX_CONF_ERROR;
+    *slot = ex;
+    return NGX_CONF_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_executor_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->executors == NULL) return NGX_OK;
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+
+    auto **exs = (ngx_http_mcp_executor_t**)mcf->executors->elts;
+    for (ngx_uint_t i = 0; i < mcf->executors->nelts; ++i) {
+        ngx_http_mcp_executor_t *ex = exs[i];
+        auto *rt = new (std::nothrow) ngx_http_mcp_executor_rt_t();
+        if (rt == nullptr) return NGX_ERROR;
+        rt->slots.reset(new (std::nothrow) ngx_http_mcp_executor_slot_t[ex->max_threads]);
+        if (!rt->slots) {
+            delete rt;
+            return NGX_ERROR;
+        }
+        rt->conf = ex;
+        rt->log = cycle->log;
+        ex->rt = rt;
+
+        for (ngx_uint_t t = 0; t < ex->threads; ++t) {
+            if (ngx_http_mcp_executor_spawn(rt, t) != NGX_OK) return NGX_ERROR;
+            rt->live++;
+        }
+
+        if (ex->max_threads > ex->threads) {
+            rt->tick.handler = ngx_http_mcp_executor_tick;
+            rt->tick.data = rt;
+            rt->tick.log = cycle->log;
+            rt->tick.cancelable = 1;
+            ngx_add_timer(&rt->tick, NGX_HTTP_MCP_EXECUTOR_TICK);
+        }
+    }
+    return NGX_OK;
+}
+
+// 停止并等待所有线程; 未开始的任务随进程退出丢弃
+void
+ngx_http_mcp_executor_exit_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->executors == NULL) return;
+
+    auto **exs = (ngx_http_mcp_executor_t**)mcf->executors->elts;
+    for (ngx_uint_t i = 0; i < mcf->executors->nelts; ++i) {
+        ngx_http_mcp_executor_rt_t *rt = exs[i]->rt;
+        if (rt == NULL) continue;
+        exs[i]->rt = NULL;
+
+        if (rt->tick.timer_set) ngx_del_timer(&rt->tick);
+        rt->stop.store(true);
+        {
+            std::lock_guard<std::mutex> lk(rt->sleep_lock);
+            rt->wake.notify_all();
+        }
+        for (ngx_uint_t t = 0; t < exs[i]->max_threads; ++t) {
+            ngx_http_mcp_executor_slot_t *slot = &rt->slots[t];
+            if (slot->running) slot->thread.join();
+            for (ngx_http_mcp_executor_job_t *job : slot->jobs) delete job;
+        }
+        while (rt->free_jobs) {
+            ngx_http_mcp_executor_job_t *job = rt->free_jobs;
+            rt->free_jobs = job->next_free;
+            delete job;
+        }
+        delete rt;
+    }
+}
+
+} // extern "C"
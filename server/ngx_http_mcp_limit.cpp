@@ -0,0 +1,931 @@
+#include "ngx_http_mcp_module.h"
+
+extern "C" {
+
+// 开放寻址的最大探测长度
+#define NGX_HTTP_MCP_LIMIT_PROBES  16
+
+// 配额快照文件头
+#define NGX_HTTP_MCP_QUOTA_MAGIC   0x3151504d  // "MPQ1"
+
+typedef struct {
+    uint32_t  magic;
+    uint32_t  count;
+} ngx_http_mcp_quota_file_header_t;
+
+// 一次限流判定中已扣减的规则, 用于失败回滚和响应后按字节补扣
+typedef struct {
+    ngx_http_mcp_method_limit_t *rule;
+    void                        *slot;   // 限流槽或配额项
+} ngx_http_mcp_limit_charge_t;
+
+static ngx_int_t ngx_http_mcp_limit_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+static ngx_int_t ngx_http_mcp_quota_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+
+static ngx_conf_enum_t ngx_http_mcp_limit_key_names[] = {
+    { ngx_string("session"), NGX_HTTP_MCP_LIMIT_KEY_SESSION },
+    { ngx_string("ip"),      NGX_HTTP_MCP_LIMIT_KEY_IP },
+    { ngx_string("api_key"), NGX_HTTP_MCP_LIMIT_KEY_API_KEY },
+    { ngx_string("tool"),    NGX_HTTP_MCP_LIMIT_KEY_TOOL },
+    { ngx_null_string, 0 }
+};
+
+// 查找或创建共享内存区, size 为 0 表示仅引用(由 *_zone 指令或默认值决定大小)
+static ngx_shm_zone_t *
+ngx_http_mcp_limit_add_zone(ngx_conf_t *cf, ngx_str_t *name, size_t size, ngx_flag_t quota) {
+    ngx_http_mcp_main_conf_t      *mcf;
+    ngx_http_mcp_limit_zone_ctx_t *ctx;
+    ngx_shm_zone_t                *shm_zone, **zp;
+    ngx_array_t                   *zones;
+    ngx_uint_t                     i;
+
+    // 两类区域使用不同 tag, 同名混用时由 nginx 报错
+    shm_zone = ngx_shared_memory_add(cf, name, size,
+        quota ? (void*)ngx_http_mcp_quota_init_zone : (void*)&ngx_http_mcp_module);
+    if (shm_zone == NULL) return NULL;
+    if (shm_zone->data) return shm_zone;
+
+    ctx = (ngx_http_mcp_limit_zone_ctx_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_limit_zone_ctx_t));
+    if (ctx == NULL) return NULL;
+    ctx->snapshot_interval = NGX_CONF_UNSET_MSEC;
+    shm_zone->init = quota ? ngx_http_mcp_quota_init_zone : ngx_http_mcp_limit_init_zone;
+    shm_zone->data = ctx;
+
+    mcf = (ngx_http_mcp_main_conf_t*)ngx_http_conf_get_module_main_conf(cf, ngx_http_mcp_module);
+    zones = quota ? mcf->quota_zones : mcf->limit_zones;
+    zp = (ngx_shm_zone_t**)zones->elts;
+    for (i = 0; i < zones->nelts; ++i) {
+        if (zp[i] == shm_zone) return shm_zone;
+    }
+    zp = (ngx_shm_zone_t**)ngx_array_push(zones);
+    if (zp == NULL) return NULL;
+    *zp = shm_zone;
+    return shm_zone;
+}
+
+// 在 slab 中分配 2 的幂个表项, 分配失败时减半重试
+static void *
+ngx_http_mcp_limit_alloc_table(ngx_shm_zone_t *shm_zone, ngx_slab_pool_t *shpool,
+                               size_t item, ngx_uint_t *mask, const char *what) {
+    ngx_uint_t n = 64;
+    while (n * 2 * item <= shm_zone->shm.size / 2) {
+        n *= 2;
+    }
+    void *p;
+    for ( ;; ) {
+        p = ngx_slab_calloc(shpool, n * item);
+        if (p) break;
+        if (n <= 64) return NULL;
+        n /= 2;
+    }
+    *mask = n - 1;
+
+    size_t len = sizeof(" in mcp  zone \"\"") + ngx_strlen(what) + shm_zone->shm.name.len;
+    shpool->log_ctx = (u_char*)ngx_slab_alloc(shpool, len);
+    if (shpool->log_ctx == NULL) return NULL;
+    ngx_sprintf(shpool->log_ctx, " in mcp %s zone \"%V\"%Z", what, &shm_zone->shm.name);
+    return p;
+}
+
+static ngx_int_t
+ngx_http_mcp_limit_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    auto *octx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(data);
+    auto *ctx  = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(shm_zone->data);
+
+    if (octx) {
+        // reload: 沿用旧配置的共享内存, 令牌状态不丢失
+        ctx->sh = octx->sh;
+        ctx->shpool = octx->shpool;
+        return NGX_OK;
+    }
+
+    ctx->shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        ctx->sh = ctx->shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_limit_shctx_t*)ngx_slab_calloc(ctx->shpool, sizeof(ngx_http_mcp_limit_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    ctx->sh = sh;
+    ctx->shpool->data = sh;
+
+    sh->cells = (ngx_http_mcp_limit_cell_t*)ngx_http_mcp_limit_alloc_table(
+        shm_zone, ctx->shpool, sizeof(ngx_http_mcp_limit_cell_t), &sh->mask, "limit");
+    return sh->cells ? NGX_OK : NGX_ERROR;
+}
+
+static ngx_http_mcp_quota_entry_t *
+ngx_http_mcp_quota_lookup_locked(ngx_http_mcp_quota_shctx_t *sh, uint64_t key, time_t now);
+
+// 启动时从快照恢复仍在当前周期内的配额
+static void
+ngx_http_mcp_quota_load(ngx_shm_zone_t *shm_zone, ngx_http_mcp_limit_zone_ctx_t *ctx) {
+    ngx_http_mcp_quota_shctx_t       *sh = (ngx_http_mcp_quota_shctx_t*)ctx->sh;
+    ngx_http_mcp_quota_file_header_t  hdr;
+    ngx_http_mcp_quota_entry_t        e, *dst;
+    ngx_uint_t                        n = 0;
+
+    ngx_fd_t fd = ngx_open_file(ctx->snapshot.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+    if (fd == NGX_INVALID_FILE) return;
+
+    time_t now = ngx_time();
+    if (ngx_read_fd(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr)
+        && hdr.magic == NGX_HTTP_MCP_QUOTA_MAGIC)
+    {
+        for (uint32_t i = 0; i < hdr.count; ++i) {
+            if (ngx_read_fd(fd, &e, sizeof(e)) != (ssize_t)sizeof(e)) break;
+            if (e.key == 0 || e.expire <= (uint64_t)now) continue;
+            dst = ngx_http_mcp_quota_lookup_locked(sh, e.key, now);
+            if (dst == NULL) break;
+            dst->expire = e.expire;
+            dst->used = e.used;
+            n++;
+        }
+    }
+    ngx_close_file(fd);
+
+    ngx_log_error(NGX_LOG_NOTICE, shm_zone->shm.log, 0,
+                  "mcp quota zone \"%V\" restored %ui entries from \"%V\"",
+                  &shm_zone->shm.name, n, &ctx->snapshot);
+}
+
+static ngx_int_t
+ngx_http_mcp_quota_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    auto *octx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(data);
+    auto *ctx  = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(shm_zone->data);
+
+    if (octx) {
+        ctx->sh = octx->sh;
+        ctx->shpool = octx->shpool;
+        return NGX_OK;
+    }
+
+    ctx->shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        ctx->sh = ctx->shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_quota_shctx_t*)ngx_slab_calloc(ctx->shpool, sizeof(ngx_http_mcp_quota_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    ctx->sh = sh;
+    ctx->shpool->data = sh;
+
+    sh->entries = (ngx_http_mcp_quota_entry_t*)ngx_http_mcp_limit_alloc_table(
+        shm_zone, ctx->shpool, sizeof(ngx_http_mcp_quota_entry_t), &sh->mask, "quota");
+    if (sh->entries == NULL) return NGX_ERROR;
+
+    if (ctx->snapshot.len) {
+        ngx_http_mcp_quota_load(shm_zone, ctx);
+    }
+    return NGX_OK;
+}
+
+// 解析 zone=name:size, 供 mcp_limit_zone / mcp_quota_zone 共用
+static ngx_shm_zone_t *
+ngx_http_mcp_parse_zone(ngx_conf_t *cf, ngx_str_t *v, ngx_flag_t quota) {
+    if (ngx_strncmp(v->data, "zone=", 5) != 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\" (zone=name:size expected)", v);
+        return NULL;
+    }
+
+    ngx_str_t name, s;
+    name.data = v->data + 5;
+    u_char *p = (u_char*)ngx_strchr(name.data, ':');
+    if (p == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid zone size \"%V\"", v);
+        return NULL;
+    }
+    name.len = p - name.data;
+    s.data = p + 1;
+    s.len = v->data + v->len - s.data;
+
+    ssize_t size = ngx_parse_size(&s);
+    if (name.len == 0 || size == NGX_ERROR) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid zone name or size \"%V\"", v);
+        return NULL;
+    }
+    if (size < (ssize_t)(8 * ngx_pagesize)) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "zone \"%V\" is too small", &name);
+        return NULL;
+    }
+
+    ngx_shm_zone_t *shm_zone = ngx_http_mcp_limit_add_zone(cf, &name, size, quota);
+    if (shm_zone == NULL) return NULL;
+
+    auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(shm_zone->data);
+    if (ctx->declared) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "zone \"%V\" is duplicate", &name);
+        return NULL;
+    }
+    ctx->declared = 1;
+    return shm_zone;
+}
+
+// mcp_limit_zone zone=name:size;
+char *ngx_http_mcp_limit_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+    if (ngx_http_mcp_parse_zone(cf, &value[1], 0) == NULL) return (char*)NGX_CONF_ERROR;
+    return NGX_CONF_OK;
+}
+
+// mcp_quota_zone zone=name:size [snapshot=path] [snapshot_interval=time];
+char *ngx_http_mcp_quota_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+    ngx_shm_zone_t *shm_zone = ngx_http_mcp_parse_zone(cf, &value[1], 1);
+    if (shm_zone == NULL) return (char*)NGX_CONF_ERROR;
+
+    auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(shm_zone->data);
+    for (ngx_uint_t i = 2; i < cf->args->nelts; ++i) {
+        ngx_str_t s;
+        if (ngx_strncmp(value[i].data, "snapshot=", 9) == 0) {
+            ctx->snapshot.data = value[i].data + 9;
+            ctx->snapshot.len = value[i].len - 9;
+            if (ngx_conf_full_name(cf->cycle, &ctx->snapshot, 0) != NGX_OK) {
+                return (char*)NGX_CONF_ERROR;
+            }
+        } else if (ngx_strncmp(value[i].data, "snapshot_interval=", 18) == 0) {
+            s.data = value[i].data + 18;
+            s.len = value[i].len - 18;
+            ngx_int_t ms = ngx_parse_time(&s, 0);
+            if (ms == NGX_ERROR || ms <= 0) return (char*)"invalid snapshot_interval";
+            ctx->snapshot_interval = (ngx_msec_t)ms;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+    return NGX_CONF_OK;
+}
+
+// 未声明大小的区域使用默认大小
+char *ngx_http_mcp_limit_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf) {
+    ngx_array_t *all[] = { mcf->limit_zones, mcf->quota_zones };
+    for (ngx_array_t *zones : all) {
+        ngx_shm_zone_t **zp = (ngx_shm_zone_t**)zones->elts;
+        for (ngx_uint_t i = 0; i < zones->nelts; ++i) {
+            if (zp[i]->shm.size == 0) {
+                zp[i]->shm.size = NGX_HTTP_MCP_LIMIT_ZONE_SIZE;
+            }
+            auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(zp[i]->data);
+            ngx_conf_init_msec_value(ctx->snapshot_interval, 60000);
+        }
+    }
+    return NGX_CONF_OK;
+}
+
+// 同一方法 + 同一组合键 + 同类规则视为同一条, 重复配置时更新
+static ngx_http_mcp_method_limit_t *
+ngx_http_mcp_find_rule(ngx_http_mcp_loc_conf_t *conf, ngx_str_t *m, ngx_uint_t keys, ngx_flag_t quota) {
+    if (!conf || !conf->methods) return NULL;
+    ngx_http_mcp_method_limit_t *arr = (ngx_http_mcp_method_limit_t*)conf->methods->elts;
+    for (ngx_uint_t i = 0; i < conf->methods->nelts; ++i) {
+        if (arr[i].method.len == m->len
+            && ngx_strncmp(arr[i].method.data, m->data, m->len) == 0
+            && arr[i].keys == keys
+            && (arr[i].period != 0) == (quota != 0))
+        {
+            return &arr[i];
+        }
+    }
+    return NULL;
+}
+
+// 解析 key=ip+tool 形式的组合键
+static char *
+ngx_http_mcp_parse_keys(ngx_str_t *v, ngx_uint_t *keys) {
+    u_char *p = v->data, *last = v->data + v->len;
+    *keys = 0;
+    while (p < last) {
+        u_char *q = p;
+        while (q < last && *q != '+') q++;
+        size_t len = q - p;
+        ngx_conf_enum_t *e = ngx_http_mcp_limit_key_names;
+        for ( ; e->name.len; ++e) {
+            if (e->name.len == len && ngx_strncmp(e->name.data, p, len) == 0) break;
+        }
+        if (e->name.len == 0) return (char*)"invalid key (session, ip, api_key or tool expected)";
+        *keys |= e->value;
+        p = q + 1;
+    }
+    return NGX_CONF_OK;
+}
+
+// mcp_limit_method / mcp_quota 共用的可选参数, 返回 NGX_DECLINED 表示不认识
+static ngx_int_t
+ngx_http_mcp_parse_rule_param(ngx_str_t *v, ngx_http_mcp_method_limit_t *ml,
+                              ngx_str_t *zone_name, char **err) {
+    ngx_str_t s;
+    if (ngx_strncmp(v->data, "key=", 4) == 0) {
+        s.data = v->data + 4;
+        s.len = v->len - 4;
+        *err = ngx_http_mcp_parse_keys(&s, &ml->keys);
+        return *err ? NGX_ERROR : NGX_OK;
+    }
+    if (ngx_strncmp(v->data, "cost=", 5) == 0) {
+        ngx_int_t n = ngx_atoi(v->data + 5, v->len - 5);
+        if (n == NGX_ERROR || n <= 0) { *err = (char*)"invalid cost"; return NGX_ERROR; }
+        ml->cost = (ngx_uint_t)n;
+        return NGX_OK;
+    }
+    if (ngx_strncmp(v->data, "req_bytes=", 10) == 0 || ngx_strncmp(v->data, "resp_bytes=", 11) == 0) {
+        ngx_flag_t req = (v->data[2] == 'q');
+        s.data = v->data + (req ? 10 : 11);
+        s.len = v->len - (req ? 10 : 11);
+        ssize_t n = ngx_parse_size(&s);
+        if (n == NGX_ERROR || n <= 0) { *err = (char*)"invalid byte weight"; return NGX_ERROR; }
+        if (req) ml->req_bytes = (size_t)n; else ml->resp_bytes = (size_t)n;
+        return NGX_OK;
+    }
+    if (ngx_strncmp(v->data, "zone=", 5) == 0) {
+        zone_name->data = v->data + 5;
+        zone_name->len = v->len - 5;
+        if (zone_name->len == 0) { *err = (char*)"invalid zone"; return NGX_ERROR; }
+        return NGX_OK;
+    }
+    return NGX_DECLINED;
+}
+
+// 追加或更新规则, 计算规则在共享内存中的标识
+static char *
+ngx_http_mcp_add_rule(ngx_conf_t *cf, ngx_http_mcp_loc_conf_t *mcp_conf,
+                      ngx_http_mcp_method_limit_t *tmpl, ngx_str_t *zone_name) {
+    ngx_flag_t quota = tmpl->period != 0;
+    ngx_shm_zone_t *shm_zone = ngx_http_mcp_limit_add_zone(cf, zone_name, 0, quota);
+    if (shm_zone == NULL) return (char*)NGX_CONF_ERROR;
+
+    if (mcp_conf->methods == NULL) {
+        mcp_conf->methods = ngx_array_create(cf->pool, 2, sizeof(ngx_http_mcp_method_limit_t));
+        if (mcp_conf->methods == NULL) return (char*)"failed to allocate methods array";
+    }
+
+    // 如果已存在同名方法则更新, 否则追加
+    ngx_http_mcp_method_limit_t *ml = ngx_http_mcp_find_rule(mcp_conf, &tmpl->method, tmpl->keys, quota);
+    if (ml == NULL) {
+        ml = (ngx_http_mcp_method_limit_t*)ngx_array_push(mcp_conf->methods);
+        if (ml == NULL) return (char*)"failed to push method item";
+    }
+    *ml = *tmpl;
+    ml->shm_zone = shm_zone;
+
+    // 规则在共享内存中的标识: 配置位置 + 方法名, reload 后配置未变则沿用原状态
+    uint64_t h = NGX_HTTP_MCP_HASH_INIT;
+    h = ngx_http_mcp_hash64(h, cf->conf_file->file.name.data, cf->conf_file->file.name.len);
+    h = ngx_http_mcp_hash64(h, (u_char*)&cf->conf_file->line, sizeof(cf->conf_file->line));
+    h = ngx_http_mcp_hash64(h, ml->method.data, ml->method.len);
+    ml->key = h;
+
+    return NGX_CONF_OK;
+}
+
+// mcp_limit_method <method|*> <rate> [burst=N] [queue=N] [interval=time] [key=a+b]
+//                  [cost=N] [req_bytes=size] [resp_bytes=size] [zone=name];
+char *ngx_http_mcp_limit_method(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_loc_conf_t *mcp_conf = (ngx_http_mcp_loc_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+    // value[1]: method, value[2]: qps
+    if (value[1].len == 0) return (char*)"invalid method name";
+    if (value[2].len == 0) return (char*)"invalid qps value";
+
+    ngx_int_t qps = ngx_atoi(value[2].data, value[2].len);
+    if (qps == NGX_ERROR || qps <= 0) return (char*)"invalid qps (positive integer expected)";
+
+    ngx_http_mcp_method_limit_t ml;
+    ngx_memzero(&ml, sizeof(ml));
+    ml.method = value[1];
+    ml.rate_limit = (ngx_uint_t)qps;
+    ml.burst = ml.rate_limit;   // 默认突发 = qps
+    ml.interval = 1000;
+    ml.cost = 1;
+    ngx_str_t zone_name = ngx_string(NGX_HTTP_MCP_LIMIT_ZONE_NAME);
+
+    for (ngx_uint_t i = 3; i < cf->args->nelts; ++i) {
+        ngx_str_t s;
+        char *err = NULL;
+        ngx_int_t rc = ngx_http_mcp_parse_rule_param(&value[i], &ml, &zone_name, &err);
+        if (rc == NGX_ERROR) return err;
+        if (rc == NGX_OK) continue;
+
+        if (ngx_strncmp(value[i].data, "burst=", 6) == 0) {
+            ngx_int_t burst = ngx_atoi(value[i].data + 6, value[i].len - 6);
+            if (burst == NGX_ERROR || burst <= 0) return (char*)"invalid burst";
+            ml.burst = (ngx_uint_t)burst;
+        } else if (ngx_strncmp(value[i].data, "queue=", 6) == 0) {
+            ngx_int_t queue = ngx_atoi(value[i].data + 6, value[i].len - 6);
+            if (queue == NGX_ERROR) return (char*)"invalid queue";
+            ml.queue = (ngx_uint_t)queue;
+        } else if (ngx_strncmp(value[i].data, "interval=", 9) == 0) {
+            s.data = value[i].data + 9;
+            s.len = value[i].len - 9;
+            ngx_int_t ms = ngx_parse_time(&s, 0);
+            if (ms == NGX_ERROR || ms <= 0) return (char*)"invalid interval";
+            ml.interval = (ngx_msec_t)ms;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    return ngx_http_mcp_add_rule(cf, mcp_conf, &ml, &zone_name);
+}
+
+// mcp_quota <method|*> <limit> period=hour|day|time [key=a+b] [cost=N]
+//           [req_bytes=size] [resp_bytes=size] [zone=name];
+char *ngx_http_mcp_quota(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_loc_conf_t *mcp_conf = (ngx_http_mcp_loc_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    ngx_int_t limit = ngx_atoi(value[2].data, value[2].len);
+    if (limit == NGX_ERROR || limit <= 0) return (char*)"invalid quota (positive integer expected)";
+
+    ngx_http_mcp_method_limit_t ml;
+    ngx_memzero(&ml, sizeof(ml));
+    ml.method = value[1];
+    ml.rate_limit = (ngx_uint_t)limit;
+    ml.period = 86400;
+    ml.cost = 1;
+    ngx_str_t zone_name = ngx_string(NGX_HTTP_MCP_QUOTA_ZONE_NAME);
+
+    for (ngx_uint_t i = 3; i < cf->args->nelts; ++i) {
+        char *err = NULL;
+        ngx_int_t rc = ngx_http_mcp_parse_rule_param(&value[i], &ml, &zone_name, &err);
+        if (rc == NGX_ERROR) return err;
+        if (rc == NGX_OK) continue;
+
+        if (ngx_strncmp(value[i].data, "period=", 7) == 0) {
+            ngx_str_t s;
+            s.data = value[i].data + 7;
+            s.len = value[i].len - 7;
+            if (s.len == 4 && ngx_strncmp(s.data, "hour", 4) == 0) {
+                ml.period = 3600;
+            } else if (s.len == 3 && ngx_strncmp(s.data, "day", 3) == 0) {
+                ml.period = 86400;
+            } else {
+                ngx_int_t sec = ngx_parse_time(&s, 1);
+                if (sec == NGX_ERROR || sec <= 0) return (char*)"invalid period";
+                ml.period = (time_t)sec;
+            }
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    return ngx_http_mcp_add_rule(cf, mcp_conf, &ml, &zone_name);
+}
+
+// 找到或占用一个限流槽; 桶已回满(tat 已过期)的槽可被其他键复用
+static ngx_http_mcp_limit_cell_t *
+ngx_http_mcp_limit_cell(ngx_http_mcp_limit_shctx_t *sh, uint64_t key, ngx_atomic_uint_t now) {
+    ngx_atomic_uint_t k = (ngx_atomic_uint_t)key ? (ngx_atomic_uint_t)key : 1;
+    ngx_uint_t n = ngx_min((ngx_uint_t)NGX_HTTP_MCP_LIMIT_PROBES, sh->mask + 1);
+    ngx_http_mcp_limit_cell_t *idle = NULL;
+
+    for (ngx_uint_t i = 0; i < n; ++i) {
+        ngx_http_mcp_limit_cell_t *cell = &sh->cells[(k + i) & sh->mask];
+        ngx_atomic_uint_t cur = cell->key;
+        if (cur == k) return cell;
+        if (cur == 0) {
+            if (ngx_atomic_cmp_set(&cell->key, 0, k) || cell->key == k) {
+                return cell;
+            }
+            continue;
+        }
+        if (idle == NULL && cell->tat <= now) {
+            idle = cell;
+        }
+    }
+
+    // 回收空闲槽: 与并发更新存在极小的竞争窗口, 最坏情况是一次判定略有偏差
+    if (idle) {
+        ngx_atomic_uint_t cur = idle->key;
+        if (idle->tat <= now && ngx_atomic_cmp_set(&idle->key, cur, k)) {
+            idle->tat = 0;
+            return idle;
+        }
+    }
+    return NULL;
+}
+
+static ngx_http_mcp_quota_entry_t *
+ngx_http_mcp_quota_lookup_locked(ngx_http_mcp_quota_shctx_t *sh, uint64_t key, time_t now) {
+    ngx_uint_t n = ngx_min((ngx_uint_t)NGX_HTTP_MCP_LIMIT_PROBES, sh->mask + 1);
+    ngx_http_mcp_quota_entry_t *free_entry = NULL;
+
+    for (ngx_uint_t i = 0; i < n; ++i) {
+        ngx_http_mcp_quota_entry_t *e = &sh->entries[(key + i) & sh->mask];
+        if (e->key == key) return e;
+        if (free_entry == NULL && (e->key == 0 || e->expire <= (uint64_t)now)) {
+            free_entry = e;
+        }
+    }
+    if (free_entry) {
+        free_entry->key = key;
+        free_entry->expire = 0;
+        free_entry->used = 0;
+    }
+    return free_entry;
+}
+
+// 按规则的组合键计算本次请求的共享内存键
+static uint64_t
+ngx_http_mcp_limit_request_key(ngx_http_request_t *r, ngx_http_mcp_loc_conf_t *conf,
+                               ngx_http_mcp_method_limit_t *ml, ngx_http_mcp_limit_input_t *in) {
+    uint64_t h = ml->key;
+    // 通配规则按实际方法分桶
+    h = ngx_http_mcp_hash64(h, in->method.data, in->method.len);
+    if (ml->keys & NGX_HTTP_MCP_LIMIT_KEY_SESSION) {
+        ngx_table_elt_t *s = ngx_http_mcp_get_header(r, (u_char*)"Mcp-Session-Id", sizeof("Mcp-Session-Id") - 1);
+        h = ngx_http_mcp_hash64(h, (u_char*)"\x01", 1);
+        if (s) h = ngx_http_mcp_hash64(h, s->value.data, s->value.len);
+    }
+    if (ml->keys & NGX_HTTP_MCP_LIMIT_KEY_IP) {
+        h = ngx_http_mcp_hash64(h, (u_char*)"\x02", 1);
+        h = ngx_http_mcp_hash64(h, r->connection->addr_text.data, r->connection->addr_text.len);
+    }
+    if (ml->keys & NGX_HTTP_MCP_LIMIT_KEY_API_KEY) {
+        ngx_table_elt_t *a = ngx_http_mcp_get_header(r, conf->api_key_header.data, conf->api_key_header.len);
+        h = ngx_http_mcp_hash64(h, (u_char*)"\x03", 1);
+        if (a) h = ngx_http_mcp_hash64(h, a->value.data, a->value.len);
+    }
+    if (ml->keys & NGX_HTTP_MCP_LIMIT_KEY_TOOL) {
+        h = ngx_http_mcp_hash64(h, (u_char*)"\x04", 1);
+        h = ngx_http_mcp_hash64(h, in->tool.data, in->tool.len);
+    }
+    return h;
+}
+
+static ngx_uint_t
+ngx_http_mcp_limit_cost(ngx_http_mcp_method_limit_t *ml, off_t body_bytes) {
+    ngx_uint_t cost = ml->cost;
+    if (ml->req_bytes && body_bytes > 0) {
+        cost += (ngx_uint_t)(body_bytes / ml->req_bytes);
+    }
+    return cost;
+}
+
+// GCRA 判定: 返回 NGX_OK 立即放行, NGX_AGAIN 延迟 st->delay 后放行, NGX_BUSY 拒绝
+static ngx_int_t
+ngx_http_mcp_limit_take(ngx_http_mcp_method_limit_t *ml, ngx_http_mcp_limit_cell_t *cell,
+                        ngx_uint_t cost, ngx_http_mcp_limit_state_t *st) {
+    auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(ml->shm_zone->data);
+    auto *sh = static_cast<ngx_http_mcp_limit_shctx_t*>(ctx->sh);
+
+    st->rule = ml;
+    st->limit = ml->burst;
+    st->remaining = ml->burst;
+    st->reset = 0;
+    st->delay = 0;
+    st->retry_after = 0;
+
+    // 发射间隔 T 与容忍度: burst 个请求可立即通过, 另有 queue 个可延迟通过
+    ngx_atomic_uint_t t = (ngx_atomic_uint_t)ml->interval * NGX_HTTP_MCP_LIMIT_TICKS / ml->rate_limit;
+    if (t == 0) t = 1;
+    ngx_atomic_uint_t tau = t * ml->burst;
+    ngx_atomic_uint_t limit = tau + t * ml->queue;
+    ngx_atomic_uint_t now = (ngx_atomic_uint_t)ngx_current_msec * NGX_HTTP_MCP_LIMIT_TICKS;
+
+    ngx_atomic_uint_t old, tat, ahead;
+    for ( ;; ) {
+        old = cell->tat;
+        tat = (old > now) ? old : now;
+        ahead = tat + t * cost - now;
+        if (ahead > limit) {
+            ngx_atomic_fetch_add(&sh->rejected, 1);
+            st->remaining = 0;
+            st->reset = (ngx_msec_t)((tat - now) / NGX_HTTP_MCP_LIMIT_TICKS);
+            st->retry_after = (ngx_msec_t)((ahead - tau) / NGX_HTTP_MCP_LIMIT_TICKS);
+            return NGX_BUSY;
+        }
+        if (ngx_atomic_cmp_set(&cell->tat, old, tat + t * cost)) {
+            break;
+        }
+    }
+
+    st->reset = (ngx_msec_t)(ahead / NGX_HTTP_MCP_LIMIT_TICKS);
+    if (ahead > tau) {
+        ngx_atomic_fetch_add(&sh->delayed, 1);
+        st->remaining = 0;
+        st->delay = (ngx_msec_t)((ahead - tau) / NGX_HTTP_MCP_LIMIT_TICKS);
+        return st->delay ? NGX_AGAIN : NGX_OK;
+    }
+    st->remaining = (ngx_uint_t)((tau - ahead) / t);
+    return NGX_OK;
+}
+
+// 令牌回退/补扣: 调整 tat, 补扣可能使后续请求等待更久
+static void
+ngx_http_mcp_limit_adjust(ngx_http_mcp_method_limit_t *ml, ngx_http_mcp_limit_cell_t *cell,
+                          ngx_atomic_int_t units) {
+    ngx_atomic_int_t t = (ngx_atomic_int_t)(ml->interval * NGX_HTTP_MCP_LIMIT_TICKS / ml->rate_limit);
+    ngx_atomic_fetch_add(&cell->tat, (t ? t : 1) * units);
+}
+
+// 长周期配额: 在互斥锁内完成查找, 周期切换和扣减
+static ngx_int_t
+ngx_http_mcp_quota_take(ngx_http_mcp_method_limit_t *ml, uint64_t key, ngx_uint_t cost,
+                        ngx_http_mcp_limit_state_t *st, ngx_http_mcp_quota_entry_t **out) {
+    auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(ml->shm_zone->data);
+    auto *sh = static_cast<ngx_http_mcp_quota_shctx_t*>(ctx->sh);
+    time_t now = ngx_time();
+    uint64_t expire = (uint64_t)(now / ml->period + 1) * ml->period;
+    ngx_int_t rc = NGX_OK;
+
+    st->rule = ml;
+    st->limit = ml->rate_limit;
+    st->delay = 0;
+    st->retry_after = 0;
+    st->reset = (ngx_msec_t)((expire - now) * 1000);
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_http_mcp_quota_entry_t *e = ngx_http_mcp_quota_lookup_locked(sh, key, now);
+    if (e == NULL) {
+        ngx_shmtx_unlock(&ctx->shpool->mutex);
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "mcp quota zone \"%V\" is full", &ml->shm_zone->shm.name);
+        *out = NULL;
+        st->remaining = ml->rate_limit;
+        return NGX_OK;
+    }
+    if (e->expire != expire) {
+        e->expire = expire;
+        e->used = 0;
+    }
+    if (e->used + cost > ml->rate_limit) {
+        sh->rejected++;
+        st->retry_after = st->reset;
+        rc = NGX_BUSY;
+    } else {
+        e->used += cost;
+    }
+    st->remaining = (e->used < ml->rate_limit) ? (ngx_uint_t)(ml->rate_limit - e->used) : 0;
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    *out = e;
+    return rc;
+}
+
+static void
+ngx_http_mcp_quota_adjust(ngx_http_mcp_method_limit_t *ml, ngx_http_mcp_quota_entry_t *e,
+                          ngx_atomic_int_t units) {
+    auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(ml->shm_zone->data);
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    if (units < 0 && e->used < (uint64_t)-units) {
+        e->used = 0;
+    } else {
+        e->used += units;
+    }
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+}
+
+static void
+ngx_http_mcp_charge_adjust(ngx_http_mcp_limit_charge_t *c, ngx_atomic_int_t units) {
+    if (c->rule->period) {
+        ngx_http_mcp_quota_adjust(c->rule, (ngx_http_mcp_quota_entry_t*)c->slot, units);
+    } else {
+        ngx_http_mcp_limit_adjust(c->rule, (ngx_http_mcp_limit_cell_t*)c->slot, units);
+    }
+}
+
+// 依次判定所有匹配的规则; 任一拒绝则回退已扣减的额度。
+// st 返回最严格的一条规则状态, 排队延迟取最大值
+ngx_int_t
+ngx_http_mcp_limit_check(ngx_http_request_t *r, ngx_http_mcp_loc_conf_t *conf,
+                         ngx_http_mcp_limit_input_t *in, ngx_http_mcp_limit_state_t *st,
+                         ngx_array_t **charges) {
+    ngx_http_mcp_limit_state_t cur;
+    ngx_int_t                  rc = NGX_OK;
+
+    ngx_memzero(st, sizeof(*st));
+    *charges = NULL;
+    if (!conf || !conf->methods) return NGX_OK;
+
+    ngx_http_mcp_method_limit_t *arr = (ngx_http_mcp_method_limit_t*)conf->methods->elts;
+    ngx_atomic_uint_t now = (ngx_atomic_uint_t)ngx_current_msec * NGX_HTTP_MCP_LIMIT_TICKS;
+
+    for (ngx_uint_t i = 0; i < conf->methods->nelts; ++i) {
+        ngx_http_mcp_method_limit_t *ml = &arr[i];
+        bool wildcard = (ml->method.len == 1 && ml->method.data[0] == '*');
+        if (!wildcard && (ml->method.len != in->method.len
+                          || ngx_strncmp(ml->method.data, in->method.data, in->method.len) != 0)) {
+            continue;
+        }
+        if (ml->rate_limit == 0) continue;
+
+        uint64_t key = ngx_http_mcp_limit_request_key(r, conf, ml, in);
+        ngx_uint_t cost = ngx_http_mcp_limit_cost(ml, in->body_bytes);
+        void *slot;
+        ngx_int_t one;
+
+        if (ml->period) {
+            ngx_http_mcp_quota_entry_t *e;
+            one = ngx_http_mcp_quota_take(ml, key, cost, &cur, &e);
+            slot = e;
+        } else {
+            auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(ml->shm_zone->data);
+            ngx_http_mcp_limit_cell_t *cell =
+                ngx_http_mcp_limit_cell((ngx_http_mcp_limit_shctx_t*)ctx->sh, key, now);
+            if (cell == NULL) {
+                // 表满时放行, 避免共享内存不足导致整体不可用
+                ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                              "mcp limit zone \"%V\" is full", &ml->shm_zone->shm.name);
+                continue;
+            }
+            one = ngx_http_mcp_limit_take(ml, cell, cost, &cur);
+            slot = cell;
+        }
+
+        ngx_msec_t delay = ngx_max(st->delay, cur.delay);
+        if (st->rule == NULL || one == NGX_BUSY || cur.remaining < st->remaining) {
+            *st = cur;
+        }
+        st->delay = delay;
+
+        if (one == NGX_BUSY) {
+            rc = NGX_BUSY;
+            break;
+        }
+        if (slot == NULL) continue;
+        if (one == NGX_AGAIN) rc = NGX_AGAIN;
+
+        if (*charges == NULL) {
+            *charges = ngx_array_create(r->pool, 2, sizeof(ngx_http_mcp_limit_charge_t));
+            if (*charges == NULL) return NGX_ERROR;
+        }
+        ngx_http_mcp_limit_charge_t *c = (ngx_http_mcp_limit_charge_t*)ngx_array_push(*charges);
+        if (c == NULL) return NGX_ERROR;
+        c->rule = ml;
+        c->slot = slot;
+    }
+
+    if (rc == NGX_BUSY && *charges) {
+        ngx_http_mcp_limit_charge_t *c = (ngx_http_mcp_limit_charge_t*)(*charges)->elts;
+        for (ngx_uint_t i = 0; i < (*charges)->nelts; ++i) {
+            ngx_http_mcp_charge_adjust(&c[i], -(ngx_atomic_int_t)ngx_http_mcp_limit_cost(c[i].rule, in->body_bytes));
+        }
+        *charges = NULL;
+    }
+    if (rc != NGX_AGAIN) {
+        st->delay = 0;
+    }
+    return rc;
+}
+
+// 响应生成后按响应字节补扣, 大结果的工具相应消耗更多额度
+void
+ngx_http_mcp_limit_charge_response(ngx_array_t *charges, size_t resp_bytes) {
+    if (charges == NULL || resp_bytes == 0) return;
+    ngx_http_mcp_limit_charge_t *c = (ngx_http_mcp_limit_charge_t*)charges->elts;
+    for (ngx_uint_t i = 0; i < charges->nelts; ++i) {
+        if (c[i].rule->resp_bytes == 0) continue;
+        ngx_atomic_int_t units = (ngx_atomic_int_t)(resp_bytes / c[i].rule->resp_bytes);
+        if (units > 0) {
+            ngx_http_mcp_charge_adjust(&c[i], units);
+        }
+    }
+}
+
+static ngx_int_t
+ngx_http_mcp_limit_push_header(ngx_http_request_t *r, const char *key, size_t key_len, ngx_uint_t value) {
+    ngx_table_elt_t *h = (ngx_table_elt_t*)ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) return NGX_ERROR;
+
+    u_char *p = (u_char*)ngx_pnalloc(r->pool, NGX_INT_T_LEN);
+    if (p == NULL) return NGX_ERROR;
+
+    h->hash = 1;
+#if (nginx_version >= 1023000)
+    h->next = NULL;
+#endif
+    h->key.len = key_len;
+    h->key.data = (u_char*)key;
+    h->value.data = p;
+    h->value.len = ngx_sprintf(p, "%ui", value) - p;
+    return NGX_OK;
+}
+
+#define ngx_http_mcp_limit_header(r, key, value) \
+    ngx_http_mcp_limit_push_header(r, key, sizeof(key) - 1, value)
+
+// RateLimit-* 响应头(秒为单位向上取整), 拒绝时附带 Retry-After
+ngx_int_t
+ngx_http_mcp_limit_set_headers(ngx_http_request_t *r, ngx_http_mcp_limit_state_t *st) {
+    if (st == NULL || st->rule == NULL) return NGX_OK;
+
+    if (ngx_http_mcp_limit_header(r, "RateLimit-Limit", st->limit) != NGX_OK
+        || ngx_http_mcp_limit_header(r, "RateLimit-Remaining", st->remaining) != NGX_OK
+        || ngx_http_mcp_limit_header(r, "RateLimit-Reset", (st->reset + 999) / 1000) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+    if (st->retry_after) {
+        ngx_uint_t sec = (st->retry_after + 999) / 1000;
+        if (ngx_http_mcp_limit_header(r, "Retry-After", sec ? sec : 1) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+    return NGX_OK;
+}
+
+// 过载拒绝等非限流场景的 Retry-After(秒, 向上取整, 至少 1)
+ngx_int_t
+ngx_http_mcp_set_retry_after(ngx_http_request_t *r, ngx_msec_t ms) {
+    ngx_uint_t sec = (ms + 999) / 1000;
+    return ngx_http_mcp_limit_header(r, "Retry-After", sec ? sec : 1);
+}
+
+// 将配额表写入临时文件后原子替换快照
+static void
+ngx_http_mcp_quota_snapshot(ngx_shm_zone_t *shm_zone, ngx_log_t *log) {
+    auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(shm_zone->data);
+    auto *sh = static_cast<ngx_http_mcp_quota_shctx_t*>(ctx->sh);
+    if (sh == NULL || ctx->snapshot.len == 0) return;
+
+    size_t cap = (sh->mask + 1) * sizeof(ngx_http_mcp_quota_entry_t);
+    auto *copy = (ngx_http_mcp_quota_entry_t*)ngx_alloc(cap, log);
+    if (copy == NULL) return;
+
+    // 持锁期间只做内存拷贝, 磁盘 IO 放到锁外
+    time_t now = ngx_time();
+    uint32_t n = 0;
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    for (ngx_uint_t i = 0; i <= sh->mask; ++i) {
+        if (sh->entries[i].key && sh->entries[i].expire > (uint64_t)now) {
+            copy[n++] = sh->entries[i];
+        }
+    }
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    u_char *tmp = (u_char*)ngx_alloc(ctx->snapshot.len + sizeof(".tmp"), log);
+    if (tmp == NULL) {
+        ngx_free(copy);
+        return;
+    }
+    ngx_sprintf(tmp, "%V.tmp%Z", &ctx->snapshot);
+
+    ngx_fd_t fd = ngx_open_file(tmp, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE, NGX_FILE_DEFAULT_ACCESS);
+    if (fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_ERR, log, ngx_errno, "mcp quota snapshot open \"%s\" failed", tmp);
+        ngx_free(copy);
+        ngx_free(tmp);
+        return;
+    }
+
+    ngx_http_mcp_quota_file_header_t hdr = { NGX_HTTP_MCP_QUOTA_MAGIC, n };
+    size_t body = n * sizeof(ngx_http_mcp_quota_entry_t);
+    bool ok = ngx_write_fd(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr)
+              && (body == 0 || ngx_write_fd(fd, copy, body) == (ssize_t)body);
+    ngx_close_file(fd);
+    ngx_free(copy);
+
+    if (!ok || ngx_rename_file(tmp, ctx->snapshot.data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ERR, log, ngx_errno, "mcp quota snapshot \"%V\" failed", &ctx->snapshot);
+        ngx_delete_file(tmp);
+    }
+    ngx_free(tmp);
+}
+
+static void
+ngx_http_mcp_quota_snapshot_handler(ngx_event_t *ev) {
+    auto *shm_zone = static_cast<ngx_shm_zone_t*>(ev->data);
+    auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(shm_zone->data);
+
+    ngx_http_mcp_quota_snapshot(shm_zone, ev->log);
+    if (!ngx_exiting) {
+        ngx_add_timer(ev, ctx->snapshot_interval);
+    }
+}
+
+// 仅由 0 号 worker 定期写快照, 避免多进程同时写同一文件
+ngx_int_t
+ngx_http_mcp_limit_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+    if (ngx_worker != 0) return NGX_OK;
+
+    ngx_shm_zone_t **zp = (ngx_shm_zone_t**)mcf->quota_zones->elts;
+    for (ngx_uint_t i = 0; i < mcf->quota_zones->nelts; ++i) {
+        auto *ctx = static_cast<ngx_http_mcp_limit_zone_ctx_t*>(zp[i]->data);
+        if (ctx->snapshot.len == 0) continue;
+
+        ngx_event_t *ev = (ngx_event_t*)ngx_pcalloc(cycle->pool, sizeof(ngx_event_t));
+        if (ev == NULL) return NGX_ERROR;
+        ev->handler = ngx_http_mcp_quota_snapshot_handler;
+        ev->data = zp[i];
+        ev->log = cycle->log;
+        ev->cancelable = 1;
+        ngx_add_timer(ev, ctx->snapshot_interval);
+    }
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_limit_exit_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (ngx_worker != 0) return;
+    ngx_shm_zone_t **zp = (ngx_shm_zone_t**)mcf->quota_zones->elts;
+    for (ngx_uint_t i = 0; i < mcf->quota_zones->nelts; ++i) {
+        ngx_http_mcp_quota_snapshot(zp[i], cycle->log);
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,258 @@
+#include <new>
+#include "ngx_http_mcp_module.h"
+
+// 独立的 GET 事件流(服务端主动推送的通知): 每个连接只持有一个 listener 和流对象,
+// 不分配线程任务与请求体解析器, 写缓冲发送完即释放; 心跳由每个 worker 的一个定时器
+// 按加入顺序轮询发送, 写出均为非阻塞, 积压超过 mcp_sse_max_pending 即断开。
+// 携带 Last-Event-ID 重连时先从事件存储补发其后的事件。
+// GET 请求的模块上下文为 ngx_http_mcp_listener_t。
+
+static const char kSseHeartbeat[] = ": ping\n\n";
+
+typedef struct {
+    ngx_queue_t        queue;          // 心跳队列, 按 next 有序
+    ngx_msec_t         next;           // 下次心跳时间
+    unsigned           linked:1;
+    unsigned           stalled:1;      // 上次心跳时仍有数据未写出
+    ngx_buf_t          ping;
+    std::shared_ptr<ngx_http_mcp_stream_t> stream;
+} ngx_http_mcp_listener_t;
+
+// 以下仅在事件循环线程访问
+static ngx_queue_t     ngx_http_mcp_listeners;
+static ngx_event_t     ngx_http_mcp_heartbeat_ev;
+static ngx_msec_t      ngx_http_mcp_heartbeat;
+static size_t          ngx_http_mcp_max_pending;
+
+extern "C" {
+
+static void
+ngx_http_mcp_listen_unlink(ngx_http_mcp_listener_t *l) {
+    if (l->linked) {
+        ngx_queue_remove(&l->queue);
+        l->linked = 0;
+    }
+}
+
+static void
+ngx_http_mcp_listen_link(ngx_http_mcp_listener_t *l) {
+    l->next = ngx_current_msec + ngx_http_mcp_heartbeat;
+    ngx_queue_insert_tail(&ngx_http_mcp_listeners, &l->queue);
+    l->linked = 1;
+}
+
+// 结束 GET 流; rc 为 NGX_OK 时先发送结束块
+static void
+ngx_http_mcp_listen_finish(ngx_http_request_t *r, ngx_http_mcp_listener_t *l, ngx_int_t rc) {
+    l->stream->on_close = nullptr;
+    l->stream->closed = true;
+    ngx_http_mcp_listen_unlink(l);
+
+    if (rc == NGX_OK && !r->connection->error) {
+        rc = ngx_http_send_special(r, NGX_HTTP_LAST);
+    }
+    ngx_http_finalize_request(r, rc);
+}
+
+// 流被关闭(会话结束, 积压溢出或写出失败)时由 ngx_http_mcp_sse_flush 调用
+static void
+ngx_http_mcp_listen_close(ngx_http_mcp_stream_t *s) {
+    ngx_http_request_t *r = s->r;
+    auto *l = static_cast<ngx_http_mcp_listener_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    ngx_http_mcp_listen_finish(r, l, NGX_OK);
+}
+
+static void
+ngx_http_mcp_listen_cleanup(void *data) {
+    auto *l = static_cast<ngx_http_mcp_listener_t*>(data);
+    ngx_http_mcp_listen_unlink(l);
+    if (l->stream) {
+        l->stream->on_close = nullptr;
+        l->stream->closed = true;
+        l->stream->r = nullptr;
+        if (!l->stream->session.empty()) ngx_http_mcp_sink_remove(l->stream->session, l->stream.get());
+    }
+    l->~ngx_http_mcp_listener_t();
+}
+
+static void
+ngx_http_mcp_listen_write_handler(ngx_http_request_t *r) {
+    auto *l = static_cast<ngx_http_mcp_listener_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    std::shared_ptr<ngx_http_mcp_stream_t> s = l->stream;   // flush 中请求可能结束
+
+    if (ngx_http_output_filter(r, NULL) == NGX_ERROR) {
+        ngx_http_mcp_listen_finish(r, l, NGX_ERROR);
+        return;
+    }
+    if (r->out == NULL) {
+        // 上一批已写完: 释放写缓冲, 发送写阻塞期间积压的消息
+        ngx_free(s->buf.start);
+        ngx_memzero(&s->buf, sizeof(ngx_buf_t));
+        ngx_http_mcp_sse_flush(s.get());
+        if (s->r == nullptr || s->closed) return;
+    }
+    if (ngx_handle_write_event(r->connection->write, 0) != NGX_OK) {
+        ngx_http_mcp_listen_finish(r, l, NGX_ERROR);
+    }
+}
+
+static ngx_int_t
+ngx_http_mcp_listen_ping(ngx_http_request_t *r, ngx_http_mcp_listener_t *l) {
+    l->ping.pos = (u_char*)kSseHeartbeat;
+    l->ping.last = l->ping.pos + sizeof(kSseHeartbeat) - 1;
+    l->ping.memory = 1;
+    l->ping.flush = 1;
+
+    ngx_chain_t out;
+    out.buf = &l->ping;
+    out.next = NULL;
+    return ngx_http_output_filter(r, &out);
+}
+
+// 只处理到期的 listener; 一个心跳周期内都没能写出的连接视为对端已停止读取
+static void
+ngx_http_mcp_heartbeat_handler(ngx_event_t *ev) {
+    while (!ngx_queue_empty(&ngx_http_mcp_listeners)) {
+        ngx_queue_t *q = ngx_queue_head(&ngx_http_mcp_listeners);
+        auto *l = ngx_queue_data(q, ngx_http_mcp_listener_t, queue);
+        if (!ngx_exiting && (ngx_msec_int_t)(l->next - ngx_current_msec) > 0) break;
+
+        ngx_http_mcp_listen_unlink(l);
+        ngx_http_request_t *r = l->stream->r;
+
+        if (ngx_exiting) {
+            ngx_http_mcp_listen_finish(r, l, NGX_OK);
+            continue;
+        }
+        if (r->out) {
+            if (l->stalled) {
+                ngx_log_error(NGX_LOG_INFO, r->connection->log, 0, "mcp event stream stalled, closing");
+                ngx_http_mcp_listen_finish(r, l, NGX_ERROR);
+                continue;
+            }
+            l->stalled = 1;
+        } else {
+            l->stalled = 0;
+            if (ngx_http_mcp_listen_ping(r, l) == NGX_ERROR) {
+                ngx_http_mcp_listen_finish(r, l, NGX_ERROR);
+                continue;
+            }
+        }
+        ngx_http_mcp_listen_link(l);
+    }
+
+    if (!ngx_queue_empty(&ngx_http_mcp_listeners)) {
+        auto *l = ngx_queue_data(ngx_queue_head(&ngx_http_mcp_listeners), ngx_http_mcp_listener_t, queue);
+        ngx_msec_t delay = l->next - ngx_current_msec;
+        ngx_add_timer(ev, ngx_max(delay, ngx_min(ngx_http_mcp_heartbeat, 1000)));
+    }
+}
+
+// GET: 为会话打开事件流, 之后的资源更新等通知经 ngx_http_mcp_sink_add 登记的流推送
+ngx_int_t
+ngx_http_mcp_listen(ngx_http_request_t *r) {
+    // 没有会话就无从投递, 按协议以 405 表示不提供 GET 事件流
+    if (!ngx_http_mcp_session_enabled(r) || ngx_exiting) return NGX_HTTP_NOT_ALLOWED;
+
+    ngx_table_elt_t *accept = ngx_http_mcp_get_header(r, (u_char*)"Accept", sizeof("Accept") - 1);
+    if (accept == NULL
+        || ngx_strlcasestrn(accept->value.data, accept->value.data + accept->value.len,
+                            (u_char*)"text/event-stream", sizeof("text/event-stream") - 2) == NULL)
+    {
+        return NGX_HTTP_NOT_ACCEPTABLE;
+    }
+
+    ngx_table_elt_t *sid = ngx_http_mcp_get_header(r, (u_char*)"Mcp-Session-Id", sizeof("Mcp-Session-Id") - 1);
+    if (sid == NULL) return NGX_HTTP_BAD_REQUEST;
+
+    ngx_http_mcp_session_info_t info;
+    if (ngx_http_mcp_session_find(r, &sid->value, &info) != NGX_OK) {
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                      "mcp unknown or expired session: %V", &sid->value);
+        return NGX_HTTP_NOT_FOUND;
+    }
+
+    ngx_int_t rc = ngx_http_discard_request_body(r);
+    if (rc != NGX_OK) return rc;
+
+    void *p = ngx_palloc(r->pool, sizeof(ngx_http_mcp_listener_t));
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (p == NULL || cln == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    auto *l = new (p) ngx_http_mcp_listener_t();
+    cln->handler = ngx_http_mcp_listen_cleanup;
+    cln->data = l;
+    ngx_http_set_ctx(r, l, ngx_http_mcp_module);
+
+    try {
+        l->stream = std::make_shared<ngx_http_mcp_stream_t>();
+    } catch (const std::bad_alloc &) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    l->stream->r = r;
+    l->stream->persistent = true;
+    l->stream->limit = ngx_http_mcp_max_pending;
+    l->stream->on_close = ngx_http_mcp_listen_close;
+    try {
+        l->stream->session.assign((const char*)sid->value.data, sid->value.len);
+    } catch (const std::bad_alloc &) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    if (ngx_http_mcp_session_set_header(r, &sid->value) != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    rc = ngx_http_mcp_sse_send_header(r);
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    // 补发与登记出口在同一轮事件循环中完成, 之间不会漏掉本 worker 的新事件
+    ngx_table_elt_t *last = ngx_http_mcp_get_header(r, (u_char*)"Last-Event-ID", sizeof("Last-Event-ID") - 1);
+    if (last) {
+        off_t id = ngx_atoof(last->value.data, last->value.len);
+        ngx_chain_t *out = NULL;
+        rc = (id == NGX_ERROR) ? NGX_DECLINED : ngx_http_mcp_events_replay(r, &sid->value, (uint64_t)id, &out);
+        if (rc == NGX_ERROR) return NGX_ERROR;
+        if (rc == NGX_DECLINED) {
+            ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                          "mcp event stream cannot fully resume from \"%V\"", &last->value);
+        }
+        if (out && ngx_http_output_filter(r, out) == NGX_ERROR) return NGX_ERROR;
+    }
+
+    try {
+        ngx_http_mcp_sink_add(std::string((const char*)sid->value.data, sid->value.len), l->stream);
+    } catch (const std::bad_alloc &) {
+        return NGX_ERROR;
+    }
+
+    r->read_event_handler = ngx_http_test_reading;   // 对端关闭时结束请求
+    r->write_event_handler = ngx_http_mcp_listen_write_handler;
+
+    ngx_http_mcp_listen_link(l);
+    if (!ngx_http_mcp_heartbeat_ev.timer_set) {
+        ngx_add_timer(&ngx_http_mcp_heartbeat_ev, ngx_http_mcp_heartbeat);
+    }
+
+    r->main->count++;
+    return NGX_DONE;
+}
+
+// 心跳定时器只在有 listener 时存在, 且不可取消: 平滑退出时由它关闭剩余的流
+ngx_int_t
+ngx_http_mcp_listen_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    ngx_queue_init(&ngx_http_mcp_listeners);
+    ngx_http_mcp_heartbeat = mcf->sse_heartbeat;
+    ngx_http_mcp_max_pending = mcf->sse_max_pending;
+    ngx_http_mcp_heartbeat_ev.handler = ngx_http_mcp_heartbeat_handler;
+    ngx_http_mcp_heartbeat_ev.log = cycle->log;
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_listen_exit_process(ngx_cycle_t *cycle) {
+    ngx_queue_init(&ngx_http_mcp_listeners);
+}
+
+} // extern "C"
@@ -0,0 +1,690 @@
+#include <time.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ngx_http_mcp_module.h"
+
+// 指标: 每个 worker 在共享内存中有自己的槽, 按 (方法, 工具) 记录请求数、错误数、限流拒绝数、
+// 处理线程 CPU 时间, 以及读取请求体、解析、线程池排队、处理、序列化耗时与响应字节的 HDR 直方图;
+// 写入只做原子加, 不加锁。mcp_status 抓取时汇总所有槽, 同名的键合并后以 Prometheus 文本格式输出,
+// 直方图合并后再算分位数(summary), 另附会话、事件存储、缓存、调度器与执行器的统计。
+
+#define NGX_HTTP_MCP_METRICS_ZONE_NAME  "mcp_metrics"
+
+// 槽数上限, worker 编号超出的不记录
+#define NGX_HTTP_MCP_METRICS_WORKERS    256
+
+// HDR 直方图: 每个 2 的幂区间再分 8 个子桶, 相对误差不超过 1/8; 值截断到 2^32 - 1
+#define NGX_HTTP_MCP_METRICS_SUB_BITS   3
+#define NGX_HTTP_MCP_METRICS_BUCKETS    240
+#define NGX_HTTP_MCP_METRICS_MAX        0xffffffffULL
+
+// 键名截断长度
+#define NGX_HTTP_MCP_METRICS_METHOD_LEN 47
+#define NGX_HTTP_MCP_METRICS_TOOL_LEN   63
+
+typedef struct {
+    ngx_atomic_t  count;
+    ngx_atomic_t  sum;
+    ngx_atomic_t  buckets[NGX_HTTP_MCP_METRICS_BUCKETS];
+} ngx_http_mcp_metrics_hist_t;
+
+typedef struct {
+    ngx_atomic_t                 ready;          // 名字写完后置 1, 汇总时跳过未就绪的键
+    u_char                       method_len;
+    u_char                       tool_len;
+    u_char                       method[NGX_HTTP_MCP_METRICS_METHOD_LEN];
+    u_char                       tool[NGX_HTTP_MCP_METRICS_TOOL_LEN];
+    ngx_atomic_t                 requests;
+    ngx_atomic_t                 errors;
+    ngx_atomic_t                 rate_limited;
+    ngx_atomic_t                 cpu_usec;
+    ngx_http_mcp_metrics_hist_t  hist[NGX_HTTP_MCP_METRICS];
+} ngx_http_mcp_metrics_key_t;
+
+// reload 后新旧 worker 可能共用同一编号的槽: 计数都是原子加, 键可能重复, 汇总时按名字合并
+typedef struct {
+    ngx_atomic_t                 nkeys;          // 已分配的键数, 表满后可能超过 keys
+    ngx_atomic_t                 dropped;        // 表满未能记录的请求数
+    ngx_http_mcp_metrics_key_t   keys[1];
+} ngx_http_mcp_metrics_slot_t;
+
+typedef struct {
+    ngx_http_mcp_metrics_slot_t *slots[NGX_HTTP_MCP_METRICS_WORKERS];  // worker 启动时分配
+} ngx_http_mcp_metrics_shctx_t;
+
+typedef struct {
+    ngx_http_mcp_metrics_shctx_t *sh;
+    ngx_slab_pool_t              *shpool;
+    ngx_uint_t                    keys;          // 每个槽的键数
+} ngx_http_mcp_metrics_zone_ctx_t;
+
+// 抓取时的汇总结果
+typedef struct {
+    uint64_t  count;
+    uint64_t  sum;
+    uint64_t  buckets[NGX_HTTP_MCP_METRICS_BUCKETS];
+} ngx_http_mcp_metrics_merged_hist_t;
+
+typedef struct {
+    uint64_t                            requests;
+    uint64_t                            errors;
+    uint64_t                            rate_limited;
+    uint64_t                            cpu_usec;
+    ngx_http_mcp_metrics_merged_hist_t  hist[NGX_HTTP_MCP_METRICS];
+} ngx_http_mcp_metrics_merged_t;
+
+typedef std::map<std::pair<std::string, std::string>, ngx_http_mcp_metrics_merged_t>  ngx_http_mcp_metrics_view_t;
+
+// 以下仅在事件循环线程访问
+static ngx_http_mcp_metrics_slot_t                                          *ngx_http_mcp_metrics_slot;
+static ngx_uint_t                                                            ngx_http_mcp_metrics_keys;
+static std::unordered_map<std::string, ngx_http_mcp_metrics_key_t*>          ngx_http_mcp_metrics_index;
+
+// 各直方图的指标名与单位换算(微秒输出为秒)
+static const struct {
+    const char *name;
+    const char *help;
+    double      scale;
+} ngx_http_mcp_metrics_hists[NGX_HTTP_MCP_METRICS] = {
+    { "mcp_body_read_seconds",  "Time spent receiving the request body, excluding parsing.", 1e-6 },
+    { "mcp_parse_seconds",      "Time spent parsing the request body and building the request.", 1e-6 },
+    { "mcp_queue_wait_seconds", "Time from posting to a thread pool until the handler starts.", 1e-6 },
+    { "mcp_handler_seconds",    "Time spent in the method handler.", 1e-6 },
+    { "mcp_serialize_seconds",  "Time spent serializing the JSON-RPC response.", 1e-6 },
+    { "mcp_response_bytes",     "Response body size in bytes.", 1 },
+};
+
+static const double ngx_http_mcp_metrics_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static const char *ngx_http_mcp_metrics_prio_names[NGX_HTTP_MCP_PRIO_CLASSES] = { "high", "normal", "low" };
+
+static ngx_uint_t
+ngx_http_mcp_metrics_bucket(uint64_t v) {
+    if (v > NGX_HTTP_MCP_METRICS_MAX) v = NGX_HTTP_MCP_METRICS_MAX;
+    if (v < (2ULL << NGX_HTTP_MCP_METRICS_SUB_BITS)) return (ngx_uint_t)v;
+    ngx_uint_t shift = 63 - __builtin_clzll(v) - NGX_HTTP_MCP_METRICS_SUB_BITS;
+    return (shift << NGX_HTTP_MCP_METRICS_SUB_BITS) + (ngx_uint_t)(v >> shift);
+}
+
+// 桶的代表值(区间中点)
+static double
+ngx_http_mcp_metrics_bucket_value(ngx_uint_t i) {
+    if (i < (2U << NGX_HTTP_MCP_METRICS_SUB_BITS)) return (double)i;
+    ngx_uint_t shift = (i >> NGX_HTTP_MCP_METRICS_SUB_BITS) - 1;
+    uint64_t top = i - (shift << NGX_HTTP_MCP_METRICS_SUB_BITS);
+    return ((double)(top << shift) + (double)(((top + 1) << shift) - 1)) / 2;
+}
+
+static ngx_int_t
+ngx_http_mcp_metrics_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    auto *octx = static_cast<ngx_http_mcp_metrics_zone_ctx_t*>(data);
+    auto *ctx  = static_cast<ngx_http_mcp_metrics_zone_ctx_t*>(shm_zone->data);
+
+    if (octx) {
+        // reload: 槽的布局不变时沿用, 计数跨 reload 累计
+        if (octx->keys != ctx->keys) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "mcp metrics zone layout changed, restart is required");
+            return NGX_ERROR;
+        }
+        ctx->sh = octx->sh;
+        ctx->shpool = octx->shpool;
+        return NGX_OK;
+    }
+
+    ctx->shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        ctx->sh = (ngx_http_mcp_metrics_shctx_t*)ctx->shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_metrics_shctx_t*)ngx_slab_calloc(ctx->shpool, sizeof(ngx_http_mcp_metrics_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    ctx->sh = sh;
+    ctx->shpool->data = sh;
+    return NGX_OK;
+}
+
+static ngx_str_t  ngx_http_mcp_metrics_unknown = ngx_string("unknown");
+
+// 本 worker 槽中的键; 首次出现时分配, 表满时返回 NULL。
+// 方法与工具名来自客户端, 只有已知方法与已注册的工具单独成键, 其余计入 "unknown",
+// 避免任意名称占满键表或撑大指标输出; 已建键的名称只查索引, 不再检查
+static ngx_http_mcp_metrics_key_t *
+ngx_http_mcp_metrics_key(ngx_str_t *method, ngx_str_t *tool, bool checked = false) {
+    size_t mlen = ngx_min(method->len, (size_t)NGX_HTTP_MCP_METRICS_METHOD_LEN);
+    size_t tlen = ngx_min(tool->len, (size_t)NGX_HTTP_MCP_METRICS_TOOL_LEN);
+    std::string name((const char*)method->data, mlen);
+    name += '\0';
+    name.append((const char*)tool->data, tlen);
+
+    auto it = ngx_http_mcp_metrics_index.find(name);
+    if (it != ngx_http_mcp_metrics_index.end()) return it->second;
+
+    if (!checked) {
+        if (!mcp::server::McpServer::is_known_method(std::string((const char*)method->data, method->len))) {
+            ngx_str_t none = ngx_null_string;
+            return ngx_http_mcp_metrics_key(&ngx_http_mcp_metrics_unknown, &none, true);
+        }
+        if (tool->len
+            && (tlen != tool->len
+                || mcp::server::ToolRegistry::instance().snapshot()->index(
+                       std::string_view((const char*)tool->data, tool->len)) < 0))
+        {
+            return ngx_http_mcp_metrics_key(method, &ngx_http_mcp_metrics_unknown, true);
+        }
+    }
+
+    ngx_http_mcp_metrics_slot_t *slot = ngx_http_mcp_metrics_slot;
+    ngx_atomic_uint_t i = ngx_atomic_fetch_add(&slot->nkeys, 1);
+    if (i >= ngx_http_mcp_metrics_keys) return NULL;
+
+    ngx_http_mcp_metrics_key_t *k = &slot->keys[i];
+    k->method_len = (u_char)mlen;
+    k->tool_len = (u_char)tlen;
+    ngx_memcpy(k->method, method->data, mlen);
+    ngx_memcpy(k->tool, tool->data, tlen);
+    ngx_memory_barrier();
+    k->ready = 1;
+    ngx_http_mcp_metrics_index.emplace(std::move(name), k);
+    return k;
+}
+
+static void
+ngx_http_mcp_metrics_merge(ngx_http_mcp_metrics_view_t &view, ngx_uint_t *dropped) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(ngx_cycle, ngx_http_mcp_module);
+    *dropped = 0;
+    if (mcf == NULL || mcf->metrics_zone == NULL) return;
+    auto *ctx = static_cast<ngx_http_mcp_metrics_zone_ctx_t*>(mcf->metrics_zone->data);
+    if (ctx->sh == NULL) return;
+
+    for (ngx_uint_t w = 0; w < NGX_HTTP_MCP_METRICS_WORKERS; ++w) {
+        ngx_http_mcp_metrics_slot_t *slot = ctx->sh->slots[w];
+        if (slot == NULL) continue;
+        *dropped += slot->dropped;
+        ngx_uint_t n = ngx_min((ngx_uint_t)slot->nkeys, ctx->keys);
+        for (ngx_uint_t i = 0; i < n; ++i) {
+            ngx_http_mcp_metrics_key_t *k = &slot->keys[i];
+            if (!k->ready) continue;
+            ngx_http_mcp_metrics_merged_t &m = view[std::make_pair(
+                std::string((const char*)k->method, k->method_len),
+                std::string((const char*)k->tool, k->tool_len))];
+            m.requests += k->requests;
+            m.errors += k->errors;
+            m.rate_limited += k->rate_limited;
+            m.cpu_usec += k->cpu_usec;
+            for (ngx_uint_t h = 0; h < NGX_HTTP_MCP_METRICS; ++h) {
+                m.hist[h].count += k->hist[h].count;
+                m.hist[h].sum += k->hist[h].sum;
+                for (ngx_uint_t b = 0; b < NGX_HTTP_MCP_METRICS_BUCKETS; ++b) {
+                    m.hist[h].buckets[b] += k->hist[h].buckets[b];
+                }
+            }
+        }
+    }
+}
+
+// 标签值转义: 反斜杠、双引号与换行
+static void
+ngx_http_mcp_status_escape(std::string &out, const std::string &v) {
+    for (char ch : v) {
+        if (ch == '\\') out += "\\\\";
+        else if (ch == '"') out += "\\\"";
+        else if (ch == '\n') out += "\\n";
+        else out += ch;
+    }
+}
+
+static void
+ngx_http_mcp_status_labels(std::string &out, const std::pair<std::string, std::string> &key) {
+    out += "{method=\"";
+    ngx_http_mcp_status_escape(out, key.first);
+    out += "\",tool=\"";
+    ngx_http_mcp_status_escape(out, key.second);
+    out += '"';
+}
+
+static void
+ngx_http_mcp_status_head(std::string &out, const char *name, const char *type, const char *help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+static void
+ngx_http_mcp_status_number(std::string &out, double v) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%.17g", v);
+    out.append(buf, n > 0 ? (size_t)n : 0);
+}
+
+// 无标签或单个标签的一行
+static void
+ngx_http_mcp_status_value(std::string &out, const char *name, const char *label, const char *value, double v) {
+    out += name;
+    if (label) {
+        out += '{';
+        out += label;
+        out += "=\"";
+        ngx_http_mcp_status_escape(out, value);
+        out += "\"}";
+    }
+    out += ' ';
+    ngx_http_mcp_status_number(out, v);
+    out += '\n';
+}
+
+// 合并后的 HDR 直方图求分位数
+static double
+ngx_http_mcp_status_quantile(const ngx_http_mcp_metrics_merged_hist_t &h, double q) {
+    uint64_t total = 0;
+    for (ngx_uint_t b = 0; b < NGX_HTTP_MCP_METRICS_BUCKETS; ++b) total += h.buckets[b];
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (ngx_uint_t b = 0; b < NGX_HTTP_MCP_METRICS_BUCKETS; ++b) {
+        seen += h.buckets[b];
+        if (seen >= rank) return ngx_http_mcp_metrics_bucket_value(b);
+    }
+    return ngx_http_mcp_metrics_bucket_value(NGX_HTTP_MCP_METRICS_BUCKETS - 1);
+}
+
+static void
+ngx_http_mcp_status_requests(std::string &out) {
+    ngx_http_mcp_metrics_view_t view;
+    ngx_uint_t dropped;
+    ngx_http_mcp_metrics_merge(view, &dropped);
+
+    static const struct {
+        const char *name;
+        const char *help;
+        uint64_t ngx_http_mcp_metrics_merged_t::*field;
+        double scale;
+    } counters[] = {
+        { "mcp_requests_total", "Requests by JSON-RPC method and tool.",
+          &ngx_http_mcp_metrics_merged_t::requests, 1 },
+        { "mcp_errors_total", "Requests answered with an HTTP or JSON-RPC error.",
+          &ngx_http_mcp_metrics_merged_t::errors, 1 },
+        { "mcp_rate_limited_total", "Requests rejected by rate limits or quotas.",
+          &ngx_http_mcp_metrics_merged_t::rate_limited, 1 },
+        { "mcp_cpu_seconds_total", "Thread CPU time spent in handlers.",
+          &ngx_http_mcp_metrics_merged_t::cpu_usec, 1e-6 },
+    };
+
+    for (const auto &c : counters) {
+        ngx_http_mcp_status_head(out, c.name, "counter", c.help);
+        for (const auto &kv : view) {
+            out += c.name;
+            ngx_http_mcp_status_labels(out, kv.first);
+            out += "} ";
+            ngx_http_mcp_status_number(out, (double)(kv.second.*c.field) * c.scale);
+            out += '\n';
+        }
+    }
+
+    for (ngx_uint_t h = 0; h < NGX_HTTP_MCP_METRICS; ++h) {
+        const char *name = ngx_http_mcp_metrics_hists[h].name;
+        double scale = ngx_http_mcp_metrics_hists[h].scale;
+        ngx_http_mcp_status_head(out, name, "summary", ngx_http_mcp_metrics_hists[h].help);
+        for (const auto &kv : view) {
+            const ngx_http_mcp_metrics_merged_hist_t &hist = kv.second.hist[h];
+            if (hist.count == 0) continue;
+            for (double q : ngx_http_mcp_metrics_quantiles) {
+                out += name;
+                ngx_http_mcp_status_labels(out, kv.first);
+                out += ",quantile=\"";
+                ngx_http_mcp_status_number(out, q);
+                out += "\"} ";
+                ngx_http_mcp_status_number(out, ngx_http_mcp_status_quantile(hist, q) * scale);
+                out += '\n';
+            }
+            out += name;
+            out += "_sum";
+            ngx_http_mcp_status_labels(out, kv.first);
+            out += "} ";
+            ngx_http_mcp_status_number(out, (double)hist.sum * scale);
+            out += '\n';
+            out += name;
+            out += "_count";
+            ngx_http_mcp_status_labels(out, kv.first);
+            out += "} ";
+            ngx_http_mcp_status_number(out, (double)hist.count);
+            out += '\n';
+        }
+    }
+
+    ngx_http_mcp_status_head(out, "mcp_metrics_dropped_total", "counter",
+                             "Requests not recorded because the metrics key table was full.");
+    ngx_http_mcp_status_value(out, "mcp_metrics_dropped_total", NULL, NULL, (double)dropped);
+}
+
+// 其他模块已有的统计: 会话与事件存储、缓存、调度器在共享内存中(全部 worker),
+// 执行器是处理本次抓取的 worker 自己的
+static void
+ngx_http_mcp_status_module(std::string &out, ngx_http_mcp_main_conf_t *mcf) {
+    ngx_cycle_t *cycle = (ngx_cycle_t*)ngx_cycle;
+
+    if (mcf->session_zone) {
+        ngx_uint_t live, capacity;
+        ngx_http_mcp_session_stats(cycle, &live, &capacity);
+        ngx_http_mcp_status_head(out, "mcp_sessions", "gauge", "Live sessions.");
+        ngx_http_mcp_status_value(out, "mcp_sessions", NULL, NULL, (double)live);
+        ngx_http_mcp_status_head(out, "mcp_sessions_capacity", "gauge", "Session table capacity.");
+        ngx_http_mcp_status_value(out, "mcp_sessions_capacity", NULL, NULL, (double)capacity);
+    }
+
+    if (mcf->event_zone) {
+        ngx_http_mcp_events_stats_t st;
+        ngx_http_mcp_events_stats(cycle, &st);
+        ngx_http_mcp_status_head(out, "mcp_event_store_sessions", "gauge", "Sessions holding an event ring.");
+        ngx_http_mcp_status_value(out, "mcp_event_store_sessions", NULL, NULL, (double)st.sessions);
+        ngx_http_mcp_status_head(out, "mcp_event_store_appended_total", "counter", "Events stored for replay.");
+        ngx_http_mcp_status_value(out, "mcp_event_store_appended_total", NULL, NULL, (double)st.appended);
+        ngx_http_mcp_status_head(out, "mcp_event_store_evicted_total", "counter", "Events overwritten before replay.");
+        ngx_http_mcp_status_value(out, "mcp_event_store_evicted_total", NULL, NULL, (double)st.evicted);
+        ngx_http_mcp_status_head(out, "mcp_event_store_replays_total", "counter", "Last-Event-ID replays by result.");
+        ngx_http_mcp_status_value(out, "mcp_event_store_replays_total", "result", "hit", (double)st.hits);
+        ngx_http_mcp_status_value(out, "mcp_event_store_replays_total", "result", "miss", (double)st.misses);
+    }
+
+    if (mcf->cache_zone) {
+        ngx_http_mcp_cache_stats_t st;
+        ngx_http_mcp_cache_stats(cycle, &st);
+        ngx_http_mcp_status_head(out, "mcp_cache_entries", "gauge", "Entries in the shared result cache.");
+        ngx_http_mcp_status_value(out, "mcp_cache_entries", NULL, NULL, (double)st.entries);
+        ngx_http_mcp_status_head(out, "mcp_cache_lookups_total", "counter", "Result cache lookups by outcome.");
+        ngx_http_mcp_status_value(out, "mcp_cache_lookups_total", "result", "l1_hit", (double)st.l1_hits);
+        ngx_http_mcp_status_value(out, "mcp_cache_lookups_total", "result", "l2_hit", (double)st.l2_hits);
+        ngx_http_mcp_status_value(out, "mcp_cache_lookups_total", "result", "stale", (double)st.stale_hits);
+        ngx_http_mcp_status_value(out, "mcp_cache_lookups_total", "result", "miss", (double)st.misses);
+        ngx_http_mcp_status_value(out, "mcp_cache_lookups_total", "result", "not_modified", (double)st.not_modified);
+        ngx_http_mcp_status_value(out, "mcp_cache_lookups_total", "result", "coalesced", (double)st.coalesced);
+        ngx_http_mcp_status_head(out, "mcp_cache_evicted_total", "counter", "Cache entries evicted.");
+        ngx_http_mcp_status_value(out, "mcp_cache_evicted_total", NULL, NULL, (double)st.evicted);
+    }
+
+    if (mcf->sched_zone) {
+        ngx_http_mcp_sched_stats_t st[NGX_HTTP_MCP_PRIO_CLASSES];
+        ngx_http_mcp_sched_stats(cycle, st);
+        ngx_http_mcp_status_head(out, "mcp_sched_queued", "gauge", "Tasks waiting in the scheduler by priority.");
+        for (ngx_uint_t c = 0; c < NGX_HTTP_MCP_PRIO_CLASSES; ++c) {
+            ngx_http_mcp_status_value(out, "mcp_sched_queued", "priority",
+                                      ngx_http_mcp_metrics_prio_names[c], (double)st[c].queued);
+        }
+        ngx_http_mcp_status_head(out, "mcp_sched_dispatched_total", "counter", "Tasks handed to thread pools.");
+        for (ngx_uint_t c = 0; c < NGX_HTTP_MCP_PRIO_CLASSES; ++c) {
+            ngx_http_mcp_status_value(out, "mcp_sched_dispatched_total", "priority",
+                                      ngx_http_mcp_metrics_prio_names[c], (double)st[c].dispatched);
+        }
+        ngx_http_mcp_status_head(out, "mcp_sched_wait_seconds_total", "counter", "Time tasks spent queued.");
+        for (ngx_uint_t c = 0; c < NGX_HTTP_MCP_PRIO_CLASSES; ++c) {
+            ngx_http_mcp_status_value(out, "mcp_sched_wait_seconds_total", "priority",
+                                      ngx_http_mcp_metrics_prio_names[c], (double)st[c].wait_msec / 1000);
+        }
+        ngx_http_mcp_status_head(out, "mcp_sched_expired_total", "counter", "Tasks dequeued after their deadline.");
+        for (ngx_uint_t c = 0; c < NGX_HTTP_MCP_PRIO_CLASSES; ++c) {
+            ngx_http_mcp_status_value(out, "mcp_sched_expired_total", "priority",
+                                      ngx_http_mcp_metrics_prio_names[c], (double)st[c].expired);
+        }
+    }
+
+    if (mcf->executors && mcf->executors->nelts) {
+        auto **ex = (ngx_http_mcp_executor_t**)mcf->executors->elts;
+        std::vector<std::pair<std::string, ngx_http_mcp_executor_stats_t>> stats;
+        for (ngx_uint_t i = 0; i < mcf->executors->nelts; ++i) {
+            ngx_http_mcp_executor_stats_t st;
+            ngx_http_mcp_executor_stats(ex[i], &st);
+            stats.emplace_back(std::string((const char*)st.name.data, st.name.len), st);
+        }
+        static const struct {
+            const char *name;
+            const char *type;
+            const char *help;
+            ngx_uint_t ngx_http_mcp_executor_stats_t::*field;
+        } fields[] = {
+            { "mcp_executor_threads", "gauge", "Executor threads in the scraping worker.",
+              &ngx_http_mcp_executor_stats_t::threads },
+            { "mcp_executor_queued", "gauge", "Executor tasks waiting in the scraping worker.",
+              &ngx_http_mcp_executor_stats_t::queued },
+            { "mcp_executor_completed_total", "counter", "Executor tasks completed by the scraping worker.",
+              &ngx_http_mcp_executor_stats_t::completed },
+            { "mcp_executor_stolen_total", "counter", "Executor tasks taken from another thread's queue.",
+              &ngx_http_mcp_executor_stats_t::stolen },
+        };
+        for (const auto &f : fields) {
+            ngx_http_mcp_status_head(out, f.name, f.type, f.help);
+            for (const auto &s : stats) {
+                ngx_http_mcp_status_value(out, f.name, "executor", s.first.c_str(), (double)(s.second.*f.field));
+            }
+        }
+    }
+}
+
+extern "C" {
+
+uint64_t
+ngx_http_mcp_metrics_usec(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 当前线程的 CPU 时间
+uint64_t
+ngx_http_mcp_metrics_cpu_usec(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void
+ngx_http_mcp_metrics_record(ngx_http_mcp_metrics_sample_t *s) {
+    if (ngx_http_mcp_metrics_slot == NULL || s->method.len == 0) return;
+
+    ngx_http_mcp_metrics_key_t *k;
+    try {
+        k = ngx_http_mcp_metrics_key(&s->method, &s->tool);
+    } catch (const std::bad_alloc &) {
+        k = NULL;
+    }
+    if (k == NULL) {
+        (void)ngx_atomic_fetch_add(&ngx_http_mcp_metrics_slot->dropped, 1);
+        return;
+    }
+
+    (void)ngx_atomic_fetch_add(&k->requests, 1);
+    if (s->error) (void)ngx_atomic_fetch_add(&k->errors, 1);
+    if (s->rate_limited) (void)ngx_atomic_fetch_add(&k->rate_limited, 1);
+    if (s->cpu_usec) (void)ngx_atomic_fetch_add(&k->cpu_usec, (ngx_atomic_int_t)s->cpu_usec);
+
+    for (ngx_uint_t h = 0; h < NGX_HTTP_MCP_METRICS; ++h) {
+        uint64_t v = s->values[h];
+        if (v == NGX_HTTP_MCP_METRIC_NONE) continue;
+        ngx_http_mcp_metrics_hist_t *hist = &k->hist[h];
+        (void)ngx_atomic_fetch_add(&hist->count, 1);
+        (void)ngx_atomic_fetch_add(&hist->sum, (ngx_atomic_int_t)v);
+        (void)ngx_atomic_fetch_add(&hist->buckets[ngx_http_mcp_metrics_bucket(v)], 1);
+    }
+}
+
+// mcp_metrics_zone size [keys=n]: keys 为每个 worker 记录的 (方法, 工具) 组合数上限
+char *ngx_http_mcp_metrics_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->metrics_zone) return (char*)"is duplicate";
+
+    ssize_t size = ngx_parse_size(&value[1]);
+    if (size == NGX_ERROR) return (char*)"invalid zone size";
+    if (size < (ssize_t)(8 * ngx_pagesize)) return (char*)"zone is too small";
+
+    auto *ctx = (ngx_http_mcp_metrics_zone_ctx_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_metrics_zone_ctx_t));
+    if (ctx == NULL) return (char*)NGX_CONF_ERROR;
+    ctx->keys = 64;
+
+    for (ngx_uint_t i = 2; i < cf->args->nelts; ++i) {
+        if (ngx_strncmp(value[i].data, "keys=", 5) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 5, value[i].len - 5);
+            if (n == NGX_ERROR || n < 1 || n > 65536) return (char*)"invalid keys";
+            ctx->keys = (ngx_uint_t)n;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    ngx_str_t name = ngx_string(NGX_HTTP_MCP_METRICS_ZONE_NAME);
+    ngx_shm_zone_t *shm_zone = ngx_shared_memory_add(cf, &name, size, (void*)ngx_http_mcp_metrics_init_zone);
+    if (shm_zone == NULL) return (char*)NGX_CONF_ERROR;
+    shm_zone->init = ngx_http_mcp_metrics_init_zone;
+    shm_zone->data = ctx;
+    mcf->metrics_zone = shm_zone;
+    return NGX_CONF_OK;
+}
+
+// 每个 worker 分配(或 reload 后沿用)自己的槽, 并把槽中已有的键载入索引
+ngx_int_t
+ngx_http_mcp_metrics_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->metrics_zone == NULL) return NGX_OK;
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+    if (ngx_worker >= NGX_HTTP_MCP_METRICS_WORKERS) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0, "mcp metrics not recorded by worker %ui", ngx_worker);
+        return NGX_OK;
+    }
+
+    auto *ctx = static_cast<ngx_http_mcp_metrics_zone_ctx_t*>(mcf->metrics_zone->data);
+    size_t size = offsetof(ngx_http_mcp_metrics_slot_t, keys) + ctx->keys * sizeof(ngx_http_mcp_metrics_key_t);
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_http_mcp_metrics_slot_t *slot = ctx->sh->slots[ngx_worker];
+    if (slot == NULL) {
+        slot = (ngx_http_mcp_metrics_slot_t*)ngx_slab_calloc_locked(ctx->shpool, size);
+        ctx->sh->slots[ngx_worker] = slot;
+    }
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    if (slot == NULL) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "mcp metrics zone \"%V\" is too small for %ui keys per worker",
+                      &mcf->metrics_zone->shm.name, ctx->keys);
+        return NGX_OK;
+    }
+
+    ngx_http_mcp_metrics_slot = slot;
+    ngx_http_mcp_metrics_keys = ctx->keys;
+    try {
+        ngx_uint_t n = ngx_min((ngx_uint_t)slot->nkeys, ctx->keys);
+        for (ngx_uint_t i = 0; i < n; ++i) {
+            ngx_http_mcp_metrics_key_t *k = &slot->keys[i];
+            if (!k->ready) continue;
+            std::string name((const char*)k->method, k->method_len);
+            name += '\0';
+            name.append((const char*)k->tool, k->tool_len);
+            ngx_http_mcp_metrics_index.emplace(std::move(name), k);
+        }
+    } catch (const std::bad_alloc &) {
+        return NGX_ERROR;
+    }
+    return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_mcp_status_handler(ngx_http_request_t *r) {
+    static ngx_str_t text_type = ngx_string("text/plain; version=0.0.4");
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+    ngx_int_t rc = ngx_http_discard_request_body(r);
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_get_module_main_conf(r, ngx_http_mcp_module);
+    std::string text;
+    try {
+        ngx_http_mcp_status_requests(text);
+        ngx_http_mcp_status_module(text, mcf);
+    } catch (const std::bad_alloc &) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = text.size();
+    r->headers_out.content_type = text_type;
+    r->headers_out.content_type_len = text_type.len;
+    r->headers_out.content_type_lowcase = NULL;
+
+    rc = ngx_http_send_header(r);
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    ngx_buf_t *b = ngx_create_temp_buf(r->pool, text.size());
+    if (b == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    b->last = ngx_cpymem(b->pos, text.data(), text.size());
+    b->last_buf = (r == r->main) ? 1 : 0;
+    b->last_in_chain = 1;
+
+    ngx_chain_t out;
+    out.buf = b;
+    out.next = NULL;
+    return ngx_http_output_filter(r, &out);
+}
+
+// mcp_status: 以 Prometheus 文本格式输出指标
+char *ngx_http_mcp_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_core_loc_conf_t *clcf =
+        (ngx_http_core_loc_conf_t*)ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_mcp_status_handler;
+    return NGX_CONF_OK;
+}
+
+} // extern "C"
+
+// 请求上下文销毁时调用; 批量请求的元素各自记录
+void
+ngx_http_mcp_metrics_request(ngx_http_mcp_async_ctx_t *ctx) {
+    if (ngx_http_mcp_metrics_slot == NULL || ctx->batch || ctx->method.empty()) return;
+    ngx_http_request_t *r = ctx->r;
+
+    ngx_http_mcp_metrics_sample_t s;
+    s.method.len = ctx->method.size();
+    s.method.data = (u_char*)ctx->method.data();
+    ngx_str_null(&s.tool);
+    if (auto *call = std::get_if<mcp::CallToolRequest>(&ctx->req_variant)) {
+        s.tool.len = call->params.name.size();
+        s.tool.data = (u_char*)call->params.name.data();
+    }
+    ngx_uint_t status = r->headers_out.status;
+    // SSE 响应头已是 200, 错误以 JSON-RPC error 事件返回
+    s.error = ctx->rpc_error || ctx->status != NGX_OK || status == 0 || status >= NGX_HTTP_BAD_REQUEST;
+    s.rate_limited = ctx->rate_limited;
+    s.cpu_usec = ctx->cpu_usec;
+
+    s.values[NGX_HTTP_MCP_METRIC_BODY] = ctx->body_usec;
+    s.values[NGX_HTTP_MCP_METRIC_PARSE] = ctx->parse_usec;
+    s.values[NGX_HTTP_MCP_METRIC_QUEUE] = ctx->posted_usec ? ctx->queue_usec : NGX_HTTP_MCP_METRIC_NONE;
+    // 缓存命中、限流拒绝等未进处理函数的请求不计处理与序列化时间
+    bool handled = ctx->handler_usec != 0;
+    s.values[NGX_HTTP_MCP_METRIC_HANDLER] =
+        handled ? ctx->handler_usec - ctx->serialize_usec : NGX_HTTP_MCP_METRIC_NONE;
+    s.values[NGX_HTTP_MCP_METRIC_SERIALIZE] = handled ? ctx->serialize_usec : NGX_HTTP_MCP_METRIC_NONE;
+    off_t sent = r->connection->sent - (off_t)r->header_size;
+    s.values[NGX_HTTP_MCP_METRIC_BYTES] = sent > 0 ? (uint64_t)sent : 0;
+
+    ngx_http_mcp_metrics_record(&s);
+}
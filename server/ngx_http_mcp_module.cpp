@@ -1,39 +1,24 @@
-extern "C" {
-    #include <ngx_config.h>
-    #include <ngx_core.h>
-    #include <ngx_http.h>
-    #include <ngx_thread_pool.h>  // 需 nginx 编译启用 --with-threads
-}
 #include <nlohmann/json/json.hpp>
+#include <chrono>
+#include <new>
 #include <variant>
 #include "../common/types.h"
-#include "include/mcp_server.h"
+#include "ngx_http_mcp_module.h"
 
 extern "C" {
 
-// 新增: 每个方法的限流配置
-typedef struct {
-    ngx_str_t   method;        // 方法名
-    ngx_uint_t  rate_limit;    // 配额(每 interval)
-    ngx_uint_t  burst;         // 突发上限
-    ngx_msec_t  interval;      // 窗口大小(毫秒)
-    ngx_uint_t  tokens;        // 当前令牌
-    ngx_msec_t  last_refill;   // 上次填充时间
-} ngx_http_mcp_method_limit_t;
-
-// 新的 loc 配置，支持多条方法
-typedef struct {
-    ngx_flag_t     enabled;
-    ngx_array_t   *methods;    // 元素类型: ngx_http_mcp_method_limit_t
-} ngx_http_mcp_loc_conf_t;
-
 static ngx_int_t ngx_http_mcp_handler(ngx_http_request_t *r);
+static void *ngx_http_mcp_create_main_conf(ngx_conf_t *cf);
+static char *ngx_http_mcp_init_main_conf(ngx_conf_t *cf, void *conf);
 static void *ngx_http_mcp_create_loc_conf(ngx_conf_t *cf);
 static char *ngx_http_mcp_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child);
-static char *ngx_http_mcp_limit_method(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static ngx_int_t ngx_http_mcp_postconfiguration(ngx_conf_t *cf);
+static ngx_int_t ngx_http_mcp_init_process(ngx_cycle_t *cycle);
+static void ngx_http_mcp_exit_process(ngx_cycle_t *cycle);
+static char *ngx_http_mcp_thread_pool(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
-// 更新: 指令定义( mcp_limit_method 现在接收 2 参数 )
+// 指令定义( mcp_limit_method 接收 method qps 以及可选的 burst/queue/interval/key/cost/zone,
+// mcp_quota 接收 method limit 以及 period/key/cost/zone )
 static ngx_command_t ngx_http_mcp_commands[] = {
     { ngx_string("mcp_enable"),
       NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
@@ -42,21 +27,231 @@ static ngx_command_t ngx_http_mcp_commands[] = {
       offsetof(ngx_http_mcp_loc_conf_t, enabled),
       NULL },
 
+    { ngx_string("mcp_limit_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_http_mcp_limit_zone,
+      0,
+      0,
+      NULL },
+
     { ngx_string("mcp_limit_method"),
-      NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
+      NGX_HTTP_LOC_CONF|NGX_CONF_2MORE,
       ngx_http_mcp_limit_method,
       NGX_HTTP_LOC_CONF_OFFSET,
       0,            // 不再使用 offsetof 直接写入，由处理函数管理
       NULL },
 
+    { ngx_string("mcp_quota_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_mcp_quota_zone,
+      0,
+      0,
+      NULL },
+
+    { ngx_string("mcp_quota"),
+      NGX_HTTP_LOC_CONF|NGX_CONF_2MORE,
+      ngx_http_mcp_quota,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_session_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE12,
+      ngx_http_mcp_session_zone,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_session_stateless"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_mcp_main_conf_t, session_stateless),
+      NULL },
+
+    { ngx_string("mcp_session_token_ttl"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_sec_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_mcp_main_conf_t, session_ttl),
+      NULL },
+
+    { ngx_string("mcp_session_key"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE2,
+      ngx_http_mcp_session_key,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_sse_heartbeat"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_mcp_main_conf_t, sse_heartbeat),
+      NULL },
+
+    { ngx_string("mcp_sse_max_pending"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_mcp_main_conf_t, sse_max_pending),
+      NULL },
+
+    { ngx_string("mcp_event_store"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_mcp_event_store,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_tool"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_http_mcp_tool,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_tools_page_size"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_mcp_main_conf_t, tools_page_size),
+      NULL },
+
+    { ngx_string("mcp_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_mcp_cache,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_tool_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_mcp_tool_cache,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_executor"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_mcp_executor,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_scheduler"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_ANY,
+      ngx_http_mcp_scheduler,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_priority"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE2,
+      ngx_http_mcp_priority,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_placement"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_mcp_placement,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_notify_window"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_mcp_main_conf_t, notify_window),
+      NULL },
+
+    { ngx_string("mcp_limit_api_key_header"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_str_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mcp_loc_conf_t, api_key_header),
+      NULL },
+
+    { ngx_string("mcp_request_buffering"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mcp_loc_conf_t, request_buffering),
+      NULL },
+
+    { ngx_string("mcp_stream_methods"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_str_array_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mcp_loc_conf_t, stream_methods),
+      NULL },
+
+    { ngx_string("mcp_thread_pool"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
+      ngx_http_mcp_thread_pool,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_concurrency"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_http_mcp_concurrency,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_max_inflight"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
+      ngx_http_mcp_max_inflight,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_actor"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_str_array_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mcp_loc_conf_t, actors),
+      NULL },
+
+    { ngx_string("mcp_request_timeout"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mcp_loc_conf_t, request_timeout),
+      NULL },
+
+    { ngx_string("mcp_cpu_limit"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mcp_loc_conf_t, cpu_limit),
+      NULL },
+
+    { ngx_string("mcp_metrics_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE12,
+      ngx_http_mcp_metrics_zone,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("mcp_status"),
+      NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS,
+      ngx_http_mcp_status,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
     ngx_null_command
 };
 
 static ngx_http_module_t ngx_http_mcp_module_ctx = {
-    nullptr,                          /* preconfiguration */
+    ngx_http_mcp_add_variables,       /* preconfiguration */
     ngx_http_mcp_postconfiguration,   /* postconfiguration */
-    nullptr,                          /* create main configuration */
-    nullptr,                          /* init main configuration */
+    ngx_http_mcp_create_main_conf,    /* create main configuration */
+    ngx_http_mcp_init_main_conf,      /* init main configuration */
     nullptr,                          /* create server configuration */
     nullptr,                          /* merge server configuration */
     ngx_http_mcp_create_loc_conf,
@@ -68,70 +263,42 @@ ngx_module_t ngx_http_mcp_module = {
     &ngx_http_mcp_module_ctx,
     ngx_http_mcp_commands,
     NGX_HTTP_MODULE,
-    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr,                          /* init master */
+    nullptr,                          /* init module */
+    ngx_http_mcp_init_process,        /* init process */
+    nullptr,                          /* init thread */
+    nullptr,                          /* exit thread */
+    ngx_http_mcp_exit_process,        /* exit process */
+    nullptr,                          /* exit master */
     NGX_MODULE_V1_PADDING
 };
 
-// 新增: 查找方法配置
-static ngx_http_mcp_method_limit_t *
-ngx_http_mcp_find_method(ngx_http_mcp_loc_conf_t *conf, ngx_str_t *m) {
-    if (!conf || !conf->methods) return NULL;
-    ngx_http_mcp_method_limit_t *arr = (ngx_http_mcp_method_limit_t*)conf->methods->elts;
-    for (ngx_uint_t i = 0; i < conf->methods->nelts; ++i) {
-        if (arr[i].method.len == m->len &&
-            ngx_strncmp(arr[i].method.data, m->data, m->len) == 0) {
-            return &arr[i];
-        }
-    }
-    return NULL;
-}
-
-// 新增: 令牌桶刷新
-static ngx_int_t
-ngx_http_mcp_take_token(ngx_http_mcp_method_limit_t *ml) {
-    if (ml->rate_limit == 0) return NGX_OK;
-
-    ngx_msec_t now = ngx_current_msec;
-    if (ml->last_refill == 0) {
-        ml->tokens = ml->rate_limit;
-        ml->last_refill = now;
-    } else {
-        ngx_msec_t elapsed = now - ml->last_refill;
-        if (elapsed > 0) {
-            // 根据经过时间补充令牌
-            ngx_uint_t add = (ngx_uint_t)(( (uint64_t)elapsed * ml->rate_limit) / ml->interval);
-            if (add > 0) {
-                ml->tokens = ngx_min((ngx_uint_t)(ml->tokens + add), ml->burst);
-                ml->last_refill = now;
-            }
-        }
-    }
-    if (ml->tokens > 0) {
-        ml->tokens--;
-        return NGX_OK;
-    }
-    return NGX_HTTP_TOO_MANY_REQUESTS;
-}
-
-// ========== 新增: 异步执行上下文与回调 ==========
-typedef struct {
-    ngx_http_request_t *r;
-    std::string        method;
-    mcp::server::McpServer::MCPRequestVariant req_variant;
-    std::string        result_json;  // 线程中生成
-    ngx_int_t          status;
-} ngx_http_mcp_async_ctx_t;
-
+// ========== 新增: 异步执行回调 (上下文定义见 ngx_http_mcp_module.h) ==========
 static void ngx_http_mcp_thread_worker(void *data, ngx_log_t *log) {
     auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(data);
     ctx->status = NGX_OK;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t cpu = ngx_http_mcp_metrics_cpu_usec();
+    ctx->queue_usec = ngx_http_mcp_metrics_usec() - ctx->posted_usec;
     try {
-        // 业务处理 + JSON-RPC 封装
-        nlohmann::json result = mcp::server::McpServer::handle(ctx->req_variant, log);
-        nlohmann::json rpc;
-        rpc["jsonrpc"] = "2.0";
-        rpc["result"]  = std::move(result);
-        ctx->result_json = rpc.dump();
+        // 业务处理 + JSON-RPC 封装(直接序列化进私有 pool 的 buf 链)
+        ctx->rctx.begin();
+        nlohmann::json result = mcp::server::McpServer::handle(ctx->req_variant, log, &ctx->rctx);
+        uint64_t serialize = ngx_http_mcp_metrics_usec();
+        ctx->out = ngx_http_mcp_cache_result(ctx, ctx->pool, result, &ctx->out_len);
+        ctx->serialize_usec = ngx_http_mcp_metrics_usec() - serialize;
+    } catch (const mcp::server::Cancelled &) {
+        // 应答(或不应答)由完成回调按取消原因决定
+        ctx->cancel.aborted = 1;
+    } catch (const std::invalid_argument &e) {
+        // 处理函数判定参数无效(如未知工具): 返回 -32602 而不是 500
+        ctx->rpc_error = true;
+        try {
+            ctx->out = ngx_http_mcp_serialize_error(ctx->pool, ctx->id, NGX_HTTP_MCP_RPC_INVALID_PARAMS,
+                                                    e.what(), nullptr, &ctx->out_len);
+        } catch (const std::exception &) {
+            ctx->status = NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
     } catch (const std::exception &e) {
         if (log) {
             ngx_log_error(NGX_LOG_ERR, log, 0,
@@ -147,6 +314,33 @@ static void ngx_http_mcp_thread_worker(void *data, ngx_log_t *log) {
         }
         ctx->status = NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
+    ctx->handler_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    ctx->cpu_usec = ngx_http_mcp_metrics_cpu_usec() - cpu;
+}
+
+// 因取消中止的请求: 超时与 CPU 超限按 JSON-RPC 错误应答; 客户端取消或断开时不再应答, 以 499 结束
+static ngx_int_t ngx_http_mcp_cancel_finish(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    mcp::server::CancelReason reason = ctx->rctx.reason();
+    if (reason != mcp::server::CancelReason::Timeout && reason != mcp::server::CancelReason::CpuLimit) {
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                      "mcp request cancelled (method=%s)", ctx->method.c_str());
+        return NGX_HTTP_CLIENT_CLOSED_REQUEST;
+    }
+
+    ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                  "mcp request aborted: %s (method=%s)",
+                  mcp::server::Cancelled(reason).what(), ctx->method.c_str());
+    ctx->rpc_error = true;
+    size_t len = 0;
+    ngx_chain_t *out;
+    try {
+        out = ngx_http_mcp_cancel_error(r->pool, ctx->id, reason, &len);
+    } catch (const std::exception &) {
+        return ctx->sse ? NGX_ERROR : NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    if (ctx->sse) return ngx_http_mcp_sse_finish(r, ctx, out);
+    return ngx_http_mcp_send_chain(r, out, len);
 }
 
 static void ngx_http_mcp_thread_complete(ngx_event_t *ev) {
@@ -154,43 +348,341 @@ static void ngx_http_mcp_thread_complete(ngx_event_t *ev) {
     auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(task->ctx);
     ngx_http_request_t *r = ctx->r;
 
+    ngx_http_mcp_sched_done(ctx->sched);
+    ngx_http_mcp_actor_done(&ctx->actor);
+    ngx_http_mcp_cancel_unregister(&ctx->cancel);
+    // 被取消的请求耗时不代表处理成本, 不参与并发限制与放置的统计
+    bool completed = ctx->status == NGX_OK && !ctx->cancel.aborted;
+    ngx_http_mcp_admit_release(&ctx->admit, completed);
+    if (completed) {
+        ngx_http_mcp_placement_record(ctx);
+    }
+
+    if (ctx->cancel.aborted) {
+        ngx_http_finalize_request(r, ngx_http_mcp_cancel_finish(r, ctx));
+        return;
+    }
+
+    if (ctx->sse) {
+        // 响应头已发出, 错误也以 JSON-RPC error 事件返回
+        if (ctx->status == NGX_OK) {
+            (void)ngx_http_mcp_cache_save(r, ctx);
+            ngx_http_mcp_limit_charge_response(ctx->charges, ctx->out_len);
+        }
+        ngx_http_finalize_request(r, ngx_http_mcp_sse_finish(r, ctx, ctx->status == NGX_OK ? ctx->out : NULL));
+        return;
+    }
+
     if (ctx->status != NGX_OK) {
-        r->headers_out.status = (ctx->status > 0) ? ctx->status : NGX_HTTP_INTERNAL_SERVER_ERROR;
-        ngx_http_send_header(r);
-        ngx_http_finalize_request(r, ctx->status);
+        ngx_http_finalize_request(r, (ctx->status > 0) ? ctx->status : NGX_HTTP_INTERNAL_SERVER_ERROR);
         return;
     }
 
-    ngx_str_t res;
-    res.len  = ctx->result_json.size();
-    res.data = static_cast<u_char*>(ngx_pnalloc(r->pool, res.len));
-    if (res.data == nullptr) {
+    if (ngx_http_mcp_cache_save(r, ctx) != NGX_OK) {
         ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
         return;
     }
-    ngx_memcpy(res.data, ctx->result_json.data(), res.len);
+    ngx_http_mcp_limit_charge_response(ctx->charges, ctx->out_len);
+    ngx_http_finalize_request(r, ngx_http_mcp_send_chain(r, ctx->out, ctx->out_len));
+}
+
+static void ngx_http_mcp_cleanup_ctx(void *data) {
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(data);
+    ngx_http_mcp_metrics_request(ctx);
+    // 未走到线程完成回调(投递失败、请求被提前终止)时归还并发额度, 撤销取消登记
+    ngx_http_mcp_admit_release(&ctx->admit, 0);
+    ngx_http_mcp_actor_done(&ctx->actor);
+    ngx_http_mcp_cancel_unregister(&ctx->cancel);
+    if (ctx->task->event.posted) {
+        ngx_delete_posted_event(&ctx->task->event);
+    }
+    ngx_http_mcp_sse_close(static_cast<ngx_http_mcp_async_ctx_t*>(data));
+    static_cast<ngx_http_mcp_async_ctx_t*>(data)->~ngx_http_mcp_async_ctx_t();
+}
+
+static ngx_http_mcp_async_ctx_t *ngx_http_mcp_create_ctx(ngx_http_request_t *r) {
+    ngx_thread_task_t *task = ngx_thread_task_alloc(r->pool, sizeof(ngx_http_mcp_async_ctx_t));
+    if (task == nullptr) return nullptr;
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == nullptr) return nullptr;
+
+    auto *ctx = new (task->ctx) ngx_http_mcp_async_ctx_t();
+    cln->handler = ngx_http_mcp_cleanup_ctx;
+    cln->data = ctx;
+
+    ctx->r = r;
+    ctx->task = task;
+    ctx->status = NGX_OK;
+    ctx->charges = NULL;
+    ctx->body_bytes = 0;
+    ctx->pool = r->pool;
+    ctx->out = NULL;
+    ctx->out_len = 0;
+    ctx->sse = false;
+    ctx->batch = NULL;
+    ngx_str_null(&ctx->session_id);
+    ctx->start_usec = ngx_http_mcp_metrics_usec();
+    task->handler = ngx_http_mcp_thread_worker;
+    task->event.handler = ngx_http_mcp_thread_complete;
+    task->event.data = task;
+
+    ngx_http_set_ctx(r, ctx, ngx_http_mcp_module);
+    return ctx;
+}
+
+// mcp_thread_pool name pool: 方法(或 tools/call 的工具名)投递到指定的 thread_pool; 同一级别可配多条,
+// 未配置的 location 继承上级
+static char *ngx_http_mcp_thread_pool(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_loc_conf_t *lcf = (ngx_http_mcp_loc_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (lcf->thread_pools == NGX_CONF_UNSET_PTR) {
+        lcf->thread_pools = ngx_array_create(cf->pool, 4, sizeof(ngx_http_mcp_thread_pool_t));
+        if (lcf->thread_pools == NULL) return (char*)NGX_CONF_ERROR;
+    }
+
+    ngx_http_mcp_thread_pool_t *tps = (ngx_http_mcp_thread_pool_t*)lcf->thread_pools->elts;
+    for (ngx_uint_t i = 0; i < lcf->thread_pools->nelts; ++i) {
+        if (tps[i].name.len == value[1].len
+            && ngx_strncmp(tps[i].name.data, value[1].data, value[1].len) == 0)
+        {
+            return (char*)"is duplicate";
+        }
+    }
+
+    ngx_http_mcp_thread_pool_t *tp = (ngx_http_mcp_thread_pool_t*)ngx_array_push(lcf->thread_pools);
+    if (tp == NULL) return (char*)NGX_CONF_ERROR;
+    ngx_memzero(tp, sizeof(ngx_http_mcp_thread_pool_t));
+    tp->name = value[1];
+    tp->pool = value[2];
+    return NGX_CONF_OK;
+}
+
+// 池名先匹配 mcp_executor, 否则为 nginx thread_pool(未用 thread_pool 声明时由 nginx 在配置结束时报错)
+static char *ngx_http_mcp_resolve_thread_pools(ngx_conf_t *cf, ngx_array_t *tps) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_conf_get_module_main_conf(cf, ngx_http_mcp_module);
+    ngx_http_mcp_thread_pool_t *tp = (ngx_http_mcp_thread_pool_t*)tps->elts;
+    for (ngx_uint_t i = 0; i < tps->nelts; ++i) {
+        if (tp[i].tp || tp[i].ex) continue;
+        tp[i].ex = ngx_http_mcp_executor_find(mcf, &tp[i].pool);
+        if (tp[i].ex) continue;
+        tp[i].tp = ngx_thread_pool_add(cf, &tp[i].pool);
+        if (tp[i].tp == NULL) return (char*)NGX_CONF_ERROR;
+    }
+    return NGX_CONF_OK;
+}
+
+static ngx_http_mcp_thread_pool_t *
+ngx_http_mcp_find_thread_pool(ngx_array_t *tps, const u_char *name, size_t len) {
+    ngx_http_mcp_thread_pool_t *tp = (ngx_http_mcp_thread_pool_t*)tps->elts;
+    for (ngx_uint_t i = 0; i < tps->nelts; ++i) {
+        if (tp[i].name.len == len && ngx_strncmp(tp[i].name.data, name, len) == 0) {
+            return &tp[i];
+        }
+    }
+    return NULL;
+}
+
+// 未配置路由的请求投递到 nginx 的 default 池, 每个 worker 启动时查找一次
+static ngx_http_mcp_thread_pool_t ngx_http_mcp_default_pool;
+
+// 请求对应的线程池: 工具名优先于方法名, 再到 "*", 最后为 default 池; 为空时调用方同步处理
+ngx_http_mcp_thread_pool_t *ngx_http_mcp_get_thread_pool(ngx_http_request_t *r, const std::string &method,
+    const mcp::server::McpServer::MCPRequestVariant &req)
+{
+    ngx_http_mcp_loc_conf_t *conf =
+        (ngx_http_mcp_loc_conf_t*)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
+    ngx_http_mcp_thread_pool_t *tp = NULL;
+
+    if (conf->thread_pools) {
+        if (auto *call = std::get_if<mcp::CallToolRequest>(&req)) {
+            const std::string &name = call->params.name;
+            tp = ngx_http_mcp_find_thread_pool(conf->thread_pools, (const u_char*)name.data(), name.size());
+        }
+        if (tp == NULL) {
+            tp = ngx_http_mcp_find_thread_pool(conf->thread_pools, (const u_char*)method.data(), method.size());
+        }
+        if (tp == NULL) {
+            tp = ngx_http_mcp_find_thread_pool(conf->thread_pools, (const u_char*)"*", 1);
+        }
+        if (tp) return tp;
+    }
+    return ngx_http_mcp_default_pool.tp ? &ngx_http_mcp_default_pool : NULL;
+}
+
+// 投递到线程池执行; 无线程池时同步处理
+ngx_int_t ngx_http_mcp_dispatch(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    if (ctx->batch) {
+        return ngx_http_mcp_batch_dispatch(r, ctx);
+    }
+
+    // tools/list 直接引用预序列化的页, 不进线程池
+    if (!ctx->sse && std::holds_alternative<mcp::ListToolsRequest>(ctx->req_variant)) {
+        return ngx_http_mcp_tools_list(r, ctx);
+    }
 
-    r->headers_out.status = NGX_HTTP_OK;
-    r->headers_out.content_length_n = res.len;
-    ngx_http_send_header(r);
+    // list/read 类方法与可缓存的工具先查结果缓存, 命中或等待同键执行时不进线程池, 也不开始事件流
+    ngx_int_t rc = ngx_http_mcp_cache_lookup(r, ctx);
+    if (rc != NGX_DECLINED) {
+        return rc;
+    }
+
+    ngx_http_mcp_thread_pool_t *tp = ngx_http_mcp_get_thread_pool(r, ctx->method, ctx->req_variant);
+
+    ngx_http_mcp_sched_input_t in;
+    in.method.len = ctx->method.size();
+    in.method.data = (u_char*)ctx->method.data();
+    ngx_str_null(&in.tool);
+    if (auto *call = std::get_if<mcp::CallToolRequest>(&ctx->req_variant)) {
+        in.tool.len = call->params.name.size();
+        in.tool.data = (u_char*)call->params.name.data();
+    }
+    in.session = ctx->session_id;
+    in.deadline = ctx->deadline;
 
-    ngx_chain_t out;
-    out.buf = ngx_create_temp_buf(r->pool, res.len);
-    if (out.buf == nullptr) {
+    // 按会话串行的 actor 请求不在事件循环中处理, 否则可能与同一信箱中正在线程里执行的请求并发
+    bool run_inline = tp == nullptr
+        || (ngx_http_mcp_placement_inline(ctx) && !ngx_http_mcp_actor_wanted(r, &in));
+
+    // 进线程池的请求先过并发限制; 拒绝在 SSE 响应头发出之前
+    if (!run_inline && ngx_http_mcp_admit(r, &in.method, &in.tool, &ctx->admit) == NGX_BUSY) {
+        if (ngx_http_mcp_set_retry_after(r, ctx->admit.retry_after) != NGX_OK) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    if (ctx->sse) {
+        rc = ngx_http_mcp_sse_start(r, ctx);
+        if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+            return rc;
+        }
+    }
+    ctx->rctx.set_session(std::string((const char*)ctx->session_id.data, ctx->session_id.len));
+    ngx_http_mcp_cancel_limits(r, &ctx->rctx, ctx->deadline);
+
+    // 无线程池时同步处理; 按历史耗时足够便宜的方法也直接在事件循环中处理, 省去线程往返
+    if (run_inline) {
+        size_t len = 0;
+        ngx_chain_t *out = NULL;
+        try {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t cpu = ngx_http_mcp_metrics_cpu_usec();
+            ctx->rctx.begin();
+            nlohmann::json result_json =
+                mcp::server::McpServer::handle(ctx->req_variant, r->connection->log, &ctx->rctx);
+            uint64_t serialize = ngx_http_mcp_metrics_usec();
+            out = ngx_http_mcp_cache_result(ctx, r->pool, result_json, &len);
+            ctx->serialize_usec = ngx_http_mcp_metrics_usec() - serialize;
+            ctx->handler_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            ctx->cpu_usec = ngx_http_mcp_metrics_cpu_usec() - cpu;
+            ngx_http_mcp_placement_record(ctx);
+        } catch (const mcp::server::Cancelled &) {
+            return ngx_http_mcp_cancel_finish(r, ctx);
+        } catch (const std::invalid_argument &e) {
+            ctx->rpc_error = true;
+            try {
+                out = ngx_http_mcp_serialize_error(r->pool, ctx->id, NGX_HTTP_MCP_RPC_INVALID_PARAMS,
+                                                   e.what(), nullptr, &len);
+            } catch (const std::exception &) {
+                if (!ctx->sse) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+        } catch (const std::exception &e) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "mcp handle std::exception: %s (method=%s)", e.what(), ctx->method.c_str());
+            ctx->rpc_error = true;
+            if (!ctx->sse) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        ngx_http_mcp_limit_charge_response(ctx->charges, len);
+        if (ngx_http_mcp_cache_save(r, ctx) != NGX_OK) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        if (ctx->sse) return ngx_http_mcp_sse_finish(r, ctx, out);
+        return ngx_http_mcp_send_chain(r, out, len);
+    }
+
+    // 线程独占的私有 pool: r->pool 不是线程安全的, 响应链在此分配, 随请求销毁
+    ctx->pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, r->connection->log);
+    if (ctx->pool == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) {
+        ngx_destroy_pool(ctx->pool);
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    cln->handler = (ngx_pool_cleanup_pt)ngx_destroy_pool;
+    cln->data = ctx->pool;
+
+    // 增加引用计数，异步完成后 finalize
+    r->main->count++;
+
+    ctx->posted_usec = ngx_http_mcp_metrics_usec();
+    if (ngx_http_mcp_actor_post(r, tp, ctx->task, &in, &ctx->sched, &ctx->actor) != NGX_OK) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "mcp failed to post thread task");
+        r->main->count--;
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    // 执行期间可被 notifications/cancelled、截止时间与客户端断开取消
+    ngx_http_mcp_cancel_register(r, &ctx->cancel, &ctx->session_id, ctx->id, &ctx->rctx,
+                                 &ctx->sched, ctx->deadline);
+    ngx_http_mcp_cancel_watch(r);
+    return NGX_DONE;
+}
+
+// 排队模式: 延迟到期后继续投递
+static void ngx_http_mcp_delay_handler(ngx_http_request_t *r) {
+    ngx_event_t *wev = r->connection->write;
+
+    if (wev->delayed) {
+        if (ngx_handle_write_event(wev, 0) != NGX_OK) {
+            ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+        }
+        return;
+    }
+
+    if (ngx_handle_read_event(r->connection->read, 0) != NGX_OK) {
         ngx_http_finalize_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
         return;
     }
-    ngx_memcpy(out.buf->pos, res.data, res.len);
-    out.buf->last = out.buf->pos + res.len;
-    out.buf->memory = 1;
-    out.buf->last_buf = 1;
-    out.next = nullptr;
 
-    ngx_http_output_filter(r, &out);
-    ngx_http_finalize_request(r, NGX_OK);
+    r->read_event_handler = ngx_http_block_reading;
+    r->write_event_handler = ngx_http_request_empty_handler;
+
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    ngx_http_finalize_request(r, ngx_http_mcp_dispatch(r, ctx));
+}
+
+// 挂起请求 delay 毫秒后再投递
+ngx_int_t ngx_http_mcp_delay(ngx_http_request_t *r, ngx_msec_t delay) {
+    r->read_event_handler = ngx_http_test_reading;
+    r->write_event_handler = ngx_http_mcp_delay_handler;
+    r->connection->write->delayed = 1;
+    ngx_add_timer(r->connection->write, delay);
+    r->main->count++;
+    return NGX_DONE;
+}
+
+// 按名称查找请求头(大小写不敏感)
+ngx_table_elt_t *ngx_http_mcp_get_header(ngx_http_request_t *r, const u_char *name, size_t len) {
+    ngx_list_part_t *part = &r->headers_in.headers.part;
+    ngx_table_elt_t *h = (ngx_table_elt_t*)part->elts;
+
+    for (ngx_uint_t i = 0; /* void */; ++i) {
+        if (i >= part->nelts) {
+            if (part->next == NULL) break;
+            part = part->next;
+            h = (ngx_table_elt_t*)part->elts;
+            i = 0;
+        }
+        if (h[i].key.len == len && ngx_strncasecmp(h[i].key.data, (u_char*)name, len) == 0) {
+            return &h[i];
+        }
+    }
+    return NULL;
 }
 
-// 修改: 处理函数支持多方法
+// 修改: 处理函数支持多方法; 请求体由 ngx_http_mcp_body_handler 异步读取并流式解析
 static ngx_int_t ngx_http_mcp_handler(ngx_http_request_t *r) {
     ngx_http_mcp_loc_conf_t *conf =
         (ngx_http_mcp_loc_conf_t *)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
@@ -198,110 +690,190 @@ static ngx_int_t ngx_http_mcp_handler(ngx_http_request_t *r) {
         return NGX_DECLINED;
     }
 
+    if (r->method == NGX_HTTP_DELETE) {
+        return ngx_http_mcp_session_terminate(r);
+    }
+    if (r->method == NGX_HTTP_GET) {
+        return ngx_http_mcp_listen(r);
+    }
+
     bool need_body = (r->method & (NGX_HTTP_POST | NGX_HTTP_PUT | NGX_HTTP_PATCH)) != 0;
     if (!need_body) {
-        // 当前协议要求 JSON body + method，非 body 方法直接拒绝
+        // 其余请求要求 JSON body + method，非 body 方法直接拒绝
         ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
                       "mcp request without body not supported");
         return NGX_HTTP_BAD_REQUEST;
     }
 
-    ngx_int_t rc_rb = ngx_http_read_client_request_body(r, NULL);
-    if (rc_rb != NGX_OK && rc_rb != NGX_AGAIN) {
-        return rc_rb;
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_create_ctx(r);
+    if (ctx == nullptr) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    if (!r->request_body || !r->request_body->buf ||
-        !r->request_body->buf->pos || r->request_body->buf->last <= r->request_body->buf->pos) {
-        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0, "mcp empty body");
-        return NGX_HTTP_BAD_REQUEST;
+    if (!conf->request_buffering) {
+        r->request_body_no_buffering = 1;
     }
 
-    size_t body_len = r->request_body->buf->last - r->request_body->buf->pos;
-    std::string body(reinterpret_cast<char*>(r->request_body->buf->pos), body_len);
+    ngx_int_t rc = ngx_http_read_client_request_body(r, ngx_http_mcp_body_handler);
+    if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+        return rc;
+    }
+    return NGX_DONE;
+}
 
-    // 解析 + 构建具体请求
-    mcp::server::McpServer::MCPRequestVariant req_variant;
-    std::string logic_method;
-    if (!mcp::server::McpServer::parse_body_and_build(
-            body, req_variant, logic_method, r->connection->log)) {
-        r->headers_out.status = NGX_HTTP_BAD_REQUEST;
-        ngx_http_send_header(r);
-        return NGX_HTTP_BAD_REQUEST;
+// 请求体解析完成后: 构建请求, 限流, 投递执行
+ngx_int_t ngx_http_mcp_process(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    ngx_http_mcp_loc_conf_t *conf =
+        (ngx_http_mcp_loc_conf_t *)ngx_http_get_module_loc_conf(r, ngx_http_mcp_module);
+
+    // 携带 Mcp-Session-Id 的请求必须对应仍然有效的会话
+    if (ngx_http_mcp_session_enabled(r)) {
+        ngx_table_elt_t *sid = ngx_http_mcp_get_header(r, (u_char*)"Mcp-Session-Id", sizeof("Mcp-Session-Id") - 1);
+        if (sid) {
+            if (ngx_http_mcp_session_find(r, &sid->value, &ctx->session) != NGX_OK) {
+                ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                              "mcp unknown or expired session: %V", &sid->value);
+                return NGX_HTTP_NOT_FOUND;
+            }
+            ctx->session_id = sid->value;
+            // 客户端按响应中的 Mcp-Session-Id 校验会话, 每个响应都回写
+            if (ngx_http_mcp_session_set_header(r, &ctx->session_id) != NGX_OK) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+        }
     }
 
-    // 限流
-    ngx_str_t ms;
-    ms.len = logic_method.size();
-    ms.data = (u_char*)logic_method.data();
-    ngx_http_mcp_method_limit_t *ml = ngx_http_mcp_find_method(conf, &ms);
-    if (ml) {
-        ngx_int_t rl_rc = ngx_http_mcp_take_token(ml);
-        if (rl_rc != NGX_OK) {
-            ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
-                          "mcp rate limit exceeded for method: %V", &ms);
-            r->headers_out.status = NGX_HTTP_TOO_MANY_REQUESTS;
-            ngx_http_send_header(r);
-            return NGX_HTTP_TOO_MANY_REQUESTS;
+    if (ctx->body_parser.result().is_array()) {
+        return ngx_http_mcp_batch_process(r, ctx);
+    }
+
+    // 通知与客户端发回的响应不需要应答: 不构建请求, 直接 202
+    if (ngx_http_mcp_no_reply(ctx->body_parser.result())) {
+        auto method = ctx->body_parser.result().find("method");
+        if (method != ctx->body_parser.result().end() && *method == "notifications/cancelled") {
+            ngx_http_mcp_cancel_notification(r, &ctx->session_id, ctx->body_parser.result());
         }
+        return ngx_http_mcp_send_accepted(r);
     }
 
-    // ========== 改为异步调用 ==========
-    ngx_str_t tp_name = ngx_string("default");
-    ngx_thread_pool_t *tp = (ngx_cycle)
-        ? ngx_thread_pool_get((ngx_cycle_t*)ngx_cycle, &tp_name)
-        : nullptr;
-    if (tp == nullptr) {
-        // 回退同步（无线程池）
-        nlohmann::json result_json = mcp::server::McpServer::handle(req_variant, r->connection->log);
-        nlohmann::json rpc;
-        rpc["jsonrpc"] = "2.0";
-        rpc["result"] = std::move(result_json);
-        std::string resp = rpc.dump();
-
-        ngx_str_t res;
-        res.len  = resp.size();
-        res.data = (u_char*)resp.data();
-
-        r->headers_out.status = NGX_HTTP_OK;
-        r->headers_out.content_length_n = res.len;
-        ngx_http_send_header(r);
-
-        ngx_chain_t out;
-        out.buf = ngx_create_temp_buf(r->pool, res.len);
-        if (out.buf == nullptr) return NGX_HTTP_INTERNAL_SERVER_ERROR;
-        ngx_memcpy(out.buf->pos, res.data, res.len);
-        out.buf->last = out.buf->pos + res.len;
-        out.buf->memory = 1;
-        out.buf->last_buf = 1;
-        out.next = nullptr;
-        return ngx_http_output_filter(r, &out);
+    uint64_t build = ngx_http_mcp_metrics_usec();
+    if (!mcp::server::McpServer::build_request(
+            ctx->body_parser.result(), ctx->req_variant, ctx->method, r->connection->log)) {
+        return NGX_HTTP_BAD_REQUEST;
+    }
+    ctx->parse_usec += ngx_http_mcp_metrics_usec() - build;
+
+    // initialize 发放新会话, 协商结果保存在共享内存中
+    if (auto *init = std::get_if<mcp::InitializeRequest>(&ctx->req_variant)) {
+        if (ngx_http_mcp_session_enabled(r)) {
+            ngx_http_mcp_session_fill(&ctx->session, *init);
+            ngx_int_t rc = ngx_http_mcp_session_create(r, &ctx->session, &ctx->session_id);
+            if (rc == NGX_BUSY) return NGX_HTTP_SERVICE_UNAVAILABLE;
+            if (rc != NGX_OK || ngx_http_mcp_session_set_header(r, &ctx->session_id) != NGX_OK) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+        }
     }
 
-    ngx_thread_task_t *task = ngx_thread_task_alloc(r->pool, sizeof(ngx_http_mcp_async_ctx_t));
-    if (task == nullptr) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    // JSON-RPC id 原样回写(数字或字符串)
+    auto id = ctx->body_parser.result().find("id");
+    ctx->id = (id != ctx->body_parser.result().end()) ? id->dump() : "null";
+
+    ctx->deadline = ngx_http_mcp_cancel_deadline(r, ctx->body_parser.result());
+
+    // 进度通知以 params._meta.progressToken 标识(字符串或数字)
+    auto params = ctx->body_parser.result().find("params");
+    if (params != ctx->body_parser.result().end() && params->is_object()) {
+        auto meta = params->find("_meta");
+        if (meta != params->end() && meta->is_object()) {
+            auto token = meta->find("progressToken");
+            if (token != meta->end() && (token->is_string() || token->is_number())) {
+                ctx->progress_token = *token;
+            }
+        }
     }
-    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(task->ctx);
-    ctx->r = r;
-    ctx->method = logic_method;
-    ctx->req_variant = req_variant;
-    ctx->status = NGX_OK;
 
-    task->handler = ngx_http_mcp_thread_worker;
-    task->event.handler = ngx_http_mcp_thread_complete;
-    task->event.data = task;
+    // 限流与配额: 状态在共享内存中, 所有 worker 共用; 同一方法可命中多条规则
+    ngx_http_mcp_limit_input_t in;
+    ngx_str_t &ms = in.method;
+    ms.len = ctx->method.size();
+    ms.data = (u_char*)ctx->method.data();
+    in.tool.len = 0;
+    in.tool.data = NULL;
+    in.body_bytes = ctx->body_bytes;
+    if (auto *call = std::get_if<mcp::CallToolRequest>(&ctx->req_variant)) {
+        in.tool.len = call->params.name.size();
+        in.tool.data = (u_char*)call->params.name.data();
+    }
 
-    // 增加引用计数，异步完成后 finalize
-    r->main->count++;
+    // 排队延迟后由 ngx_http_mcp_delay_handler 投递, 响应方式须在此之前确定
+    ctx->sse = ngx_http_mcp_sse_wanted(r, conf, &ms);
 
-    if (ngx_thread_task_post(tp, task) != NGX_OK) {
-        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                      "mcp failed to post thread task");
+    ngx_int_t rl_rc = ngx_http_mcp_limit_check(r, conf, &in, &ctx->limit, &ctx->charges);
+    if (rl_rc == NGX_ERROR) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
+    if (ctx->limit.rule) {
+        if (ngx_http_mcp_limit_set_headers(r, &ctx->limit) != NGX_OK) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        if (rl_rc == NGX_BUSY) {
+            ctx->rate_limited = true;
+            ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                          "mcp rate limit exceeded for method: %V", &ms);
+            return NGX_HTTP_TOO_MANY_REQUESTS;
+        }
+        if (rl_rc == NGX_AGAIN) {
+            ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                          "mcp rate limit delaying method: %V by %M ms", &ms, ctx->limit.delay);
+            return ngx_http_mcp_delay(r, ctx->limit.delay);
+        }
+    }
 
-    return NGX_DONE;
+    return ngx_http_mcp_dispatch(r, ctx);
+}
+
+static void *ngx_http_mcp_create_main_conf(ngx_conf_t *cf) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_main_conf_t));
+    if (mcf == NULL) return NULL;
+    mcf->limit_zones = ngx_array_create(cf->pool, 2, sizeof(ngx_shm_zone_t*));
+    if (mcf->limit_zones == NULL) return NULL;
+    mcf->quota_zones = ngx_array_create(cf->pool, 2, sizeof(ngx_shm_zone_t*));
+    if (mcf->quota_zones == NULL) return NULL;
+    mcf->session_keys = ngx_array_create(cf->pool, 2, sizeof(ngx_http_mcp_session_key_t));
+    if (mcf->session_keys == NULL) return NULL;
+    mcf->session_stateless = NGX_CONF_UNSET;
+    mcf->session_ttl = NGX_CONF_UNSET;
+    mcf->notify_window = NGX_CONF_UNSET_MSEC;
+    mcf->sse_heartbeat = NGX_CONF_UNSET_MSEC;
+    mcf->sse_max_pending = NGX_CONF_UNSET_SIZE;
+    mcf->tools_page_size = NGX_CONF_UNSET_UINT;
+    mcf->placement_inline = NGX_CONF_UNSET_UINT;
+    mcf->placement_body = NGX_CONF_UNSET_SIZE;
+    return mcf;
+}
+
+static char *ngx_http_mcp_init_main_conf(ngx_conf_t *cf, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_conf_init_msec_value(mcf->notify_window, 100);
+    ngx_conf_init_msec_value(mcf->sse_heartbeat, 15000);
+    ngx_conf_init_size_value(mcf->sse_max_pending, 64 * 1024);
+    ngx_conf_init_uint_value(mcf->tools_page_size, 100);
+    ngx_conf_init_uint_value(mcf->placement_inline, 0);
+    ngx_conf_init_size_value(mcf->placement_body, 64 * 1024);
+    if (mcf->sse_heartbeat == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"mcp_sse_heartbeat\" must be positive");
+        return (char*)NGX_CONF_ERROR;
+    }
+    if (ngx_http_mcp_token_init_main_conf(cf, mcf) != NGX_CONF_OK
+        || ngx_http_mcp_cache_init_main_conf(cf, mcf) != NGX_CONF_OK
+        || ngx_http_mcp_cancel_init_main_conf(cf, mcf) != NGX_CONF_OK
+        || ngx_http_mcp_subscribe_init_main_conf(cf, mcf) != NGX_CONF_OK)
+    {
+        return (char*)NGX_CONF_ERROR;
+    }
+    return ngx_http_mcp_limit_init_main_conf(cf, mcf);
 }
 
 // 更新: create loc conf
@@ -311,6 +883,14 @@ static void *ngx_http_mcp_create_loc_conf(ngx_conf_t *cf) {
     if (conf == NULL) return NULL;
     conf->enabled = NGX_CONF_UNSET;
     conf->methods = NULL;
+    conf->request_buffering = NGX_CONF_UNSET;
+    conf->stream_methods = (ngx_array_t*)NGX_CONF_UNSET_PTR;
+    conf->thread_pools = (ngx_array_t*)NGX_CONF_UNSET_PTR;
+    conf->concurrency = (ngx_http_mcp_concurrency_t*)NGX_CONF_UNSET_PTR;
+    conf->max_inflight = (ngx_array_t*)NGX_CONF_UNSET_PTR;
+    conf->request_timeout = NGX_CONF_UNSET_MSEC;
+    conf->cpu_limit = NGX_CONF_UNSET_MSEC;
+    conf->actors = (ngx_array_t*)NGX_CONF_UNSET_PTR;
     return conf;
 }
 
@@ -323,45 +903,27 @@ static char *ngx_http_mcp_merge_loc_conf(ngx_conf_t *cf, void *parent, void *chi
     if (conf->methods == NULL) {
         conf->methods = prev->methods; // 直接继承指针 (父级只读)
     }
-    return NGX_CONF_OK;
-}
-
-// 更新: 指令处理(追加或更新方法)
-static char *ngx_http_mcp_limit_method(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
-    ngx_http_mcp_loc_conf_t *mcp_conf = (ngx_http_mcp_loc_conf_t*)conf;
-    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
-    // value[1]: method, value[2]: qps
-    if (value[1].len == 0) return (char*)"invalid method name";
-    if (value[2].len == 0) return (char*)"invalid qps value";
-
-    ngx_int_t qps = ngx_atoi(value[2].data, value[2].len);
-    if (qps == NGX_ERROR || qps <= 0) return (char*)"invalid qps (positive integer expected)";
-
-    if (mcp_conf->methods == NULL) {
-        mcp_conf->methods = ngx_array_create(cf->pool, 2, sizeof(ngx_http_mcp_method_limit_t));
-        if (mcp_conf->methods == NULL) return (char*)"failed to allocate methods array";
+    ngx_conf_merge_str_value(conf->api_key_header, prev->api_key_header, "Authorization");
+    ngx_conf_merge_value(conf->request_buffering, prev->request_buffering, 0);
+    ngx_conf_merge_ptr_value(conf->stream_methods, prev->stream_methods, NULL);
+    if (conf->stream_methods == NULL) {
+        // 默认仅 tools/call 这类可能长时间运行的方法使用 SSE
+        conf->stream_methods = ngx_array_create(cf->pool, 1, sizeof(ngx_str_t));
+        if (conf->stream_methods == NULL) return (char*)NGX_CONF_ERROR;
+        ngx_str_t *m = (ngx_str_t*)ngx_array_push(conf->stream_methods);
+        if (m == NULL) return (char*)NGX_CONF_ERROR;
+        ngx_str_set(m, "tools/call");
     }
-
-    // 如果已存在同名方法则更新
-    ngx_http_mcp_method_limit_t *existing = ngx_http_mcp_find_method(mcp_conf, &value[1]);
-    if (existing) {
-        existing->rate_limit = (ngx_uint_t)qps;
-        existing->burst = existing->burst ? existing->burst : existing->rate_limit;
-        existing->interval = 1000;
-        return NGX_CONF_OK;
+    // 继承的并发限制与上级共用同一份计数
+    ngx_conf_merge_ptr_value(conf->concurrency, prev->concurrency, NULL);
+    ngx_conf_merge_ptr_value(conf->max_inflight, prev->max_inflight, NULL);
+    ngx_conf_merge_msec_value(conf->request_timeout, prev->request_timeout, 0);
+    ngx_conf_merge_msec_value(conf->cpu_limit, prev->cpu_limit, 0);
+    ngx_conf_merge_ptr_value(conf->actors, prev->actors, NULL);
+    ngx_conf_merge_ptr_value(conf->thread_pools, prev->thread_pools, NULL);
+    if (conf->thread_pools) {
+        return ngx_http_mcp_resolve_thread_pools(cf, conf->thread_pools);
     }
-
-    ngx_http_mcp_method_limit_t *ml =
-        (ngx_http_mcp_method_limit_t*)ngx_array_push(mcp_conf->methods);
-    if (ml == NULL) return (char*)"failed to push method item";
-
-    ml->method = value[1];
-    ml->rate_limit = (ngx_uint_t)qps;
-    ml->burst = ml->rate_limit;   // 默认突发 = qps
-    ml->interval = 1000;          // 固定 1s 窗口
-    ml->tokens = ml->rate_limit;  // 初始满桶
-    ml->last_refill = 0;
-
     return NGX_CONF_OK;
 }
 
@@ -384,4 +946,71 @@ static ngx_int_t ngx_http_mcp_postconfiguration(ngx_conf_t *cf) {
     return NGX_OK;
 }
 
+static ngx_int_t ngx_http_mcp_init_process(ngx_cycle_t *cycle) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(cycle, ngx_http_mcp_module);
+    if (mcf == NULL) return NGX_OK;
+    if ((ngx_process == NGX_PROCESS_WORKER || ngx_process == NGX_PROCESS_SINGLE)
+        && ngx_http_mcp_notify_init(cycle) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+    ngx_str_t tp_name = ngx_string("default");
+    ngx_http_mcp_default_pool.tp = ngx_thread_pool_get(cycle, &tp_name);
+    if (ngx_http_mcp_session_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_subscribe_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_listen_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_events_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_tools_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_cache_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_sched_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_executor_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_placement_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_cancel_init_process(cycle, mcf) != NGX_OK
+        || ngx_http_mcp_metrics_init_process(cycle, mcf) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+    return ngx_http_mcp_limit_init_process(cycle, mcf);
+}
+
+static void ngx_http_mcp_exit_process(ngx_cycle_t *cycle) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(cycle, ngx_http_mcp_module);
+    if (mcf == NULL) return;
+    ngx_http_mcp_limit_exit_process(cycle, mcf);
+    ngx_http_mcp_session_exit_process(cycle, mcf);
+    ngx_http_mcp_listen_exit_process(cycle);
+    ngx_http_mcp_subscribe_exit_process(cycle);
+    // 执行器线程停止后才关闭唤醒通道
+    ngx_http_mcp_executor_exit_process(cycle, mcf);
+    ngx_http_mcp_notify_done(cycle);
+}
+
 } // extern "C"
+
+ngx_msec_t ngx_http_mcp_request_deadline(const nlohmann::json &msg) {
+    auto params = msg.find("params");
+    if (params == msg.end() || !params->is_object()) return 0;
+    auto meta = params->find("_meta");
+    if (meta == params->end() || !meta->is_object()) return 0;
+    auto timeout = meta->find("timeout");
+    if (timeout == meta->end() || !timeout->is_number_unsigned()) return 0;
+    uint64_t ms = timeout->get<uint64_t>();
+    // 0 与超出 ngx_msec_t 比较范围的值都视为不限
+    if (ms == 0 || ms > NGX_MAX_INT32_VALUE) return 0;
+    ngx_msec_t deadline = ngx_current_msec + (ngx_msec_t)ms;
+    return deadline ? deadline : 1;
+}
+
+// 无 id 且不是已知请求方法的是通知(如 notifications/initialized); 无 method 而带 result/error 的
+// 是客户端对服务端请求的响应。无 id 的已知请求方法仍按原样执行
+bool ngx_http_mcp_no_reply(const nlohmann::json &msg) {
+    if (!msg.is_object()) return false;
+    auto method = msg.find("method");
+    if (method == msg.end()) {
+        return msg.contains("id") && (msg.contains("result") || msg.contains("error"));
+    }
+    return method->is_string() && !msg.contains("id")
+        && !mcp::server::McpServer::is_known_method(method->get_ref<const std::string&>());
+}
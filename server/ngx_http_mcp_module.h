@@ -0,0 +1,679 @@
+#ifndef NGX_HTTP_MCP_MODULE_H_
+#define NGX_HTTP_MCP_MODULE_H_
+
+extern "C" {
+    #include <ngx_config.h>
+    #include <ngx_core.h>
+    #include <ngx_http.h>
+    #include <ngx_thread_pool.h>  // 需 nginx 编译启用 --with-threads
+}
+
+// 模块内各编译单元共享的配置结构与函数声明
+extern "C" {
+
+// 限流共享内存中的时间刻度: 64 位原子量下用微秒, 否则退化为毫秒
+#if (NGX_PTR_SIZE == 8)
+#define NGX_HTTP_MCP_LIMIT_TICKS     1000
+#else
+#define NGX_HTTP_MCP_LIMIT_TICKS     1
+#endif
+
+#define NGX_HTTP_MCP_LIMIT_ZONE_NAME "mcp_limit"
+#define NGX_HTTP_MCP_QUOTA_ZONE_NAME "mcp_quota"
+#define NGX_HTTP_MCP_LIMIT_ZONE_SIZE (1024 * 1024)
+
+// 会话: Mcp-Session-Id 为 128 位随机数的十六进制
+#define NGX_HTTP_MCP_SESSION_ZONE_NAME   "mcp_session"
+#define NGX_HTTP_MCP_SESSION_ID_LEN      32
+#define NGX_HTTP_MCP_SESSION_VERSION_LEN 23
+
+// 会话中保存的客户端能力位图
+#define NGX_HTTP_MCP_CAP_ROOTS          0x01
+#define NGX_HTTP_MCP_CAP_ROOTS_CHANGED  0x02
+#define NGX_HTTP_MCP_CAP_SAMPLING       0x04
+#define NGX_HTTP_MCP_CAP_ELICITATION    0x08
+#define NGX_HTTP_MCP_CAP_EXPERIMENTAL   0x10
+
+// JSON-RPC 2.0 错误码
+#define NGX_HTTP_MCP_RPC_INVALID_REQUEST   -32600
+#define NGX_HTTP_MCP_RPC_METHOD_NOT_FOUND  -32601
+#define NGX_HTTP_MCP_RPC_INVALID_PARAMS    -32602
+#define NGX_HTTP_MCP_RPC_INTERNAL_ERROR    -32603
+#define NGX_HTTP_MCP_RPC_RATE_LIMITED      -32000   // 实现自定义: 限流/配额拒绝
+#define NGX_HTTP_MCP_RPC_OVERLOADED        -32001   // 实现自定义: 并发限制拒绝
+#define NGX_HTTP_MCP_RPC_TIMEOUT           -32002   // 实现自定义: 超过截止时间或 CPU 时间上限
+
+// 结果缓存按目录类别失效
+#define NGX_HTTP_MCP_CACHE_PROMPTS    0
+#define NGX_HTTP_MCP_CACHE_RESOURCES  1
+#define NGX_HTTP_MCP_CACHE_TOOLS      2   // tools/call 结果
+#define NGX_HTTP_MCP_CACHE_FAMILIES   3
+
+// 请求的缓存结果($mcp_cache_status)
+#define NGX_HTTP_MCP_CACHE_STATUS_NONE       0   // 不可缓存或未查找
+#define NGX_HTTP_MCP_CACHE_STATUS_MISS       1
+#define NGX_HTTP_MCP_CACHE_STATUS_HIT        2
+#define NGX_HTTP_MCP_CACHE_STATUS_STALE      3   // 过期但在 stale 窗口内, 已触发后台刷新
+#define NGX_HTTP_MCP_CACHE_STATUS_COALESCED  4   // 共享了同键请求的执行结果
+
+// 调度优先级: 数值小的先出队
+#define NGX_HTTP_MCP_PRIO_HIGH      0   // initialize、ping、通知
+#define NGX_HTTP_MCP_PRIO_NORMAL    1
+#define NGX_HTTP_MCP_PRIO_LOW       2   // tools/call
+#define NGX_HTTP_MCP_PRIO_CLASSES   3
+
+// 指标直方图(mcp_metrics_zone), 值为微秒或字节
+#define NGX_HTTP_MCP_METRIC_BODY        0   // 读取请求体, 不含解析
+#define NGX_HTTP_MCP_METRIC_PARSE       1   // 解析请求体与构建请求
+#define NGX_HTTP_MCP_METRIC_QUEUE       2   // 线程池排队
+#define NGX_HTTP_MCP_METRIC_HANDLER     3
+#define NGX_HTTP_MCP_METRIC_SERIALIZE   4
+#define NGX_HTTP_MCP_METRIC_BYTES       5   // 响应体字节
+#define NGX_HTTP_MCP_METRICS            6
+#define NGX_HTTP_MCP_METRIC_NONE        ((uint64_t)-1)  // 未测量
+
+// ETag: 带引号的 16 位十六进制(含结尾 0)
+#define NGX_HTTP_MCP_ETAG_LEN  sizeof("\"0123456789abcdef\"")
+
+// 响应 buf 链的单块上限(首块一页, 逐块倍增)
+#define NGX_HTTP_MCP_OUTPUT_CHUNK_MAX (64 * 1024)
+
+// 组合限流键: 规则可按任意组合区分调用方
+#define NGX_HTTP_MCP_LIMIT_KEY_SESSION  0x01   // Mcp-Session-Id
+#define NGX_HTTP_MCP_LIMIT_KEY_IP       0x02   // 客户端地址
+#define NGX_HTTP_MCP_LIMIT_KEY_API_KEY  0x04   // mcp_limit_api_key_header 指定的请求头
+#define NGX_HTTP_MCP_LIMIT_KEY_TOOL     0x08   // tools/call 的工具名
+
+// 限流槽: key 为规则哈希(0 表示空槽), tat 为 GCRA 理论到达时间
+typedef struct {
+    ngx_atomic_t  key;
+    ngx_atomic_t  tat;
+} ngx_http_mcp_limit_cell_t;
+
+// 限流共享内存头, 所有 worker 共用同一张开放寻址表
+typedef struct {
+    ngx_uint_t                  mask;       // 槽位数 - 1 (槽位数为 2 的幂)
+    ngx_atomic_t                rejected;   // 累计拒绝次数
+    ngx_atomic_t                delayed;    // 累计排队次数
+    ngx_http_mcp_limit_cell_t  *cells;
+} ngx_http_mcp_limit_shctx_t;
+
+// 长周期配额项: expire 为所在周期结束的 unix 时间, 过期后槽位可复用
+typedef struct {
+    uint64_t  key;
+    uint64_t  expire;
+    uint64_t  used;
+} ngx_http_mcp_quota_entry_t;
+
+// 配额共享内存头, 读写在 slab 互斥锁内完成
+typedef struct {
+    ngx_uint_t                   mask;
+    ngx_uint_t                   rejected;
+    ngx_http_mcp_quota_entry_t  *entries;
+} ngx_http_mcp_quota_shctx_t;
+
+// 限流区与配额区共用, sh 指向各自的共享内存头
+typedef struct {
+    void                       *sh;
+    ngx_slab_pool_t            *shpool;
+    ngx_flag_t                  declared;   // 是否由 *_zone 指令显式声明
+    ngx_str_t                   snapshot;   // 配额快照文件, 为空则不落盘
+    ngx_msec_t                  snapshot_interval;
+} ngx_http_mcp_limit_zone_ctx_t;
+
+// 每个方法的限流/配额配置(令牌状态保存在共享内存中)
+typedef struct {
+    ngx_str_t        method;        // 方法名, "*" 匹配所有方法
+    ngx_uint_t       rate_limit;    // 配额(每 interval, 或长周期配额的每 period 总量)
+    ngx_uint_t       burst;         // 突发上限(可立即通过的请求数)
+    ngx_uint_t       queue;         // 超出突发后可延迟等待的请求数, 0 表示直接拒绝
+    ngx_msec_t       interval;      // 窗口大小(毫秒)
+    time_t           period;        // 长周期配额的周期(秒), 0 表示 GCRA 限流规则
+    ngx_uint_t       keys;          // NGX_HTTP_MCP_LIMIT_KEY_* 组合
+    ngx_uint_t       cost;          // 每个请求的基础消耗
+    size_t           req_bytes;     // 请求体每满 N 字节额外消耗 1, 0 表示不计
+    size_t           resp_bytes;    // 响应每满 N 字节额外消耗 1(响应后补扣), 0 表示不计
+    uint64_t         key;           // 规则哈希, 定位共享内存槽
+    ngx_shm_zone_t  *shm_zone;
+} ngx_http_mcp_method_limit_t;
+
+// 限流判定的请求侧输入
+typedef struct {
+    ngx_str_t        method;
+    ngx_str_t        tool;          // tools/call 的 params.name, 其他方法为空
+    off_t            body_bytes;
+} ngx_http_mcp_limit_input_t;
+
+// 单次限流判定结果, 用于延迟处理和 RateLimit-* 响应头
+typedef struct {
+    ngx_http_mcp_method_limit_t *rule;
+    ngx_uint_t                   limit;
+    ngx_uint_t                   remaining;
+    ngx_msec_t                   reset;       // 桶恢复满额所需毫秒
+    ngx_msec_t                   delay;       // 需要等待的毫秒(排队模式)
+    ngx_msec_t                   retry_after; // 被拒绝时建议的重试间隔
+} ngx_http_mcp_limit_state_t;
+
+// initialize 协商出的会话状态
+typedef struct {
+    uint32_t  caps;          // NGX_HTTP_MCP_CAP_*
+    u_char    version_len;
+    u_char    version[NGX_HTTP_MCP_SESSION_VERSION_LEN];
+    time_t    created;
+    time_t    last;          // 最近活动时间
+} ngx_http_mcp_session_info_t;
+
+// 无状态会话令牌的签名密钥
+typedef struct {
+    ngx_uint_t  kid;
+    ngx_str_t   secret;
+} ngx_http_mcp_session_key_t;
+
+// tools/call 结果缓存规则(mcp_tool_cache)
+typedef struct {
+    ngx_str_t   tool;               // 工具名, "*" 匹配其余工具
+    ngx_msec_t  ttl;
+    size_t      max_size;           // 每个工具在 L2 中的字节预算
+} ngx_http_mcp_tool_cache_t;
+
+// 模块自己的执行器(mcp_executor), 定义见 ngx_http_mcp_executor.cpp
+typedef struct ngx_http_mcp_executor_s  ngx_http_mcp_executor_t;
+
+// 方法或工具到线程池的路由(mcp_thread_pool); 池名为 mcp_executor 声明的名字时投递到执行器,
+// 否则为 nginx 的 thread_pool
+typedef struct {
+    ngx_str_t          name;        // 方法名或 tools/call 的工具名, "*" 匹配其余请求
+    ngx_str_t          pool;        // 池名, 合并 location 配置时解析
+    ngx_thread_pool_t *tp;
+    ngx_http_mcp_executor_t *ex;
+} ngx_http_mcp_thread_pool_t;
+
+// 方法或工具的调度优先级(mcp_priority)
+typedef struct {
+    ngx_str_t   name;               // 方法名或 tools/call 的工具名, "*" 匹配其余请求
+    ngx_uint_t  prio;               // NGX_HTTP_MCP_PRIO_*
+} ngx_http_mcp_priority_t;
+
+// 投递线程任务时的调度依据
+typedef struct {
+    ngx_str_t   method;
+    ngx_str_t   tool;               // tools/call 的工具名, 其余为空
+    ngx_str_t   session;            // Mcp-Session-Id, 无会话时按客户端地址
+    ngx_msec_t  deadline;           // ngx_current_msec 下的截止时间, 0 表示无
+} ngx_http_mcp_sched_input_t;
+
+// 调度中的任务, 定义见 ngx_http_mcp_sched.cpp
+typedef struct ngx_http_mcp_sched_entry_s  ngx_http_mcp_sched_entry_t;
+
+// 自适应并发限制(mcp_concurrency), 定义见 ngx_http_mcp_adaptive.cpp
+typedef struct ngx_http_mcp_concurrency_s  ngx_http_mcp_concurrency_t;
+
+// 方法或工具同时执行的上限(mcp_max_inflight); 计数在配置内存中, fork 后每个 worker 一份
+typedef struct {
+    ngx_str_t   name;               // 方法名或 tools/call 的工具名
+    ngx_uint_t  max;
+    ngx_uint_t  inflight;
+} ngx_http_mcp_max_inflight_t;
+
+// 已准入线程池的请求, 完成或请求销毁时归还
+typedef struct {
+    ngx_http_mcp_concurrency_t  *limiter;
+    ngx_http_mcp_max_inflight_t *rule;
+    ngx_str_t                    method;      // 延迟按方法各自比较基线
+    uint64_t                     start;       // 准入时刻(微秒)
+    ngx_msec_t                   retry_after; // 拒绝时建议的重试间隔
+} ngx_http_mcp_admit_t;
+
+// 一个请求(或批量元素)的指标样本
+typedef struct {
+    ngx_str_t   method;
+    ngx_str_t   tool;                          // tools/call 的工具名, 其余为空
+    ngx_flag_t  error;                         // HTTP 错误或 JSON-RPC error 响应
+    ngx_flag_t  rate_limited;
+    uint64_t    cpu_usec;                      // 处理线程 CPU 时间
+    uint64_t    values[NGX_HTTP_MCP_METRICS];  // NGX_HTTP_MCP_METRIC_NONE 表示未测量
+} ngx_http_mcp_metrics_sample_t;
+
+// 会话内串行执行的 actor(mcp_actor) 信箱, 定义见 ngx_http_mcp_actor.cpp
+typedef struct ngx_http_mcp_actor_mailbox_s  ngx_http_mcp_actor_mailbox_t;
+
+// 经 actor 投递的任务: 同一会话同一工具前一个完成后才交给调度器; 嵌在请求上下文或批量元素中
+typedef struct {
+    ngx_queue_t                    queue;     // 信箱中等待时链入
+    ngx_http_mcp_actor_mailbox_t  *mailbox;   // 为空表示未经 actor
+    ngx_http_request_t            *r;
+    ngx_http_mcp_thread_pool_t    *tp;
+    ngx_thread_task_t             *task;
+    ngx_http_mcp_sched_input_t     in;
+    ngx_http_mcp_sched_entry_t   **sched;
+    unsigned                       waiting:1;
+} ngx_http_mcp_actor_t;
+
+// 单个请求的缓存策略, 查找时确定, 存入时沿用
+typedef struct {
+    ngx_uint_t  family;             // NGX_HTTP_MCP_CACHE_*
+    ngx_msec_t  ttl;
+    ngx_msec_t  stale;
+    size_t      max_size;           // 工具预算, budget 为 0 时不用
+    uint64_t    budget;             // 工具名哈希, 0 表示不按工具记账
+} ngx_http_mcp_cache_policy_t;
+
+// 跨线程唤醒项: 由投递方分配, handler 在 worker 事件循环中执行并负责释放
+typedef struct ngx_http_mcp_notify_s  ngx_http_mcp_notify_t;
+struct ngx_http_mcp_notify_s {
+    ngx_http_mcp_notify_t  *next;
+    void                  (*handler)(ngx_http_mcp_notify_t *item);
+};
+
+typedef struct {
+    ngx_array_t   *limit_zones;  // 元素类型: ngx_shm_zone_t *
+    ngx_array_t   *quota_zones;  // 元素类型: ngx_shm_zone_t *
+    ngx_shm_zone_t *session_zone; // mcp_session_zone, 未配置时不发放会话
+    ngx_flag_t     session_stateless; // 以签名令牌代替共享表
+    time_t         session_ttl;       // 令牌有效期(秒)
+    ngx_array_t   *session_keys;      // 元素类型: ngx_http_mcp_session_key_t, 首个用于签发
+    ngx_msec_t     notify_window;     // 资源更新通知的合并窗口
+    ngx_msec_t     sse_heartbeat;     // GET 事件流的心跳间隔
+    size_t         sse_max_pending;   // 每个 GET 事件流积压的字节上限
+    ngx_shm_zone_t *event_zone;       // mcp_event_store, 未配置时事件不带 id, 不能续传
+    struct ngx_http_mcp_tools_conf_s *tools; // mcp_tool 声明的工具
+    ngx_uint_t     tools_page_size;   // tools/list 每页工具数, 0 不分页
+    ngx_shm_zone_t *cache_zone;       // mcp_cache, 未配置时 list/read 结果不缓存
+    ngx_array_t   *tool_cache;        // 元素类型: ngx_http_mcp_tool_cache_t
+    ngx_shm_zone_t *sched_zone;       // mcp_scheduler, 未配置时任务直接投递到线程池
+    ngx_array_t   *priorities;        // 元素类型: ngx_http_mcp_priority_t
+    ngx_array_t   *executors;         // 元素类型: ngx_http_mcp_executor_t *
+    ngx_uint_t     placement_inline;  // mcp_placement: 平均耗时低于此值(微秒)的方法在事件循环中处理, 0 关闭
+    size_t         placement_body;    // 超过此大小的请求体在线程池中解析
+    ngx_shm_zone_t *cancel_zone;      // 跨 worker 转发 notifications/cancelled
+    ngx_shm_zone_t *subscribe_zone;   // 跨 worker 转发订阅变化与资源更新, 启用会话时才有
+    ngx_shm_zone_t *metrics_zone;     // mcp_metrics_zone, 未配置时不记录按方法的指标
+} ngx_http_mcp_main_conf_t;
+
+typedef struct {
+    ngx_flag_t     enabled;
+    ngx_array_t   *methods;    // 元素类型: ngx_http_mcp_method_limit_t
+    ngx_str_t      api_key_header;
+    ngx_flag_t     request_buffering; // off: 边接收边解析请求体
+    ngx_array_t   *stream_methods;    // 以 SSE 响应的方法(ngx_str_t), 需客户端 Accept text/event-stream
+    ngx_array_t   *thread_pools;      // 元素类型: ngx_http_mcp_thread_pool_t, 未匹配时用 default 池
+    ngx_http_mcp_concurrency_t *concurrency; // mcp_concurrency, 未配置时不限
+    ngx_array_t   *max_inflight;      // 元素类型: ngx_http_mcp_max_inflight_t
+    ngx_msec_t     request_timeout;   // 请求未给出 _meta.timeout 时的处理时限, 0 不限
+    ngx_msec_t     cpu_limit;         // 处理函数的线程 CPU 时间上限, 0 不限
+    ngx_array_t   *actors;            // 按会话串行执行的工具或方法(ngx_str_t), "*" 匹配全部
+} ngx_http_mcp_loc_conf_t;
+
+extern ngx_module_t ngx_http_mcp_module;
+
+// FNV-1a 64 位哈希, 结果保证非 0 (0 在共享内存表中表示空槽)
+static inline uint64_t
+ngx_http_mcp_hash64(uint64_t h, const u_char *p, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h ? h : 1;
+}
+
+#define NGX_HTTP_MCP_HASH_INIT  0xcbf29ce484222325ULL
+
+// ngx_http_mcp_module.cpp
+ngx_table_elt_t *ngx_http_mcp_get_header(ngx_http_request_t *r, const u_char *name, size_t len);
+
+// ngx_http_mcp_notify.cpp
+ngx_int_t ngx_http_mcp_notify_init(ngx_cycle_t *cycle);
+void ngx_http_mcp_notify_done(ngx_cycle_t *cycle);
+ngx_int_t ngx_http_mcp_notify_post(ngx_http_mcp_notify_t *item);
+
+// ngx_http_mcp_limit.cpp
+char *ngx_http_mcp_limit_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_limit_method(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_quota_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_quota(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_limit_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf);
+ngx_int_t ngx_http_mcp_limit_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_limit_exit_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+ngx_int_t ngx_http_mcp_limit_check(ngx_http_request_t *r, ngx_http_mcp_loc_conf_t *conf,
+    ngx_http_mcp_limit_input_t *in, ngx_http_mcp_limit_state_t *st, ngx_array_t **charges);
+void ngx_http_mcp_limit_charge_response(ngx_array_t *charges, size_t resp_bytes);
+ngx_int_t ngx_http_mcp_limit_set_headers(ngx_http_request_t *r, ngx_http_mcp_limit_state_t *st);
+ngx_int_t ngx_http_mcp_set_retry_after(ngx_http_request_t *r, ngx_msec_t ms);
+
+// ngx_http_mcp_session.cpp
+char *ngx_http_mcp_session_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_mcp_session_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_session_exit_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+ngx_flag_t ngx_http_mcp_session_enabled(ngx_http_request_t *r);
+ngx_int_t ngx_http_mcp_session_create(ngx_http_request_t *r, ngx_http_mcp_session_info_t *info, ngx_str_t *id);
+ngx_int_t ngx_http_mcp_session_find(ngx_http_request_t *r, ngx_str_t *id, ngx_http_mcp_session_info_t *info);
+ngx_int_t ngx_http_mcp_session_delete(ngx_http_request_t *r, ngx_str_t *id);
+ngx_flag_t ngx_http_mcp_session_alive(ngx_cycle_t *cycle, ngx_str_t *id);
+ngx_int_t ngx_http_mcp_session_terminate(ngx_http_request_t *r);
+ngx_int_t ngx_http_mcp_session_set_header(ngx_http_request_t *r, ngx_str_t *id);
+void ngx_http_mcp_session_stats(ngx_cycle_t *cycle, ngx_uint_t *live, ngx_uint_t *capacity);
+ngx_int_t ngx_http_mcp_random(u_char *buf, size_t len, ngx_log_t *log);
+
+// ngx_http_mcp_events.cpp
+typedef struct {
+    ngx_uint_t     sessions;
+    ngx_uint_t     rings;             // 环形缓冲区个数, 即可同时保存的会话数
+    ngx_uint_t     events;            // 每个环的事件数
+    size_t         memory;            // 环形缓冲区总字节数
+    ngx_uint_t     appended;
+    ngx_uint_t     evicted;
+    ngx_uint_t     oversize;
+    ngx_uint_t     hits;              // Last-Event-ID 之后的事件全部补发
+    ngx_uint_t     misses;
+} ngx_http_mcp_events_stats_t;
+
+char *ngx_http_mcp_event_store(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_mcp_events_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+uint64_t ngx_http_mcp_events_append(ngx_str_t *session, const u_char *data, size_t len);
+ngx_int_t ngx_http_mcp_events_replay(ngx_http_request_t *r, ngx_str_t *session, uint64_t last, ngx_chain_t **out);
+void ngx_http_mcp_events_drop(ngx_str_t *session);
+void ngx_http_mcp_events_stats(ngx_cycle_t *cycle, ngx_http_mcp_events_stats_t *st);
+
+// ngx_http_mcp_cache.cpp
+typedef struct {
+    ngx_uint_t     entries;           // L2 条目数
+    ngx_uint_t     l1_hits;
+    ngx_uint_t     l2_hits;
+    ngx_uint_t     stale_hits;        // 过期但在 stale 窗口内, 已触发后台刷新
+    ngx_uint_t     misses;
+    ngx_uint_t     not_modified;      // 以 304 响应
+    ngx_uint_t     evicted;
+    ngx_uint_t     coalesced;         // 合并到执行中同键请求的次数
+} ngx_http_mcp_cache_stats_t;
+
+char *ngx_http_mcp_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_tool_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_cache_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf);
+ngx_int_t ngx_http_mcp_cache_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_cache_invalidate(ngx_uint_t family);
+void ngx_http_mcp_cache_stats(ngx_cycle_t *cycle, ngx_http_mcp_cache_stats_t *st);
+ngx_flag_t ngx_http_mcp_cache_not_modified(ngx_http_request_t *r, uint64_t etag);
+ngx_int_t ngx_http_mcp_cache_set_etag(ngx_http_request_t *r, uint64_t etag);
+ngx_int_t ngx_http_mcp_cache_send_not_modified(ngx_http_request_t *r, uint64_t etag);
+
+// ngx_http_mcp_sched.cpp
+typedef struct {
+    ngx_uint_t     queued;            // 当前排队的任务数(所有 worker)
+    ngx_uint_t     dispatched;        // 累计投递到线程池的任务数
+    ngx_uint_t     wait_msec;         // 累计排队时间
+    ngx_uint_t     expired;           // 出队时已过截止时间的任务数
+} ngx_http_mcp_sched_stats_t;
+
+char *ngx_http_mcp_scheduler(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_priority(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_mcp_sched_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+ngx_uint_t ngx_http_mcp_sched_priority(ngx_http_request_t *r, ngx_str_t *method, ngx_str_t *tool);
+ngx_int_t ngx_http_mcp_sched_post(ngx_http_request_t *r, ngx_http_mcp_thread_pool_t *tp, ngx_thread_task_t *task,
+    ngx_http_mcp_sched_input_t *in, ngx_http_mcp_sched_entry_t **entry);
+void ngx_http_mcp_sched_done(ngx_http_mcp_sched_entry_t *e);
+ngx_int_t ngx_http_mcp_sched_cancel(ngx_http_mcp_sched_entry_t *e);
+void ngx_http_mcp_sched_stats(ngx_cycle_t *cycle, ngx_http_mcp_sched_stats_t st[NGX_HTTP_MCP_PRIO_CLASSES]);
+
+// ngx_http_mcp_executor.cpp
+typedef struct {
+    ngx_str_t      name;
+    ngx_uint_t     threads;           // 当前线程数
+    ngx_uint_t     queued;
+    ngx_uint_t     completed;
+    ngx_uint_t     stolen;            // 从其他线程队列取得的任务数
+    ngx_uint_t     latency_usec;      // 最近一个采样周期的平均排队时间
+} ngx_http_mcp_executor_stats_t;
+
+char *ngx_http_mcp_executor(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_http_mcp_executor_t *ngx_http_mcp_executor_find(ngx_http_mcp_main_conf_t *mcf, ngx_str_t *name);
+ngx_int_t ngx_http_mcp_executor_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_executor_exit_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+ngx_int_t ngx_http_mcp_thread_task_post(ngx_http_mcp_thread_pool_t *tp, ngx_thread_task_t *task);
+void ngx_http_mcp_executor_stats(ngx_http_mcp_executor_t *ex, ngx_http_mcp_executor_stats_t *st);
+
+// ngx_http_mcp_adaptive.cpp
+char *ngx_http_mcp_concurrency(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_max_inflight(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_mcp_admit(ngx_http_request_t *r, ngx_str_t *method, ngx_str_t *tool, ngx_http_mcp_admit_t *a);
+void ngx_http_mcp_admit_release(ngx_http_mcp_admit_t *a, ngx_flag_t sample);
+
+// ngx_http_mcp_metrics.cpp
+char *ngx_http_mcp_metrics_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_mcp_metrics_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_metrics_record(ngx_http_mcp_metrics_sample_t *s);
+uint64_t ngx_http_mcp_metrics_usec(void);
+uint64_t ngx_http_mcp_metrics_cpu_usec(void);
+
+// ngx_http_mcp_variables.cpp
+ngx_int_t ngx_http_mcp_add_variables(ngx_conf_t *cf);
+
+// ngx_http_mcp_actor.cpp
+ngx_flag_t ngx_http_mcp_actor_wanted(ngx_http_request_t *r, ngx_http_mcp_sched_input_t *in);
+ngx_int_t ngx_http_mcp_actor_post(ngx_http_request_t *r, ngx_http_mcp_thread_pool_t *tp, ngx_thread_task_t *task,
+    ngx_http_mcp_sched_input_t *in, ngx_http_mcp_sched_entry_t **sched, ngx_http_mcp_actor_t *a);
+void ngx_http_mcp_actor_done(ngx_http_mcp_actor_t *a);
+
+// ngx_http_mcp_cancel.cpp
+char *ngx_http_mcp_cancel_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf);
+ngx_int_t ngx_http_mcp_cancel_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_cancel_watch(ngx_http_request_t *r);
+
+// ngx_http_mcp_placement.cpp
+char *ngx_http_mcp_placement(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_mcp_placement_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+ngx_flag_t ngx_http_mcp_placement_offload_body(off_t size);
+
+// ngx_http_mcp_tools.cpp
+char *ngx_http_mcp_tool(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_mcp_tools_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+
+// ngx_http_mcp_subscribe.cpp
+char *ngx_http_mcp_subscribe_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf);
+ngx_int_t ngx_http_mcp_subscribe_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_subscribe_exit_process(ngx_cycle_t *cycle);
+void ngx_http_mcp_subscribe_session_closed(ngx_str_t *session);
+
+// ngx_http_mcp_token.cpp
+char *ngx_http_mcp_session_key(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_mcp_token_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf);
+ngx_int_t ngx_http_mcp_token_issue(ngx_http_request_t *r, ngx_http_mcp_main_conf_t *mcf,
+    ngx_http_mcp_session_info_t *info, ngx_str_t *id);
+ngx_int_t ngx_http_mcp_token_verify(ngx_http_request_t *r, ngx_http_mcp_main_conf_t *mcf,
+    ngx_str_t *id, ngx_http_mcp_session_info_t *info);
+time_t ngx_http_mcp_token_expire(ngx_str_t *id);
+
+} // extern "C"
+
+// ========== 请求级上下文(含 C++ 成员, 各编译单元共享) ==========
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "include/mcp_server.h"
+#include "include/json_stream_parser.h"
+#include "include/request_context.h"
+
+// SSE 响应流: 线程侧 push, 事件循环侧发送; 由 shared_ptr 持有,
+// 请求结束后仍在唤醒队列中的引用也能安全访问(closed 后丢弃)
+// 待发送的 SSE 事件: id 在推送到会话时由事件存储分配, 0 表示不带 id
+typedef struct {
+    uint64_t                   id;
+    std::string                data;          // 已序列化的 JSON-RPC 通知
+} ngx_http_mcp_stream_msg_t;
+
+typedef struct ngx_http_mcp_stream_s : std::enable_shared_from_this<ngx_http_mcp_stream_s> {
+    ngx_http_request_t        *r = nullptr;   // 仅事件循环线程访问
+    std::mutex                 mutex;
+    std::vector<ngx_http_mcp_stream_msg_t> pending;
+    size_t                     pending_bytes = 0;
+    size_t                     limit = 0;     // pending 字节上限, 超出即关闭流; 0 不限制
+    std::atomic<bool>          queued{false};
+    std::atomic<bool>          closed{false};
+
+    // 长连接流(GET): 写缓冲取自堆并在写完后释放, 上一批未写完时新消息留在 pending 中;
+    // 否则写缓冲从请求 pool 分配
+    bool                       persistent = false;
+    std::string                session;       // 长连接流所属会话
+    ngx_buf_t                  buf{};
+    void                     (*on_close)(ngx_http_mcp_stream_s *s) = nullptr; // 事件循环中关闭请求
+
+    ~ngx_http_mcp_stream_s();
+    bool enqueue(std::string &&msg, uint64_t id = 0); // 仅入队, 超出上限返回 false
+    void push(std::string &&msg);             // 入队并唤醒事件循环, 任意线程
+} ngx_http_mcp_stream_t;
+
+// 可取消的在途请求: 按 (会话或客户端地址, 请求 id) 登记, notifications/cancelled、客户端断开
+// 与截止时间都经此取消; 嵌在请求上下文或批量元素中, 仅事件循环线程访问
+typedef struct {
+    uint64_t                      key;       // 0 表示未登记
+    ngx_msec_t                    since;     // 登记时间, 更早的跨 worker 取消不作用于本请求
+    mcp::server::RequestContext  *rctx;
+    ngx_http_mcp_sched_entry_t  **sched;     // 仍在调度器中排队时直接移出
+    ngx_event_t                   timer;     // 截止时间
+    unsigned                      aborted:1; // 排队中被移出或处理函数因取消中止, 完成回调据此应答
+} ngx_http_mcp_cancel_t;
+
+// 与线程任务一同分配; 需 placement new 并在 pool 清理时析构
+typedef struct ngx_http_mcp_async_ctx_s {
+    ngx_http_request_t *r;
+    ngx_thread_task_t  *task;
+    std::string        method;
+    mcp::server::McpServer::MCPRequestVariant req_variant;
+    std::string        id;           // 请求 id 的 JSON 文本, 原样回写到响应
+    ngx_pool_t        *pool;         // 线程独占的私有 pool, 响应 buf 链在其中分配
+    ngx_chain_t       *out;          // 线程中生成的响应 buf 链
+    size_t             out_len;
+    ngx_int_t          status;
+    ngx_http_mcp_limit_state_t limit; // 限流结果, 用于 RateLimit-* 响应头
+    ngx_array_t       *charges;      // 已扣减的规则, 响应后按字节补扣
+    mcp::server::JsonStreamParser body_parser; // 请求体随到随解析
+    off_t              body_bytes;
+    nlohmann::json     progress_token; // params._meta.progressToken
+    bool               sse;
+    std::shared_ptr<ngx_http_mcp_stream_t> stream;
+    mcp::server::RequestContext rctx; // 传给处理函数, SSE 模式下推送进度
+    struct ngx_http_mcp_batch_s *batch; // JSON-RPC 批量请求, 非批量时为空
+    ngx_str_t          session_id;   // 已验证的 Mcp-Session-Id, 无会话时为空
+    ngx_http_mcp_session_info_t session;
+    std::string        cache_key;    // 可缓存方法未命中时设置, 结果算出后存入缓存
+    ngx_http_mcp_cache_policy_t cache_policy;
+    ngx_atomic_uint_t  cache_generation; // 查找时的目录代数, 之后变化则不存
+    std::shared_ptr<const std::string> cache_body; // result 的 JSON 文本, 响应 buf 直接引用
+    ngx_uint_t         cache_flight; // 同键请求合并中的角色, 见 ngx_http_mcp_cache.cpp
+    ngx_uint_t         cache_status; // NGX_HTTP_MCP_CACHE_STATUS_*
+    ngx_msec_t         deadline;     // params._meta.timeout 换算的截止时间, 0 表示无
+    ngx_http_mcp_sched_entry_t *sched; // 经调度器投递时非空
+    uint64_t           handler_usec; // 处理加序列化耗时(微秒), 用于放置决策
+    ngx_http_mcp_admit_t admit;      // 并发限制的准入, 进线程池时设置
+    ngx_http_mcp_cancel_t cancel;
+    ngx_http_mcp_actor_t actor;      // 经 mcp_actor 串行执行时使用
+    // 以下用于指标与日志变量, 单位微秒
+    uint64_t           start_usec;     // 进入 handler 的时刻
+    uint64_t           body_usec;      // 读取请求体, 不含解析
+    uint64_t           parse_usec;     // 解析请求体与构建请求
+    uint64_t           posted_usec;    // 投递线程任务的时刻, 0 表示未进线程池
+    uint64_t           queue_usec;     // 投递到开始执行
+    uint64_t           serialize_usec; // 包含在 handler_usec 中
+    uint64_t           cpu_usec;       // 处理线程 CPU 时间
+    bool               rate_limited;   // 被限流或配额拒绝
+    bool               rpc_error;      // 以 JSON-RPC error 应答
+} ngx_http_mcp_async_ctx_t;
+
+extern "C" {
+
+// ngx_http_mcp_module.cpp
+ngx_int_t ngx_http_mcp_process(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+ngx_int_t ngx_http_mcp_dispatch(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+ngx_http_mcp_thread_pool_t *ngx_http_mcp_get_thread_pool(ngx_http_request_t *r, const std::string &method,
+    const mcp::server::McpServer::MCPRequestVariant &req);
+ngx_int_t ngx_http_mcp_delay(ngx_http_request_t *r, ngx_msec_t delay);
+
+// ngx_http_mcp_batch.cpp
+ngx_int_t ngx_http_mcp_batch_process(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+ngx_int_t ngx_http_mcp_batch_dispatch(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+
+// ngx_http_mcp_cache.cpp
+ngx_int_t ngx_http_mcp_cache_lookup(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+ngx_int_t ngx_http_mcp_cache_save(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+
+// ngx_http_mcp_placement.cpp
+ngx_flag_t ngx_http_mcp_placement_inline(ngx_http_mcp_async_ctx_t *ctx);
+void ngx_http_mcp_placement_record(ngx_http_mcp_async_ctx_t *ctx);
+
+// ngx_http_mcp_tools.cpp
+ngx_int_t ngx_http_mcp_tools_list(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+
+// ngx_http_mcp_body.cpp
+void ngx_http_mcp_body_handler(ngx_http_request_t *r);
+
+// ngx_http_mcp_output.cpp
+ngx_int_t ngx_http_mcp_send_chain(ngx_http_request_t *r, ngx_chain_t *out, size_t len);
+ngx_int_t ngx_http_mcp_send_accepted(ngx_http_request_t *r);
+
+// ngx_http_mcp_sse.cpp
+ngx_flag_t ngx_http_mcp_sse_wanted(ngx_http_request_t *r, ngx_http_mcp_loc_conf_t *conf, ngx_str_t *method);
+ngx_int_t ngx_http_mcp_sse_start(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx);
+ngx_int_t ngx_http_mcp_sse_finish(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx, ngx_chain_t *out);
+void ngx_http_mcp_sse_close(ngx_http_mcp_async_ctx_t *ctx);
+ngx_int_t ngx_http_mcp_sse_send_header(ngx_http_request_t *r);
+size_t ngx_http_mcp_sse_event_size(uint64_t id, size_t len);
+u_char *ngx_http_mcp_sse_event(u_char *p, uint64_t id, const u_char *data, size_t len);
+void ngx_http_mcp_sse_flush(ngx_http_mcp_stream_t *s);
+
+// ngx_http_mcp_listen.cpp
+ngx_int_t ngx_http_mcp_listen(ngx_http_request_t *r);
+ngx_int_t ngx_http_mcp_listen_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf);
+void ngx_http_mcp_listen_exit_process(ngx_cycle_t *cycle);
+
+} // extern "C"
+
+// ngx_http_mcp_output.cpp: 把 JSON-RPC 成功响应序列化进 pool 分配的 buf 链, 分配失败抛 std::bad_alloc;
+// 在线程中调用时 pool 必须为该线程独占
+ngx_chain_t *ngx_http_mcp_serialize_result(ngx_pool_t *pool, const std::string &id,
+                                           const nlohmann::json &result, size_t *len);
+ngx_chain_t *ngx_http_mcp_serialize_error(ngx_pool_t *pool, const std::string &id, int code,
+                                          const char *message, const nlohmann::json &data, size_t *len);
+
+ngx_chain_t *ngx_http_mcp_wrap_result(ngx_pool_t *pool, const std::string &id,
+                                      const u_char *data, size_t n, size_t *len);
+
+// ngx_http_mcp_cache.cpp: 可缓存的请求把 result 序列化进 ctx->cache_body, 响应直接引用;
+// 其余请求同 ngx_http_mcp_serialize_result。可在线程中调用
+ngx_chain_t *ngx_http_mcp_cache_result(ngx_http_mcp_async_ctx_t *ctx, ngx_pool_t *pool,
+                                       const nlohmann::json &result, size_t *len);
+
+// ngx_http_mcp_module.cpp: params._meta.timeout(毫秒)换算的截止时间, 未给出时为 0
+ngx_msec_t ngx_http_mcp_request_deadline(const nlohmann::json &msg);
+
+// ngx_http_mcp_module.cpp: 通知与客户端发回的响应, 只需 202 确认
+bool ngx_http_mcp_no_reply(const nlohmann::json &msg);
+
+// ngx_http_mcp_cancel.cpp: 仅在事件循环线程调用
+ngx_msec_t ngx_http_mcp_cancel_deadline(ngx_http_request_t *r, const nlohmann::json &msg);
+void ngx_http_mcp_cancel_limits(ngx_http_request_t *r, mcp::server::RequestContext *rctx, ngx_msec_t deadline);
+void ngx_http_mcp_cancel_register(ngx_http_request_t *r, ngx_http_mcp_cancel_t *c, ngx_str_t *session,
+                                  const std::string &id, mcp::server::RequestContext *rctx,
+                                  ngx_http_mcp_sched_entry_t **sched, ngx_msec_t deadline);
+void ngx_http_mcp_cancel_unregister(ngx_http_mcp_cancel_t *c);
+void ngx_http_mcp_cancel_request(ngx_http_mcp_cancel_t *c, mcp::server::CancelReason reason);
+void ngx_http_mcp_cancel_notification(ngx_http_request_t *r, ngx_str_t *session, const nlohmann::json &msg);
+// 超时与 CPU 超限的 JSON-RPC 错误; 分配失败抛 std::bad_alloc
+ngx_chain_t *ngx_http_mcp_cancel_error(ngx_pool_t *pool, const std::string &id,
+                                       mcp::server::CancelReason reason, size_t *len);
+
+// ngx_http_mcp_metrics.cpp: 请求结束时记录, 批量请求的元素由 ngx_http_mcp_batch.cpp 各自记录
+void ngx_http_mcp_metrics_request(ngx_http_mcp_async_ctx_t *ctx);
+
+// ngx_http_mcp_batch.cpp
+void ngx_http_mcp_batch_cancel(ngx_http_mcp_async_ctx_t *ctx, mcp::server::CancelReason reason);
+
+// ngx_http_mcp_subscribe.cpp: 仅在事件循环线程调用
+void ngx_http_mcp_sink_add(const std::string &session, const std::shared_ptr<ngx_http_mcp_stream_t> &stream);
+void ngx_http_mcp_sink_remove(const std::string &session, ngx_http_mcp_stream_t *stream);
+
+// ngx_http_mcp_session.cpp
+void ngx_http_mcp_session_fill(ngx_http_mcp_session_info_t *info, const mcp::InitializeRequest &req);
+
+#endif
@@ -0,0 +1,132 @@
+#include <atomic>
+#include "ngx_http_mcp_module.h"
+
+#if (NGX_HAVE_EVENTFD && NGX_HAVE_SYS_EVENTFD_H)
+#include <sys/eventfd.h>
+#endif
+
+// 线程 -> 事件循环的唤醒通道: 每个 worker 一个 eventfd(无 eventfd 时退化为 pipe)
+// 加一个无锁 MPSC 栈。不复用 ngx_notify, 它只有一个全局 handler, 已被线程池占用。
+
+static std::atomic<ngx_http_mcp_notify_t*> ngx_http_mcp_notify_head{nullptr};
+static ngx_connection_t *ngx_http_mcp_notify_conn;
+static ngx_fd_t          ngx_http_mcp_notify_wfd = NGX_INVALID_FILE;
+
+extern "C" {
+
+static void
+ngx_http_mcp_notify_drain(ngx_fd_t fd) {
+    u_char buf[64];
+    for ( ;; ) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n > 0 && (size_t)n == sizeof(buf)) continue;
+        if (n == -1 && ngx_errno == NGX_EINTR) continue;
+        break;
+    }
+}
+
+static void
+ngx_http_mcp_notify_read_handler(ngx_event_t *rev) {
+    ngx_connection_t *c = static_cast<ngx_connection_t*>(rev->data);
+
+    // 先清空唤醒计数再摘链, 保证摘链之后的投递一定会触发下一次唤醒
+    ngx_http_mcp_notify_drain(c->fd);
+    ngx_http_mcp_notify_t *list = ngx_http_mcp_notify_head.exchange(nullptr, std::memory_order_acquire);
+
+    // 栈为 LIFO, 反转后按投递顺序执行
+    ngx_http_mcp_notify_t *fifo = nullptr;
+    while (list) {
+        ngx_http_mcp_notify_t *next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    while (fifo) {
+        ngx_http_mcp_notify_t *next = fifo->next;
+        fifo->handler(fifo);
+        fifo = next;
+    }
+}
+
+// 任意线程可调用; 仅在队列由空变非空时写唤醒, 合并同一轮内的多次投递
+ngx_int_t
+ngx_http_mcp_notify_post(ngx_http_mcp_notify_t *item) {
+    if (ngx_http_mcp_notify_wfd == NGX_INVALID_FILE) return NGX_ERROR;
+
+    item->next = ngx_http_mcp_notify_head.load(std::memory_order_relaxed);
+    while (!ngx_http_mcp_notify_head.compare_exchange_weak(
+               item->next, item, std::memory_order_release, std::memory_order_relaxed)) {
+        /* retry */
+    }
+    if (item->next != nullptr) return NGX_OK;
+
+#if (NGX_HAVE_EVENTFD && NGX_HAVE_SYS_EVENTFD_H)
+    uint64_t one = 1;
+#else
+    u_char one = 1;
+#endif
+    for ( ;; ) {
+        ssize_t n = write(ngx_http_mcp_notify_wfd, &one, sizeof(one));
+        if (n == -1 && ngx_errno == NGX_EINTR) continue;
+        // EAGAIN: 计数已满/管道已满, 说明已有未处理的唤醒
+        break;
+    }
+    return NGX_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_notify_init(ngx_cycle_t *cycle) {
+    ngx_fd_t rfd;
+
+#if (NGX_HAVE_EVENTFD && NGX_HAVE_SYS_EVENTFD_H)
+    rfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (rfd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, "mcp eventfd() failed");
+        return NGX_ERROR;
+    }
+    ngx_http_mcp_notify_wfd = rfd;
+#else
+    int fds[2];
+    if (pipe(fds) == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, "mcp pipe() failed");
+        return NGX_ERROR;
+    }
+    if (ngx_nonblocking(fds[0]) == -1 || ngx_nonblocking(fds[1]) == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, "mcp notify pipe nonblocking failed");
+        close(fds[0]);
+        close(fds[1]);
+        return NGX_ERROR;
+    }
+    rfd = fds[0];
+    ngx_http_mcp_notify_wfd = fds[1];
+#endif
+
+    ngx_connection_t *c = ngx_get_connection(rfd, cycle->log);
+    if (c == NULL) {
+        return NGX_ERROR;
+    }
+    c->log = cycle->log;
+    c->read->log = cycle->log;
+    c->read->handler = ngx_http_mcp_notify_read_handler;
+    c->read->channel = 1;   // 不计入连接数, 退出时不等待
+
+    if (ngx_add_event(c->read, NGX_READ_EVENT, 0) == NGX_ERROR) {
+        ngx_close_connection(c);
+        return NGX_ERROR;
+    }
+    ngx_http_mcp_notify_conn = c;
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_notify_done(ngx_cycle_t *cycle) {
+    if (ngx_http_mcp_notify_conn == NULL) return;
+#if !(NGX_HAVE_EVENTFD && NGX_HAVE_SYS_EVENTFD_H)
+    close(ngx_http_mcp_notify_wfd);
+#endif
+    ngx_http_mcp_notify_wfd = NGX_INVALID_FILE;
+    ngx_close_connection(ngx_http_mcp_notify_conn);
+    ngx_http_mcp_notify_conn = NULL;
+}
+
+} // extern "C"
@@ -0,0 +1,170 @@
+#include <new>
+#include "ngx_http_mcp_module.h"
+
+namespace {
+
+// 预序列化的 JSON-RPC 响应外壳
+const char kEnvelopeHead[] = "{\"jsonrpc\":\"2.0\",\"id\":";
+const char kEnvelopeResult[] = ",\"result\":";
+const char kEnvelopeTail[] = "}";
+
+// nlohmann 序列化输出适配器: 直接写入 pool 中按块分配的 ngx_buf_t 链,
+// 块大小从一页开始倍增, 大结果不需要一整块连续内存
+class ChainWriter : public nlohmann::detail::output_adapter_protocol<char> {
+public:
+    explicit ChainWriter(ngx_pool_t *pool) : pool_(pool) {}
+
+    void write_character(char c) override {
+        if (buf_ == nullptr || buf_->last == buf_->end) grow();
+        *buf_->last++ = static_cast<u_char>(c);
+        size_++;
+    }
+
+    void write_characters(const char *s, std::size_t n) override {
+        size_ += n;
+        while (n) {
+            if (buf_ == nullptr || buf_->last == buf_->end) grow();
+            size_t k = ngx_min(n, (size_t)(buf_->end - buf_->last));
+            buf_->last = ngx_cpymem(buf_->last, s, k);
+            s += k;
+            n -= k;
+        }
+    }
+
+    ngx_chain_t *chain() const { return head_; }
+    size_t size() const { return size_; }
+
+private:
+    void grow() {
+        size_t chunk = next_;
+        if (next_ < NGX_HTTP_MCP_OUTPUT_CHUNK_MAX) next_ *= 2;
+
+        ngx_buf_t *b = ngx_create_temp_buf(pool_, chunk);
+        ngx_chain_t *cl = ngx_alloc_chain_link(pool_);
+        if (b == NULL || cl == NULL) throw std::bad_alloc();
+        cl->buf = b;
+        cl->next = NULL;
+        *last_ = cl;
+        last_ = &cl->next;
+        buf_ = b;
+    }
+
+    ngx_pool_t   *pool_;
+    ngx_buf_t    *buf_ = nullptr;
+    ngx_chain_t  *head_ = nullptr;
+    ngx_chain_t **last_ = &head_;
+    size_t        size_ = 0;
+    size_t        next_ = ngx_pagesize;
+};
+
+} // namespace
+
+ngx_chain_t *
+ngx_http_mcp_serialize_result(ngx_pool_t *pool, const std::string &id,
+                              const nlohmann::json &result, size_t *len) {
+    auto writer = std::make_shared<ChainWriter>(pool);
+    writer->write_characters(kEnvelopeHead, sizeof(kEnvelopeHead) - 1);
+    writer->write_characters(id.data(), id.size());
+    writer->write_characters(kEnvelopeResult, sizeof(kEnvelopeResult) - 1);
+
+    nlohmann::detail::serializer<nlohmann::json> s(writer, ' ');
+    s.dump(result, false, false, 0);
+
+    writer->write_characters(kEnvelopeTail, sizeof(kEnvelopeTail) - 1);
+    *len = writer->size();
+    return writer->chain();
+}
+
+// JSON-RPC 错误对象, 仅在错误路径使用, 不追求零拷贝
+ngx_chain_t *
+ngx_http_mcp_serialize_error(ngx_pool_t *pool, const std::string &id, int code,
+                             const char *message, const nlohmann::json &data, size_t *len) {
+    nlohmann::json err;
+    err["code"] = code;
+    err["message"] = message;
+    if (!data.is_null()) err["data"] = data;
+
+    auto writer = std::make_shared<ChainWriter>(pool);
+    writer->write_characters(kEnvelopeHead, sizeof(kEnvelopeHead) - 1);
+    writer->write_characters(id.data(), id.size());
+    writer->write_characters(",\"error\":", sizeof(",\"error\":") - 1);
+    nlohmann::detail::serializer<nlohmann::json> s(writer, ' ');
+    s.dump(err, false, false, 0);
+    writer->write_characters(kEnvelopeTail, sizeof(kEnvelopeTail) - 1);
+    *len = writer->size();
+    return writer->chain();
+}
+
+// 以预序列化的 result 文本构造响应, 不复制 data; data 须在请求结束前保持有效
+ngx_chain_t *
+ngx_http_mcp_wrap_result(ngx_pool_t *pool, const std::string &id, const u_char *data, size_t n, size_t *len) {
+    const u_char *parts[4] = {
+        (const u_char*)kEnvelopeHead, NULL, data, (const u_char*)kEnvelopeTail
+    };
+    size_t sizes[4] = { sizeof(kEnvelopeHead) - 1, 0, n, sizeof(kEnvelopeTail) - 1 };
+
+    // id 与 ",\"result\":" 拼在一个小 buf 中
+    size_t id_len = id.size() + sizeof(kEnvelopeResult) - 1;
+    u_char *p = (u_char*)ngx_pnalloc(pool, id_len);
+    if (p == NULL) return NULL;
+    ngx_memcpy(ngx_cpymem(p, id.data(), id.size()), kEnvelopeResult, sizeof(kEnvelopeResult) - 1);
+    parts[1] = p;
+    sizes[1] = id_len;
+
+    ngx_chain_t *out = NULL, **ll = &out;
+    *len = 0;
+    for (int i = 0; i < 4; ++i) {
+        ngx_buf_t *b = ngx_calloc_buf(pool);
+        ngx_chain_t *cl = ngx_alloc_chain_link(pool);
+        if (b == NULL || cl == NULL) return NULL;
+        b->pos = (u_char*)parts[i];
+        b->last = b->pos + sizes[i];
+        b->memory = 1;
+        cl->buf = b;
+        cl->next = NULL;
+        *ll = cl;
+        ll = &cl->next;
+        *len += sizes[i];
+    }
+    return out;
+}
+
+extern "C" {
+
+// 只含通知(无 id)的请求: 202 Accepted, 无响应体
+ngx_int_t ngx_http_mcp_send_accepted(ngx_http_request_t *r) {
+    r->headers_out.status = NGX_HTTP_ACCEPTED;
+    r->headers_out.content_length_n = 0;
+    r->header_only = 1;
+
+    ngx_int_t rc = ngx_http_send_header(r);
+    if (rc == NGX_ERROR || rc > NGX_OK) {
+        return rc;
+    }
+    return ngx_http_send_special(r, NGX_HTTP_LAST);
+}
+
+// 发送已序列化好的 buf 链作为 application/json 响应
+ngx_int_t ngx_http_mcp_send_chain(ngx_http_request_t *r, ngx_chain_t *out, size_t len) {
+    static ngx_str_t json_type = ngx_string("application/json");
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = len;
+    r->headers_out.content_type = json_type;
+    r->headers_out.content_type_len = json_type.len;
+    r->headers_out.content_type_lowcase = NULL;
+
+    ngx_int_t rc = ngx_http_send_header(r);
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    ngx_chain_t *cl = out;
+    while (cl->next) cl = cl->next;
+    cl->buf->last_buf = (r == r->main) ? 1 : 0;
+    cl->buf->last_in_chain = 1;
+
+    return ngx_http_output_filter(r, out);
+}
+
+} // extern "C"
@@ -0,0 +1,133 @@
+#include <string>
+#include <unordered_map>
+#include "ngx_http_mcp_module.h"
+
+// 各阶段在事件循环还是线程池中执行: 每个 worker 按方法(tools/call 按工具)记录处理加序列化耗时的
+// EWMA, 样本足够且低于 inline 阈值的请求直接在事件循环中处理, 省去一次线程往返;
+// 请求体超过 body 阈值时解析、处理与序列化都放进线程池, 不阻塞事件循环。
+
+// EWMA 权重 1/8
+#define NGX_HTTP_MCP_PLACEMENT_SHIFT    3
+
+// 至少这么多个样本后才考虑在事件循环中处理
+#define NGX_HTTP_MCP_PLACEMENT_SAMPLES  4
+
+// 每个 worker 记录的方法/工具数上限, 防止任意工具名撑大表
+#define NGX_HTTP_MCP_PLACEMENT_KEYS     4096
+
+typedef struct {
+    uint64_t    ewma_usec;
+    ngx_uint_t  samples;
+} ngx_http_mcp_placement_cost_t;
+
+// 以下仅在事件循环线程访问
+static ngx_uint_t                                                      ngx_http_mcp_placement_inline_usec;
+static size_t                                                          ngx_http_mcp_placement_body;
+static std::unordered_map<std::string, ngx_http_mcp_placement_cost_t>  ngx_http_mcp_placement_costs;
+
+// tools/call 按工具名区分, 与方法名不会冲突
+static std::string
+ngx_http_mcp_placement_key(ngx_http_mcp_async_ctx_t *ctx) {
+    if (auto *call = std::get_if<mcp::CallToolRequest>(&ctx->req_variant)) {
+        return ctx->method + ':' + call->params.name;
+    }
+    return ctx->method;
+}
+
+extern "C" {
+
+ngx_flag_t
+ngx_http_mcp_placement_inline(ngx_http_mcp_async_ctx_t *ctx) {
+    if (ngx_http_mcp_placement_inline_usec == 0 || ctx->sse
+        || (size_t)ctx->body_bytes > ngx_http_mcp_placement_body)
+    {
+        return 0;
+    }
+    try {
+        auto it = ngx_http_mcp_placement_costs.find(ngx_http_mcp_placement_key(ctx));
+        return it != ngx_http_mcp_placement_costs.end()
+            && it->second.samples >= NGX_HTTP_MCP_PLACEMENT_SAMPLES
+            && it->second.ewma_usec < ngx_http_mcp_placement_inline_usec;
+    } catch (const std::bad_alloc &) {
+        return 0;
+    }
+}
+
+// 事件循环中调用; 耗时由执行处记在 ctx->handler_usec
+void
+ngx_http_mcp_placement_record(ngx_http_mcp_async_ctx_t *ctx) {
+    if (ngx_http_mcp_placement_inline_usec == 0) return;
+    try {
+        std::string key = ngx_http_mcp_placement_key(ctx);
+        auto it = ngx_http_mcp_placement_costs.find(key);
+        if (it == ngx_http_mcp_placement_costs.end()) {
+            if (ngx_http_mcp_placement_costs.size() >= NGX_HTTP_MCP_PLACEMENT_KEYS) return;
+            ngx_http_mcp_placement_costs.emplace(std::move(key),
+                                                 ngx_http_mcp_placement_cost_t{ctx->handler_usec, 1});
+            return;
+        }
+        ngx_http_mcp_placement_cost_t &c = it->second;
+        if (ctx->handler_usec >= c.ewma_usec) {
+            c.ewma_usec += (ctx->handler_usec - c.ewma_usec) >> NGX_HTTP_MCP_PLACEMENT_SHIFT;
+        } else {
+            c.ewma_usec -= (c.ewma_usec - ctx->handler_usec) >> NGX_HTTP_MCP_PLACEMENT_SHIFT;
+        }
+        c.samples++;
+    } catch (const std::bad_alloc &) {
+    }
+}
+
+ngx_flag_t
+ngx_http_mcp_placement_offload_body(off_t size) {
+    return ngx_http_mcp_placement_inline_usec != 0 && (size_t)size > ngx_http_mcp_placement_body;
+}
+
+// mcp_placement off | [inline=time] [body=size]; inline 可写 us 或 ms
+char *ngx_http_mcp_placement(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->placement_inline != NGX_CONF_UNSET_UINT) return (char*)"is duplicate";
+
+    if (cf->args->nelts == 2 && value[1].len == 3 && ngx_strncmp(value[1].data, "off", 3) == 0) {
+        mcf->placement_inline = 0;
+        return NGX_CONF_OK;
+    }
+
+    mcf->placement_inline = 50;
+    for (ngx_uint_t i = 1; i < cf->args->nelts; ++i) {
+        ngx_str_t s;
+        if (ngx_strncmp(value[i].data, "inline=", 7) == 0) {
+            s.data = value[i].data + 7;
+            s.len = value[i].len - 7;
+            if (s.len > 2 && ngx_strncmp(s.data + s.len - 2, "us", 2) == 0) {
+                ngx_int_t n = ngx_atoi(s.data, s.len - 2);
+                if (n == NGX_ERROR || n == 0) return (char*)"invalid inline";
+                mcf->placement_inline = (ngx_uint_t)n;
+            } else {
+                ngx_msec_t t = ngx_parse_time(&s, 0);
+                if (t == (ngx_msec_t)NGX_ERROR || t == 0) return (char*)"invalid inline";
+                mcf->placement_inline = (ngx_uint_t)t * 1000;
+            }
+        } else if (ngx_strncmp(value[i].data, "body=", 5) == 0) {
+            s.data = value[i].data + 5;
+            s.len = value[i].len - 5;
+            ssize_t n = ngx_parse_size(&s);
+            if (n == NGX_ERROR) return (char*)"invalid body";
+            mcf->placement_body = (size_t)n;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+    return NGX_CONF_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_placement_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    ngx_http_mcp_placement_inline_usec = mcf->placement_inline;
+    ngx_http_mcp_placement_body = mcf->placement_body;
+    return NGX_OK;
+}
+
+} // extern "C"
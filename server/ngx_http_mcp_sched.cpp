@@ -0,0 +1,410 @@
+#include <new>
+#include <string>
+#include <unordered_map>
+#include "ngx_http_mcp_module.h"
+
+// 线程池前的调度器: nginx 线程池是 FIFO, 一个会话的突发请求会排在所有人前面。
+// 每个 worker 对每个线程池只投递 inflight 个任务, 其余留在本模块的队列中:
+// 先按优先级(initialize/ping 最先), 同一优先级内按会话分队列做亏损轮转(DRR),
+// 每个会话每轮最多出队 quantum 个任务; deadline=on 时会话队列内按截止时间排序。
+// 任务完成后由完成回调调用 ngx_http_mcp_sched_done 释放名额并补投下一个。
+// 各优先级的排队数与排队时间记在共享内存中, 所有 worker 共用。
+
+#define NGX_HTTP_MCP_SCHED_ZONE_NAME  "mcp_sched"
+
+typedef struct {
+    ngx_atomic_t        queued;
+    ngx_atomic_t        dispatched;
+    ngx_atomic_t        wait_msec;
+    ngx_atomic_t        expired;
+} ngx_http_mcp_sched_counters_t;
+
+typedef struct {
+    ngx_http_mcp_sched_counters_t classes[NGX_HTTP_MCP_PRIO_CLASSES];
+} ngx_http_mcp_sched_shctx_t;
+
+typedef struct {
+    ngx_http_mcp_sched_shctx_t *sh;
+    ngx_uint_t                  inflight;   // 每个 worker 每个线程池同时执行的任务数
+    ngx_uint_t                  quantum;    // 每个会话每轮出队的任务数
+    ngx_flag_t                  deadline;   // 会话队列内按截止时间排序
+} ngx_http_mcp_sched_conf_t;
+
+namespace {
+
+struct ngx_http_mcp_sched_class_s;
+
+// 某优先级下一个会话的排队任务
+struct ngx_http_mcp_sched_session_t {
+    ngx_queue_t                        tasks;     // ngx_http_mcp_sched_entry_t.queue
+    ngx_queue_t                        ring;      // 所在优先级的轮转环
+    ngx_uint_t                         deficit = 0;
+    std::string                        key;
+    struct ngx_http_mcp_sched_class_s *cls = nullptr;
+};
+
+struct ngx_http_mcp_sched_class_s {
+    std::unordered_map<std::string, ngx_http_mcp_sched_session_t> sessions;
+    ngx_queue_t                        ring;      // 有任务排队的会话
+};
+
+struct ngx_http_mcp_sched_pool_s {
+    ngx_http_mcp_thread_pool_t        *tp = nullptr;
+    ngx_uint_t                         inflight = 0;
+    ngx_uint_t                         queued = 0;
+    ngx_http_mcp_sched_class_s         classes[NGX_HTTP_MCP_PRIO_CLASSES];
+};
+
+} // namespace
+
+struct ngx_http_mcp_sched_entry_s {
+    ngx_queue_t                        queue;
+    ngx_thread_task_t                 *task;
+    ngx_http_mcp_sched_pool_s         *pool;
+    ngx_http_mcp_sched_session_t      *session;   // 排队中非空
+    ngx_uint_t                         prio;
+    ngx_msec_t                         deadline;
+    ngx_msec_t                         queued;    // 进入调度器的时间
+    ngx_msec_t                         started;   // 投递到线程池的时间
+    unsigned                           running:1;
+};
+
+// 以下仅在事件循环线程访问
+static ngx_shm_zone_t                                                     *ngx_http_mcp_sched_zone;
+static std::unordered_map<const void*, ngx_http_mcp_sched_pool_s>         ngx_http_mcp_sched_pools;  // 键为 thread_pool 或执行器
+
+extern "C" {
+
+static ngx_http_mcp_sched_conf_t *
+ngx_http_mcp_sched_conf() {
+    return ngx_http_mcp_sched_zone
+        ? static_cast<ngx_http_mcp_sched_conf_t*>(ngx_http_mcp_sched_zone->data) : NULL;
+}
+
+static ngx_http_mcp_priority_t *
+ngx_http_mcp_sched_rule(ngx_array_t *rules, ngx_str_t *name) {
+    if (rules == NULL || name->len == 0) return NULL;
+    auto *rule = (ngx_http_mcp_priority_t*)rules->elts;
+    for (ngx_uint_t i = 0; i < rules->nelts; ++i) {
+        if (rule[i].name.len == name->len && ngx_strncmp(rule[i].name.data, name->data, name->len) == 0) {
+            return &rule[i];
+        }
+    }
+    return NULL;
+}
+
+// 工具名优先于方法名, 再到 "*"; 都未配置时 initialize、ping 与通知为高, tools/call 为低
+ngx_uint_t
+ngx_http_mcp_sched_priority(ngx_http_request_t *r, ngx_str_t *method, ngx_str_t *tool) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_get_module_main_conf(r, ngx_http_mcp_module);
+    ngx_str_t any = ngx_string("*");
+    ngx_http_mcp_priority_t *rule = NULL;
+
+    if (tool && tool->len) rule = ngx_http_mcp_sched_rule(mcf->priorities, tool);
+    if (rule == NULL) rule = ngx_http_mcp_sched_rule(mcf->priorities, method);
+    if (rule == NULL) rule = ngx_http_mcp_sched_rule(mcf->priorities, &any);
+    if (rule) return rule->prio;
+
+    if ((method->len == sizeof("initialize") - 1 && ngx_strncmp(method->data, "initialize", method->len) == 0)
+        || (method->len == sizeof("ping") - 1 && ngx_strncmp(method->data, "ping", method->len) == 0)
+        || (method->len > sizeof("notifications/") - 1
+            && ngx_strncmp(method->data, "notifications/", sizeof("notifications/") - 1) == 0))
+    {
+        return NGX_HTTP_MCP_PRIO_HIGH;
+    }
+    if (method->len == sizeof("tools/call") - 1 && ngx_strncmp(method->data, "tools/call", method->len) == 0) {
+        return NGX_HTTP_MCP_PRIO_LOW;
+    }
+    return NGX_HTTP_MCP_PRIO_NORMAL;
+}
+
+// 从会话队列摘下, 队列空时会话离开轮转环
+static void
+ngx_http_mcp_sched_unlink(ngx_http_mcp_sched_entry_t *e) {
+    ngx_http_mcp_sched_session_t *s = e->session;
+    ngx_http_mcp_sched_conf_t *conf = ngx_http_mcp_sched_conf();
+
+    ngx_queue_remove(&e->queue);
+    e->session = NULL;
+    e->pool->queued--;
+    (void)ngx_atomic_fetch_add(&conf->sh->classes[e->prio].queued, (ngx_atomic_int_t)-1);
+
+    if (ngx_queue_empty(&s->tasks)) {
+        ngx_queue_remove(&s->ring);
+        auto it = s->cls->sessions.find(s->key);
+        s->cls->sessions.erase(it);
+    }
+}
+
+static void
+ngx_http_mcp_sched_enqueue(ngx_http_mcp_sched_conf_t *conf, ngx_http_mcp_sched_entry_t *e, const std::string &key) {
+    ngx_http_mcp_sched_class_s &cls = e->pool->classes[e->prio];
+    auto ins = cls.sessions.try_emplace(key);
+    ngx_http_mcp_sched_session_t *s = &ins.first->second;
+    if (ins.second) {
+        s->key = key;
+        s->cls = &cls;
+        ngx_queue_init(&s->tasks);
+        ngx_queue_insert_tail(&cls.ring, &s->ring);
+    }
+
+    // 截止时间早的排在前面, 没有截止时间的视为无穷远; 相同时保持到达顺序
+    ngx_queue_t *q = ngx_queue_last(&s->tasks);
+    if (conf->deadline && e->deadline) {
+        while (q != ngx_queue_sentinel(&s->tasks)) {
+            auto *prev = ngx_queue_data(q, ngx_http_mcp_sched_entry_t, queue);
+            if (prev->deadline && (ngx_msec_int_t)(prev->deadline - e->deadline) <= 0) break;
+            q = ngx_queue_prev(q);
+        }
+    }
+    ngx_queue_insert_after(q, &e->queue);
+
+    e->session = s;
+    e->pool->queued++;
+    (void)ngx_atomic_fetch_add(&conf->sh->classes[e->prio].queued, 1);
+}
+
+// 最高的非空优先级中, 轮转环首个会话出队一个任务; 用完本轮 quantum 的会话移到环尾
+static ngx_http_mcp_sched_entry_t *
+ngx_http_mcp_sched_pick(ngx_http_mcp_sched_conf_t *conf, ngx_http_mcp_sched_pool_s *p) {
+    for (ngx_uint_t c = 0; c < NGX_HTTP_MCP_PRIO_CLASSES; ++c) {
+        ngx_http_mcp_sched_class_s &cls = p->classes[c];
+        if (ngx_queue_empty(&cls.ring)) continue;
+
+        auto *s = ngx_queue_data(ngx_queue_head(&cls.ring), ngx_http_mcp_sched_session_t, ring);
+        if (s->deficit == 0) s->deficit = conf->quantum;
+        s->deficit--;
+        auto *e = ngx_queue_data(ngx_queue_head(&s->tasks), ngx_http_mcp_sched_entry_t, queue);
+
+        if (s->deficit == 0 && ngx_queue_next(&s->tasks) != ngx_queue_last(&s->tasks)) {
+            ngx_queue_remove(&s->ring);
+            ngx_queue_insert_tail(&cls.ring, &s->ring);
+        }
+        ngx_http_mcp_sched_unlink(e);
+        return e;
+    }
+    return NULL;
+}
+
+static ngx_int_t
+ngx_http_mcp_sched_start(ngx_http_mcp_sched_conf_t *conf, ngx_http_mcp_sched_entry_t *e) {
+    ngx_http_mcp_sched_counters_t *cnt = &conf->sh->classes[e->prio];
+
+    e->started = ngx_current_msec;
+    e->running = 1;
+    e->pool->inflight++;
+    (void)ngx_atomic_fetch_add(&cnt->dispatched, 1);
+    (void)ngx_atomic_fetch_add(&cnt->wait_msec, e->started - e->queued);
+    if (e->deadline && (ngx_msec_int_t)(e->started - e->deadline) > 0) {
+        (void)ngx_atomic_fetch_add(&cnt->expired, 1);
+    }
+    return ngx_http_mcp_thread_task_post(e->pool->tp, e->task);
+}
+
+// 名额空出时按调度顺序补投; 线程池拒收(max_queue 已满)时在事件循环中执行, 完成回调照常触发
+static void
+ngx_http_mcp_sched_pump(ngx_http_mcp_sched_conf_t *conf, ngx_http_mcp_sched_pool_s *p) {
+    while (p->inflight < conf->inflight && p->queued) {
+        ngx_http_mcp_sched_entry_t *e = ngx_http_mcp_sched_pick(conf, p);
+        if (ngx_http_mcp_sched_start(conf, e) == NGX_OK) continue;
+
+        ngx_log_error(NGX_LOG_ERR, ngx_cycle->log, 0, "mcp failed to post scheduled thread task, running inline");
+        e->task->handler(e->task->ctx, ngx_cycle->log);
+        ngx_post_event(&e->task->event, &ngx_posted_events);
+    }
+}
+
+// 请求在排队中结束时移出队列; 已投递的任务由完成回调释放名额
+static void
+ngx_http_mcp_sched_cleanup(void *data) {
+    auto *e = static_cast<ngx_http_mcp_sched_entry_t*>(data);
+    if (e->session) ngx_http_mcp_sched_unlink(e);
+}
+
+ngx_int_t
+ngx_http_mcp_sched_post(ngx_http_request_t *r, ngx_http_mcp_thread_pool_t *tp, ngx_thread_task_t *task,
+    ngx_http_mcp_sched_input_t *in, ngx_http_mcp_sched_entry_t **entry)
+{
+    ngx_http_mcp_sched_conf_t *conf = ngx_http_mcp_sched_conf();
+    *entry = NULL;
+    if (conf == NULL) return ngx_http_mcp_thread_task_post(tp, task);
+
+    auto *e = (ngx_http_mcp_sched_entry_t*)ngx_pcalloc(r->pool, sizeof(ngx_http_mcp_sched_entry_t));
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (e == NULL || cln == NULL) return NGX_ERROR;
+
+    try {
+        ngx_http_mcp_sched_pool_s &p = ngx_http_mcp_sched_pools[tp->ex ? (const void*)tp->ex : (const void*)tp->tp];
+        if (p.tp == NULL) {
+            p.tp = tp;
+            for (auto &cls : p.classes) {
+                ngx_queue_init(&cls.ring);
+            }
+        }
+        e->task = task;
+        e->pool = &p;
+        e->prio = ngx_http_mcp_sched_priority(r, &in->method, &in->tool);
+        e->deadline = in->deadline;
+        e->queued = ngx_current_msec;
+
+        if (p.inflight < conf->inflight && p.queued == 0) {
+            if (ngx_http_mcp_sched_start(conf, e) != NGX_OK) {
+                p.inflight--;
+                return NGX_ERROR;
+            }
+        } else {
+            ngx_str_t *key = in->session.len ? &in->session : &r->connection->addr_text;
+            ngx_http_mcp_sched_enqueue(conf, e, std::string((const char*)key->data, key->len));
+        }
+    } catch (const std::bad_alloc &) {
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_http_mcp_sched_cleanup;
+    cln->data = e;
+    *entry = e;
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_sched_done(ngx_http_mcp_sched_entry_t *e) {
+    if (e == NULL || !e->running) return;
+    e->running = 0;
+    e->pool->inflight--;
+    ngx_http_mcp_sched_pump(ngx_http_mcp_sched_conf(), e->pool);
+}
+
+// 仍在排队的任务移出并投递完成事件(不执行), 已投递到线程池的返回 NGX_DECLINED
+ngx_int_t
+ngx_http_mcp_sched_cancel(ngx_http_mcp_sched_entry_t *e) {
+    if (e == NULL || e->session == NULL) return NGX_DECLINED;
+    ngx_http_mcp_sched_unlink(e);
+    ngx_post_event(&e->task->event, &ngx_posted_events);
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_sched_stats(ngx_cycle_t *cycle, ngx_http_mcp_sched_stats_t st[NGX_HTTP_MCP_PRIO_CLASSES]) {
+    ngx_memzero(st, sizeof(ngx_http_mcp_sched_stats_t) * NGX_HTTP_MCP_PRIO_CLASSES);
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(cycle, ngx_http_mcp_module);
+    if (mcf == NULL || mcf->sched_zone == NULL) return;
+    auto *conf = static_cast<ngx_http_mcp_sched_conf_t*>(mcf->sched_zone->data);
+    if (conf->sh == NULL) return;
+
+    for (ngx_uint_t c = 0; c < NGX_HTTP_MCP_PRIO_CLASSES; ++c) {
+        ngx_http_mcp_sched_counters_t *cnt = &conf->sh->classes[c];
+        st[c].queued = cnt->queued;
+        st[c].dispatched = cnt->dispatched;
+        st[c].wait_msec = cnt->wait_msec;
+        st[c].expired = cnt->expired;
+    }
+}
+
+static ngx_int_t
+ngx_http_mcp_sched_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    auto *oconf = static_cast<ngx_http_mcp_sched_conf_t*>(data);
+    auto *conf  = static_cast<ngx_http_mcp_sched_conf_t*>(shm_zone->data);
+
+    if (oconf) {
+        conf->sh = oconf->sh;
+        return NGX_OK;
+    }
+
+    auto *shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        conf->sh = (ngx_http_mcp_sched_shctx_t*)shpool->data;
+        return NGX_OK;
+    }
+
+    conf->sh = (ngx_http_mcp_sched_shctx_t*)ngx_slab_calloc(shpool, sizeof(ngx_http_mcp_sched_shctx_t));
+    if (conf->sh == NULL) return NGX_ERROR;
+    shpool->data = conf->sh;
+    return NGX_OK;
+}
+
+// mcp_scheduler [inflight=n] [quantum=n] [deadline=on|off];
+char *ngx_http_mcp_scheduler(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->sched_zone) return (char*)"is duplicate";
+
+    auto *sc = (ngx_http_mcp_sched_conf_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_sched_conf_t));
+    if (sc == NULL) return (char*)NGX_CONF_ERROR;
+    sc->inflight = 32;
+    sc->quantum = 1;
+    sc->deadline = 0;
+
+    for (ngx_uint_t i = 1; i < cf->args->nelts; ++i) {
+        if (ngx_strncmp(value[i].data, "inflight=", 9) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 9, value[i].len - 9);
+            if (n == NGX_ERROR || n < 1) return (char*)"invalid inflight";
+            sc->inflight = (ngx_uint_t)n;
+        } else if (ngx_strncmp(value[i].data, "quantum=", 8) == 0) {
+            ngx_int_t n = ngx_atoi(value[i].data + 8, value[i].len - 8);
+            if (n == NGX_ERROR || n < 1) return (char*)"invalid quantum";
+            sc->quantum = (ngx_uint_t)n;
+        } else if (value[i].len == sizeof("deadline=on") - 1
+                   && ngx_strncmp(value[i].data, "deadline=on", value[i].len) == 0)
+        {
+            sc->deadline = 1;
+        } else if (value[i].len == sizeof("deadline=off") - 1
+                   && ngx_strncmp(value[i].data, "deadline=off", value[i].len) == 0)
+        {
+            sc->deadline = 0;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    ngx_str_t name = ngx_string(NGX_HTTP_MCP_SCHED_ZONE_NAME);
+    ngx_shm_zone_t *shm_zone = ngx_shared_memory_add(cf, &name, 8 * ngx_pagesize,
+                                                     (void*)ngx_http_mcp_sched_init_zone);
+    if (shm_zone == NULL) return (char*)NGX_CONF_ERROR;
+    shm_zone->init = ngx_http_mcp_sched_init_zone;
+    shm_zone->data = sc;
+    mcf->sched_zone = shm_zone;
+    return NGX_CONF_OK;
+}
+
+// mcp_priority name|* high|normal|low;
+char *ngx_http_mcp_priority(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->priorities == NULL) {
+        mcf->priorities = ngx_array_create(cf->pool, 4, sizeof(ngx_http_mcp_priority_t));
+        if (mcf->priorities == NULL) return (char*)NGX_CONF_ERROR;
+    }
+    if (ngx_http_mcp_sched_rule(mcf->priorities, &value[1])) return (char*)"is duplicate";
+
+    ngx_uint_t prio;
+    if (value[2].len == 4 && ngx_strncmp(value[2].data, "high", 4) == 0) {
+        prio = NGX_HTTP_MCP_PRIO_HIGH;
+    } else if (value[2].len == 6 && ngx_strncmp(value[2].data, "normal", 6) == 0) {
+        prio = NGX_HTTP_MCP_PRIO_NORMAL;
+    } else if (value[2].len == 3 && ngx_strncmp(value[2].data, "low", 3) == 0) {
+        prio = NGX_HTTP_MCP_PRIO_LOW;
+    } else {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid priority \"%V\"", &value[2]);
+        return (char*)NGX_CONF_ERROR;
+    }
+
+    auto *rule = (ngx_http_mcp_priority_t*)ngx_array_push(mcf->priorities);
+    if (rule == NULL) return (char*)NGX_CONF_ERROR;
+    rule->name = value[1];
+    rule->prio = prio;
+    return NGX_CONF_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_sched_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+    ngx_http_mcp_sched_zone = mcf->sched_zone;
+    return NGX_OK;
+}
+
+} // extern "C"
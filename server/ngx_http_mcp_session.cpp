@@ -0,0 +1,511 @@
+#include "ngx_http_mcp_module.h"
+
+extern "C" {
+
+// 开放寻址的最大探测长度
+#define NGX_HTTP_MCP_SESSION_PROBES  32
+
+// 槽位 key 的保留值
+#define NGX_HTTP_MCP_SESSION_EMPTY   0
+#define NGX_HTTP_MCP_SESSION_DELETED 1
+
+// 会话槽: 写入方持 slab 锁并以 seq 奇偶标记写入中, 读路径按 seqlock 无锁读取
+typedef struct {
+    ngx_atomic_t  seq;
+    uint64_t      key;          // 会话 id 哈希; 0 空槽, 1 已删除
+    ngx_atomic_t  last;         // 最近活动时间, 读路径以 CAS 更新
+    time_t        created;
+    uint32_t      caps;
+    u_char        version_len;
+    u_char        version[NGX_HTTP_MCP_SESSION_VERSION_LEN];
+    u_char        id[NGX_HTTP_MCP_SESSION_ID_LEN];
+} ngx_http_mcp_session_entry_t;
+
+typedef struct {
+    ngx_uint_t                     mask;       // 槽位数 - 1
+    ngx_uint_t                     live;       // 有效会话数(持锁修改)
+    ngx_uint_t                     deleted;    // 已删除槽位数(持锁修改)
+    ngx_atomic_t                   expired;    // 累计过期数
+    ngx_http_mcp_session_entry_t  *entries;
+} ngx_http_mcp_session_shctx_t;
+
+typedef struct {
+    ngx_http_mcp_session_shctx_t  *sh;
+    ngx_slab_pool_t               *shpool;
+    time_t                         timeout;
+} ngx_http_mcp_session_zone_ctx_t;
+
+static ngx_fd_t ngx_http_mcp_session_random_fd = NGX_INVALID_FILE;
+
+static ngx_http_mcp_session_zone_ctx_t *
+ngx_http_mcp_session_ctx(ngx_http_request_t *r) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_get_module_main_conf(r, ngx_http_mcp_module);
+    if (mcf == NULL || mcf->session_zone == NULL || mcf->session_stateless) return NULL;
+    auto *ctx = static_cast<ngx_http_mcp_session_zone_ctx_t*>(mcf->session_zone->data);
+    return ctx->sh ? ctx : NULL;
+}
+
+static ngx_int_t
+ngx_http_mcp_session_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    auto *octx = static_cast<ngx_http_mcp_session_zone_ctx_t*>(data);
+    auto *ctx  = static_cast<ngx_http_mcp_session_zone_ctx_t*>(shm_zone->data);
+
+    if (octx) {
+        // reload: 沿用旧配置的共享内存, 已建立的会话不失效
+        ctx->sh = octx->sh;
+        ctx->shpool = octx->shpool;
+        return NGX_OK;
+    }
+
+    ctx->shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        ctx->sh = (ngx_http_mcp_session_shctx_t*)ctx->shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_session_shctx_t*)ngx_slab_calloc(ctx->shpool, sizeof(ngx_http_mcp_session_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    ctx->sh = sh;
+    ctx->shpool->data = sh;
+
+    // 槽位数取 2 的幂, 约占区域的一半
+    ngx_uint_t n = 64;
+    while (n * 2 * sizeof(ngx_http_mcp_session_entry_t) <= shm_zone->shm.size / 2) {
+        n *= 2;
+    }
+    for ( ;; ) {
+        sh->entries = (ngx_http_mcp_session_entry_t*)ngx_slab_calloc(
+            ctx->shpool, n * sizeof(ngx_http_mcp_session_entry_t));
+        if (sh->entries) break;
+        if (n <= 64) return NGX_ERROR;
+        n /= 2;
+    }
+    sh->mask = n - 1;
+
+    size_t len = sizeof(" in mcp session zone \"\"") + shm_zone->shm.name.len;
+    ctx->shpool->log_ctx = (u_char*)ngx_slab_alloc(ctx->shpool, len);
+    if (ctx->shpool->log_ctx == NULL) return NGX_ERROR;
+    ngx_sprintf(ctx->shpool->log_ctx, " in mcp session zone \"%V\"%Z", &shm_zone->shm.name);
+    return NGX_OK;
+}
+
+// mcp_session_zone size [timeout=time];
+char *ngx_http_mcp_session_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->session_zone) return (char*)"is duplicate";
+
+    ssize_t size = ngx_parse_size(&value[1]);
+    if (size == NGX_ERROR) return (char*)"invalid zone size";
+    if (size < (ssize_t)(8 * ngx_pagesize)) return (char*)"zone is too small";
+
+    auto *ctx = (ngx_http_mcp_session_zone_ctx_t*)ngx_pcalloc(cf->pool, sizeof(ngx_http_mcp_session_zone_ctx_t));
+    if (ctx == NULL) return (char*)NGX_CONF_ERROR;
+    ctx->timeout = 1800;
+
+    for (ngx_uint_t i = 2; i < cf->args->nelts; ++i) {
+        if (ngx_strncmp(value[i].data, "timeout=", 8) == 0) {
+            ngx_str_t s;
+            s.data = value[i].data + 8;
+            s.len = value[i].len - 8;
+            ngx_int_t sec = ngx_parse_time(&s, 1);
+            if (sec == NGX_ERROR || sec <= 0) return (char*)"invalid timeout";
+            ctx->timeout = (time_t)sec;
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+            return (char*)NGX_CONF_ERROR;
+        }
+    }
+
+    ngx_str_t name = ngx_string(NGX_HTTP_MCP_SESSION_ZONE_NAME);
+    ngx_shm_zone_t *shm_zone = ngx_shared_memory_add(cf, &name, size, (void*)ngx_http_mcp_session_init_zone);
+    if (shm_zone == NULL) return (char*)NGX_CONF_ERROR;
+    shm_zone->init = ngx_http_mcp_session_init_zone;
+    shm_zone->data = ctx;
+    mcf->session_zone = shm_zone;
+    return NGX_CONF_OK;
+}
+
+// 无锁读取一个槽位的一致快照
+static void
+ngx_http_mcp_session_read(ngx_http_mcp_session_entry_t *e, ngx_http_mcp_session_entry_t *copy) {
+    for ( ;; ) {
+        ngx_atomic_uint_t seq = e->seq;
+        if (seq & 1) {
+            ngx_cpu_pause();
+            continue;
+        }
+        ngx_memory_barrier();
+        ngx_memcpy(copy, e, sizeof(*copy));
+        ngx_memory_barrier();
+        if (e->seq == seq) return;
+    }
+}
+
+static void
+ngx_http_mcp_session_write_begin(ngx_http_mcp_session_entry_t *e) {
+    e->seq = e->seq + 1;
+    ngx_memory_barrier();
+}
+
+static void
+ngx_http_mcp_session_write_end(ngx_http_mcp_session_entry_t *e) {
+    ngx_memory_barrier();
+    e->seq = e->seq + 1;
+}
+
+static uint64_t
+ngx_http_mcp_session_hash(const u_char *id, size_t len) {
+    uint64_t h = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, id, len);
+    return h > NGX_HTTP_MCP_SESSION_DELETED ? h : h + 2;
+}
+
+ngx_int_t
+ngx_http_mcp_random(u_char *buf, size_t len, ngx_log_t *log) {
+    if (ngx_http_mcp_session_random_fd != NGX_INVALID_FILE
+        && ngx_read_fd(ngx_http_mcp_session_random_fd, buf, len) == (ssize_t)len)
+    {
+        return NGX_OK;
+    }
+    ngx_log_error(NGX_LOG_ERR, log, ngx_errno, "mcp read /dev/urandom failed");
+    return NGX_ERROR;
+}
+
+static ngx_http_mcp_main_conf_t *
+ngx_http_mcp_session_stateless(ngx_http_request_t *r) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_get_module_main_conf(r, ngx_http_mcp_module);
+    return (mcf && mcf->session_stateless) ? mcf : NULL;
+}
+
+ngx_flag_t
+ngx_http_mcp_session_enabled(ngx_http_request_t *r) {
+    return ngx_http_mcp_session_stateless(r) != NULL || ngx_http_mcp_session_ctx(r) != NULL;
+}
+
+// 有状态模式: 生成 128 位随机会话 id 并写入共享表, 表满时返回 NGX_BUSY;
+// 无状态模式: 签发携带会话状态的令牌
+ngx_int_t
+ngx_http_mcp_session_create(ngx_http_request_t *r, ngx_http_mcp_session_info_t *info, ngx_str_t *id) {
+    time_t now = ngx_time();
+    info->created = now;
+    info->last = now;
+
+    ngx_http_mcp_main_conf_t *mcf = ngx_http_mcp_session_stateless(r);
+    if (mcf) {
+        return ngx_http_mcp_token_issue(r, mcf, info, id);
+    }
+
+    ngx_http_mcp_session_zone_ctx_t *ctx = ngx_http_mcp_session_ctx(r);
+    if (ctx == NULL) return NGX_DECLINED;
+
+    u_char rnd[NGX_HTTP_MCP_SESSION_ID_LEN / 2];
+    if (ngx_http_mcp_random(rnd, sizeof(rnd), r->connection->log) != NGX_OK) {
+        return NGX_ERROR;
+    }
+    id->data = (u_char*)ngx_pnalloc(r->pool, NGX_HTTP_MCP_SESSION_ID_LEN);
+    if (id->data == NULL) return NGX_ERROR;
+    id->len = ngx_hex_dump(id->data, rnd, sizeof(rnd)) - id->data;
+
+    uint64_t key = ngx_http_mcp_session_hash(id->data, id->len);
+    ngx_http_mcp_session_shctx_t *sh = ctx->sh;
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_uint_t i = key & sh->mask;
+    for (ngx_uint_t n = 0; n < NGX_HTTP_MCP_SESSION_PROBES; ++n, i = (i + 1) & sh->mask) {
+        ngx_http_mcp_session_entry_t *e = &sh->entries[i];
+        if (e->key != NGX_HTTP_MCP_SESSION_EMPTY && e->key != NGX_HTTP_MCP_SESSION_DELETED) {
+            continue;
+        }
+        if (e->key == NGX_HTTP_MCP_SESSION_DELETED) sh->deleted--;
+
+        ngx_http_mcp_session_write_begin(e);
+        e->key = key;
+        e->last = now;
+        e->created = now;
+        e->caps = info->caps;
+        e->version_len = info->version_len;
+        ngx_memcpy(e->version, info->version, info->version_len);
+        ngx_memcpy(e->id, id->data, NGX_HTTP_MCP_SESSION_ID_LEN);
+        ngx_http_mcp_session_write_end(e);
+
+        sh->live++;
+        ngx_shmtx_unlock(&ctx->shpool->mutex);
+        return NGX_OK;
+    }
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                  "mcp session zone is full (%ui live sessions)", sh->live);
+    return NGX_BUSY;
+}
+
+// 按 id 查找会话并刷新活动时间; 不存在或已过期返回 NGX_DECLINED
+ngx_int_t
+ngx_http_mcp_session_find(ngx_http_request_t *r, ngx_str_t *id, ngx_http_mcp_session_info_t *info) {
+    ngx_http_mcp_main_conf_t *mcf = ngx_http_mcp_session_stateless(r);
+    if (mcf) {
+        return ngx_http_mcp_token_verify(r, mcf, id, info);
+    }
+
+    ngx_http_mcp_session_zone_ctx_t *ctx = ngx_http_mcp_session_ctx(r);
+    if (ctx == NULL) return NGX_DECLINED;
+    if (id->len != NGX_HTTP_MCP_SESSION_ID_LEN) return NGX_DECLINED;
+
+    uint64_t key = ngx_http_mcp_session_hash(id->data, id->len);
+    ngx_http_mcp_session_shctx_t *sh = ctx->sh;
+    ngx_http_mcp_session_entry_t copy;
+    time_t now = ngx_time();
+
+    ngx_uint_t i = key & sh->mask;
+    for (ngx_uint_t n = 0; n < NGX_HTTP_MCP_SESSION_PROBES; ++n, i = (i + 1) & sh->mask) {
+        ngx_http_mcp_session_entry_t *e = &sh->entries[i];
+        ngx_http_mcp_session_read(e, &copy);
+
+        if (copy.key == NGX_HTTP_MCP_SESSION_EMPTY) break;
+        if (copy.key != key || ngx_memcmp(copy.id, id->data, NGX_HTTP_MCP_SESSION_ID_LEN) != 0) {
+            continue;
+        }
+        if (now - (time_t)copy.last > ctx->timeout) break;   // 留给清理定时器回收
+
+        // 槽位若已被复用, last 不同, CAS 失败即可
+        if ((time_t)copy.last != now) {
+            ngx_atomic_cmp_set(&e->last, copy.last, (ngx_atomic_uint_t)now);
+        }
+        info->caps = copy.caps;
+        info->version_len = copy.version_len;
+        ngx_memcpy(info->version, copy.version, copy.version_len);
+        info->created = copy.created;
+        info->last = now;
+        return NGX_OK;
+    }
+    return NGX_DECLINED;
+}
+
+// 会话是否仍然有效, 不刷新活动时间; 订阅表据此清理已结束的会话。未启用会话时返回 1
+ngx_flag_t
+ngx_http_mcp_session_alive(ngx_cycle_t *cycle, ngx_str_t *id) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(cycle, ngx_http_mcp_module);
+    if (mcf == NULL) return 1;
+    if (mcf->session_stateless) return ngx_http_mcp_token_expire(id) > ngx_time();
+    if (mcf->session_zone == NULL) return 1;
+
+    auto *ctx = static_cast<ngx_http_mcp_session_zone_ctx_t*>(mcf->session_zone->data);
+    ngx_http_mcp_session_shctx_t *sh = ctx->sh;
+    if (sh == NULL || id->len != NGX_HTTP_MCP_SESSION_ID_LEN) return 0;
+
+    uint64_t key = ngx_http_mcp_session_hash(id->data, id->len);
+    ngx_http_mcp_session_entry_t copy;
+    ngx_uint_t i = key & sh->mask;
+    for (ngx_uint_t n = 0; n < NGX_HTTP_MCP_SESSION_PROBES; ++n, i = (i + 1) & sh->mask) {
+        ngx_http_mcp_session_read(&sh->entries[i], &copy);
+        if (copy.key == NGX_HTTP_MCP_SESSION_EMPTY) break;
+        if (copy.key == key && ngx_memcmp(copy.id, id->data, NGX_HTTP_MCP_SESSION_ID_LEN) == 0) {
+            return ngx_time() - (time_t)copy.last <= ctx->timeout;
+        }
+    }
+    return 0;
+}
+
+ngx_int_t
+ngx_http_mcp_session_delete(ngx_http_request_t *r, ngx_str_t *id) {
+    ngx_http_mcp_session_zone_ctx_t *ctx = ngx_http_mcp_session_ctx(r);
+    if (ctx == NULL || id->len != NGX_HTTP_MCP_SESSION_ID_LEN) return NGX_DECLINED;
+
+    uint64_t key = ngx_http_mcp_session_hash(id->data, id->len);
+    ngx_http_mcp_session_shctx_t *sh = ctx->sh;
+    ngx_int_t rc = NGX_DECLINED;
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    ngx_uint_t i = key & sh->mask;
+    for (ngx_uint_t n = 0; n < NGX_HTTP_MCP_SESSION_PROBES; ++n, i = (i + 1) & sh->mask) {
+        ngx_http_mcp_session_entry_t *e = &sh->entries[i];
+        if (e->key == NGX_HTTP_MCP_SESSION_EMPTY) break;
+        if (e->key != key || ngx_memcmp(e->id, id->data, NGX_HTTP_MCP_SESSION_ID_LEN) != 0) continue;
+
+        ngx_http_mcp_session_write_begin(e);
+        e->key = NGX_HTTP_MCP_SESSION_DELETED;
+        ngx_http_mcp_session_write_end(e);
+        sh->live--;
+        sh->deleted++;
+        rc = NGX_OK;
+        break;
+    }
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+    return rc;
+}
+
+// DELETE + Mcp-Session-Id: 客户端主动结束会话
+ngx_int_t
+ngx_http_mcp_session_terminate(ngx_http_request_t *r) {
+    // 无状态令牌在过期前不可撤销
+    if (ngx_http_mcp_session_ctx(r) == NULL) return NGX_HTTP_NOT_ALLOWED;
+
+    ngx_int_t rc = ngx_http_discard_request_body(r);
+    if (rc != NGX_OK) return rc;
+
+    ngx_table_elt_t *sid = ngx_http_mcp_get_header(r, (u_char*)"Mcp-Session-Id", sizeof("Mcp-Session-Id") - 1);
+    if (sid == NULL) return NGX_HTTP_BAD_REQUEST;
+    if (ngx_http_mcp_session_delete(r, &sid->value) != NGX_OK) return NGX_HTTP_NOT_FOUND;
+    ngx_http_mcp_subscribe_session_closed(&sid->value);
+    ngx_http_mcp_events_drop(&sid->value);
+
+    r->headers_out.status = NGX_HTTP_NO_CONTENT;
+    r->header_only = 1;
+    return ngx_http_send_header(r);
+}
+
+ngx_int_t
+ngx_http_mcp_session_set_header(ngx_http_request_t *r, ngx_str_t *id) {
+    ngx_table_elt_t *h = (ngx_table_elt_t*)ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) return NGX_ERROR;
+    h->hash = 1;
+#if (nginx_version >= 1023000)
+    h->next = NULL;
+#endif
+    ngx_str_set(&h->key, "Mcp-Session-Id");
+    h->value = *id;
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_session_stats(ngx_cycle_t *cycle, ngx_uint_t *live, ngx_uint_t *capacity) {
+    ngx_http_mcp_main_conf_t *mcf =
+        (ngx_http_mcp_main_conf_t*)ngx_http_cycle_get_module_main_conf(cycle, ngx_http_mcp_module);
+    *live = 0;
+    *capacity = 0;
+    if (mcf == NULL || mcf->session_zone == NULL) return;
+    auto *ctx = static_cast<ngx_http_mcp_session_zone_ctx_t*>(mcf->session_zone->data);
+    if (ctx->sh == NULL) return;
+    *live = ctx->sh->live;
+    *capacity = ctx->sh->mask + 1;
+}
+
+// 回收过期会话; 之后从一个空槽向前回扫, 紧邻空槽的删除标记可直接置空, 缩短探测链。
+// 过期会话的订阅与事件随后清除, 与 DELETE 相同
+static void
+ngx_http_mcp_session_sweep(ngx_shm_zone_t *shm_zone, ngx_log_t *log) {
+    auto *ctx = static_cast<ngx_http_mcp_session_zone_ctx_t*>(shm_zone->data);
+    ngx_http_mcp_session_shctx_t *sh = ctx->sh;
+    time_t now = ngx_time();
+    ngx_uint_t expired = 0, i, empty = NGX_CONF_UNSET_UINT;
+    std::vector<std::string> ids;
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+    for (i = 0; i <= sh->mask; ++i) {
+        ngx_http_mcp_session_entry_t *e = &sh->entries[i];
+        if (e->key == NGX_HTTP_MCP_SESSION_EMPTY) {
+            empty = i;
+            continue;
+        }
+        if (e->key == NGX_HTTP_MCP_SESSION_DELETED || now - (time_t)e->last <= ctx->timeout) continue;
+
+        ngx_http_mcp_session_write_begin(e);
+        e->key = NGX_HTTP_MCP_SESSION_DELETED;
+        ngx_http_mcp_session_write_end(e);
+        sh->live--;
+        sh->deleted++;
+        expired++;
+        try {
+            ids.emplace_back((const char*)e->id, NGX_HTTP_MCP_SESSION_ID_LEN);
+        } catch (const std::bad_alloc &) {
+            // 漏掉的会话由各 worker 的定期清理回收
+        }
+    }
+
+    if (empty != NGX_CONF_UNSET_UINT) {
+        for (ngx_uint_t n = 1; n <= sh->mask; ++n) {
+            i = (empty - n) & sh->mask;
+            ngx_http_mcp_session_entry_t *e = &sh->entries[i];
+            if (e->key != NGX_HTTP_MCP_SESSION_DELETED) continue;
+            if (sh->entries[(i + 1) & sh->mask].key != NGX_HTTP_MCP_SESSION_EMPTY) continue;
+            ngx_http_mcp_session_write_begin(e);
+            e->key = NGX_HTTP_MCP_SESSION_EMPTY;
+            ngx_http_mcp_session_write_end(e);
+            sh->deleted--;
+        }
+    }
+    ngx_uint_t live = sh->live, deleted = sh->deleted;
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    for (auto &id : ids) {
+        ngx_str_t sid;
+        sid.data = (u_char*)id.data();
+        sid.len = id.size();
+        ngx_http_mcp_subscribe_session_closed(&sid);
+        ngx_http_mcp_events_drop(&sid);
+    }
+
+    (void)ngx_atomic_fetch_add(&sh->expired, expired);
+    ngx_log_error(NGX_LOG_INFO, log, 0,
+                  "mcp session zone \"%V\": %ui live, %ui expired, %ui deleted slots, load %ui%%",
+                  &shm_zone->shm.name, live, expired, deleted, (live + deleted) * 100 / (sh->mask + 1));
+}
+
+static void
+ngx_http_mcp_session_sweep_handler(ngx_event_t *ev) {
+    auto *shm_zone = static_cast<ngx_shm_zone_t*>(ev->data);
+    auto *ctx = static_cast<ngx_http_mcp_session_zone_ctx_t*>(shm_zone->data);
+
+    ngx_http_mcp_session_sweep(shm_zone, ev->log);
+    if (!ngx_exiting) {
+        ngx_add_timer(ev, (ngx_msec_t)ngx_min(ctx->timeout * 1000 / 4, 60000));
+    }
+}
+
+// 每个 worker 打开随机源; 仅 0 号 worker 运行清理定时器
+ngx_int_t
+ngx_http_mcp_session_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->session_zone == NULL && !mcf->session_stateless) return NGX_OK;
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+
+    ngx_http_mcp_session_random_fd = ngx_open_file("/dev/urandom", NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+    if (ngx_http_mcp_session_random_fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno, "mcp open /dev/urandom failed");
+        return NGX_ERROR;
+    }
+
+    if (ngx_worker != 0 || mcf->session_zone == NULL || mcf->session_stateless) return NGX_OK;
+
+    auto *ctx = static_cast<ngx_http_mcp_session_zone_ctx_t*>(mcf->session_zone->data);
+    ngx_event_t *ev = (ngx_event_t*)ngx_pcalloc(cycle->pool, sizeof(ngx_event_t));
+    if (ev == NULL) return NGX_ERROR;
+    ev->handler = ngx_http_mcp_session_sweep_handler;
+    ev->data = mcf->session_zone;
+    ev->log = cycle->log;
+    ev->cancelable = 1;
+    ngx_add_timer(ev, (ngx_msec_t)ngx_min(ctx->timeout * 1000 / 4, 60000));
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_session_exit_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (ngx_http_mcp_session_random_fd != NGX_INVALID_FILE) {
+        ngx_close_file(ngx_http_mcp_session_random_fd);
+        ngx_http_mcp_session_random_fd = NGX_INVALID_FILE;
+    }
+}
+
+} // extern "C"
+
+// initialize 请求中的客户端能力与协商版本
+void
+ngx_http_mcp_session_fill(ngx_http_mcp_session_info_t *info, const mcp::InitializeRequest &req) {
+    const mcp::ClientCapabilities &c = req.params.capabilities;
+    info->caps = 0;
+    if (c.roots) {
+        info->caps |= NGX_HTTP_MCP_CAP_ROOTS;
+        if (c.roots->listChanged.value_or(false)) info->caps |= NGX_HTTP_MCP_CAP_ROOTS_CHANGED;
+    }
+    if (c.sampling) info->caps |= NGX_HTTP_MCP_CAP_SAMPLING;
+    if (c.elicitation) info->caps |= NGX_HTTP_MCP_CAP_ELICITATION;
+    if (c.experimental) info->caps |= NGX_HTTP_MCP_CAP_EXPERIMENTAL;
+
+    // 与 handle_initialize 的协商结果一致
+    const std::string &v = req.params.protocolVersion.empty() ? std::string("1.0") : req.params.protocolVersion;
+    info->version_len = (u_char)ngx_min(v.size(), (size_t)NGX_HTTP_MCP_SESSION_VERSION_LEN);
+    ngx_memcpy(info->version, v.data(), info->version_len);
+}
@@ -0,0 +1,296 @@
+#include <new>
+#include "ngx_http_mcp_module.h"
+
+static const char kSseEventHead[] = "event: message\ndata: ";
+static const char kSseEventTail[] = "\n\n";
+
+// 唤醒项持有流的引用, 保证事件循环处理时流对象仍然有效
+struct ngx_http_mcp_stream_wakeup_t : ngx_http_mcp_notify_t {
+    std::shared_ptr<ngx_http_mcp_stream_t> stream;
+};
+
+extern "C" {
+
+// 一个 SSE 事件的长度上限; id 为 0 时不带 id 行
+size_t
+ngx_http_mcp_sse_event_size(uint64_t id, size_t len) {
+    size_t size = sizeof(kSseEventHead) - 1 + len + sizeof(kSseEventTail) - 1;
+    if (id) size += sizeof("id: \n") - 1 + NGX_INT64_LEN;
+    return size;
+}
+
+u_char *
+ngx_http_mcp_sse_event(u_char *p, uint64_t id, const u_char *data, size_t len) {
+    if (id) p = ngx_sprintf(p, "id: %uL\n", id);
+    p = ngx_cpymem(p, kSseEventHead, sizeof(kSseEventHead) - 1);
+    p = ngx_cpymem(p, data, len);
+    return ngx_cpymem(p, kSseEventTail, sizeof(kSseEventTail) - 1);
+}
+
+static void
+ngx_http_mcp_sse_wakeup(ngx_http_mcp_notify_t *item) {
+    auto *w = static_cast<ngx_http_mcp_stream_wakeup_t*>(item);
+    std::shared_ptr<ngx_http_mcp_stream_t> s = std::move(w->stream);
+    delete w;
+
+    // 先清标志再取数据, 之后的 push 会重新投递唤醒
+    s->queued.store(false, std::memory_order_release);
+    ngx_http_mcp_sse_flush(s.get());
+}
+
+// 发送被写阻塞时由写事件继续推送
+static void
+ngx_http_mcp_sse_write_handler(ngx_http_request_t *r) {
+    auto *ctx = static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+    ngx_event_t *wev = r->connection->write;
+
+    if (wev->timedout) {
+        // 超时交由线程完成后的 finalize 统一处理
+        r->connection->error = 1;
+        if (ctx && ctx->stream) ctx->stream->closed = true;
+        return;
+    }
+    if (ngx_http_output_filter(r, NULL) == NGX_ERROR
+        || ngx_handle_write_event(wev, 0) != NGX_OK)
+    {
+        if (ctx && ctx->stream) ctx->stream->closed = true;
+    }
+}
+
+// 把积压的通知拼成一个 buf 发出; 仅在事件循环线程调用
+static ngx_int_t
+ngx_http_mcp_sse_send_pending(ngx_http_mcp_stream_t *s, ngx_flag_t flush) {
+    if (s->closed || s->r == nullptr) return NGX_OK;
+
+    // 长连接流上一批仍在发送: 新消息留在队列中, 由写事件继续
+    if (s->persistent && s->buf.pos != s->buf.last) return NGX_AGAIN;
+
+    std::vector<ngx_http_mcp_stream_msg_t> batch;
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        batch.swap(s->pending);
+        s->pending_bytes = 0;
+    }
+    if (batch.empty()) return NGX_OK;
+
+    ngx_http_request_t *r = s->r;
+    size_t len = 0;
+    for (const auto &m : batch) {
+        len += ngx_http_mcp_sse_event_size(m.id, m.data.size());
+    }
+
+    ngx_buf_t *b;
+    if (s->persistent) {
+        ngx_free(s->buf.start);
+        ngx_memzero(&s->buf, sizeof(ngx_buf_t));
+        b = &s->buf;
+        b->start = (u_char*)ngx_alloc(len, r->connection->log);
+        if (b->start == NULL) return NGX_ERROR;
+        b->pos = b->start;
+        b->last = b->start;
+        b->end = b->start + len;
+        b->temporary = 1;
+    } else {
+        b = ngx_create_temp_buf(r->pool, len);
+        if (b == NULL) return NGX_ERROR;
+    }
+    for (const auto &m : batch) {
+        // 沿用推送时事件存储分配的 id, 与重连补发的事件一致
+        b->last = ngx_http_mcp_sse_event(b->last, m.id, (const u_char*)m.data.data(), m.data.size());
+    }
+    b->flush = flush ? 1 : 0;
+
+    ngx_chain_t out;
+    out.buf = b;
+    out.next = NULL;
+
+    ngx_int_t rc = ngx_http_output_filter(r, &out);
+    if (rc == NGX_AGAIN && !s->persistent) {
+        r->write_event_handler = ngx_http_mcp_sse_write_handler;
+    }
+    return rc;
+}
+
+// 仅在事件循环线程调用; 发送失败或队列溢出时交由 on_close 结束请求
+void
+ngx_http_mcp_sse_flush(ngx_http_mcp_stream_t *s) {
+    if (ngx_http_mcp_sse_send_pending(s, 1) == NGX_ERROR) {
+        s->closed = true;
+    }
+    if (s->closed && s->r && s->on_close) {
+        s->on_close(s);
+    }
+}
+
+} // extern "C"
+
+ngx_http_mcp_stream_s::~ngx_http_mcp_stream_s() {
+    ngx_free(buf.start);
+}
+
+bool ngx_http_mcp_stream_s::enqueue(std::string &&msg, uint64_t id) {
+    if (closed.load(std::memory_order_relaxed)) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (limit && pending_bytes + msg.size() > limit) {
+        // 客户端读得太慢, 不再积压
+        closed = true;
+        return false;
+    }
+    pending_bytes += msg.size();
+    pending.push_back({id, std::move(msg)});
+    return true;
+}
+
+// 线程侧: 入队并在需要时唤醒事件循环
+void ngx_http_mcp_stream_s::push(std::string &&msg) {
+    if (!enqueue(std::move(msg))) {
+        if (on_close == nullptr) return;   // 溢出的长连接流仍需唤醒事件循环关闭请求
+    }
+    if (queued.exchange(true, std::memory_order_acq_rel)) return;
+
+    auto *w = new (std::nothrow) ngx_http_mcp_stream_wakeup_t();
+    if (w == nullptr) {
+        queued = false;   // 留待结束时一并发送
+        return;
+    }
+    w->handler = ngx_http_mcp_sse_wakeup;
+    w->stream = shared_from_this();
+    if (ngx_http_mcp_notify_post(w) != NGX_OK) {
+        delete w;
+        queued = false;
+    }
+}
+
+extern "C" {
+
+// 方法在 mcp_stream_methods 中且客户端接受 text/event-stream 时使用 SSE
+ngx_flag_t
+ngx_http_mcp_sse_wanted(ngx_http_request_t *r, ngx_http_mcp_loc_conf_t *conf, ngx_str_t *method) {
+    if (conf->stream_methods == NULL) return 0;
+
+    ngx_str_t *m = (ngx_str_t*)conf->stream_methods->elts;
+    ngx_uint_t i;
+    for (i = 0; i < conf->stream_methods->nelts; ++i) {
+        if (m[i].len == method->len && ngx_strncmp(m[i].data, method->data, method->len) == 0) break;
+    }
+    if (i == conf->stream_methods->nelts) return 0;
+
+    ngx_table_elt_t *accept = ngx_http_mcp_get_header(r, (u_char*)"Accept", sizeof("Accept") - 1);
+    if (accept == NULL) return 0;
+    return ngx_strlcasestrn(accept->value.data, accept->value.data + accept->value.len,
+                            (u_char*)"text/event-stream", sizeof("text/event-stream") - 2) != NULL;
+}
+
+// 发送 text/event-stream 响应头并立即 flush
+ngx_int_t
+ngx_http_mcp_sse_send_header(ngx_http_request_t *r) {
+    static ngx_str_t sse_type = ngx_string("text/event-stream");
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = -1;
+    r->headers_out.content_type = sse_type;
+    r->headers_out.content_type_len = sse_type.len;
+    r->headers_out.content_type_lowcase = NULL;
+
+    ngx_table_elt_t *h = (ngx_table_elt_t*)ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) return NGX_ERROR;
+    h->hash = 1;
+#if (nginx_version >= 1023000)
+    h->next = NULL;
+#endif
+    ngx_str_set(&h->key, "Cache-Control");
+    ngx_str_set(&h->value, "no-cache");
+
+    ngx_int_t rc = ngx_http_send_header(r);
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    ngx_buf_t *b = ngx_calloc_buf(r->pool);
+    if (b == NULL) return NGX_ERROR;
+    b->flush = 1;
+    ngx_chain_t out;
+    out.buf = b;
+    out.next = NULL;
+    return ngx_http_output_filter(r, &out);
+}
+
+// 立即发送响应头并 flush, 首字节不再等待处理函数完成
+ngx_int_t
+ngx_http_mcp_sse_start(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    try {
+        ctx->stream = std::make_shared<ngx_http_mcp_stream_t>();
+    } catch (const std::bad_alloc &) {
+        return NGX_ERROR;
+    }
+    ctx->stream->r = r;
+    std::shared_ptr<ngx_http_mcp_stream_t> s = ctx->stream;
+    ctx->rctx = mcp::server::RequestContext(ctx->progress_token,
+                                            [s](std::string &&m) { s->push(std::move(m)); });
+
+    ngx_int_t rc = ngx_http_mcp_sse_send_header(r);
+    if (rc == NGX_AGAIN) {
+        r->write_event_handler = ngx_http_mcp_sse_write_handler;
+        rc = NGX_OK;
+    }
+    return rc;
+}
+
+// 发出剩余通知后以 message 事件发送最终结果; out 为空时发送 JSON-RPC 内部错误
+ngx_int_t
+ngx_http_mcp_sse_finish(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx, ngx_chain_t *out) {
+    ngx_http_mcp_stream_t *s = ctx->stream.get();
+    if (s == nullptr || s->closed) return NGX_ERROR;
+
+    if (ngx_http_mcp_sse_send_pending(s, 0) == NGX_ERROR) {
+        s->closed = true;
+        return NGX_ERROR;
+    }
+
+    if (out == NULL) {
+        size_t len;
+        try {
+            out = ngx_http_mcp_serialize_error(r->pool, ctx->id, NGX_HTTP_MCP_RPC_INTERNAL_ERROR,
+                                               "Internal error", nullptr, &len);
+        } catch (const std::exception &) {
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_buf_t *head = ngx_calloc_buf(r->pool);
+    ngx_buf_t *tail = ngx_calloc_buf(r->pool);
+    ngx_chain_t *hl = ngx_alloc_chain_link(r->pool);
+    ngx_chain_t *tl = ngx_alloc_chain_link(r->pool);
+    if (head == NULL || tail == NULL || hl == NULL || tl == NULL) return NGX_ERROR;
+
+    head->pos = (u_char*)kSseEventHead;
+    head->last = head->pos + sizeof(kSseEventHead) - 1;
+    head->memory = 1;
+    tail->pos = (u_char*)kSseEventTail;
+    tail->last = tail->pos + sizeof(kSseEventTail) - 1;
+    tail->memory = 1;
+    tail->last_buf = (r == r->main) ? 1 : 0;
+    tail->last_in_chain = 1;
+
+    ngx_chain_t *cl = out;
+    while (cl->next) cl = cl->next;
+    cl->next = tl;
+    tl->buf = tail;
+    tl->next = NULL;
+    hl->buf = head;
+    hl->next = out;
+
+    s->closed = true;
+    return ngx_http_output_filter(r, hl);
+}
+
+// 请求销毁时断开流与请求的关联, 之后到达的唤醒直接丢弃
+void
+ngx_http_mcp_sse_close(ngx_http_mcp_async_ctx_t *ctx) {
+    if (ctx->stream) {
+        ctx->stream->closed = true;
+        ctx->stream->r = nullptr;
+    }
+}
+
+} // extern "C"
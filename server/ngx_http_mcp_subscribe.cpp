@@ -0,0 +1,578 @@
+#include <signal.h>
+#include <deque>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
+#include "ngx_http_mcp_module.h"
+
+// notifications/resources/updated 的合并与分批推送:
+// 线程侧 publish 只把 URI 放进待合并集合, 窗口到期后在事件循环中按订阅表展开,
+// 同一窗口内对同一 URI 的多次更新只推送一次; 推送按批进行, 每批之后让出事件循环。
+// 配置了事件存储时每个订阅会话的事件都在推送时记录并取得 id, 无论此刻有没有 GET 流,
+// 断线期间的事件在带 Last-Event-ID 重连时补发; 在线的流沿用同一 id。
+//
+// 订阅表与推送流每个 worker 一份。启用会话时, 订阅变化、会话结束与资源更新写入共享内存中的
+// 转发板, 各 worker 定时读取后更新自己的订阅表副本, 因此 subscribe 与 GET 流、资源更新
+// 可以落在不同 worker。共享内存中另有会话到 GET 流所在 worker 的登记, 每个会话的事件只由
+// 该 worker 记录并推送(没有流时由发布更新的 worker 记录), 不会重复。
+// 过期会话的订阅由会话清理与每个 worker 的定期检查移除(无状态会话按令牌过期时间)。
+// reload 后新 worker 的订阅表为空, 客户端需要重新订阅。
+
+#define NGX_HTTP_MCP_FANOUT_BATCH  256
+
+#define NGX_HTTP_MCP_RELAY_ZONE_NAME  "mcp_subscribe"
+
+// 转发板槽数, 按写入顺序循环覆盖; 读取落后超过一圈时丢弃未读的记录
+#define NGX_HTTP_MCP_RELAY_SLOTS      512
+#define NGX_HTTP_MCP_RELAY_DATA       480
+
+// 查看转发板的间隔
+#define NGX_HTTP_MCP_RELAY_POLL       20
+
+// 会话到 GET 流所在 worker 的登记, 开放寻址
+#define NGX_HTTP_MCP_OWNERS           4096
+#define NGX_HTTP_MCP_OWNER_PROBES     32
+#define NGX_HTTP_MCP_OWNER_EMPTY      0
+#define NGX_HTTP_MCP_OWNER_DELETED    1
+
+// 检查订阅会话是否过期的间隔
+#define NGX_HTTP_MCP_PURGE_INTERVAL   60000
+
+enum {
+    NGX_HTTP_MCP_RELAY_SUBSCRIBE = 1,
+    NGX_HTTP_MCP_RELAY_UNSUBSCRIBE,
+    NGX_HTTP_MCP_RELAY_CLOSED,
+    NGX_HTTP_MCP_RELAY_UPDATED
+};
+
+typedef struct {
+    ngx_atomic_t   seq;            // 写入中为 0, 写完为该记录的序号
+    ngx_pid_t      origin;
+    u_char         op;
+    u_short        session_len;
+    u_short        uri_len;
+    u_char         data[NGX_HTTP_MCP_RELAY_DATA];   // 会话 id 后接 URI
+} ngx_http_mcp_relay_slot_t;
+
+typedef struct {
+    ngx_atomic_t   key;
+    ngx_atomic_t   pid;
+} ngx_http_mcp_owner_t;
+
+typedef struct {
+    ngx_atomic_t                next;   // 最近一次写入的序号
+    ngx_http_mcp_relay_slot_t   slots[NGX_HTTP_MCP_RELAY_SLOTS];
+    ngx_http_mcp_owner_t        owners[NGX_HTTP_MCP_OWNERS];   // 在 shpool 锁内修改
+} ngx_http_mcp_relay_shctx_t;
+
+typedef struct {
+    std::string                                        session;
+    std::vector<std::shared_ptr<const std::string>>    msgs;
+} ngx_http_mcp_fanout_t;
+
+static std::mutex                       ngx_http_mcp_updates_mutex;
+static std::unordered_map<std::string, bool>  ngx_http_mcp_updates;   // URI -> 是否由本 worker 发布
+static std::atomic<bool>                ngx_http_mcp_updates_armed{false};
+
+// 转发板在任意线程写入, 仅读取在事件循环线程
+static ngx_http_mcp_relay_shctx_t      *ngx_http_mcp_relay_sh;
+static ngx_slab_pool_t                 *ngx_http_mcp_relay_shpool;
+
+// 以下仅在事件循环线程访问
+static ngx_event_t                      ngx_http_mcp_window_ev;
+static ngx_event_t                      ngx_http_mcp_fanout_ev;
+static ngx_event_t                      ngx_http_mcp_relay_ev;
+static ngx_event_t                      ngx_http_mcp_purge_ev;
+static ngx_atomic_uint_t                ngx_http_mcp_relay_seen;
+static ngx_msec_t                       ngx_http_mcp_window;
+static ngx_flag_t                       ngx_http_mcp_fanout_store;   // 配置了 mcp_event_store
+static std::deque<ngx_http_mcp_fanout_t> ngx_http_mcp_fanout;
+static std::unordered_multimap<std::string, std::weak_ptr<ngx_http_mcp_stream_t>> ngx_http_mcp_sinks;
+
+// 任意线程: 写入转发板, 放不下的记录只记日志
+static void
+ngx_http_mcp_relay_post(ngx_uint_t op, const std::string &session, const std::string &uri) {
+    ngx_http_mcp_relay_shctx_t *sh = ngx_http_mcp_relay_sh;
+    if (sh == NULL) return;
+    if (session.size() + uri.size() > NGX_HTTP_MCP_RELAY_DATA) {
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "mcp subscription change for \"%*s\" is too long to relay to other workers",
+                      uri.size(), uri.data());
+        return;
+    }
+
+    ngx_atomic_uint_t seq = ngx_atomic_fetch_add(&sh->next, 1) + 1;
+    ngx_http_mcp_relay_slot_t *slot = &sh->slots[seq % NGX_HTTP_MCP_RELAY_SLOTS];
+    slot->seq = 0;
+    ngx_memory_barrier();
+    slot->origin = ngx_pid;
+    slot->op = (u_char)op;
+    slot->session_len = (u_short)session.size();
+    slot->uri_len = (u_short)uri.size();
+    ngx_memcpy(slot->data, session.data(), session.size());
+    ngx_memcpy(slot->data + session.size(), uri.data(), uri.size());
+    ngx_memory_barrier();
+    slot->seq = seq;
+}
+
+static uint64_t
+ngx_http_mcp_owner_key(const std::string &session) {
+    uint64_t h = ngx_http_mcp_hash64(NGX_HTTP_MCP_HASH_INIT, (const u_char*)session.data(), session.size());
+    return h > NGX_HTTP_MCP_OWNER_DELETED ? h : h + 2;
+}
+
+// 登记本 worker 持有会话的 GET 流; 同一会话以最近打开的流为准
+static void
+ngx_http_mcp_owner_set(const std::string &session) {
+    ngx_http_mcp_relay_shctx_t *sh = ngx_http_mcp_relay_sh;
+    if (sh == NULL) return;
+
+    uint64_t key = ngx_http_mcp_owner_key(session);
+    ngx_http_mcp_owner_t *o = NULL, *free = NULL;
+    ngx_shmtx_lock(&ngx_http_mcp_relay_shpool->mutex);
+    for (ngx_uint_t n = 0; n < NGX_HTTP_MCP_OWNER_PROBES; ++n) {
+        ngx_http_mcp_owner_t *e = &sh->owners[(key + n) & (NGX_HTTP_MCP_OWNERS - 1)];
+        if (e->key == key) {
+            o = e;
+            break;
+        }
+        if (e->key == NGX_HTTP_MCP_OWNER_EMPTY) {
+            if (free == NULL) free = e;
+            break;
+        }
+        if (e->key == NGX_HTTP_MCP_OWNER_DELETED && free == NULL) free = e;
+    }
+    if (o == NULL && free != NULL) {
+        o = free;
+        o->key = key;
+    }
+    if (o) o->pid = (ngx_atomic_uint_t)ngx_pid;
+    ngx_shmtx_unlock(&ngx_http_mcp_relay_shpool->mutex);
+
+    if (o == NULL) {
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "mcp subscription owner table is full, events of session \"%*s\" may be recorded twice",
+                      session.size(), session.data());
+    }
+}
+
+// pid 为 0 时无条件清除
+static void
+ngx_http_mcp_owner_clear(const std::string &session, ngx_pid_t pid) {
+    ngx_http_mcp_relay_shctx_t *sh = ngx_http_mcp_relay_sh;
+    if (sh == NULL) return;
+
+    uint64_t key = ngx_http_mcp_owner_key(session);
+    ngx_shmtx_lock(&ngx_http_mcp_relay_shpool->mutex);
+    for (ngx_uint_t n = 0; n < NGX_HTTP_MCP_OWNER_PROBES; ++n) {
+        ngx_http_mcp_owner_t *e = &sh->owners[(key + n) & (NGX_HTTP_MCP_OWNERS - 1)];
+        if (e->key == NGX_HTTP_MCP_OWNER_EMPTY) break;
+        if (e->key != key) continue;
+        if (pid == 0 || e->pid == (ngx_atomic_uint_t)pid) {
+            e->key = NGX_HTTP_MCP_OWNER_DELETED;
+            e->pid = 0;
+        }
+        break;
+    }
+    ngx_shmtx_unlock(&ngx_http_mcp_relay_shpool->mutex);
+}
+
+static ngx_pid_t
+ngx_http_mcp_owner_get(const std::string &session) {
+    ngx_http_mcp_relay_shctx_t *sh = ngx_http_mcp_relay_sh;
+    if (sh == NULL) return 0;
+
+    ngx_pid_t pid = 0;
+    uint64_t key = ngx_http_mcp_owner_key(session);
+    ngx_shmtx_lock(&ngx_http_mcp_relay_shpool->mutex);
+    for (ngx_uint_t n = 0; n < NGX_HTTP_MCP_OWNER_PROBES; ++n) {
+        ngx_http_mcp_owner_t *e = &sh->owners[(key + n) & (NGX_HTTP_MCP_OWNERS - 1)];
+        if (e->key == NGX_HTTP_MCP_OWNER_EMPTY) break;
+        if (e->key == key) {
+            pid = (ngx_pid_t)e->pid;
+            break;
+        }
+    }
+    ngx_shmtx_unlock(&ngx_http_mcp_relay_shpool->mutex);
+    return pid;
+}
+
+extern "C" {
+
+static void
+ngx_http_mcp_window_arm(ngx_http_mcp_notify_t *item) {
+    delete item;
+    if (!ngx_http_mcp_window_ev.timer_set && !ngx_exiting) {
+        ngx_add_timer(&ngx_http_mcp_window_ev, ngx_http_mcp_window);
+    }
+}
+
+static void
+ngx_http_mcp_updates_add(const std::string &uri, bool local) {
+    std::lock_guard<std::mutex> lock(ngx_http_mcp_updates_mutex);
+    auto r = ngx_http_mcp_updates.emplace(uri, local);
+    if (!r.second && local) r.first->second = true;
+}
+
+// 任意线程: 记录变化的 URI, 窗口未开启时通知事件循环开启
+static void
+ngx_http_mcp_resource_updated(const std::string &uri) {
+    // 资源内容变化同时使缓存的 resources/* 结果失效
+    ngx_http_mcp_cache_invalidate(NGX_HTTP_MCP_CACHE_RESOURCES);
+    ngx_http_mcp_relay_post(NGX_HTTP_MCP_RELAY_UPDATED, std::string(), uri);
+    ngx_http_mcp_updates_add(uri, true);
+    if (ngx_http_mcp_updates_armed.exchange(true, std::memory_order_acq_rel)) return;
+
+    auto *item = new (std::nothrow) ngx_http_mcp_notify_t();
+    if (item) {
+        item->handler = ngx_http_mcp_window_arm;
+        if (ngx_http_mcp_notify_post(item) == NGX_OK) return;
+        delete item;
+    }
+    ngx_http_mcp_updates_armed = false;
+}
+
+// 任意线程: 本 worker 的订阅表变化转发给其他 worker
+static void
+ngx_http_mcp_subscription_changed(mcp::server::SubscriptionRegistry::Change change,
+                                  const std::string &uri, const std::string &session) {
+    ngx_http_mcp_relay_post(change == mcp::server::SubscriptionRegistry::Change::Subscribe
+                            ? NGX_HTTP_MCP_RELAY_SUBSCRIBE : NGX_HTTP_MCP_RELAY_UNSUBSCRIBE,
+                            session, uri);
+}
+
+// 只清除本 worker 的订阅与推送流, 不转发
+static void
+ngx_http_mcp_subscribe_close_local(const std::string &id) {
+    mcp::server::SubscriptionRegistry::instance().remove_session(id);
+
+    std::vector<std::shared_ptr<ngx_http_mcp_stream_t>> streams;
+    auto range = ngx_http_mcp_sinks.equal_range(id);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (auto s = it->second.lock()) streams.push_back(std::move(s));
+    }
+    if (!streams.empty()) ngx_http_mcp_owner_clear(id, ngx_pid);
+    ngx_http_mcp_sinks.erase(id);
+
+    for (auto &s : streams) {
+        s->closed = true;
+        if (s->r && s->on_close) s->on_close(s.get());
+    }
+}
+
+static void
+ngx_http_mcp_relay_apply(ngx_uint_t op, const std::string &session, const std::string &uri) {
+    auto &registry = mcp::server::SubscriptionRegistry::instance();
+    switch (op) {
+    case NGX_HTTP_MCP_RELAY_SUBSCRIBE:
+        registry.subscribe(uri, session, false);
+        break;
+    case NGX_HTTP_MCP_RELAY_UNSUBSCRIBE:
+        registry.unsubscribe(uri, session, false);
+        break;
+    case NGX_HTTP_MCP_RELAY_CLOSED:
+        ngx_http_mcp_subscribe_close_local(session);
+        break;
+    case NGX_HTTP_MCP_RELAY_UPDATED:
+        // 其他 worker 发布的更新: 只推送给本 worker 持有流的会话
+        ngx_http_mcp_updates_add(uri, false);
+        if (!ngx_http_mcp_updates_armed.exchange(true, std::memory_order_acq_rel)
+            && !ngx_http_mcp_window_ev.timer_set && !ngx_exiting)
+        {
+            ngx_add_timer(&ngx_http_mcp_window_ev, ngx_http_mcp_window);
+        }
+        break;
+    }
+}
+
+// 读取其他 worker 写入的记录; 正在写入的槽留到下次, 读取期间被覆盖的记录丢弃
+static void
+ngx_http_mcp_relay_poll(ngx_event_t *ev) {
+    ngx_http_mcp_relay_shctx_t *sh = ngx_http_mcp_relay_sh;
+    ngx_atomic_uint_t head = sh->next;
+    ngx_atomic_uint_t lost = 0;
+
+    if (head - ngx_http_mcp_relay_seen > NGX_HTTP_MCP_RELAY_SLOTS) {
+        lost = head - ngx_http_mcp_relay_seen - NGX_HTTP_MCP_RELAY_SLOTS;
+        ngx_http_mcp_relay_seen = head - NGX_HTTP_MCP_RELAY_SLOTS;
+    }
+
+    try {
+        std::string session, uri;
+        while (ngx_http_mcp_relay_seen != head) {
+            ngx_atomic_uint_t s = ngx_http_mcp_relay_seen + 1;
+            ngx_http_mcp_relay_slot_t *slot = &sh->slots[s % NGX_HTTP_MCP_RELAY_SLOTS];
+            ngx_atomic_uint_t seq = slot->seq;
+            if ((ngx_atomic_int_t)(seq - s) < 0) break;   // 写入中
+
+            if (seq == s) {
+                ngx_memory_barrier();
+                ngx_uint_t op = slot->op;
+                ngx_pid_t origin = slot->origin;
+                size_t slen = slot->session_len, ulen = slot->uri_len;
+                if (slen + ulen <= NGX_HTTP_MCP_RELAY_DATA) {
+                    session.assign((const char*)slot->data, slen);
+                    uri.assign((const char*)slot->data + slen, ulen);
+                }
+                ngx_memory_barrier();
+                if (slot->seq != s || slen + ulen > NGX_HTTP_MCP_RELAY_DATA) {
+                    lost++;
+                } else if (origin != ngx_pid) {
+                    ngx_http_mcp_relay_apply(op, session, uri);
+                }
+            } else {
+                lost++;
+            }
+            ngx_http_mcp_relay_seen = s;
+        }
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_ERR, ev->log, 0, "mcp subscription relay failed: %s", e.what());
+    }
+
+    if (lost) {
+        ngx_log_error(NGX_LOG_WARN, ev->log, 0,
+                      "mcp subscription relay overrun, %uA changes from other workers lost", lost);
+    }
+    if (!ngx_exiting) ngx_add_timer(ev, NGX_HTTP_MCP_RELAY_POLL);
+}
+
+// 过期会话(含无状态会话与错过的会话结束记录)的订阅与推送流在本 worker 中移除
+static void
+ngx_http_mcp_purge_handler(ngx_event_t *ev) {
+    try {
+        std::vector<std::string> ids = mcp::server::SubscriptionRegistry::instance().sessions();
+        for (const auto &kv : ngx_http_mcp_sinks) ids.push_back(kv.first);
+        for (const auto &id : ids) {
+            ngx_str_t s;
+            s.data = (u_char*)id.data();
+            s.len = id.size();
+            if (!ngx_http_mcp_session_alive((ngx_cycle_t*)ngx_cycle, &s)) {
+                ngx_http_mcp_subscribe_close_local(id);
+            }
+        }
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_ERR, ev->log, 0, "mcp subscription purge failed: %s", e.what());
+    }
+    if (!ngx_exiting) ngx_add_timer(ev, NGX_HTTP_MCP_PURGE_INTERVAL);
+}
+
+static void
+ngx_http_mcp_fanout_handler(ngx_event_t *ev) {
+    ngx_uint_t n = 0;
+    while (!ngx_http_mcp_fanout.empty() && n++ < NGX_HTTP_MCP_FANOUT_BATCH) {
+        ngx_http_mcp_fanout_t &f = ngx_http_mcp_fanout.front();
+
+        std::vector<uint64_t> ids(f.msgs.size(), 0);
+        if (ngx_http_mcp_fanout_store) {
+            ngx_str_t session;
+            session.data = (u_char*)f.session.data();
+            session.len = f.session.size();
+            for (size_t i = 0; i < f.msgs.size(); ++i) {
+                ids[i] = ngx_http_mcp_events_append(&session, (const u_char*)f.msgs[i]->data(), f.msgs[i]->size());
+            }
+        }
+
+        auto range = ngx_http_mcp_sinks.equal_range(f.session);
+        for (auto it = range.first; it != range.second; ) {
+            std::shared_ptr<ngx_http_mcp_stream_t> s = it->second.lock();
+            if (!s || s->closed) {
+                it = ngx_http_mcp_sinks.erase(it);
+                continue;
+            }
+            // 已在事件循环中: 整批入队后直接发送, 不经唤醒队列
+            for (size_t i = 0; i < f.msgs.size(); ++i) {
+                if (!s->enqueue(std::string(*f.msgs[i]), ids[i])) break;
+            }
+            ++it;
+            ngx_http_mcp_sse_flush(s.get());
+        }
+        ngx_http_mcp_fanout.pop_front();
+    }
+
+    // 挂到下一轮: ngx_posted_events 会在本轮处理到空为止, 不能让出事件循环
+    if (!ngx_http_mcp_fanout.empty()) {
+        ngx_post_event(ev, &ngx_posted_next_events);
+    }
+}
+
+// 窗口到期: 取出本窗口的 URI, 展开为每个订阅者一项
+static void
+ngx_http_mcp_window_handler(ngx_event_t *ev) {
+    std::unordered_map<std::string, bool> uris;
+    ngx_http_mcp_updates_armed.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(ngx_http_mcp_updates_mutex);
+        uris.swap(ngx_http_mcp_updates);
+    }
+
+    try {
+        std::unordered_map<std::string, size_t> index;
+        std::unordered_map<ngx_pid_t, bool> alive;
+        std::unordered_set<std::string> sessions;
+        for (const auto &u : uris) {
+            const std::string &uri = u.first;
+            sessions.clear();
+            mcp::server::SubscriptionRegistry::instance().match(uri, sessions);
+            if (sessions.empty()) continue;
+
+            nlohmann::json n;
+            n["jsonrpc"] = "2.0";
+            n["method"] = "notifications/resources/updated";
+            n["params"]["uri"] = uri;
+            auto msg = std::make_shared<const std::string>(n.dump());
+
+            for (const auto &s : sessions) {
+                // 会话的事件只由一个 worker 记录与推送: 持有其 GET 流的 worker, 没有流时为发布更新的 worker
+                ngx_pid_t owner = ngx_http_mcp_owner_get(s);
+                if (owner && owner != ngx_pid) {
+                    auto a = alive.find(owner);
+                    if (a == alive.end()) {
+                        bool ok = kill(owner, 0) == 0 || ngx_errno != NGX_ESRCH;
+                        a = alive.emplace(owner, ok).first;
+                    }
+                    if (!a->second) {
+                        ngx_http_mcp_owner_clear(s, owner);
+                        owner = 0;
+                    }
+                }
+                if (owner ? owner != ngx_pid : !u.second) continue;
+
+                // 无事件存储时只推送给在线的流
+                if (!ngx_http_mcp_fanout_store && ngx_http_mcp_sinks.find(s) == ngx_http_mcp_sinks.end()) {
+                    continue;
+                }
+                auto it = index.find(s);
+                if (it == index.end()) {
+                    index.emplace(s, ngx_http_mcp_fanout.size());
+                    ngx_http_mcp_fanout.push_back({s, {msg}});
+                } else {
+                    ngx_http_mcp_fanout[it->second].msgs.push_back(msg);
+                }
+            }
+        }
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_ERR, ev->log, 0, "mcp resource update fan-out failed: %s", e.what());
+    }
+
+    if (!ngx_http_mcp_fanout.empty() && !ngx_http_mcp_fanout_ev.posted) {
+        ngx_post_event(&ngx_http_mcp_fanout_ev, &ngx_posted_events);
+    }
+}
+
+static ngx_int_t
+ngx_http_mcp_relay_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    if (data) {
+        shm_zone->data = data;
+        return NGX_OK;
+    }
+
+    auto *shpool = (ngx_slab_pool_t*)shm_zone->shm.addr;
+    if (shm_zone->shm.exists) {
+        shm_zone->data = shpool->data;
+        return NGX_OK;
+    }
+
+    auto *sh = (ngx_http_mcp_relay_shctx_t*)ngx_slab_calloc(shpool, sizeof(ngx_http_mcp_relay_shctx_t));
+    if (sh == NULL) return NGX_ERROR;
+    shpool->data = sh;
+    shm_zone->data = sh;
+    return NGX_OK;
+}
+
+// 启用会话(mcp_session_zone 或无状态会话)时才需要跨 worker 转发
+char *
+ngx_http_mcp_subscribe_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf) {
+    if (mcf->session_zone == NULL && !mcf->session_stateless) return NGX_CONF_OK;
+
+    ngx_str_t name = ngx_string(NGX_HTTP_MCP_RELAY_ZONE_NAME);
+    size_t size = ngx_align(sizeof(ngx_http_mcp_relay_shctx_t), ngx_pagesize) + 8 * ngx_pagesize;
+    mcf->subscribe_zone = ngx_shared_memory_add(cf, &name, size, &ngx_http_mcp_module);
+    if (mcf->subscribe_zone == NULL) return (char*)NGX_CONF_ERROR;
+    mcf->subscribe_zone->init = ngx_http_mcp_relay_init_zone;
+    return NGX_CONF_OK;
+}
+
+ngx_int_t
+ngx_http_mcp_subscribe_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+
+    ngx_http_mcp_window = mcf->notify_window;
+    ngx_http_mcp_fanout_store = mcf->event_zone != NULL;
+    ngx_http_mcp_window_ev.handler = ngx_http_mcp_window_handler;
+    ngx_http_mcp_window_ev.log = cycle->log;
+    ngx_http_mcp_window_ev.cancelable = 1;
+    ngx_http_mcp_fanout_ev.handler = ngx_http_mcp_fanout_handler;
+    ngx_http_mcp_fanout_ev.log = cycle->log;
+
+    mcp::server::SubscriptionRegistry::instance().set_publisher(ngx_http_mcp_resource_updated);
+
+    if (mcf->subscribe_zone) {
+        ngx_http_mcp_relay_sh = static_cast<ngx_http_mcp_relay_shctx_t*>(mcf->subscribe_zone->data);
+        ngx_http_mcp_relay_shpool = (ngx_slab_pool_t*)mcf->subscribe_zone->shm.addr;
+        ngx_http_mcp_relay_seen = ngx_http_mcp_relay_sh->next;
+        ngx_http_mcp_relay_ev.handler = ngx_http_mcp_relay_poll;
+        ngx_http_mcp_relay_ev.log = cycle->log;
+        ngx_http_mcp_relay_ev.cancelable = 1;
+        ngx_add_timer(&ngx_http_mcp_relay_ev, NGX_HTTP_MCP_RELAY_POLL);
+        mcp::server::SubscriptionRegistry::instance().set_observer(ngx_http_mcp_subscription_changed);
+
+        ngx_http_mcp_purge_ev.handler = ngx_http_mcp_purge_handler;
+        ngx_http_mcp_purge_ev.log = cycle->log;
+        ngx_http_mcp_purge_ev.cancelable = 1;
+        ngx_add_timer(&ngx_http_mcp_purge_ev, NGX_HTTP_MCP_PURGE_INTERVAL);
+    }
+    return NGX_OK;
+}
+
+void
+ngx_http_mcp_subscribe_exit_process(ngx_cycle_t *cycle) {
+    mcp::server::SubscriptionRegistry::instance().set_publisher(nullptr);
+    mcp::server::SubscriptionRegistry::instance().set_observer(nullptr);
+    if (ngx_http_mcp_fanout_ev.posted) {
+        ngx_delete_posted_event(&ngx_http_mcp_fanout_ev);
+    }
+    ngx_http_mcp_fanout.clear();
+    for (const auto &kv : ngx_http_mcp_sinks) ngx_http_mcp_owner_clear(kv.first, ngx_pid);
+    ngx_http_mcp_sinks.clear();
+    ngx_http_mcp_relay_sh = NULL;
+}
+
+// 会话结束(DELETE 或会话清理): 清除订阅, 关闭该会话的推送流, 并通知其他 worker;
+// 没有订阅也没有 GET 流的会话不转发, 免得清理大量空闲会话时冲掉转发板
+void
+ngx_http_mcp_subscribe_session_closed(ngx_str_t *session) {
+    std::string id((const char*)session->data, session->len);
+    bool relay = mcp::server::SubscriptionRegistry::instance().remove_session(id)
+                 || ngx_http_mcp_owner_get(id) != 0;
+    if (relay) {
+        ngx_http_mcp_owner_clear(id, 0);
+        ngx_http_mcp_relay_post(NGX_HTTP_MCP_RELAY_CLOSED, id, std::string());
+    }
+    ngx_http_mcp_subscribe_close_local(id);
+}
+
+} // extern "C"
+
+// 登记会话的推送出口, 之后该会话的事件由本 worker 记录与推送
+void
+ngx_http_mcp_sink_add(const std::string &session, const std::shared_ptr<ngx_http_mcp_stream_t> &stream) {
+    ngx_http_mcp_sinks.emplace(session, stream);
+    ngx_http_mcp_owner_set(session);
+}
+
+// 流结束时移除; 本 worker 不再有该会话的流时撤销登记
+void
+ngx_http_mcp_sink_remove(const std::string &session, ngx_http_mcp_stream_t *stream) {
+    bool left = false;
+    auto range = ngx_http_mcp_sinks.equal_range(session);
+    for (auto it = range.first; it != range.second; ) {
+        std::shared_ptr<ngx_http_mcp_stream_t> s = it->second.lock();
+        if (!s || s.get() == stream) {
+            it = ngx_http_mcp_sinks.erase(it);
+            continue;
+        }
+        if (!s->closed) left = true;
+        ++it;
+    }
+    if (!left) ngx_http_mcp_owner_clear(session, ngx_pid);
+}
@@ -0,0 +1,226 @@
+#include "ngx_http_mcp_module.h"
+
+#if (NGX_OPENSSL)
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#endif
+
+// 无状态会话: 会话状态编码进 Mcp-Session-Id, 以 HMAC-SHA256 签名, 任意节点的任意 worker
+// 只凭密钥即可验证, 不依赖共享表。令牌在过期前不可撤销。
+
+extern "C" {
+
+#define NGX_HTTP_MCP_TOKEN_VERSION  1
+#define NGX_HTTP_MCP_TOKEN_NONCE    8
+#define NGX_HTTP_MCP_TOKEN_MAC      16   // HMAC-SHA256 截断到 128 位
+
+// 明文布局(网络字节序): ver(1) kid(1) caps(2) expire(4) nonce(8) vlen(1) version(vlen), 之后附 MAC
+#define NGX_HTTP_MCP_TOKEN_FIXED    17
+#define NGX_HTTP_MCP_TOKEN_MAX      (NGX_HTTP_MCP_TOKEN_FIXED + NGX_HTTP_MCP_SESSION_VERSION_LEN \
+                                     + NGX_HTTP_MCP_TOKEN_MAC)
+
+#define NGX_HTTP_MCP_KEY_MIN        16
+#define NGX_HTTP_MCP_KEY_MAX        1024
+
+// mcp_session_key kid path; 第一条用于签发, 其余仅用于验证(轮换期间保留旧密钥)
+char *ngx_http_mcp_session_key(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+#if !(NGX_OPENSSL)
+    return (char*)"requires nginx built with OpenSSL";
+#endif
+
+    ngx_int_t kid = ngx_atoi(value[1].data, value[1].len);
+    if (kid == NGX_ERROR || kid > 255) return (char*)"invalid key id (0-255 expected)";
+
+    ngx_http_mcp_session_key_t *k = (ngx_http_mcp_session_key_t*)mcf->session_keys->elts;
+    for (ngx_uint_t i = 0; i < mcf->session_keys->nelts; ++i) {
+        if (k[i].kid == (ngx_uint_t)kid) return (char*)"duplicate key id";
+    }
+
+    ngx_str_t path = value[2];
+    if (ngx_conf_full_name(cf->cycle, &path, 1) != NGX_OK) return (char*)NGX_CONF_ERROR;
+
+    ngx_fd_t fd = ngx_open_file(path.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+    if (fd == NGX_INVALID_FILE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno, "open key file \"%V\" failed", &path);
+        return (char*)NGX_CONF_ERROR;
+    }
+
+    ngx_file_info_t fi;
+    ssize_t n = NGX_ERROR;
+    u_char *secret = NULL;
+    if (ngx_fd_info(fd, &fi) != NGX_FILE_ERROR
+        && ngx_file_size(&fi) >= NGX_HTTP_MCP_KEY_MIN && ngx_file_size(&fi) <= NGX_HTTP_MCP_KEY_MAX)
+    {
+        size_t size = (size_t)ngx_file_size(&fi);
+        secret = (u_char*)ngx_pnalloc(cf->pool, size);
+        if (secret) n = ngx_read_fd(fd, secret, size);
+    }
+    ngx_close_file(fd);
+
+    // 去掉文件末尾的换行等空白
+    while (n > 0 && (secret[n - 1] == '\n' || secret[n - 1] == '\r'
+                     || secret[n - 1] == ' ' || secret[n - 1] == '\t')) {
+        n--;
+    }
+    if (n < NGX_HTTP_MCP_KEY_MIN) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "key file \"%V\" must contain %d to %d bytes",
+                           &path, NGX_HTTP_MCP_KEY_MIN, NGX_HTTP_MCP_KEY_MAX);
+        return (char*)NGX_CONF_ERROR;
+    }
+
+    k = (ngx_http_mcp_session_key_t*)ngx_array_push(mcf->session_keys);
+    if (k == NULL) return (char*)NGX_CONF_ERROR;
+    k->kid = (ngx_uint_t)kid;
+    k->secret.data = secret;
+    k->secret.len = (size_t)n;
+    return NGX_CONF_OK;
+}
+
+char *ngx_http_mcp_token_init_main_conf(ngx_conf_t *cf, ngx_http_mcp_main_conf_t *mcf) {
+    ngx_conf_init_value(mcf->session_stateless, 0);
+    ngx_conf_init_value(mcf->session_ttl, 86400);
+
+    if (mcf->session_stateless && mcf->session_keys->nelts == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"mcp_session_stateless\" requires \"mcp_session_key\"");
+        return (char*)NGX_CONF_ERROR;
+    }
+    return NGX_CONF_OK;
+}
+
+#if (NGX_OPENSSL)
+
+static ngx_int_t
+ngx_http_mcp_token_mac(ngx_http_mcp_session_key_t *key, const u_char *data, size_t len, u_char *mac) {
+    u_char       md[EVP_MAX_MD_SIZE];
+    unsigned int md_len = 0;
+
+    if (HMAC(EVP_sha256(), key->secret.data, (int)key->secret.len, data, len, md, &md_len) == NULL
+        || md_len < NGX_HTTP_MCP_TOKEN_MAC)
+    {
+        return NGX_ERROR;
+    }
+    ngx_memcpy(mac, md, NGX_HTTP_MCP_TOKEN_MAC);
+    return NGX_OK;
+}
+
+// 用第一把密钥签发令牌, base64url 编码后写入 id
+ngx_int_t
+ngx_http_mcp_token_issue(ngx_http_request_t *r, ngx_http_mcp_main_conf_t *mcf,
+                         ngx_http_mcp_session_info_t *info, ngx_str_t *id) {
+    ngx_http_mcp_session_key_t *key = (ngx_http_mcp_session_key_t*)mcf->session_keys->elts;
+    u_char raw[NGX_HTTP_MCP_TOKEN_MAX], *p = raw;
+    uint32_t expire = (uint32_t)(info->created + mcf->session_ttl);
+
+    *p++ = NGX_HTTP_MCP_TOKEN_VERSION;
+    *p++ = (u_char)key->kid;
+    *p++ = (u_char)(info->caps >> 8);
+    *p++ = (u_char)info->caps;
+    *p++ = (u_char)(expire >> 24);
+    *p++ = (u_char)(expire >> 16);
+    *p++ = (u_char)(expire >> 8);
+    *p++ = (u_char)expire;
+    if (ngx_http_mcp_random(p, NGX_HTTP_MCP_TOKEN_NONCE, r->connection->log) != NGX_OK) {
+        return NGX_ERROR;
+    }
+    p += NGX_HTTP_MCP_TOKEN_NONCE;
+    *p++ = info->version_len;
+    p = ngx_cpymem(p, info->version, info->version_len);
+
+    if (ngx_http_mcp_token_mac(key, raw, p - raw, p) != NGX_OK) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0, "mcp session token HMAC failed");
+        return NGX_ERROR;
+    }
+    p += NGX_HTTP_MCP_TOKEN_MAC;
+
+    ngx_str_t src;
+    src.data = raw;
+    src.len = p - raw;
+    id->data = (u_char*)ngx_pnalloc(r->pool, ngx_base64_encoded_length(src.len));
+    if (id->data == NULL) return NGX_ERROR;
+    ngx_encode_base64url(id, &src);
+    return NGX_OK;
+}
+
+// 校验签名与有效期; 按 kid 选择密钥, 轮换期间旧密钥签发的令牌仍然有效
+ngx_int_t
+ngx_http_mcp_token_verify(ngx_http_request_t *r, ngx_http_mcp_main_conf_t *mcf,
+                          ngx_str_t *id, ngx_http_mcp_session_info_t *info) {
+    u_char raw[NGX_HTTP_MCP_TOKEN_MAX + 3], mac[NGX_HTTP_MCP_TOKEN_MAC];
+
+    if (id->len == 0 || id->len > ngx_base64_encoded_length(NGX_HTTP_MCP_TOKEN_MAX)) {
+        return NGX_DECLINED;
+    }
+    ngx_str_t dst;
+    dst.data = raw;
+    if (ngx_decode_base64url(&dst, id) != NGX_OK
+        || dst.len < NGX_HTTP_MCP_TOKEN_FIXED + NGX_HTTP_MCP_TOKEN_MAC
+        || raw[0] != NGX_HTTP_MCP_TOKEN_VERSION)
+    {
+        return NGX_DECLINED;
+    }
+
+    size_t vlen = raw[NGX_HTTP_MCP_TOKEN_FIXED - 1];
+    size_t body = NGX_HTTP_MCP_TOKEN_FIXED + vlen;
+    if (vlen > NGX_HTTP_MCP_SESSION_VERSION_LEN || dst.len != body + NGX_HTTP_MCP_TOKEN_MAC) {
+        return NGX_DECLINED;
+    }
+
+    ngx_http_mcp_session_key_t *key = (ngx_http_mcp_session_key_t*)mcf->session_keys->elts;
+    ngx_uint_t i;
+    for (i = 0; i < mcf->session_keys->nelts; ++i) {
+        if (key[i].kid == raw[1]) break;
+    }
+    if (i == mcf->session_keys->nelts) return NGX_DECLINED;
+
+    if (ngx_http_mcp_token_mac(&key[i], raw, body, mac) != NGX_OK
+        || CRYPTO_memcmp(mac, raw + body, NGX_HTTP_MCP_TOKEN_MAC) != 0)
+    {
+        return NGX_DECLINED;
+    }
+
+    time_t expire = ((time_t)raw[4] << 24) | ((time_t)raw[5] << 16) | ((time_t)raw[6] << 8) | raw[7];
+    time_t now = ngx_time();
+    if (expire <= now) return NGX_DECLINED;
+
+    info->caps = ((uint32_t)raw[2] << 8) | raw[3];
+    info->version_len = (u_char)vlen;
+    ngx_memcpy(info->version, raw + NGX_HTTP_MCP_TOKEN_FIXED, vlen);
+    info->created = expire - mcf->session_ttl;
+    info->last = now;
+    return NGX_OK;
+}
+
+#else
+
+ngx_int_t
+ngx_http_mcp_token_issue(ngx_http_request_t *r, ngx_http_mcp_main_conf_t *mcf,
+                         ngx_http_mcp_session_info_t *info, ngx_str_t *id) {
+    return NGX_ERROR;
+}
+
+ngx_int_t
+ngx_http_mcp_token_verify(ngx_http_request_t *r, ngx_http_mcp_main_conf_t *mcf,
+                          ngx_str_t *id, ngx_http_mcp_session_info_t *info) {
+    return NGX_DECLINED;
+}
+
+#endif
+
+// 令牌中的过期时间, 不校验签名(仅用于已验证过的令牌); 格式不对时返回 0
+time_t
+ngx_http_mcp_token_expire(ngx_str_t *id) {
+    u_char raw[NGX_HTTP_MCP_TOKEN_MAX + 3];
+
+    if (id->len == 0 || id->len > ngx_base64_encoded_length(NGX_HTTP_MCP_TOKEN_MAX)) return 0;
+    ngx_str_t dst;
+    dst.data = raw;
+    if (ngx_decode_base64url(&dst, id) != NGX_OK || dst.len < NGX_HTTP_MCP_TOKEN_FIXED) return 0;
+    return ((time_t)raw[4] << 24) | ((time_t)raw[5] << 16) | ((time_t)raw[6] << 8) | raw[7];
+}
+
+} // extern "C"
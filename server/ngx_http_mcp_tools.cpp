@@ -0,0 +1,129 @@
+#include <fstream>
+#include <new>
+#include <vector>
+#include "ngx_http_mcp_module.h"
+
+// nginx.conf 中声明的工具: mcp_tool 指向的 JSON 文件在解析配置时读取并校验,
+// 每个 worker 启动时整体替换注册表中来自配置的工具, 之后 tools/list 只引用预序列化的页。
+
+struct ngx_http_mcp_tools_conf_s {
+    std::vector<mcp::Tool> tools;
+};
+
+extern "C" {
+
+static void
+ngx_http_mcp_tools_conf_cleanup(void *data) {
+    delete static_cast<ngx_http_mcp_tools_conf_s*>(data);
+}
+
+// mcp_tool path; 文件内容为一个 Tool 对象或 Tool 数组
+char *ngx_http_mcp_tool(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_mcp_main_conf_t *mcf = (ngx_http_mcp_main_conf_t*)conf;
+    ngx_str_t *value = (ngx_str_t*)cf->args->elts;
+
+    if (mcf->tools == NULL) {
+        ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(cf->pool, 0);
+        if (cln == NULL) return (char*)NGX_CONF_ERROR;
+        mcf->tools = new (std::nothrow) ngx_http_mcp_tools_conf_s();
+        if (mcf->tools == NULL) return (char*)NGX_CONF_ERROR;
+        cln->handler = ngx_http_mcp_tools_conf_cleanup;
+        cln->data = mcf->tools;
+    }
+
+    ngx_str_t path = value[1];
+    if (ngx_conf_full_name(cf->cycle, &path, 1) != NGX_OK) return (char*)NGX_CONF_ERROR;
+
+    try {
+        std::ifstream in(std::string((const char*)path.data, path.len));
+        if (!in) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno, "open tool file \"%V\" failed", &path);
+            return (char*)NGX_CONF_ERROR;
+        }
+        nlohmann::json j = nlohmann::json::parse(in);
+        std::vector<mcp::Tool> tools;
+        if (j.is_array()) {
+            tools = j.get<std::vector<mcp::Tool>>();
+        } else {
+            tools.push_back(j.get<mcp::Tool>());
+        }
+
+        for (auto &t : tools) {
+            mcp::server::ToolRegistry::validate(t);
+            for (const auto &o : mcf->tools->tools) {
+                if (o.name == t.name) {
+                    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "duplicate tool \"%s\"", t.name.c_str());
+                    return (char*)NGX_CONF_ERROR;
+                }
+            }
+            mcf->tools->tools.push_back(std::move(t));
+        }
+    } catch (const std::exception &e) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid tool file \"%V\": %s", &path, e.what());
+        return (char*)NGX_CONF_ERROR;
+    }
+    return NGX_CONF_OK;
+}
+
+// 各 worker 在此预序列化 tools/list
+ngx_int_t
+ngx_http_mcp_tools_init_process(ngx_cycle_t *cycle, ngx_http_mcp_main_conf_t *mcf) {
+    if (ngx_process != NGX_PROCESS_WORKER && ngx_process != NGX_PROCESS_SINGLE) return NGX_OK;
+
+    try {
+        auto &registry = mcp::server::ToolRegistry::instance();
+        mcp::server::McpServer::register_builtin_tools();
+        registry.set_page_size(mcf->tools_page_size);
+        registry.set_config_tools(mcf->tools ? mcf->tools->tools : std::vector<mcp::Tool>());
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0, "mcp tool registry init failed: %s", e.what());
+        return NGX_ERROR;
+    }
+    return NGX_OK;
+}
+
+static void
+ngx_http_mcp_tools_snapshot_cleanup(void *data) {
+    delete static_cast<std::shared_ptr<const mcp::server::ToolRegistry::Snapshot>*>(data);
+}
+
+// tools/list: 响应体直接引用快照中的页, 快照由请求 pool 持有到请求结束
+ngx_int_t
+ngx_http_mcp_tools_list(ngx_http_request_t *r, ngx_http_mcp_async_ctx_t *ctx) {
+    const auto &req = std::get<mcp::ListToolsRequest>(ctx->req_variant);
+    size_t len = 0;
+    ngx_chain_t *out;
+
+    try {
+        auto snap = mcp::server::ToolRegistry::instance().snapshot();
+        const std::string *page = snap->page(req.params ? req.params->cursor : std::nullopt);
+        if (page == nullptr) {
+            out = ngx_http_mcp_serialize_error(r->pool, ctx->id, NGX_HTTP_MCP_RPC_INVALID_PARAMS,
+                                               "Invalid cursor", nullptr, &len);
+            return ngx_http_mcp_send_chain(r, out, len);
+        }
+
+        // 页内容未变时只回 304
+        uint64_t etag = snap->etags[page - snap->pages.data()];
+        if (ngx_http_mcp_cache_not_modified(r, etag)) {
+            return ngx_http_mcp_cache_send_not_modified(r, etag);
+        }
+        if (ngx_http_mcp_cache_set_etag(r, etag) != NGX_OK) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+        ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(r->pool, 0);
+        if (cln == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        cln->data = new std::shared_ptr<const mcp::server::ToolRegistry::Snapshot>(std::move(snap));
+        cln->handler = ngx_http_mcp_tools_snapshot_cleanup;
+
+        out = ngx_http_mcp_wrap_result(r->pool, ctx->id, (const u_char*)page->data(), page->size(), &len);
+        if (out == NULL) return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    } catch (const std::exception &e) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0, "mcp tools/list failed: %s", e.what());
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    ngx_http_mcp_limit_charge_response(ctx->charges, len);
+    return ngx_http_mcp_send_chain(r, out, len);
+}
+
+} // extern "C"
@@ -0,0 +1,172 @@
+#include "ngx_http_mcp_module.h"
+
+// 访问日志变量: 取自请求上下文中已解析的请求与各阶段计时, 不重新解析请求体。
+// 只有带请求体的 MCP 请求(POST 等)有值; GET 事件流、DELETE 与批量请求的方法、工具等为空("-"),
+// 批量请求只有 $mcp_session_id 与 $mcp_rate_limited。
+
+enum {
+    NGX_HTTP_MCP_VAR_QUEUE,
+    NGX_HTTP_MCP_VAR_HANDLER
+};
+
+static ngx_str_t ngx_http_mcp_cache_status_names[] = {
+    ngx_null_string,
+    ngx_string("MISS"),
+    ngx_string("HIT"),
+    ngx_string("STALE"),
+    ngx_string("COALESCED"),
+};
+
+extern "C" {
+
+// 请求体已按 MCP 请求读取时返回其上下文; GET 的模块上下文为 listener, 其余请求没有上下文
+static ngx_http_mcp_async_ctx_t *
+ngx_http_mcp_variable_ctx(ngx_http_request_t *r) {
+    if (!(r->method & (NGX_HTTP_POST|NGX_HTTP_PUT|NGX_HTTP_PATCH))) return NULL;
+    return static_cast<ngx_http_mcp_async_ctx_t*>(ngx_http_get_module_ctx(r, ngx_http_mcp_module));
+}
+
+static ngx_int_t
+ngx_http_mcp_variable_str(ngx_http_variable_value_t *v, u_char *data, size_t len) {
+    if (len == 0) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+    v->len = len;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = data;
+    return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_mcp_variable_method(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_variable_ctx(r);
+    if (ctx == NULL) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+    return ngx_http_mcp_variable_str(v, (u_char*)ctx->method.data(), ctx->method.size());
+}
+
+static ngx_int_t
+ngx_http_mcp_variable_tool(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_variable_ctx(r);
+    auto *call = ctx ? std::get_if<mcp::CallToolRequest>(&ctx->req_variant) : nullptr;
+    if (call == nullptr || ctx->method.empty()) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+    return ngx_http_mcp_variable_str(v, (u_char*)call->params.name.data(), call->params.name.size());
+}
+
+static ngx_int_t
+ngx_http_mcp_variable_session_id(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_variable_ctx(r);
+    if (ctx == NULL) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+    return ngx_http_mcp_variable_str(v, ctx->session_id.data, ctx->session_id.len);
+}
+
+// 字符串 id 去掉外层引号(内部转义保持 JSON 形式), 数字原样输出
+static ngx_int_t
+ngx_http_mcp_variable_request_id(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_variable_ctx(r);
+    if (ctx == NULL || ctx->id.empty() || ctx->id == "null") {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+    const std::string &id = ctx->id;
+    if (id.size() >= 2 && id.front() == '"' && id.back() == '"') {
+        return ngx_http_mcp_variable_str(v, (u_char*)id.data() + 1, id.size() - 2);
+    }
+    return ngx_http_mcp_variable_str(v, (u_char*)id.data(), id.size());
+}
+
+// 毫秒, 精确到微秒, 与 $request_time 的写法一致; 未经过该阶段时为空
+static ngx_int_t
+ngx_http_mcp_variable_msec(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_variable_ctx(r);
+    if (ctx == NULL || ctx->method.empty()) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    uint64_t usec;
+    if (data == NGX_HTTP_MCP_VAR_QUEUE) {
+        if (ctx->posted_usec == 0) {
+            v->not_found = 1;
+            return NGX_OK;
+        }
+        usec = ctx->queue_usec;
+    } else {
+        if (ctx->handler_usec == 0) {
+            v->not_found = 1;
+            return NGX_OK;
+        }
+        usec = ctx->handler_usec;
+    }
+
+    u_char *p = (u_char*)ngx_pnalloc(r->pool, NGX_INT64_LEN + sizeof(".000") - 1);
+    if (p == NULL) return NGX_ERROR;
+    u_char *last = ngx_sprintf(p, "%uL.%03uL", usec / 1000, usec % 1000);
+    return ngx_http_mcp_variable_str(v, p, last - p);
+}
+
+static ngx_int_t
+ngx_http_mcp_variable_rate_limited(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_variable_ctx(r);
+    if (ctx == NULL) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+    return ngx_http_mcp_variable_str(v, (u_char*)(ctx->rate_limited ? "1" : "0"), 1);
+}
+
+static ngx_int_t
+ngx_http_mcp_variable_cache_status(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data) {
+    ngx_http_mcp_async_ctx_t *ctx = ngx_http_mcp_variable_ctx(r);
+    if (ctx == NULL || ctx->cache_status >= sizeof(ngx_http_mcp_cache_status_names) / sizeof(ngx_str_t)) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+    ngx_str_t *name = &ngx_http_mcp_cache_status_names[ctx->cache_status];
+    return ngx_http_mcp_variable_str(v, name->data, name->len);
+}
+
+static ngx_http_variable_t ngx_http_mcp_variables[] = {
+    { ngx_string("mcp_method"), NULL, ngx_http_mcp_variable_method, 0,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    { ngx_string("mcp_tool"), NULL, ngx_http_mcp_variable_tool, 0,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    { ngx_string("mcp_session_id"), NULL, ngx_http_mcp_variable_session_id, 0,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    { ngx_string("mcp_request_id"), NULL, ngx_http_mcp_variable_request_id, 0,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    { ngx_string("mcp_queue_ms"), NULL, ngx_http_mcp_variable_msec, NGX_HTTP_MCP_VAR_QUEUE,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    { ngx_string("mcp_handler_ms"), NULL, ngx_http_mcp_variable_msec, NGX_HTTP_MCP_VAR_HANDLER,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    { ngx_string("mcp_rate_limited"), NULL, ngx_http_mcp_variable_rate_limited, 0,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    { ngx_string("mcp_cache_status"), NULL, ngx_http_mcp_variable_cache_status, 0,
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+    ngx_http_null_variable
+};
+
+// preconfiguration: 注册 $mcp_* 变量
+ngx_int_t
+ngx_http_mcp_add_variables(ngx_conf_t *cf) {
+    for (ngx_http_variable_t *v = ngx_http_mcp_variables; v->name.len; ++v) {
+        ngx_http_variable_t *var = ngx_http_add_variable(cf, &v->name, v->flags);
+        if (var == NULL) return NGX_ERROR;
+        var->get_handler = v->get_handler;
+        var->data = v->data;
+    }
+    return NGX_OK;
+}
+
+} // extern "C"
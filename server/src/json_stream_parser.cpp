@@ -0,0 +1,355 @@
+#include "../include/json_stream_parser.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+
+namespace mcp {
+namespace server {
+
+namespace {
+inline bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 字符串中可整段追加的普通字符
+inline bool is_plain(unsigned char c) {
+    return c >= 0x20 && c < 0x80 && c != '"' && c != '\\';
+}
+
+// RFC 8259 数字语法: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool valid_number(const std::string& s, bool& integral) {
+    size_t i = 0, n = s.size();
+    integral = true;
+    if (i < n && s[i] == '-') ++i;
+    if (i >= n) return false;
+    if (s[i] == '0') {
+        ++i;
+    } else if (s[i] >= '1' && s[i] <= '9') {
+        while (i < n && s[i] >= '0' && s[i] <= '9') ++i;
+    } else {
+        return false;
+    }
+    if (i < n && s[i] == '.') {
+        integral = false;
+        size_t start = ++i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') ++i;
+        if (i == start) return false;
+    }
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        integral = false;
+        ++i;
+        if (i < n && (s[i] == '+' || s[i] == '-')) ++i;
+        size_t start = i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') ++i;
+        if (i == start) return false;
+    }
+    return i == n;
+}
+} // namespace
+
+JsonStreamParser::JsonStreamParser(size_t max_depth)
+    : max_depth_(max_depth) {}
+
+bool JsonStreamParser::fail(const char* msg) {
+    if (error_.empty()) {
+        error_ = msg;
+        error_ += " at offset " + std::to_string(consumed_);
+    }
+    return false;
+}
+
+bool JsonStreamParser::feed(const char* data, size_t len) {
+    if (failed()) return false;
+    size_t i = 0;
+    while (i < len) {
+        // 快速路径: 长字符串(如 tools/call 参数)按段追加
+        if (token_ == Token::String && escape_ == 0 && utf8_need_ == 0 && high_surrogate_ == 0) {
+            size_t j = i;
+            while (j < len && is_plain(static_cast<unsigned char>(data[j]))) ++j;
+            if (j > i) {
+                buf_.append(data + i, j - i);
+                consumed_ += j - i;
+                i = j;
+                continue;
+            }
+        }
+        if (!step(data[i])) return false;
+        ++consumed_;
+        ++i;
+    }
+    return true;
+}
+
+bool JsonStreamParser::finish() {
+    if (failed()) return false;
+    if (token_ == Token::Number && !end_number()) return false;
+    if (token_ != Token::None) return fail("unexpected end of input");
+    if (mode_ != Mode::Done) return fail("incomplete document");
+    return true;
+}
+
+bool JsonStreamParser::step(char c) {
+    unsigned char uc = static_cast<unsigned char>(c);
+
+    switch (token_) {
+    case Token::String:
+        if (escape_ == 1) {
+            escape_ = 0;
+            if (high_surrogate_ && c != 'u') return fail("unpaired surrogate");
+            switch (c) {
+            case '"':  buf_ += '"'; break;
+            case '\\': buf_ += '\\'; break;
+            case '/':  buf_ += '/'; break;
+            case 'b':  buf_ += '\b'; break;
+            case 'f':  buf_ += '\f'; break;
+            case 'n':  buf_ += '\n'; break;
+            case 'r':  buf_ += '\r'; break;
+            case 't':  buf_ += '\t'; break;
+            case 'u':  escape_ = 2; unicode_ = 0; break;
+            default:   return fail("invalid escape");
+            }
+            return true;
+        }
+        if (escape_ >= 2) {
+            int v = hex_value(c);
+            if (v < 0) return fail("invalid \\u escape");
+            unicode_ = (unicode_ << 4) | static_cast<uint32_t>(v);
+            if (++escape_ < 6) return true;
+            escape_ = 0;
+            if (unicode_ >= 0xD800 && unicode_ <= 0xDBFF) {
+                if (high_surrogate_) return fail("unpaired surrogate");
+                high_surrogate_ = unicode_;
+            } else if (unicode_ >= 0xDC00 && unicode_ <= 0xDFFF) {
+                if (!high_surrogate_) return fail("unpaired surrogate");
+                append_utf8(0x10000 + ((high_surrogate_ - 0xD800) << 10) + (unicode_ - 0xDC00));
+                high_surrogate_ = 0;
+            } else {
+                if (high_surrogate_) return fail("unpaired surrogate");
+                append_utf8(unicode_);
+            }
+            return true;
+        }
+        if (utf8_need_) {
+            if ((uc & 0xC0) != 0x80) return fail("invalid UTF-8");
+            --utf8_need_;
+            buf_ += c;
+            return true;
+        }
+        if (high_surrogate_ && c != '\\') return fail("unpaired surrogate");
+        if (c == '\\') { escape_ = 1; return true; }
+        if (c == '"') return end_string();
+        if (uc < 0x20) return fail("control character in string");
+        if (uc >= 0x80) {
+            if (uc >= 0xC2 && uc <= 0xDF) utf8_need_ = 1;
+            else if (uc >= 0xE0 && uc <= 0xEF) utf8_need_ = 2;
+            else if (uc >= 0xF0 && uc <= 0xF4) utf8_need_ = 3;
+            else return fail("invalid UTF-8");
+        }
+        buf_ += c;
+        return true;
+
+    case Token::Number:
+        if (is_number_char(c)) { buf_ += c; return true; }
+        if (!end_number()) return false;
+        break;  // 结束数字后继续按结构字符处理 c
+
+    case Token::Literal:
+        if (*literal_ != c) return fail("invalid literal");
+        if (*++literal_ == '\0') {
+            token_ = Token::None;
+            switch (buf_[0]) {
+            case 't': return put(nlohmann::json(true));
+            case 'f': return put(nlohmann::json(false));
+            default:  return put(nlohmann::json(nullptr));
+            }
+        }
+        return true;
+
+    case Token::None:
+        break;
+    }
+
+    if (is_ws(c)) return true;
+
+    switch (mode_) {
+    case Mode::Value:
+        return begin_value(c);
+    case Mode::ArrayFirst:
+        if (c == ']') return pop(c);
+        return begin_value(c);
+    case Mode::ObjectFirst:
+        if (c == '}') return pop(c);
+        /* fall through */
+    case Mode::Key:
+        if (c != '"') return fail("expected object key");
+        token_ = Token::String;
+        is_key_ = true;
+        buf_.clear();
+        return true;
+    case Mode::Colon:
+        if (c != ':') return fail("expected ':'");
+        mode_ = Mode::Value;
+        return true;
+    case Mode::CommaOrEnd:
+        if (c == ',') {
+            mode_ = stack_.back()->is_array() ? Mode::Value : Mode::Key;
+            return true;
+        }
+        if (c == ']' || c == '}') return pop(c);
+        return fail("expected ',' or end of container");
+    case Mode::Done:
+        return fail("trailing characters after document");
+    }
+    return fail("invalid parser state");
+}
+
+bool JsonStreamParser::begin_value(char c) {
+    switch (c) {
+    case '{':
+        if (!push(nlohmann::json::object())) return false;
+        mode_ = Mode::ObjectFirst;
+        return true;
+    case '[':
+        if (!push(nlohmann::json::array())) return false;
+        mode_ = Mode::ArrayFirst;
+        return true;
+    case '"':
+        token_ = Token::String;
+        is_key_ = false;
+        buf_.clear();
+        return true;
+    case 't':
+        literal_ = "true" + 1;
+        break;
+    case 'f':
+        literal_ = "false" + 1;
+        break;
+    case 'n':
+        literal_ = "null" + 1;
+        break;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            token_ = Token::Number;
+            buf_.assign(1, c);
+            return true;
+        }
+        return fail("unexpected character");
+    }
+    token_ = Token::Literal;
+    buf_.assign(1, c);
+    return true;
+}
+
+bool JsonStreamParser::end_string() {
+    if (high_surrogate_) return fail("unpaired surrogate");
+    token_ = Token::None;
+    if (is_key_) {
+        key_ = std::move(buf_);
+        buf_.clear();
+        mode_ = Mode::Colon;
+        return true;
+    }
+    nlohmann::json v(std::move(buf_));
+    buf_.clear();
+    return put(std::move(v));
+}
+
+bool JsonStreamParser::end_number() {
+    token_ = Token::None;
+    bool integral = true;
+    if (!valid_number(buf_, integral)) return fail("invalid number");
+
+    // 与 nlohmann 一致: 整数优先, 溢出时退化为浮点
+    if (integral) {
+        errno = 0;
+        if (buf_[0] == '-') {
+            long long v = std::strtoll(buf_.c_str(), nullptr, 10);
+            if (errno == 0) return put(nlohmann::json(static_cast<int64_t>(v)));
+        } else {
+            unsigned long long v = std::strtoull(buf_.c_str(), nullptr, 10);
+            if (errno == 0) {
+                if (v <= static_cast<unsigned long long>(INT64_MAX)) {
+                    return put(nlohmann::json(static_cast<int64_t>(v)));
+                }
+                return put(nlohmann::json(static_cast<uint64_t>(v)));
+            }
+        }
+    }
+    // 与 nlohmann 一致: 超出 double 范围(如 1e400)是解析错误, 下溢按 0 处理
+    double d = std::strtod(buf_.c_str(), nullptr);
+    if (!std::isfinite(d)) return fail("number overflow");
+    return put(nlohmann::json(d));
+}
+
+bool JsonStreamParser::put(nlohmann::json&& v) {
+    if (stack_.empty()) {
+        root_ = std::move(v);
+        mode_ = Mode::Done;
+        return true;
+    }
+    nlohmann::json* top = stack_.back();
+    if (top->is_array()) {
+        top->push_back(std::move(v));
+    } else {
+        (*top)[key_] = std::move(v);
+    }
+    mode_ = Mode::CommaOrEnd;
+    return true;
+}
+
+// 父容器在子容器关闭前不会再被修改, 因此栈中的指针保持有效
+bool JsonStreamParser::push(nlohmann::json&& container) {
+    if (stack_.size() >= max_depth_) return fail("nesting too deep");
+    if (stack_.empty()) {
+        root_ = std::move(container);
+        stack_.push_back(&root_);
+        return true;
+    }
+    nlohmann::json* top = stack_.back();
+    if (top->is_array()) {
+        top->push_back(std::move(container));
+        stack_.push_back(&top->back());
+    } else {
+        stack_.push_back(&((*top)[key_] = std::move(container)));
+    }
+    return true;
+}
+
+bool JsonStreamParser::pop(char close) {
+    if (stack_.back()->is_array() != (close == ']')) return fail("mismatched bracket");
+    stack_.pop_back();
+    mode_ = stack_.empty() ? Mode::Done : Mode::CommaOrEnd;
+    return true;
+}
+
+void JsonStreamParser::append_utf8(uint32_t cp) {
+    if (cp < 0x80) {
+        buf_ += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        buf_ += static_cast<char>(0xC0 | (cp >> 6));
+        buf_ += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        buf_ += static_cast<char>(0xE0 | (cp >> 12));
+        buf_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        buf_ += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        buf_ += static_cast<char>(0xF0 | (cp >> 18));
+        buf_ += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        buf_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        buf_ += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+} // namespace server
+} // namespace mcp
@@ -1,5 +1,7 @@
 #include "../include/mcp_server.h"
+#include <atomic>
 #include <exception>
+#include <stdexcept>
 
 namespace mcp {
 namespace server {
@@ -128,6 +130,17 @@ bool McpServer::parse_body_and_build(const std::string& body,
                                "mcp json parse_body_and_build unknown error");
         return false;
     }
+    return build_request(j, out, method_out, log);
+}
+
+bool McpServer::build_request(const nlohmann::json& j,
+                              MCPRequestVariant& out,
+                              std::string& method_out,
+                              ngx_log_t* log) {
+    if (!j.is_object()) {
+        if (log) ngx_log_error(NGX_LOG_ERR, log, 0, "mcp request is not a JSON object");
+        return false;
+    }
     auto it = j.find("method");
     if (it == j.end() || !it->is_string()) {
         if (log) ngx_log_error(NGX_LOG_ERR, log, 0,
@@ -143,6 +156,10 @@ bool McpServer::parse_body_and_build(const std::string& body,
     return true;
 }
 
+bool McpServer::is_known_method(const std::string& method) {
+    return to_method_id(method) != MCPMethodId::Unknown;
+}
+
 // ====== 新增: 各具体请求处理实现 ======
 InitializeResult McpServer::handle_initialize(const InitializeRequest& req, ngx_log_t* log) {
     if (log) ngx_log_error(NGX_LOG_INFO, log, 0, "mcp handle_initialize");
@@ -160,24 +177,77 @@ EmptyResult McpServer::handle_ping(const PingRequest& req, ngx_log_t* log) {
 
 ListToolsResult McpServer::handle_list_tools(const ListToolsRequest& req, ngx_log_t* log) {
     if (log) ngx_log_error(NGX_LOG_INFO, log, 0, "mcp handle_list_tools");
-    ListToolsResult r;
-    r.tools = {}; // 返回空列表，占位
-    return r;
+    // 单个请求的快速路径直接引用预序列化的页, 这里只服务批量请求等路径
+    return ToolRegistry::instance().list(req.params ? req.params->cursor : std::nullopt);
 }
 
-CallToolResult McpServer::handle_call_tool(const CallToolRequest& req, ngx_log_t* log) {
+CallToolResult McpServer::handle_call_tool(const CallToolRequest& req, ngx_log_t* log,
+                                           RequestContext* ctx) {
     if (log) ngx_log_error(NGX_LOG_INFO, log, 0, "mcp handle_call_tool name=%s",
                            req.params.name.c_str());
-    CallToolResult r;
-    r.isError = false;
-    // 简单回显
-    nlohmann::json echo;
-    echo["called"] = req.params.name;
-    echo["args"] = req.params.arguments;
-    r.structureContent = echo;
+    // 快照持有处理函数, 调用期间注册表可以被替换
+    auto snap = ToolRegistry::instance().snapshot();
+    bool known;
+    const ToolRegistry::Handler* handler = snap->handler(req.params.name, &known);
+    if (!known) {
+        throw std::invalid_argument("Unknown tool: " + req.params.name);
+    }
+    if (handler == nullptr) {
+        return ToolRegistry::error_result("tool \"" + req.params.name + "\" has no implementation");
+    }
+
+    if (ctx) ctx->progress(0, 1, "started");
+    CallToolResult r = (*handler)(req.params.arguments, ctx);
+    if (ctx) ctx->progress(1, 1);
     return r;
 }
 
+namespace {
+struct EchoArguments {
+    std::string        message;
+    std::optional<int> repeat;
+
+    MCP_TOOL_ARGUMENTS(EchoArguments, message, repeat)
+};
+} // namespace
+
+namespace {
+std::atomic<McpServer::CatalogListener> catalog_listener{nullptr};
+} // namespace
+
+void McpServer::set_catalog_listener(CatalogListener listener) {
+    catalog_listener.store(listener, std::memory_order_release);
+}
+
+void McpServer::catalog_changed(Catalog c) {
+    CatalogListener listener = catalog_listener.load(std::memory_order_acquire);
+    if (listener) listener(c);
+}
+
+void McpServer::register_builtin_tools() {
+    Tool echo;
+    echo.name = "echo";
+    echo.description = "Echo the message back, optionally repeated";
+    // 结果只取决于参数, 可由 mcp_tool_cache 缓存
+    echo.annotations = ToolAnnotations{};
+    echo.annotations->readOnlyHint = true;
+    echo.annotations->idempotentHint = true;
+    ToolRegistry::instance().add_typed<EchoArguments>(std::move(echo),
+        [](const EchoArguments& args, RequestContext*) {
+            if (args.repeat.value_or(1) < 0 || args.repeat.value_or(1) > 100) {
+                return ToolRegistry::error_result("repeat must be between 0 and 100");
+            }
+            CallToolResult r;
+            std::string text;
+            for (int i = 0; i < args.repeat.value_or(1); ++i) text += args.message;
+            TextContent item;
+            item.text = text;
+            r.content.push_back(item);
+            r.structureContent = nlohmann::json{{"message", std::move(text)}};
+            return r;
+        });
+}
+
 ListResourcesResult McpServer::handle_list_resources(const ListResourcesRequest& req, ngx_log_t* log) {
     if (log) ngx_log_error(NGX_LOG_INFO, log, 0, "mcp handle_list_resources");
     ListResourcesResult r;
@@ -204,15 +274,28 @@ ReadResourceResult McpServer::handle_read_resource(const ReadResourceRequest& re
     return r;
 }
 
-EmptyResult McpServer::handle_subscribe(const SubscribeRequest& req, ngx_log_t* log) {
+// 订阅以会话为单位; uri 以 '*' 结尾时订阅整个前缀
+EmptyResult McpServer::handle_subscribe(const SubscribeRequest& req, ngx_log_t* log,
+                                        RequestContext* ctx) {
     if (log) ngx_log_error(NGX_LOG_INFO, log, 0, "mcp handle_subscribe uri=%s",
                            req.params.uri.c_str());
+    if (ctx == nullptr || ctx->session().empty()) {
+        throw std::invalid_argument("resources/subscribe requires Mcp-Session-Id");
+    }
+    if (req.params.uri.empty()) {
+        throw std::invalid_argument("resources/subscribe requires uri");
+    }
+    SubscriptionRegistry::instance().subscribe(req.params.uri, ctx->session());
     return EmptyResult{};
 }
 
-EmptyResult McpServer::handle_unsubscribe(const UnsubscribeRequest& req, ngx_log_t* log) {
+EmptyResult McpServer::handle_unsubscribe(const UnsubscribeRequest& req, ngx_log_t* log,
+                                          RequestContext* ctx) {
     if (log) ngx_log_error(NGX_LOG_INFO, log, 0, "mcp handle_unsubscribe uri=%s",
                            req.params.uri.c_str());
+    if (ctx && !ctx->session().empty()) {
+        SubscriptionRegistry::instance().unsubscribe(req.params.uri, ctx->session());
+    }
     return EmptyResult{};
 }
 
@@ -257,15 +340,12 @@ EmptyResult McpServer::handle_set_level(const SetLevelRequest& req, ngx_log_t* l
     return EmptyResult{};
 }
 
-// 将 Result 系列对象简单转 json（借助已生成的 to_json）
-nlohmann::json McpServer::to_json_result(const Result& r) {
-    nlohmann::json j = r; // 触发 ADL 的 to_json
-    return j;
-}
-
 // 统一分发：返回可直接用作 JSON-RPC result 字段的对象
-nlohmann::json McpServer::handle(const MCPRequestVariant& req, ngx_log_t* log) {
-    return std::visit([log](auto const& concrete) -> nlohmann::json {
+nlohmann::json McpServer::handle(const MCPRequestVariant& req, ngx_log_t* log,
+                                 RequestContext* ctx) {
+    // 排队期间已取消或超时的请求不再执行
+    if (ctx) ctx->check();
+    return std::visit([log, ctx](auto const& concrete) -> nlohmann::json {
         using T = std::decay_t<decltype(concrete)>;
         if constexpr (std::is_same_v<T, InitializeRequest>) {
             return to_json_result(handle_initialize(concrete, log));
@@ -274,7 +354,7 @@ nlohmann::json McpServer::handle(const MCPRequestVariant& req, ngx_log_t* log) {
         } else if constexpr (std::is_same_v<T, ListToolsRequest>) {
             return to_json_result(handle_list_tools(concrete, log));
         } else if constexpr (std::is_same_v<T, CallToolRequest>) {
-            return to_json_result(handle_call_tool(concrete, log));
+            return to_json_result(handle_call_tool(concrete, log, ctx));
         } else if constexpr (std::is_same_v<T, ListResourcesRequest>) {
             return to_json_result(handle_list_resources(concrete, log));
         } else if constexpr (std::is_same_v<T, ListResourceTemplatesRequest>) {
@@ -282,9 +362,9 @@ nlohmann::json McpServer::handle(const MCPRequestVariant& req, ngx_log_t* log) {
         } else if constexpr (std::is_same_v<T, ReadResourceRequest>) {
             return to_json_result(handle_read_resource(concrete, log));
         } else if constexpr (std::is_same_v<T, SubscribeRequest>) {
-            return to_json_result(handle_subscribe(concrete, log));
+            return to_json_result(handle_subscribe(concrete, log, ctx));
         } else if constexpr (std::is_same_v<T, UnsubscribeRequest>) {
-            return to_json_result(handle_unsubscribe(concrete, log));
+            return to_json_result(handle_unsubscribe(concrete, log, ctx));
         } else if constexpr (std::is_same_v<T, ListPromptsRequest>) {
             return to_json_result(handle_list_prompts(concrete, log));
         } else if constexpr (std::is_same_v<T, GetPromptRequest>) {
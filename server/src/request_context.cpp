@@ -0,0 +1,93 @@
+#include <time.h>
+#include "../include/request_context.h"
+
+namespace mcp {
+namespace server {
+
+namespace {
+std::chrono::microseconds thread_cpu_time() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return std::chrono::microseconds(0);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::microseconds(ts.tv_nsec / 1000);
+}
+} // namespace
+
+const char* Cancelled::what() const noexcept {
+    switch (reason_) {
+    case CancelReason::Cancelled:    return "request cancelled";
+    case CancelReason::Disconnected: return "client disconnected";
+    case CancelReason::Timeout:      return "request timed out";
+    case CancelReason::CpuLimit:     return "CPU time limit exceeded";
+    default:                         return "request aborted";
+    }
+}
+
+RequestContext::RequestContext(nlohmann::json progress_token, Sink sink)
+    : progress_token_(std::move(progress_token)), sink_(std::move(sink)) {}
+
+void RequestContext::progress(double progress, std::optional<double> total,
+                              const std::string& message) {
+    check();
+    if (!sink_ || progress_token_.is_null() || progress <= last_progress_) return;
+    last_progress_ = progress;
+
+    nlohmann::json params;
+    params["progressToken"] = progress_token_;
+    params["progress"] = progress;
+    if (total) params["total"] = *total;
+    if (!message.empty()) params["message"] = message;
+
+    nlohmann::json n;
+    n["jsonrpc"] = "2.0";
+    n["method"] = "notifications/progress";
+    n["params"] = std::move(params);
+    sink_(n.dump());
+}
+
+void RequestContext::partial(const nlohmann::json& data, const std::string& level) {
+    check();
+    if (!sink_) return;
+
+    nlohmann::json n;
+    n["jsonrpc"] = "2.0";
+    n["method"] = "notifications/message";
+    n["params"]["level"] = level;
+    n["params"]["data"] = data;
+    sink_(n.dump());
+}
+
+void RequestContext::cancel(CancelReason reason) {
+    int expected = 0;
+    cancel_->compare_exchange_strong(expected, static_cast<int>(reason), std::memory_order_acq_rel);
+}
+
+// 超时与 CPU 超限在检查时才发现, 同样记进令牌, 之后 reason() 可在其他线程读到
+CancelReason RequestContext::cancelled() const {
+    int r = cancel_->load(std::memory_order_acquire);
+    if (r == 0) {
+        if (deadline_ != std::chrono::steady_clock::time_point::max()
+            && std::chrono::steady_clock::now() >= deadline_)
+        {
+            r = static_cast<int>(CancelReason::Timeout);
+        } else if (cpu_limit_.count() && thread_cpu_time() - cpu_start_ >= cpu_limit_) {
+            r = static_cast<int>(CancelReason::CpuLimit);
+        } else {
+            return CancelReason::None;
+        }
+        int expected = 0;
+        if (!cancel_->compare_exchange_strong(expected, r, std::memory_order_acq_rel)) r = expected;
+    }
+    return static_cast<CancelReason>(r);
+}
+
+void RequestContext::check() const {
+    CancelReason r = cancelled();
+    if (r != CancelReason::None) throw Cancelled(r);
+}
+
+void RequestContext::begin() {
+    if (cpu_limit_.count()) cpu_start_ = thread_cpu_time();
+}
+
+} // namespace server
+} // namespace mcp
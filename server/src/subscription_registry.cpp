@@ -0,0 +1,198 @@
+#include "../include/subscription_registry.h"
+#include <algorithm>
+#include <mutex>
+
+namespace mcp {
+namespace server {
+
+namespace {
+// '*' 结尾表示前缀订阅, 返回去掉 '*' 的路径
+bool split_prefix(const std::string& uri, std::string& key) {
+    if (!uri.empty() && uri.back() == '*') {
+        key.assign(uri, 0, uri.size() - 1);
+        return true;
+    }
+    key = uri;
+    return false;
+}
+} // namespace
+
+SubscriptionRegistry& SubscriptionRegistry::instance() {
+    static SubscriptionRegistry registry;
+    return registry;
+}
+
+std::unique_ptr<SubscriptionRegistry::Node>* SubscriptionRegistry::child(Node* n, char c) {
+    for (auto& ch : n->children) {
+        if (ch->label[0] == c) return &ch;
+    }
+    return nullptr;
+}
+
+// 沿边下行, 必要时分裂边, 保证 key 恰好落在某个节点上
+SubscriptionRegistry::Node* SubscriptionRegistry::insert_path(const std::string& key) {
+    Node* n = &root_;
+    size_t i = 0;
+    while (i < key.size()) {
+        std::unique_ptr<Node>* slot = child(n, key[i]);
+        if (slot == nullptr) {
+            auto leaf = std::make_unique<Node>();
+            leaf->label.assign(key, i, std::string::npos);
+            n->children.push_back(std::move(leaf));
+            return n->children.back().get();
+        }
+
+        Node* c = slot->get();
+        size_t common = 0;
+        while (common < c->label.size() && i + common < key.size()
+               && c->label[common] == key[i + common]) {
+            ++common;
+        }
+        if (common < c->label.size()) {
+            auto mid = std::make_unique<Node>();
+            mid->label.assign(c->label, 0, common);
+            c->label.erase(0, common);
+            mid->children.push_back(std::move(*slot));
+            *slot = std::move(mid);
+            c = slot->get();
+        }
+        n = c;
+        i += common;
+    }
+    return n;
+}
+
+void SubscriptionRegistry::subscribe(const std::string& uri, const std::string& session, bool notify) {
+    std::string key;
+    bool is_prefix = split_prefix(uri, key);
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        Node* n = insert_path(key);
+        auto& set = is_prefix ? n->prefix : n->exact;
+        if (!set.insert(session).second) return;
+        by_session_[session].emplace_back(std::move(key), is_prefix);
+        ++count_;
+    }
+    if (notify) changed(Change::Subscribe, uri, session);
+}
+
+// 删除后回收空叶子, 并把只剩一个孩子的空节点与孩子合并
+bool SubscriptionRegistry::erase_path(Node* n, const std::string& key, size_t pos,
+                                      bool is_prefix, const std::string& session) {
+    if (pos == key.size()) {
+        return (is_prefix ? n->prefix : n->exact).erase(session) > 0;
+    }
+    std::unique_ptr<Node>* slot = child(n, key[pos]);
+    if (slot == nullptr) return false;
+    Node* c = slot->get();
+    if (key.compare(pos, c->label.size(), c->label) != 0) return false;
+    if (!erase_path(c, key, pos + c->label.size(), is_prefix, session)) return false;
+
+    if (c->empty()) {
+        if (c->children.empty()) {
+            n->children.erase(n->children.begin() + (slot - n->children.data()));
+        } else if (c->children.size() == 1) {
+            std::unique_ptr<Node> only = std::move(c->children.front());
+            only->label.insert(0, c->label);
+            *slot = std::move(only);
+        }
+    }
+    return true;
+}
+
+bool SubscriptionRegistry::unsubscribe(const std::string& uri, const std::string& session, bool notify) {
+    std::string key;
+    bool is_prefix = split_prefix(uri, key);
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!erase_path(&root_, key, 0, is_prefix, session)) return false;
+        --count_;
+
+        auto it = by_session_.find(session);
+        if (it != by_session_.end()) {
+            auto& v = it->second;
+            v.erase(std::remove(v.begin(), v.end(), std::make_pair(key, is_prefix)), v.end());
+            if (v.empty()) by_session_.erase(it);
+        }
+    }
+    if (notify) changed(Change::Unsubscribe, uri, session);
+    return true;
+}
+
+bool SubscriptionRegistry::remove_session(const std::string& session) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = by_session_.find(session);
+    if (it == by_session_.end()) return false;
+    for (const auto& s : it->second) {
+        if (erase_path(&root_, s.first, 0, s.second, session)) --count_;
+    }
+    by_session_.erase(it);
+    return true;
+}
+
+void SubscriptionRegistry::match(const std::string& uri, std::unordered_set<std::string>& sessions) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const Node* n = &root_;
+    size_t i = 0;
+    for ( ;; ) {
+        sessions.insert(n->prefix.begin(), n->prefix.end());
+        if (i == uri.size()) {
+            sessions.insert(n->exact.begin(), n->exact.end());
+            return;
+        }
+        const Node* next = nullptr;
+        for (const auto& ch : n->children) {
+            if (ch->label[0] == uri[i]) {
+                next = ch.get();
+                break;
+            }
+        }
+        if (next == nullptr || uri.compare(i, next->label.size(), next->label) != 0) return;
+        i += next->label.size();
+        n = next;
+    }
+}
+
+std::vector<std::string> SubscriptionRegistry::sessions() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<std::string> v;
+    v.reserve(by_session_.size());
+    for (const auto& kv : by_session_) v.push_back(kv.first);
+    return v;
+}
+
+size_t SubscriptionRegistry::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return count_;
+}
+
+void SubscriptionRegistry::set_publisher(Publisher p) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    publisher_ = std::move(p);
+}
+
+void SubscriptionRegistry::set_observer(Observer o) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    observer_ = std::move(o);
+}
+
+void SubscriptionRegistry::changed(Change change, const std::string& uri, const std::string& session) const {
+    Observer o;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        o = observer_;
+    }
+    if (o) o(change, uri, session);
+}
+
+void SubscriptionRegistry::publish(const std::string& uri) const {
+    Publisher p;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        p = publisher_;
+    }
+    if (p) p(uri);
+}
+
+} // namespace server
+} // namespace mcp
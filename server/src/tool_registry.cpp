@@ -0,0 +1,283 @@
+#include "../include/tool_registry.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+namespace mcp {
+namespace server {
+
+namespace {
+// FNV-1a 加种子, 末尾做一次 fmix64 使低位也充分混合
+uint64_t name_hash(std::string_view s, uint64_t seed) {
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// 单个桶尝试的种子上限, 超过后扩大槽位表重来
+const uint32_t kMaxSeed = 1u << 16;
+
+// 为 names 构建位移表; 桶按大小降序放置, 先放难放的
+void build_perfect_hash(ToolRegistry::Snapshot& snap) {
+    size_t n = snap.names.size();
+    if (n == 0) return;
+
+    size_t nbuckets = (n + 1) / 2;
+    std::vector<std::vector<uint32_t>> buckets(nbuckets);
+    for (size_t i = 0; i < n; ++i) {
+        buckets[name_hash(snap.names[i], 0) % nbuckets].push_back(static_cast<uint32_t>(i));
+    }
+    std::vector<size_t> order(nbuckets);
+    for (size_t b = 0; b < nbuckets; ++b) order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    size_t nslots = 1;
+    while (nslots < n + n / 4) nslots <<= 1;
+
+    for (;;) {
+        snap.seeds.assign(nbuckets, 0);
+        snap.slots.assign(nslots, -1);
+        bool placed = true;
+
+        for (size_t b : order) {
+            const auto& bucket = buckets[b];
+            if (bucket.empty()) break;
+
+            std::vector<size_t> pos(bucket.size());
+            uint32_t seed = 1;
+            for (; seed < kMaxSeed; ++seed) {
+                bool ok = true;
+                for (size_t k = 0; k < bucket.size() && ok; ++k) {
+                    pos[k] = name_hash(snap.names[bucket[k]], seed) & (nslots - 1);
+                    if (snap.slots[pos[k]] != -1) ok = false;
+                    for (size_t j = 0; j < k && ok; ++j) {
+                        if (pos[j] == pos[k]) ok = false;
+                    }
+                }
+                if (ok) break;
+            }
+            if (seed == kMaxSeed) {
+                placed = false;
+                break;
+            }
+            snap.seeds[b] = seed;
+            for (size_t k = 0; k < bucket.size(); ++k) {
+                snap.slots[pos[k]] = static_cast<int32_t>(bucket[k]);
+            }
+        }
+        if (placed) return;
+        nslots <<= 1;
+    }
+}
+} // namespace
+
+int32_t ToolRegistry::Snapshot::index(std::string_view name) const {
+    if (slots.empty()) return -1;
+
+    uint32_t seed = seeds[name_hash(name, 0) % seeds.size()];
+    int32_t i = slots[name_hash(name, seed) & (slots.size() - 1)];
+    if (i < 0 || names[i] != name) return -1;
+    return i;
+}
+
+const ToolRegistry::Handler* ToolRegistry::Snapshot::handler(std::string_view name, bool* known) const {
+    int32_t i = index(name);
+    if (known) *known = i >= 0;
+    return i >= 0 ? handlers[i].get() : nullptr;
+}
+
+bool ToolRegistry::Snapshot::memoizable(std::string_view name) const {
+    int32_t i = index(name);
+    return i >= 0 && memo[i];
+}
+
+const std::string* ToolRegistry::Snapshot::page(const std::optional<std::string>& cursor) const {
+    if (!cursor) return pages.empty() ? nullptr : &pages[0];
+
+    size_t n = 0;
+    if (cursor->empty() || cursor->size() > 9) return nullptr;
+    for (char c : *cursor) {
+        if (c < '0' || c > '9') return nullptr;
+        n = n * 10 + (c - '0');
+    }
+    return n < pages.size() ? &pages[n] : nullptr;
+}
+
+ToolRegistry& ToolRegistry::instance() {
+    static ToolRegistry registry;
+    return registry;
+}
+
+void ToolRegistry::validate(const Tool& tool) {
+    if (tool.name.empty()) {
+        throw std::invalid_argument("tool name is empty");
+    }
+    if (!tool.inputSchema.is_object()) {
+        throw std::invalid_argument("tool \"" + tool.name + "\" inputSchema must be an object");
+    }
+    if (tool.outputSchema && !tool.outputSchema->is_object()) {
+        throw std::invalid_argument("tool \"" + tool.name + "\" outputSchema must be an object");
+    }
+}
+
+CallToolResult ToolRegistry::error_result(std::string message) {
+    CallToolResult r;
+    r.isError = true;
+    TextContent text;
+    text.text = message;
+    r.content.push_back(text);
+    r.structureContent = nlohmann::json{{"error", std::move(message)}};
+    return r;
+}
+
+std::string ToolRegistry::decode(const nlohmann::json& arguments, const nlohmann::json& schema,
+                                 const std::function<void(const nlohmann::json&)>& from) {
+    static const nlohmann::json empty = nlohmann::json::object();
+    const nlohmann::json& args = arguments.is_null() ? empty : arguments;
+    if (!args.is_object()) {
+        return "arguments must be an object";
+    }
+    // from_json 对缺失字段保留默认值, 必填字段需在此先检查
+    auto required = schema.find("required");
+    if (required != schema.end()) {
+        for (const auto& name : *required) {
+            if (!args.contains(name.get_ref<const std::string&>())) {
+                return "missing required argument \"" + name.get<std::string>() + "\"";
+            }
+        }
+    }
+    try {
+        from(args);
+    } catch (const nlohmann::json::exception& e) {
+        return std::string("invalid arguments: ") + e.what();
+    }
+    return std::string();
+}
+
+void ToolRegistry::add(Tool tool) {
+    add(std::move(tool), nullptr);
+}
+
+void ToolRegistry::add(Tool tool, Handler handler) {
+    validate(tool);
+    std::shared_ptr<const Handler> h;
+    if (handler) h = std::make_shared<const Handler>(std::move(handler));
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(tool.name);
+    if (it != index_.end()) {
+        tools_[it->second] = Entry{std::move(tool), false, std::move(h)};
+    } else {
+        index_.emplace(tool.name, tools_.size());
+        tools_.push_back(Entry{std::move(tool), false, std::move(h)});
+    }
+    rebuild();
+}
+
+bool ToolRegistry::remove(const std::string& name) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (it == index_.end()) return false;
+    tools_.erase(tools_.begin() + it->second);
+    index_.clear();
+    for (size_t i = 0; i < tools_.size(); ++i) {
+        index_.emplace(tools_[i].tool.name, i);
+    }
+    rebuild();
+    return true;
+}
+
+void ToolRegistry::set_config_tools(std::vector<Tool> tools) {
+    for (const auto& t : tools) validate(t);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::vector<Entry> kept;
+    for (auto& e : tools_) {
+        if (!e.from_config) kept.push_back(std::move(e));
+    }
+    tools_ = std::move(kept);
+    index_.clear();
+    for (size_t i = 0; i < tools_.size(); ++i) {
+        index_.emplace(tools_[i].tool.name, i);
+    }
+    // 与代码注册的工具同名时以代码为准
+    for (auto& t : tools) {
+        if (index_.count(t.name)) continue;
+        index_.emplace(t.name, tools_.size());
+        tools_.push_back(Entry{std::move(t), true, nullptr});
+    }
+    rebuild();
+}
+
+void ToolRegistry::set_page_size(size_t n) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (page_size_ == n) return;
+    page_size_ = n;
+    rebuild();
+}
+
+std::optional<Tool> ToolRegistry::find(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (it == index_.end()) return std::nullopt;
+    return tools_[it->second].tool;
+}
+
+size_t ToolRegistry::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return tools_.size();
+}
+
+std::shared_ptr<const ToolRegistry::Snapshot> ToolRegistry::snapshot() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return snapshot_;
+}
+
+ListToolsResult ToolRegistry::list(const std::optional<std::string>& cursor) const {
+    auto snap = snapshot();
+    const std::string* page = snap->page(cursor);
+    if (page == nullptr) {
+        throw std::invalid_argument("invalid cursor");
+    }
+    return nlohmann::json::parse(*page).get<ListToolsResult>();
+}
+
+void ToolRegistry::rebuild() {
+    auto snap = std::make_shared<Snapshot>();
+    size_t per_page = page_size_ ? page_size_ : tools_.size();
+    size_t i = 0;
+    do {
+        ListToolsResult r;
+        size_t end = std::min(tools_.size(), i + per_page);
+        for (; i < end; ++i) {
+            r.tools.push_back(tools_[i].tool);
+        }
+        if (i < tools_.size()) {
+            r.nextCursor = std::to_string(snap->pages.size() + 1);
+        }
+        snap->pages.push_back(nlohmann::json(r).dump());
+        snap->etags.push_back(name_hash(snap->pages.back(), snap->pages.size()));
+    } while (i < tools_.size());
+
+    for (const auto& e : tools_) {
+        snap->names.push_back(e.tool.name);
+        snap->handlers.push_back(e.handler);
+        const auto& a = e.tool.annotations;
+        snap->memo.push_back(a && a->readOnlyHint.value_or(false) && a->idempotentHint.value_or(false));
+    }
+    build_perfect_hash(*snap);
+    snapshot_ = std::move(snap);
+}
+
+} // namespace server
+} // namespace mcp